@@ -35,6 +35,9 @@
 ////                                                                 ////
 ////    can_clear_interrupt - Clear specified CAN interrupt flag     ////
 ////                                                                 ////
+////    can_rx_pump - Moves received frames into the software        ////
+////                  receive FIFO (CAN_RX_FIFO_SIZE only)           ////
+////                                                                 ////
 //// You will need a CAN transceiver to connect CANRX and CANTX      ////
 //// pins to CANH and CANL bus lines.                                ////
 ////                                                                 ////
@@ -69,6 +72,13 @@
 ////                                                                 ////
 ////  Dec 11 14 - Optimized SPI reads on can_getd()                  ////
 ////                                                                 ////
+////  Oct 17 26 - Added the interrupt driven software receive FIFO.  ////
+////              Define CAN_RX_FIFO_SIZE and wire the MCP2510 INT   ////
+////              pin to CAN_INT_SOURCE.  Frames are burst read from ////
+////              the interrupt and can_getd() only dequeues them.   ////
+////              can_putd() and can_tbe() use READ STATUS, and      ////
+////              can_putd() loads a buffer with one SPI write.      ////
+////                                                                 ////
 /////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 1996,2013 Custom Computer Services         ////
 //// This source code may only be used by licensed users of the CCS  ////
@@ -106,6 +116,26 @@
  #define can_debug
 #endif
 
+#if CAN_RX_FIFO_SIZE
+ #if (CAN_RX_FIFO_SIZE & (CAN_RX_FIFO_SIZE - 1)) || (CAN_RX_FIFO_SIZE > 128)
+  #error CAN_RX_FIFO_SIZE must be a power of 2 up to 128
+ #endif
+
+CAN_RX_FRAME can_rx_fifo[CAN_RX_FIFO_SIZE];
+unsigned int8 can_rx_head=0;     //written by the interrupt only
+unsigned int8 can_rx_tail=0;     //written by can_getd() only
+int1 can_rx_overflow=FALSE;      //a frame was dropped because the FIFO was full
+int1 can_int_enabled=FALSE;
+
+ //The interrupt uses the SPI bus too, so it is masked while the rest of the
+ //driver is in the middle of an SPI transaction.
+ #define CAN_INT_OFF()   disable_interrupts(CAN_INT_SOURCE)
+ #define CAN_INT_ON()    {if (can_int_enabled) enable_interrupts(CAN_INT_SOURCE);}
+#else
+ #define CAN_INT_OFF()
+ #define CAN_INT_ON()
+#endif
+
 ////////////////////////////////////////////////////////////////////////
 //
 // can_init()
@@ -124,6 +154,11 @@
 void can_init(void) {
    struct struct_RXB0CTRL b_rxb0ctrl;
 
+  #if CAN_RX_FIFO_SIZE
+   can_int_enabled=FALSE;
+   disable_interrupts(CAN_INT_SOURCE);
+  #endif
+
    mcp2510_init();
 
    can_set_mode(CAN_OP_CONFIG);   //must be in config mode before params can be set
@@ -149,6 +184,30 @@ void can_init(void) {
    can_set_id(RX1FILTER5, 0, CAN_USE_EXTENDED_ID);  //set filter 3 of mask 1 (RX BUFFER 1)
 
    can_set_mode(CAN_OP_NORMAL);
+
+  #if CAN_RX_FIFO_SIZE
+   can_rx_head=0;
+   can_rx_tail=0;
+   can_rx_overflow=FALSE;
+
+   mcp2510_write(CANINTE, RX0 | RX1);
+
+   #if (CAN_INT_SOURCE == INT_EXT1)
+    ext_int_edge(1, H_TO_L);
+   #elif (CAN_INT_SOURCE == INT_EXT2)
+    ext_int_edge(2, H_TO_L);
+   #else
+    ext_int_edge(0, H_TO_L);
+   #endif
+   clear_interrupt(CAN_INT_SOURCE);
+
+   //the INT pin only interrupts on a falling edge, so empty the receive
+   //buffers in case it is already low
+   can_rx_pump();
+
+   can_int_enabled=TRUE;
+   enable_interrupts(CAN_INT_SOURCE);
+  #endif
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -219,9 +278,33 @@ void can_set_mode(CAN_OP_MODE mode) {
 ////////////////////////////////////////////////////////////////////////
 void can_set_id(unsigned int8 addr, unsigned int32 id, int1 ext) {
    unsigned int8 converted_id[4];
+
+   can_encode_id(converted_id, id, ext);
+
+   //0=eidl, 1=eidh, 2=sidl, 3=sidh
+   mcp2510_write(addr--, converted_id[3]);
+   mcp2510_write(addr--, converted_id[2]);
+   mcp2510_write(addr--, converted_id[1]);
+   mcp2510_write(addr, converted_id[0]);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// can_encode_id()
+//
+// Converts an ID into the four ID registers of a buffer, in the order
+// the MCP2510 stores them.
+//
+//   Parameters:
+//     regs - where to put the registers, 0=sidh, 1=sidl, 2=eidh, 3=eidl
+//     id - ID to convert
+//     ext - Set to TRUE if this is an extended ID, FALSE if not
+//
+////////////////////////////////////////////////////////////////////////
+void can_encode_id(unsigned int8 *regs, unsigned int32 id, int1 ext) {
    unsigned int8 *ptr;
 
-   ptr=&converted_id[3];   //3=eidl, 2=eidh, 1=sidl, 0=sidh
+   ptr=&regs[3];   //3=eidl, 2=eidh, 1=sidl, 0=sidh
 
    if (ext) {  //extended
       //eidl
@@ -260,12 +343,6 @@ void can_set_id(unsigned int8 addr, unsigned int32 id, int1 ext) {
       *ptr=(make8(id,0) >> 3) & 0x1F;
       *ptr|=(make8(id,1) << 5) & 0xE0;
    }
-
-   //0=eidl, 1=eidh, 2=sidl, 3=sidh
-   mcp2510_write(addr--, converted_id[3]);
-   mcp2510_write(addr--, converted_id[2]);
-   mcp2510_write(addr--, converted_id[1]);
-   mcp2510_write(addr, converted_id[0]);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -285,12 +362,8 @@ void can_set_id(unsigned int8 addr, unsigned int32 id, int1 ext) {
 //
 ////////////////////////////////////////////////////////////////////////
 unsigned int32 can_get_id(unsigned int8 addr, int1 ext) {
-   unsigned int32 ret;
-   unsigned int8 * ptr;
    unsigned int8 converted_id[4];
 
-   ptr=&converted_id[3];   //3=eidl, 2=eidh, 1=sidl, 0=sidh
-
   #if 0
    converted_id[3]=mcp2510_read(addr--);
    converted_id[2]=mcp2510_read(addr--);
@@ -300,6 +373,30 @@ unsigned int32 can_get_id(unsigned int8 addr, int1 ext) {
    mcp2510_read_bytes(converted_id, addr-3, 4);
   #endif
 
+   return(can_decode_id(converted_id, ext));
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// can_decode_id()
+//
+// The opposite of can_encode_id().  Converts the four ID registers of a
+// buffer back into an ID.
+//
+//   Parameters:
+//     regs - the registers, 0=sidh, 1=sidl, 2=eidh, 3=eidl
+//     ext - Set to TRUE if this is an extended ID, FALSE if not
+//
+//   Returns:
+//     The ID
+//
+////////////////////////////////////////////////////////////////////////
+unsigned int32 can_decode_id(unsigned int8 *regs, int1 ext) {
+   unsigned int32 ret;
+   unsigned int8 * ptr;
+
+   ptr=&regs[3];   //3=eidl, 2=eidh, 1=sidl, 0=sidh
+
    ret=0;
 
 
@@ -352,46 +449,21 @@ unsigned int32 can_get_id(unsigned int8 addr, int1 ext) {
 int1 can_putd(unsigned int32 id, unsigned int8 * data, unsigned int8 len, unsigned int8 priority, int1 ext, int1 rtr) {
    unsigned int8 i;
    unsigned int8 port;
+   unsigned int8 status;
+   unsigned int8 buffer[14];   //ctrl, sidh, sidl, eidh, eidl, dlc, d0-d7
 
-   unsigned int8 TXRXBaD0;
-   unsigned int8 TXBaCTRL;
-   unsigned int8 TXRXBaEIDL;
-   unsigned int8 TXBaDLC;
-
-   struct txbNctrl_struct b_TXBaCTRL;
    struct rxbNdlc_struct b_TXBaDLC;
-   struct txbNctrl_struct b_TXB0CTRL, b_TXB1CTRL, b_TXB2CTRL;
 
-   //b_TXB0CTRL=mcp2510_read(TXB0CTRL);
-   memset(&b_TXB0CTRL,mcp2510_read(TXB0CTRL),1);
-   //b_TXB1CTRL=mcp2510_read(TXB1CTRL);
-   memset(&b_TXB1CTRL,mcp2510_read(TXB1CTRL),1);
-   //b_TXB2CTRL=mcp2510_read(TXB2CTRL);
-   memset(&b_TXB2CTRL,mcp2510_read(TXB2CTRL),1);
+   //READ STATUS returns the txreq bit of every transmit buffer
+   status=mcp2510_status();
 
     // find empty transmitter
-    //map access bank addresses to empty transmitter
-   if (!b_TXB0CTRL.txreq) {
-      TXRXBaD0=TXB0D0;
-      TXBaCTRL=TXB0CTRL;
-      TXRXBaEIDL=TXB0EIDL;
-      TXBaDLC=TXB0DLC;
+   if (!bit_test(status,2))      //TXB0CTRL.txreq
       port=0;
-   }
-   else if (!b_TXB1CTRL.txreq) {
-      TXRXBaD0=TXB1D0;
-      TXBaCTRL=TXB1CTRL;
-      TXRXBaEIDL=TXB1EIDL;
-      TXBaDLC=TXB1DLC;
+   else if (!bit_test(status,4)) //TXB1CTRL.txreq
       port=1;
-   }
-   else if (!b_TXB2CTRL.txreq) {
-      TXRXBaD0=TXB2D0;
-      TXBaCTRL=TXB2CTRL;
-      TXRXBaEIDL=TXB2EIDL;
-      TXBaDLC=TXB2DLC;
+   else if (!bit_test(status,6)) //TXB2CTRL.txreq
       port=2;
-   }
    else {
       #if CAN_DO_DEBUG
          can_debug("\r\nCAN_PUTD() FAIL: NO OPEN TX BUFFERS\r\n");
@@ -399,38 +471,34 @@ int1 can_putd(unsigned int32 id, unsigned int8 * data, unsigned int8 len, unsign
       return(0);
    }
 
-   //set priority.
-   //b_TXBaCTRL=mcp2510_read(TXBaCTRL);
-   memset(&b_TXBaCTRL,mcp2510_read(TXBaCTRL),1);
-   
-   b_TXBaCTRL.txpri=priority;
-   mcp2510_write(TXBaCTRL, (unsigned int8)b_TXBaCTRL);
+   if (len>8)
+      len=8;
+
+   //set priority, txreq stays clear until the request to send below
+   buffer[0]=priority & 0x03;
 
    //set tx mask
-   can_set_id(TXRXBaEIDL, id, ext);
+   can_encode_id(&buffer[1], id, ext);
 
    //set tx data count
    //b_TXBaDLC=len;
    memset(&b_TXBaDLC,len,1);
    b_TXBaDLC.rtr=rtr;
-   mcp2510_write(TXBaDLC, (unsigned int8)b_TXBaDLC);
+   buffer[5]=(unsigned int8)b_TXBaDLC;
 
-   //write to buffer
-    for (i=TXRXBaD0; i<(TXRXBaD0 + len); i++) {
-      mcp2510_write(i,*data);
-      data++;
-    }
+   for (i=0; i<len; i++)
+      buffer[6+i]=data[i];
+
+   //TXBnCTRL through TXBnD7 are consecutive, so one sequential write
+   //loads the whole buffer
+   mcp2510_write_bytes(TXB0CTRL + (port << 4), buffer, 6 + len);
 
-   //enable transmission
-   //b_TXBaCTRL=mcp2510_read(TXBaCTRL);
-   memset(&b_TXBaCTRL,mcp2510_read(TXBaCTRL),1);
-   b_TXBaCTRL.txreq=1;
-   mcp2510_write(TXBaCTRL, (unsigned int8)b_TXBaCTRL);
+   //enable transmission (RTS instruction)
+   mcp2510_command(0x80 | (1 << port));
 
    #if CAN_DO_DEBUG
             can_debug("\r\nCAN_PUTD(): BUFF=%U ID=%LX LEN=%U PRI=%U EXT=%U RTR=%U\r\n", port, id, len, priority, ext, rtr);
             if ((len)&&(!rtr)) {
-               data-=len;
                can_debug("  DATA = ");
                for (i=0;i<len;i++) {
                   can_debug("%X ",*data);
@@ -461,6 +529,67 @@ int1 can_putd(unsigned int32 id, unsigned int8 * data, unsigned int8 len, unsign
 //      if there was none.
 //
 ////////////////////////////////////////////////////////////////////////
+#if CAN_RX_FIFO_SIZE
+int1 can_getd(unsigned int32 & id, unsigned int8 * data, unsigned int8 & len, struct rx_stat & stat)
+{
+   CAN_RX_FRAME *frame;
+   struct rxbNdlc_struct b_RXBaDLC;
+   struct struct_TXRXBaSIDL b_TXRXBaSIDL;
+  #if CAN_DO_DEBUG
+   unsigned int8 i;
+  #endif
+
+   if (can_rx_head == can_rx_tail) {
+      #if CAN_DO_DEBUG
+         can_debug("\r\nFAIL ON CAN_GETD(): NO MESSAGE IN BUFFER\r\n");
+      #endif
+      return (0);
+   }
+
+   frame=&can_rx_fifo[can_rx_tail];
+
+   stat.buffer=bit_test(frame->stat,3);
+   stat.filthit=frame->stat & 0x07;
+   stat.inv=0;
+
+   //frames lost since the last call
+   CAN_INT_OFF();
+   stat.err_ovfl=can_rx_overflow;
+   can_rx_overflow=FALSE;
+   CAN_INT_ON();
+
+   //get count
+   memset(&b_RXBaDLC,frame->regs[4],1);
+   len = b_RXBaDLC.dlc;
+   if (len > 8)
+      len = 8;
+   stat.rtr=b_RXBaDLC.rtr;
+
+   //was it extended or standard?
+   memset(&b_TXRXBaSIDL,frame->regs[1],1);
+   stat.ext=b_TXRXBaSIDL.ext;
+   id=can_decode_id(frame->regs,stat.ext);
+
+   //get data
+   memcpy(data, &frame->regs[5], len);
+
+   //hand the slot back to the interrupt
+   can_rx_tail=(can_rx_tail + 1) & (CAN_RX_FIFO_SIZE - 1);
+
+   #if CAN_DO_DEBUG
+      can_debug("\r\nCAN_GETD(): BUFF=%U ID=%LX LEN=%U OVF=%U ", stat.buffer, id, len, stat.err_ovfl);
+      can_debug("FILT=%U RTR=%U EXT=%U", stat.filthit, stat.rtr, stat.ext);
+      if ((len)&&(!stat.rtr)) {
+         can_debug("\r\n    DATA = ");
+         for (i=0;i<len;i++)
+            can_debug("%X ",data[i]);
+      }
+      can_debug("\r\n");
+   #endif
+
+   return(1);
+}
+#else
 int1 can_getd(unsigned int32 & id, unsigned int8 * data, unsigned int8 & len, struct rx_stat & stat)
 {
    struct struct_RXB0CTRL b_RXB0CTRL;
@@ -568,15 +697,20 @@ int1 can_getd(unsigned int32 & id, unsigned int8 * data, unsigned int8 & len, st
 
     return(1);
 }
+#endif
 
 ////////////////////////////////////////////////////////////////////////
 //
 // can_kbhit()
 //
-// Returns TRUE if there is data in the receive buffers
+// Returns TRUE if there is data in the receive buffers (or in the
+// software receive FIFO)
 //
 //////////////////////////////////////////////////////////////////////////////
 int1 can_kbhit(void) {
+  #if CAN_RX_FIFO_SIZE
+   return(can_rx_head != can_rx_tail);
+  #else
    struct struct_CANINTF b_CANINTF;
 
    //b_CANINTF=mcp2510_read(CANINTF);
@@ -585,6 +719,7 @@ int1 can_kbhit(void) {
       {return(1);}
 
    return(0);
+  #endif
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -595,16 +730,9 @@ int1 can_kbhit(void) {
 //
 //////////////////////////////////////////////////////////////////////////////
 int1 can_tbe(void) {
-   struct txbNctrl_struct b_TXB0CTRL, b_TXB1CTRL, b_TXB2CTRL;
-
-   //b_TXB0CTRL=mcp2510_read(TXB0CTRL);
-   memset(&b_TXB0CTRL,mcp2510_read(TXB0CTRL),1);
-   //b_TXB1CTRL=mcp2510_read(TXB1CTRL);
-   memset(&b_TXB1CTRL,mcp2510_read(TXB1CTRL),1);
-   //b_TXB2CTRL=mcp2510_read(TXB2CTRL);
-   memset(&b_TXB2CTRL,mcp2510_read(TXB2CTRL),1);
-
-   if (!b_TXB0CTRL.txreq || !b_TXB1CTRL.txreq || !b_TXB2CTRL.txreq)
+   //READ STATUS bits 2, 4 and 6 are TXB0CTRL.txreq, TXB1CTRL.txreq and
+   //TXB2CTRL.txreq
+   if ((mcp2510_status() & 0x54) != 0x54)
       {return(1);}
 
    return(0);
@@ -731,6 +859,7 @@ void can_clear_interrupt(INTERRUPT settings)
 unsigned int8 mcp2510_read(unsigned int8 address) {
    unsigned int8 data;
 
+   CAN_INT_OFF();
    output_low(EXT_CAN_CS);
    
    spi_xfer(MCP2510,0x03);
@@ -738,11 +867,13 @@ unsigned int8 mcp2510_read(unsigned int8 address) {
    data = spi_xfer(MCP2510,0);
    
    output_high(EXT_CAN_CS);
+   CAN_INT_ON();
 
    return(data);
 }
 
 void mcp2510_read_bytes(unsigned int8 *pDest, unsigned int8 canAddress, unsigned int8 num) {
+   CAN_INT_OFF();
    output_low(EXT_CAN_CS);
    
    spi_xfer(MCP2510,0x03);
@@ -755,11 +886,30 @@ void mcp2510_read_bytes(unsigned int8 *pDest, unsigned int8 canAddress, unsigned
    }
    
    output_high(EXT_CAN_CS);
+   CAN_INT_ON();
+}
+
+void mcp2510_write_bytes(unsigned int8 canAddress, unsigned int8 *pSrc, unsigned int8 num) {
+   CAN_INT_OFF();
+   output_low(EXT_CAN_CS);
+   
+   spi_xfer(MCP2510,0x02);
+   spi_xfer(MCP2510,canAddress);
+   
+   while(num--)
+   {
+      spi_xfer(MCP2510,*pSrc);
+      pSrc++;
+   }
+   
+   output_high(EXT_CAN_CS);
+   CAN_INT_ON();
 }
 
 unsigned int8 mcp2510_status(void) {
    unsigned int8 data;
    
+   CAN_INT_OFF();
    output_low(EXT_CAN_CS);
    
    spi_xfer(MCP2510,0xA0);
@@ -767,12 +917,14 @@ unsigned int8 mcp2510_status(void) {
    spi_xfer(MCP2510,0);
    
    output_high(EXT_CAN_CS);
+   CAN_INT_ON();
 
    return(data);
 }
 
 
 void mcp2510_write(unsigned int8 address, unsigned int8 data) {
+   CAN_INT_OFF();
    output_low(EXT_CAN_CS);
    
    spi_xfer(MCP2510,0x02);
@@ -780,14 +932,17 @@ void mcp2510_write(unsigned int8 address, unsigned int8 data) {
    spi_xfer(MCP2510,data);
    
    output_high(EXT_CAN_CS);
+   CAN_INT_ON();
 }
 
 void mcp2510_command(unsigned int8 command) {
+   CAN_INT_OFF();
    output_low(EXT_CAN_CS);
    
    spi_xfer(MCP2510,command);
    
    output_high(EXT_CAN_CS);
+   CAN_INT_ON();
 }
 
 void mcp2510_init(void) {
@@ -816,6 +971,7 @@ void mcp2510_init(void) {
 
 void mcp2510_bit_modify(unsigned int8 address, unsigned int8 mask, unsigned int8 data)
 {
+   CAN_INT_OFF();
    output_low(EXT_CAN_CS);
    
    spi_xfer(MCP2510, 0x05);
@@ -824,4 +980,132 @@ void mcp2510_bit_modify(unsigned int8 address, unsigned int8 mask, unsigned int8
    spi_xfer(MCP2510, data);
    
    output_high(EXT_CAN_CS);
+   CAN_INT_ON();
 }
+
+#if CAN_RX_FIFO_SIZE
+///////////////////////////////////////////////////////////////////////////////
+//
+// can_rx_pump()
+//
+//    Moves every frame waiting in the receive buffers into the software
+//    receive FIFO, one SPI transaction per frame.  Runs in the INT pin
+//    interrupt, so it talks to the MCP2510 directly instead of through the
+//    functions above, which mask that interrupt.  If the FIFO is full the
+//    frame is read and dropped, and the next can_getd() reports err_ovfl.
+//
+///////////////////////////////////////////////////////////////////////////////
+void can_rx_pump(void)
+{
+   unsigned int8 status;
+   unsigned int8 buffer;
+   unsigned int8 next;
+   unsigned int8 i;
+   CAN_RX_FRAME discard;
+   CAN_RX_FRAME *frame;
+   unsigned int8 *ptr;
+
+   for(;;)
+   {
+      output_low(EXT_CAN_CS);
+     #if CAN_MCP2515
+      spi_xfer(MCP2510, 0xB0);      //RX STATUS
+     #else
+      spi_xfer(MCP2510, 0xA0);      //READ STATUS
+     #endif
+      status = spi_xfer(MCP2510, 0);
+      output_high(EXT_CAN_CS);
+
+     #if CAN_MCP2515
+      if (bit_test(status, 6))      //message in RXB0
+         buffer = 0;
+      else if (bit_test(status, 7)) //message in RXB1
+         buffer = 1;
+     #else
+      if (bit_test(status, 0))      //CANINTF.rx0if
+         buffer = 0;
+      else if (bit_test(status, 1)) //CANINTF.rx1if
+         buffer = 1;
+     #endif
+      else
+         break;
+
+      next = (can_rx_head + 1) & (CAN_RX_FIFO_SIZE - 1);
+      if (next == can_rx_tail)
+      {
+         frame = &discard;
+         can_rx_overflow = TRUE;
+      }
+      else
+         frame = &can_rx_fifo[can_rx_head];
+
+      output_low(EXT_CAN_CS);
+     #if CAN_MCP2515
+      //READ RX BUFFER starting at RXBnSIDH, clears RXnIF when CS goes high
+      spi_xfer(MCP2510, 0x90 | (buffer << 2));
+      ptr = frame->regs;
+      for (i = 0; i < 13; i++)
+         *ptr++ = spi_xfer(MCP2510, 0);
+      output_high(EXT_CAN_CS);
+
+      status &= 0x07;               //filter hit
+      if (status >= 6)
+         status -= 6;               //RXF0 or RXF1, rolled over into RXB1
+     #else
+      //RXBnCTRL through RXBnD7 are consecutive, CTRL lands in frame->stat
+      spi_xfer(MCP2510, 0x03);
+      spi_xfer(MCP2510, RXB0CTRL + (buffer << 4));
+      ptr = &frame->stat;
+      for (i = 0; i < 14; i++)
+         *ptr++ = spi_xfer(MCP2510, 0);
+      output_high(EXT_CAN_CS);
+
+      if (buffer)
+         status = frame->stat & 0x07;
+      else
+         status = frame->stat & 0x01;
+
+      //clear RXnIF
+      output_low(EXT_CAN_CS);
+      spi_xfer(MCP2510, 0x05);
+      spi_xfer(MCP2510, CANINTF);
+      spi_xfer(MCP2510, RX0 << buffer);
+      spi_xfer(MCP2510, 0);
+      output_high(EXT_CAN_CS);
+     #endif
+
+      frame->stat = status | (buffer << 3);
+
+      if (frame != &discard)
+         can_rx_head = next;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// can_rx_isr()
+//
+//    The INT pin interrupt.  The flag is cleared before the receive buffers
+//    are emptied, and the buffers are emptied again for as long as the INT
+//    pin stays low.  A frame that arrives while the last one is being read
+//    keeps INT low without another falling edge, and would otherwise sit in
+//    its buffer with the interrupt never firing again.
+//
+///////////////////////////////////////////////////////////////////////////////
+#if (CAN_INT_SOURCE == INT_EXT1)
+#int_ext1 NOCLEAR
+#elif (CAN_INT_SOURCE == INT_EXT2)
+#int_ext2 NOCLEAR
+#elif defined(__PCD__)
+#int_ext0 NOCLEAR
+#else
+#int_ext NOCLEAR
+#endif
+void can_rx_isr(void)
+{
+   clear_interrupt(CAN_INT_SOURCE);
+   do {
+      can_rx_pump();
+   } while (!input(CAN_INT_PIN));
+}
+#endif
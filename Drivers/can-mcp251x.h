@@ -28,6 +28,10 @@
 ////                                                                 ////
 ////  Dec 11 14 - Optimized SPI reads on can_getd()                  ////
 ////                                                                 ////
+////  Oct 17 26 - Added the interrupt driven software receive FIFO   ////
+////              (CAN_RX_FIFO_SIZE).  can_putd() loads a transmit   ////
+////              buffer with one SPI write.                         ////
+////                                                                 ////
 /////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 1996,2013 Custom Computer Services         ////
 //// This source code may only be used by licensed users of the CCS  ////
@@ -93,6 +97,44 @@
  #define CAN_ENABLE_CAN_CAPTURE 0
 #endif
 
+//Size of the software receive FIFO, a power of 2 up to 128.  When not 0 the
+//MCP2510 INT pin must be wired to the external interrupt CAN_INT_SOURCE.  Its
+//interrupt copies every received frame into the FIFO, and can_getd() and
+//can_kbhit() only look at the FIFO.  The RX0 and RX1 interrupts are the only
+//MCP2510 interrupts that may be enabled.
+#ifndef CAN_RX_FIFO_SIZE
+ #define CAN_RX_FIFO_SIZE 0
+#endif
+
+#ifndef CAN_INT_SOURCE
+ #if defined(__PCD__)
+  #define CAN_INT_SOURCE INT_EXT0
+ #else
+  #define CAN_INT_SOURCE INT_EXT   //INT_EXT, INT_EXT1 or INT_EXT2
+ #endif
+#endif
+
+//The pin CAN_INT_SOURCE is on.  The interrupt reads it to see whether the
+//MCP2510 still has its INT pin low after the receive buffers were emptied.
+#ifndef CAN_INT_PIN
+ #if defined(__PCD__)
+  #define CAN_INT_PIN  PIN_B7      //INT0 on most PIC24 and dsPIC33 parts
+ #elif (CAN_INT_SOURCE == INT_EXT1)
+  #define CAN_INT_PIN  PIN_B1
+ #elif (CAN_INT_SOURCE == INT_EXT2)
+  #define CAN_INT_PIN  PIN_B2
+ #else
+  #define CAN_INT_PIN  PIN_B0
+ #endif
+#endif
+
+//The FIFO interrupt reads a frame with the MCP2515 READ RX BUFFER and
+//RX STATUS instructions.  Set to FALSE for an MCP2510, which doesn't have
+//them.
+#ifndef CAN_MCP2515
+ #define CAN_MCP2515 TRUE
+#endif
+
 enum CAN_OP_MODE {CAN_OP_CONFIG=4, CAN_OP_LISTEN=3, CAN_OP_LOOPBACK=2, CAN_OP_SLEEP=1, CAN_OP_NORMAL=0};
 
 //can control
@@ -401,11 +443,21 @@ struct rx_stat {
    int1 inv;
 };
 
+#if CAN_RX_FIFO_SIZE
+//a frame in the software receive FIFO, as it was in the receive buffer
+typedef struct {
+   unsigned int8 stat;     //0:2 filter hit, 3 receive buffer
+   unsigned int8 regs[13]; //sidh, sidl, eidh, eidl, dlc, d0-d7
+} CAN_RX_FRAME;
+#endif
+
 void  can_init(void);
 void  can_set_baud(void);
 void  can_set_mode(CAN_OP_MODE mode);
 void can_set_id(unsigned int8 addr, unsigned int32 id, int1 ext);
 unsigned int32 can_get_id(unsigned int8 addr, int1 ext);
+void can_encode_id(unsigned int8 *regs, unsigned int32 id, int1 ext);
+unsigned int32 can_decode_id(unsigned int8 *regs, int1 ext);
 int1  can_putd(unsigned int32 id, unsigned int8 * data, unsigned int8 len, unsigned int8 priority, int1 ext, int1 rtr);
 int1  can_getd(unsigned int32 & id, unsigned int8 * data, unsigned int8 & len, struct rx_stat & stat);
 int1 can_kbhit(void);
@@ -414,6 +466,9 @@ void can_abort(void);
 void can_enable_interrupts(INTERRUPT settings);
 void can_disable_interrupts(INTERRUPT settings);
 void can_clear_interrupt(INTERRUPT settings);
+#if CAN_RX_FIFO_SIZE
+void can_rx_pump(void);
+#endif
 
 void mcp2510_init();
 void mcp2510_command(unsigned int8 command);
@@ -421,6 +476,7 @@ void mcp2510_write(unsigned int8 address, unsigned int8 data);
 unsigned int8 mcp2510_status(void);
 unsigned int8 mcp2510_read(unsigned int8 address);
 void mcp2510_read_bytes(unsigned int8 *pDest, unsigned int8 canAddress, unsigned int8 num);
+void mcp2510_write_bytes(unsigned int8 canAddress, unsigned int8 *pSrc, unsigned int8 num);
 void mcp2510_bit_modify(unsigned int8 address, unsigned int8 mask, unsigned int8 data);
 
 #endif
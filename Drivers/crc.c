@@ -9,6 +9,40 @@
 ////  generate_32bit_crc(data, length, pattern)                      ////
 ////        Generates 32 bit crc from the data using the pattern.    ////
 ////                                                                 ////
+////  The generate functions above work a bit at a time.  The        ////
+////  functions below give the same result from lookup tables and    ////
+////  can be called repeatedly on a stream.  Start with crc = 0 to   ////
+////  match generate_xxbit_crc(), or with the initial value the      ////
+////  protocol calls for, and feed each new block with the previous  ////
+////  result.  Input and result are not reflected.                   ////
+////                                                                 ////
+////  crc8_update(crc, data, length)                                 ////
+////        Continues an 8 bit crc using CRC_8.                      ////
+////                                                                 ////
+////  crc16_update(crc, data, length)                                ////
+////        Continues a 16 bit crc using CRC16_PATTERN.              ////
+////                                                                 ////
+////  crc32_update(crc, data, length)                                ////
+////        Continues a 32 bit crc using CRC_32.                     ////
+////                                                                 ////
+////  Check values, the crc of the ASCII string "123456789":         ////
+////        crc8_update(0, ...)              0xF4                    ////
+////        crc16_update(0, ...)             0x31C3 with CRC_CCITT   ////
+////                                         0xFEE8 with CRC_16      ////
+////        crc16_update(0xFFFF, ...)        0x29B1 with CRC_CCITT   ////
+////        crc32_update(0, ...)             0x89A1897F              ////
+////        crc32_update(0xFFFFFFFF, ...)    0x0376E6E7              ////
+////                                                                 ////
+////  Options (define before including this file):                   ////
+////    CRC16_PATTERN  CRC_CCITT (default) or CRC_16                 ////
+////    CRC_ENGINE     CRC_ENGINE_NIBBLE - 16 entry tables, two      ////
+////                      lookups per byte.  Default on PIC10-16.    ////
+////                   CRC_ENGINE_BYTE - 256 entry tables in ROM,    ////
+////                      one lookup per byte.  Default on PIC18.    ////
+////                   CRC_ENGINE_SLICE4 - as BYTE, plus three more  ////
+////                      32 bit tables so crc32_update() does four  ////
+////                      bytes per step.  Default on PIC24/dsPIC.   ////
+////                                                                 ////
 /////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 1996,2003 Custom Computer Services         ////
 //// This source code may only be used by licensed users of the CCS  ////
@@ -22,14 +56,37 @@
 #define CRC_16    0x8005      //bit pattern (1)1000 0000 0000 0101
 #define CRC_CCITT 0x1021      //bit pattern (1)0001 0000 0010 0001
 #define CRC_32    0x04C11DB7  //bit pattern (1)0000 0100 1100 0001 0001 1101 1011 0111
+#define CRC_8     0x07        //bit pattern (1)0000 0111
+
+#define CRC_ENGINE_NIBBLE  0
+#define CRC_ENGINE_BYTE    1
+#define CRC_ENGINE_SLICE4  2
+
+#ifndef CRC_ENGINE
+ #if defined(__PCD__)
+  #define CRC_ENGINE   CRC_ENGINE_SLICE4
+ #elif defined(__PCH__)
+  #define CRC_ENGINE   CRC_ENGINE_BYTE
+ #else
+  #define CRC_ENGINE   CRC_ENGINE_NIBBLE
+ #endif
+#endif
+
+#ifndef CRC16_PATTERN
+ #define CRC16_PATTERN CRC_CCITT
+#endif
+
+#if (CRC16_PATTERN != CRC_CCITT) && (CRC16_PATTERN != CRC_16)
+ #error CRC16_PATTERN must be CRC_CCITT or CRC_16
+#endif
 
 
 int generate_8bit_crc(char* data, int16 length, int pattern)
 {
-   int   *current_data;
-   int   crc_byte;
+   unsigned int8 *current_data;
+   unsigned int8 crc_byte;
    int16 byte_counter;
-   int   bit_counter;
+   unsigned int8 bit_counter;
 
    current_data = data;
    crc_byte = *current_data++;
@@ -68,10 +125,10 @@ int generate_8bit_crc(char* data, int16 length, int pattern)
 
 int16 generate_16bit_crc(char* data, int16 length, int16 pattern)
 {
-   int   *current_data;
+   unsigned int8 *current_data;
    int16 crc_Dbyte;
    int16 byte_counter;
-   int   bit_counter;
+   unsigned int8 bit_counter;
 
    current_data = data + 2;
    crc_Dbyte =  make16(data[0], data[1]);
@@ -111,10 +168,10 @@ int16 generate_16bit_crc(char* data, int16 length, int16 pattern)
 
 int32 generate_32bit_crc(char* data, int16 length, int32 pattern)
 {
-   int   *current_data;
+   unsigned int8 *current_data;
    int32 crc_Dbyte;
    int16 byte_counter;
-   int   bit_counter;
+   unsigned int8 bit_counter;
 
    current_data = data + 4;
    crc_Dbyte =  make32(data[0], data[1], data[2], data[3]);
@@ -151,3 +208,454 @@ int32 generate_32bit_crc(char* data, int16 length, int32 pattern)
 
    return crc_Dbyte;
 }
+
+/////////////////////////////////////////////////////////////////////////
+//// Lookup tables.  Entry i is the crc of i shifted in at the top of ////
+//// the register, so each table only fits the pattern it was made   ////
+//// from.                                                           ////
+/////////////////////////////////////////////////////////////////////////
+
+#if CRC_ENGINE == CRC_ENGINE_NIBBLE
+
+const unsigned int8 crc8_nibble_table[16] = {
+   0x00,0x07,0x0E,0x09,0x1C,0x1B,0x12,0x15,0x38,0x3F,0x36,0x31,0x24,0x23,0x2A,0x2D
+};
+
+#if CRC16_PATTERN == CRC_CCITT
+const unsigned int16 crc16_nibble_table[16] = {
+   0x0000,0x1021,0x2042,0x3063,0x4084,0x50A5,0x60C6,0x70E7,
+   0x8108,0x9129,0xA14A,0xB16B,0xC18C,0xD1AD,0xE1CE,0xF1EF
+};
+#else
+const unsigned int16 crc16_nibble_table[16] = {
+   0x0000,0x8005,0x800F,0x000A,0x801B,0x001E,0x0014,0x8011,
+   0x8033,0x0036,0x003C,0x8039,0x0028,0x802D,0x8027,0x0022
+};
+#endif
+
+const unsigned int32 crc32_nibble_table[16] = {
+   0x00000000,0x04C11DB7,0x09823B6E,0x0D4326D9,
+   0x130476DC,0x17C56B6B,0x1A864DB2,0x1E475005,
+   0x2608EDB8,0x22C9F00F,0x2F8AD6D6,0x2B4BCB61,
+   0x350C9B64,0x31CD86D3,0x3C8EA00A,0x384FBDBD
+};
+
+#else
+
+const unsigned int8 crc8_table[256] = {
+   0x00,0x07,0x0E,0x09,0x1C,0x1B,0x12,0x15,0x38,0x3F,0x36,0x31,0x24,0x23,0x2A,0x2D,
+   0x70,0x77,0x7E,0x79,0x6C,0x6B,0x62,0x65,0x48,0x4F,0x46,0x41,0x54,0x53,0x5A,0x5D,
+   0xE0,0xE7,0xEE,0xE9,0xFC,0xFB,0xF2,0xF5,0xD8,0xDF,0xD6,0xD1,0xC4,0xC3,0xCA,0xCD,
+   0x90,0x97,0x9E,0x99,0x8C,0x8B,0x82,0x85,0xA8,0xAF,0xA6,0xA1,0xB4,0xB3,0xBA,0xBD,
+   0xC7,0xC0,0xC9,0xCE,0xDB,0xDC,0xD5,0xD2,0xFF,0xF8,0xF1,0xF6,0xE3,0xE4,0xED,0xEA,
+   0xB7,0xB0,0xB9,0xBE,0xAB,0xAC,0xA5,0xA2,0x8F,0x88,0x81,0x86,0x93,0x94,0x9D,0x9A,
+   0x27,0x20,0x29,0x2E,0x3B,0x3C,0x35,0x32,0x1F,0x18,0x11,0x16,0x03,0x04,0x0D,0x0A,
+   0x57,0x50,0x59,0x5E,0x4B,0x4C,0x45,0x42,0x6F,0x68,0x61,0x66,0x73,0x74,0x7D,0x7A,
+   0x89,0x8E,0x87,0x80,0x95,0x92,0x9B,0x9C,0xB1,0xB6,0xBF,0xB8,0xAD,0xAA,0xA3,0xA4,
+   0xF9,0xFE,0xF7,0xF0,0xE5,0xE2,0xEB,0xEC,0xC1,0xC6,0xCF,0xC8,0xDD,0xDA,0xD3,0xD4,
+   0x69,0x6E,0x67,0x60,0x75,0x72,0x7B,0x7C,0x51,0x56,0x5F,0x58,0x4D,0x4A,0x43,0x44,
+   0x19,0x1E,0x17,0x10,0x05,0x02,0x0B,0x0C,0x21,0x26,0x2F,0x28,0x3D,0x3A,0x33,0x34,
+   0x4E,0x49,0x40,0x47,0x52,0x55,0x5C,0x5B,0x76,0x71,0x78,0x7F,0x6A,0x6D,0x64,0x63,
+   0x3E,0x39,0x30,0x37,0x22,0x25,0x2C,0x2B,0x06,0x01,0x08,0x0F,0x1A,0x1D,0x14,0x13,
+   0xAE,0xA9,0xA0,0xA7,0xB2,0xB5,0xBC,0xBB,0x96,0x91,0x98,0x9F,0x8A,0x8D,0x84,0x83,
+   0xDE,0xD9,0xD0,0xD7,0xC2,0xC5,0xCC,0xCB,0xE6,0xE1,0xE8,0xEF,0xFA,0xFD,0xF4,0xF3
+};
+
+#if CRC16_PATTERN == CRC_CCITT
+const unsigned int16 crc16_table[256] = {
+   0x0000,0x1021,0x2042,0x3063,0x4084,0x50A5,0x60C6,0x70E7,
+   0x8108,0x9129,0xA14A,0xB16B,0xC18C,0xD1AD,0xE1CE,0xF1EF,
+   0x1231,0x0210,0x3273,0x2252,0x52B5,0x4294,0x72F7,0x62D6,
+   0x9339,0x8318,0xB37B,0xA35A,0xD3BD,0xC39C,0xF3FF,0xE3DE,
+   0x2462,0x3443,0x0420,0x1401,0x64E6,0x74C7,0x44A4,0x5485,
+   0xA56A,0xB54B,0x8528,0x9509,0xE5EE,0xF5CF,0xC5AC,0xD58D,
+   0x3653,0x2672,0x1611,0x0630,0x76D7,0x66F6,0x5695,0x46B4,
+   0xB75B,0xA77A,0x9719,0x8738,0xF7DF,0xE7FE,0xD79D,0xC7BC,
+   0x48C4,0x58E5,0x6886,0x78A7,0x0840,0x1861,0x2802,0x3823,
+   0xC9CC,0xD9ED,0xE98E,0xF9AF,0x8948,0x9969,0xA90A,0xB92B,
+   0x5AF5,0x4AD4,0x7AB7,0x6A96,0x1A71,0x0A50,0x3A33,0x2A12,
+   0xDBFD,0xCBDC,0xFBBF,0xEB9E,0x9B79,0x8B58,0xBB3B,0xAB1A,
+   0x6CA6,0x7C87,0x4CE4,0x5CC5,0x2C22,0x3C03,0x0C60,0x1C41,
+   0xEDAE,0xFD8F,0xCDEC,0xDDCD,0xAD2A,0xBD0B,0x8D68,0x9D49,
+   0x7E97,0x6EB6,0x5ED5,0x4EF4,0x3E13,0x2E32,0x1E51,0x0E70,
+   0xFF9F,0xEFBE,0xDFDD,0xCFFC,0xBF1B,0xAF3A,0x9F59,0x8F78,
+   0x9188,0x81A9,0xB1CA,0xA1EB,0xD10C,0xC12D,0xF14E,0xE16F,
+   0x1080,0x00A1,0x30C2,0x20E3,0x5004,0x4025,0x7046,0x6067,
+   0x83B9,0x9398,0xA3FB,0xB3DA,0xC33D,0xD31C,0xE37F,0xF35E,
+   0x02B1,0x1290,0x22F3,0x32D2,0x4235,0x5214,0x6277,0x7256,
+   0xB5EA,0xA5CB,0x95A8,0x8589,0xF56E,0xE54F,0xD52C,0xC50D,
+   0x34E2,0x24C3,0x14A0,0x0481,0x7466,0x6447,0x5424,0x4405,
+   0xA7DB,0xB7FA,0x8799,0x97B8,0xE75F,0xF77E,0xC71D,0xD73C,
+   0x26D3,0x36F2,0x0691,0x16B0,0x6657,0x7676,0x4615,0x5634,
+   0xD94C,0xC96D,0xF90E,0xE92F,0x99C8,0x89E9,0xB98A,0xA9AB,
+   0x5844,0x4865,0x7806,0x6827,0x18C0,0x08E1,0x3882,0x28A3,
+   0xCB7D,0xDB5C,0xEB3F,0xFB1E,0x8BF9,0x9BD8,0xABBB,0xBB9A,
+   0x4A75,0x5A54,0x6A37,0x7A16,0x0AF1,0x1AD0,0x2AB3,0x3A92,
+   0xFD2E,0xED0F,0xDD6C,0xCD4D,0xBDAA,0xAD8B,0x9DE8,0x8DC9,
+   0x7C26,0x6C07,0x5C64,0x4C45,0x3CA2,0x2C83,0x1CE0,0x0CC1,
+   0xEF1F,0xFF3E,0xCF5D,0xDF7C,0xAF9B,0xBFBA,0x8FD9,0x9FF8,
+   0x6E17,0x7E36,0x4E55,0x5E74,0x2E93,0x3EB2,0x0ED1,0x1EF0
+};
+#else
+const unsigned int16 crc16_table[256] = {
+   0x0000,0x8005,0x800F,0x000A,0x801B,0x001E,0x0014,0x8011,
+   0x8033,0x0036,0x003C,0x8039,0x0028,0x802D,0x8027,0x0022,
+   0x8063,0x0066,0x006C,0x8069,0x0078,0x807D,0x8077,0x0072,
+   0x0050,0x8055,0x805F,0x005A,0x804B,0x004E,0x0044,0x8041,
+   0x80C3,0x00C6,0x00CC,0x80C9,0x00D8,0x80DD,0x80D7,0x00D2,
+   0x00F0,0x80F5,0x80FF,0x00FA,0x80EB,0x00EE,0x00E4,0x80E1,
+   0x00A0,0x80A5,0x80AF,0x00AA,0x80BB,0x00BE,0x00B4,0x80B1,
+   0x8093,0x0096,0x009C,0x8099,0x0088,0x808D,0x8087,0x0082,
+   0x8183,0x0186,0x018C,0x8189,0x0198,0x819D,0x8197,0x0192,
+   0x01B0,0x81B5,0x81BF,0x01BA,0x81AB,0x01AE,0x01A4,0x81A1,
+   0x01E0,0x81E5,0x81EF,0x01EA,0x81FB,0x01FE,0x01F4,0x81F1,
+   0x81D3,0x01D6,0x01DC,0x81D9,0x01C8,0x81CD,0x81C7,0x01C2,
+   0x0140,0x8145,0x814F,0x014A,0x815B,0x015E,0x0154,0x8151,
+   0x8173,0x0176,0x017C,0x8179,0x0168,0x816D,0x8167,0x0162,
+   0x8123,0x0126,0x012C,0x8129,0x0138,0x813D,0x8137,0x0132,
+   0x0110,0x8115,0x811F,0x011A,0x810B,0x010E,0x0104,0x8101,
+   0x8303,0x0306,0x030C,0x8309,0x0318,0x831D,0x8317,0x0312,
+   0x0330,0x8335,0x833F,0x033A,0x832B,0x032E,0x0324,0x8321,
+   0x0360,0x8365,0x836F,0x036A,0x837B,0x037E,0x0374,0x8371,
+   0x8353,0x0356,0x035C,0x8359,0x0348,0x834D,0x8347,0x0342,
+   0x03C0,0x83C5,0x83CF,0x03CA,0x83DB,0x03DE,0x03D4,0x83D1,
+   0x83F3,0x03F6,0x03FC,0x83F9,0x03E8,0x83ED,0x83E7,0x03E2,
+   0x83A3,0x03A6,0x03AC,0x83A9,0x03B8,0x83BD,0x83B7,0x03B2,
+   0x0390,0x8395,0x839F,0x039A,0x838B,0x038E,0x0384,0x8381,
+   0x0280,0x8285,0x828F,0x028A,0x829B,0x029E,0x0294,0x8291,
+   0x82B3,0x02B6,0x02BC,0x82B9,0x02A8,0x82AD,0x82A7,0x02A2,
+   0x82E3,0x02E6,0x02EC,0x82E9,0x02F8,0x82FD,0x82F7,0x02F2,
+   0x02D0,0x82D5,0x82DF,0x02DA,0x82CB,0x02CE,0x02C4,0x82C1,
+   0x8243,0x0246,0x024C,0x8249,0x0258,0x825D,0x8257,0x0252,
+   0x0270,0x8275,0x827F,0x027A,0x826B,0x026E,0x0264,0x8261,
+   0x0220,0x8225,0x822F,0x022A,0x823B,0x023E,0x0234,0x8231,
+   0x8213,0x0216,0x021C,0x8219,0x0208,0x820D,0x8207,0x0202
+};
+#endif
+
+const unsigned int32 crc32_table[256] = {
+   0x00000000,0x04C11DB7,0x09823B6E,0x0D4326D9,
+   0x130476DC,0x17C56B6B,0x1A864DB2,0x1E475005,
+   0x2608EDB8,0x22C9F00F,0x2F8AD6D6,0x2B4BCB61,
+   0x350C9B64,0x31CD86D3,0x3C8EA00A,0x384FBDBD,
+   0x4C11DB70,0x48D0C6C7,0x4593E01E,0x4152FDA9,
+   0x5F15ADAC,0x5BD4B01B,0x569796C2,0x52568B75,
+   0x6A1936C8,0x6ED82B7F,0x639B0DA6,0x675A1011,
+   0x791D4014,0x7DDC5DA3,0x709F7B7A,0x745E66CD,
+   0x9823B6E0,0x9CE2AB57,0x91A18D8E,0x95609039,
+   0x8B27C03C,0x8FE6DD8B,0x82A5FB52,0x8664E6E5,
+   0xBE2B5B58,0xBAEA46EF,0xB7A96036,0xB3687D81,
+   0xAD2F2D84,0xA9EE3033,0xA4AD16EA,0xA06C0B5D,
+   0xD4326D90,0xD0F37027,0xDDB056FE,0xD9714B49,
+   0xC7361B4C,0xC3F706FB,0xCEB42022,0xCA753D95,
+   0xF23A8028,0xF6FB9D9F,0xFBB8BB46,0xFF79A6F1,
+   0xE13EF6F4,0xE5FFEB43,0xE8BCCD9A,0xEC7DD02D,
+   0x34867077,0x30476DC0,0x3D044B19,0x39C556AE,
+   0x278206AB,0x23431B1C,0x2E003DC5,0x2AC12072,
+   0x128E9DCF,0x164F8078,0x1B0CA6A1,0x1FCDBB16,
+   0x018AEB13,0x054BF6A4,0x0808D07D,0x0CC9CDCA,
+   0x7897AB07,0x7C56B6B0,0x71159069,0x75D48DDE,
+   0x6B93DDDB,0x6F52C06C,0x6211E6B5,0x66D0FB02,
+   0x5E9F46BF,0x5A5E5B08,0x571D7DD1,0x53DC6066,
+   0x4D9B3063,0x495A2DD4,0x44190B0D,0x40D816BA,
+   0xACA5C697,0xA864DB20,0xA527FDF9,0xA1E6E04E,
+   0xBFA1B04B,0xBB60ADFC,0xB6238B25,0xB2E29692,
+   0x8AAD2B2F,0x8E6C3698,0x832F1041,0x87EE0DF6,
+   0x99A95DF3,0x9D684044,0x902B669D,0x94EA7B2A,
+   0xE0B41DE7,0xE4750050,0xE9362689,0xEDF73B3E,
+   0xF3B06B3B,0xF771768C,0xFA325055,0xFEF34DE2,
+   0xC6BCF05F,0xC27DEDE8,0xCF3ECB31,0xCBFFD686,
+   0xD5B88683,0xD1799B34,0xDC3ABDED,0xD8FBA05A,
+   0x690CE0EE,0x6DCDFD59,0x608EDB80,0x644FC637,
+   0x7A089632,0x7EC98B85,0x738AAD5C,0x774BB0EB,
+   0x4F040D56,0x4BC510E1,0x46863638,0x42472B8F,
+   0x5C007B8A,0x58C1663D,0x558240E4,0x51435D53,
+   0x251D3B9E,0x21DC2629,0x2C9F00F0,0x285E1D47,
+   0x36194D42,0x32D850F5,0x3F9B762C,0x3B5A6B9B,
+   0x0315D626,0x07D4CB91,0x0A97ED48,0x0E56F0FF,
+   0x1011A0FA,0x14D0BD4D,0x19939B94,0x1D528623,
+   0xF12F560E,0xF5EE4BB9,0xF8AD6D60,0xFC6C70D7,
+   0xE22B20D2,0xE6EA3D65,0xEBA91BBC,0xEF68060B,
+   0xD727BBB6,0xD3E6A601,0xDEA580D8,0xDA649D6F,
+   0xC423CD6A,0xC0E2D0DD,0xCDA1F604,0xC960EBB3,
+   0xBD3E8D7E,0xB9FF90C9,0xB4BCB610,0xB07DABA7,
+   0xAE3AFBA2,0xAAFBE615,0xA7B8C0CC,0xA379DD7B,
+   0x9B3660C6,0x9FF77D71,0x92B45BA8,0x9675461F,
+   0x8832161A,0x8CF30BAD,0x81B02D74,0x857130C3,
+   0x5D8A9099,0x594B8D2E,0x5408ABF7,0x50C9B640,
+   0x4E8EE645,0x4A4FFBF2,0x470CDD2B,0x43CDC09C,
+   0x7B827D21,0x7F436096,0x7200464F,0x76C15BF8,
+   0x68860BFD,0x6C47164A,0x61043093,0x65C52D24,
+   0x119B4BE9,0x155A565E,0x18197087,0x1CD86D30,
+   0x029F3D35,0x065E2082,0x0B1D065B,0x0FDC1BEC,
+   0x3793A651,0x3352BBE6,0x3E119D3F,0x3AD08088,
+   0x2497D08D,0x2056CD3A,0x2D15EBE3,0x29D4F654,
+   0xC5A92679,0xC1683BCE,0xCC2B1D17,0xC8EA00A0,
+   0xD6AD50A5,0xD26C4D12,0xDF2F6BCB,0xDBEE767C,
+   0xE3A1CBC1,0xE760D676,0xEA23F0AF,0xEEE2ED18,
+   0xF0A5BD1D,0xF464A0AA,0xF9278673,0xFDE69BC4,
+   0x89B8FD09,0x8D79E0BE,0x803AC667,0x84FBDBD0,
+   0x9ABC8BD5,0x9E7D9662,0x933EB0BB,0x97FFAD0C,
+   0xAFB010B1,0xAB710D06,0xA6322BDF,0xA2F33668,
+   0xBCB4666D,0xB8757BDA,0xB5365D03,0xB1F740B4
+};
+
+#if CRC_ENGINE == CRC_ENGINE_SLICE4
+const unsigned int32 crc32_table1[256] = {
+   0x00000000,0xD219C1DC,0xA0F29E0F,0x72EB5FD3,
+   0x452421A9,0x973DE075,0xE5D6BFA6,0x37CF7E7A,
+   0x8A484352,0x5851828E,0x2ABADD5D,0xF8A31C81,
+   0xCF6C62FB,0x1D75A327,0x6F9EFCF4,0xBD873D28,
+   0x10519B13,0xC2485ACF,0xB0A3051C,0x62BAC4C0,
+   0x5575BABA,0x876C7B66,0xF58724B5,0x279EE569,
+   0x9A19D841,0x4800199D,0x3AEB464E,0xE8F28792,
+   0xDF3DF9E8,0x0D243834,0x7FCF67E7,0xADD6A63B,
+   0x20A33626,0xF2BAF7FA,0x8051A829,0x524869F5,
+   0x6587178F,0xB79ED653,0xC5758980,0x176C485C,
+   0xAAEB7574,0x78F2B4A8,0x0A19EB7B,0xD8002AA7,
+   0xEFCF54DD,0x3DD69501,0x4F3DCAD2,0x9D240B0E,
+   0x30F2AD35,0xE2EB6CE9,0x9000333A,0x4219F2E6,
+   0x75D68C9C,0xA7CF4D40,0xD5241293,0x073DD34F,
+   0xBABAEE67,0x68A32FBB,0x1A487068,0xC851B1B4,
+   0xFF9ECFCE,0x2D870E12,0x5F6C51C1,0x8D75901D,
+   0x41466C4C,0x935FAD90,0xE1B4F243,0x33AD339F,
+   0x04624DE5,0xD67B8C39,0xA490D3EA,0x76891236,
+   0xCB0E2F1E,0x1917EEC2,0x6BFCB111,0xB9E570CD,
+   0x8E2A0EB7,0x5C33CF6B,0x2ED890B8,0xFCC15164,
+   0x5117F75F,0x830E3683,0xF1E56950,0x23FCA88C,
+   0x1433D6F6,0xC62A172A,0xB4C148F9,0x66D88925,
+   0xDB5FB40D,0x094675D1,0x7BAD2A02,0xA9B4EBDE,
+   0x9E7B95A4,0x4C625478,0x3E890BAB,0xEC90CA77,
+   0x61E55A6A,0xB3FC9BB6,0xC117C465,0x130E05B9,
+   0x24C17BC3,0xF6D8BA1F,0x8433E5CC,0x562A2410,
+   0xEBAD1938,0x39B4D8E4,0x4B5F8737,0x994646EB,
+   0xAE893891,0x7C90F94D,0x0E7BA69E,0xDC626742,
+   0x71B4C179,0xA3AD00A5,0xD1465F76,0x035F9EAA,
+   0x3490E0D0,0xE689210C,0x94627EDF,0x467BBF03,
+   0xFBFC822B,0x29E543F7,0x5B0E1C24,0x8917DDF8,
+   0xBED8A382,0x6CC1625E,0x1E2A3D8D,0xCC33FC51,
+   0x828CD898,0x50951944,0x227E4697,0xF067874B,
+   0xC7A8F931,0x15B138ED,0x675A673E,0xB543A6E2,
+   0x08C49BCA,0xDADD5A16,0xA83605C5,0x7A2FC419,
+   0x4DE0BA63,0x9FF97BBF,0xED12246C,0x3F0BE5B0,
+   0x92DD438B,0x40C48257,0x322FDD84,0xE0361C58,
+   0xD7F96222,0x05E0A3FE,0x770BFC2D,0xA5123DF1,
+   0x189500D9,0xCA8CC105,0xB8679ED6,0x6A7E5F0A,
+   0x5DB12170,0x8FA8E0AC,0xFD43BF7F,0x2F5A7EA3,
+   0xA22FEEBE,0x70362F62,0x02DD70B1,0xD0C4B16D,
+   0xE70BCF17,0x35120ECB,0x47F95118,0x95E090C4,
+   0x2867ADEC,0xFA7E6C30,0x889533E3,0x5A8CF23F,
+   0x6D438C45,0xBF5A4D99,0xCDB1124A,0x1FA8D396,
+   0xB27E75AD,0x6067B471,0x128CEBA2,0xC0952A7E,
+   0xF75A5404,0x254395D8,0x57A8CA0B,0x85B10BD7,
+   0x383636FF,0xEA2FF723,0x98C4A8F0,0x4ADD692C,
+   0x7D121756,0xAF0BD68A,0xDDE08959,0x0FF94885,
+   0xC3CAB4D4,0x11D37508,0x63382ADB,0xB121EB07,
+   0x86EE957D,0x54F754A1,0x261C0B72,0xF405CAAE,
+   0x4982F786,0x9B9B365A,0xE9706989,0x3B69A855,
+   0x0CA6D62F,0xDEBF17F3,0xAC544820,0x7E4D89FC,
+   0xD39B2FC7,0x0182EE1B,0x7369B1C8,0xA1707014,
+   0x96BF0E6E,0x44A6CFB2,0x364D9061,0xE45451BD,
+   0x59D36C95,0x8BCAAD49,0xF921F29A,0x2B383346,
+   0x1CF74D3C,0xCEEE8CE0,0xBC05D333,0x6E1C12EF,
+   0xE36982F2,0x3170432E,0x439B1CFD,0x9182DD21,
+   0xA64DA35B,0x74546287,0x06BF3D54,0xD4A6FC88,
+   0x6921C1A0,0xBB38007C,0xC9D35FAF,0x1BCA9E73,
+   0x2C05E009,0xFE1C21D5,0x8CF77E06,0x5EEEBFDA,
+   0xF33819E1,0x2121D83D,0x53CA87EE,0x81D34632,
+   0xB61C3848,0x6405F994,0x16EEA647,0xC4F7679B,
+   0x79705AB3,0xAB699B6F,0xD982C4BC,0x0B9B0560,
+   0x3C547B1A,0xEE4DBAC6,0x9CA6E515,0x4EBF24C9
+};
+
+const unsigned int32 crc32_table2[256] = {
+   0x00000000,0x01D8AC87,0x03B1590E,0x0269F589,
+   0x0762B21C,0x06BA1E9B,0x04D3EB12,0x050B4795,
+   0x0EC56438,0x0F1DC8BF,0x0D743D36,0x0CAC91B1,
+   0x09A7D624,0x087F7AA3,0x0A168F2A,0x0BCE23AD,
+   0x1D8AC870,0x1C5264F7,0x1E3B917E,0x1FE33DF9,
+   0x1AE87A6C,0x1B30D6EB,0x19592362,0x18818FE5,
+   0x134FAC48,0x129700CF,0x10FEF546,0x112659C1,
+   0x142D1E54,0x15F5B2D3,0x179C475A,0x1644EBDD,
+   0x3B1590E0,0x3ACD3C67,0x38A4C9EE,0x397C6569,
+   0x3C7722FC,0x3DAF8E7B,0x3FC67BF2,0x3E1ED775,
+   0x35D0F4D8,0x3408585F,0x3661ADD6,0x37B90151,
+   0x32B246C4,0x336AEA43,0x31031FCA,0x30DBB34D,
+   0x269F5890,0x2747F417,0x252E019E,0x24F6AD19,
+   0x21FDEA8C,0x2025460B,0x224CB382,0x23941F05,
+   0x285A3CA8,0x2982902F,0x2BEB65A6,0x2A33C921,
+   0x2F388EB4,0x2EE02233,0x2C89D7BA,0x2D517B3D,
+   0x762B21C0,0x77F38D47,0x759A78CE,0x7442D449,
+   0x714993DC,0x70913F5B,0x72F8CAD2,0x73206655,
+   0x78EE45F8,0x7936E97F,0x7B5F1CF6,0x7A87B071,
+   0x7F8CF7E4,0x7E545B63,0x7C3DAEEA,0x7DE5026D,
+   0x6BA1E9B0,0x6A794537,0x6810B0BE,0x69C81C39,
+   0x6CC35BAC,0x6D1BF72B,0x6F7202A2,0x6EAAAE25,
+   0x65648D88,0x64BC210F,0x66D5D486,0x670D7801,
+   0x62063F94,0x63DE9313,0x61B7669A,0x606FCA1D,
+   0x4D3EB120,0x4CE61DA7,0x4E8FE82E,0x4F5744A9,
+   0x4A5C033C,0x4B84AFBB,0x49ED5A32,0x4835F6B5,
+   0x43FBD518,0x4223799F,0x404A8C16,0x41922091,
+   0x44996704,0x4541CB83,0x47283E0A,0x46F0928D,
+   0x50B47950,0x516CD5D7,0x5305205E,0x52DD8CD9,
+   0x57D6CB4C,0x560E67CB,0x54679242,0x55BF3EC5,
+   0x5E711D68,0x5FA9B1EF,0x5DC04466,0x5C18E8E1,
+   0x5913AF74,0x58CB03F3,0x5AA2F67A,0x5B7A5AFD,
+   0xEC564380,0xED8EEF07,0xEFE71A8E,0xEE3FB609,
+   0xEB34F19C,0xEAEC5D1B,0xE885A892,0xE95D0415,
+   0xE29327B8,0xE34B8B3F,0xE1227EB6,0xE0FAD231,
+   0xE5F195A4,0xE4293923,0xE640CCAA,0xE798602D,
+   0xF1DC8BF0,0xF0042777,0xF26DD2FE,0xF3B57E79,
+   0xF6BE39EC,0xF766956B,0xF50F60E2,0xF4D7CC65,
+   0xFF19EFC8,0xFEC1434F,0xFCA8B6C6,0xFD701A41,
+   0xF87B5DD4,0xF9A3F153,0xFBCA04DA,0xFA12A85D,
+   0xD743D360,0xD69B7FE7,0xD4F28A6E,0xD52A26E9,
+   0xD021617C,0xD1F9CDFB,0xD3903872,0xD24894F5,
+   0xD986B758,0xD85E1BDF,0xDA37EE56,0xDBEF42D1,
+   0xDEE40544,0xDF3CA9C3,0xDD555C4A,0xDC8DF0CD,
+   0xCAC91B10,0xCB11B797,0xC978421E,0xC8A0EE99,
+   0xCDABA90C,0xCC73058B,0xCE1AF002,0xCFC25C85,
+   0xC40C7F28,0xC5D4D3AF,0xC7BD2626,0xC6658AA1,
+   0xC36ECD34,0xC2B661B3,0xC0DF943A,0xC10738BD,
+   0x9A7D6240,0x9BA5CEC7,0x99CC3B4E,0x981497C9,
+   0x9D1FD05C,0x9CC77CDB,0x9EAE8952,0x9F7625D5,
+   0x94B80678,0x9560AAFF,0x97095F76,0x96D1F3F1,
+   0x93DAB464,0x920218E3,0x906BED6A,0x91B341ED,
+   0x87F7AA30,0x862F06B7,0x8446F33E,0x859E5FB9,
+   0x8095182C,0x814DB4AB,0x83244122,0x82FCEDA5,
+   0x8932CE08,0x88EA628F,0x8A839706,0x8B5B3B81,
+   0x8E507C14,0x8F88D093,0x8DE1251A,0x8C39899D,
+   0xA168F2A0,0xA0B05E27,0xA2D9ABAE,0xA3010729,
+   0xA60A40BC,0xA7D2EC3B,0xA5BB19B2,0xA463B535,
+   0xAFAD9698,0xAE753A1F,0xAC1CCF96,0xADC46311,
+   0xA8CF2484,0xA9178803,0xAB7E7D8A,0xAAA6D10D,
+   0xBCE23AD0,0xBD3A9657,0xBF5363DE,0xBE8BCF59,
+   0xBB8088CC,0xBA58244B,0xB831D1C2,0xB9E97D45,
+   0xB2275EE8,0xB3FFF26F,0xB19607E6,0xB04EAB61,
+   0xB545ECF4,0xB49D4073,0xB6F4B5FA,0xB72C197D
+};
+
+const unsigned int32 crc32_table3[256] = {
+   0x00000000,0xDC6D9AB7,0xBC1A28D9,0x6077B26E,
+   0x7CF54C05,0xA098D6B2,0xC0EF64DC,0x1C82FE6B,
+   0xF9EA980A,0x258702BD,0x45F0B0D3,0x999D2A64,
+   0x851FD40F,0x59724EB8,0x3905FCD6,0xE5686661,
+   0xF7142DA3,0x2B79B714,0x4B0E057A,0x97639FCD,
+   0x8BE161A6,0x578CFB11,0x37FB497F,0xEB96D3C8,
+   0x0EFEB5A9,0xD2932F1E,0xB2E49D70,0x6E8907C7,
+   0x720BF9AC,0xAE66631B,0xCE11D175,0x127C4BC2,
+   0xEAE946F1,0x3684DC46,0x56F36E28,0x8A9EF49F,
+   0x961C0AF4,0x4A719043,0x2A06222D,0xF66BB89A,
+   0x1303DEFB,0xCF6E444C,0xAF19F622,0x73746C95,
+   0x6FF692FE,0xB39B0849,0xD3ECBA27,0x0F812090,
+   0x1DFD6B52,0xC190F1E5,0xA1E7438B,0x7D8AD93C,
+   0x61082757,0xBD65BDE0,0xDD120F8E,0x017F9539,
+   0xE417F358,0x387A69EF,0x580DDB81,0x84604136,
+   0x98E2BF5D,0x448F25EA,0x24F89784,0xF8950D33,
+   0xD1139055,0x0D7E0AE2,0x6D09B88C,0xB164223B,
+   0xADE6DC50,0x718B46E7,0x11FCF489,0xCD916E3E,
+   0x28F9085F,0xF49492E8,0x94E32086,0x488EBA31,
+   0x540C445A,0x8861DEED,0xE8166C83,0x347BF634,
+   0x2607BDF6,0xFA6A2741,0x9A1D952F,0x46700F98,
+   0x5AF2F1F3,0x869F6B44,0xE6E8D92A,0x3A85439D,
+   0xDFED25FC,0x0380BF4B,0x63F70D25,0xBF9A9792,
+   0xA31869F9,0x7F75F34E,0x1F024120,0xC36FDB97,
+   0x3BFAD6A4,0xE7974C13,0x87E0FE7D,0x5B8D64CA,
+   0x470F9AA1,0x9B620016,0xFB15B278,0x277828CF,
+   0xC2104EAE,0x1E7DD419,0x7E0A6677,0xA267FCC0,
+   0xBEE502AB,0x6288981C,0x02FF2A72,0xDE92B0C5,
+   0xCCEEFB07,0x108361B0,0x70F4D3DE,0xAC994969,
+   0xB01BB702,0x6C762DB5,0x0C019FDB,0xD06C056C,
+   0x3504630D,0xE969F9BA,0x891E4BD4,0x5573D163,
+   0x49F12F08,0x959CB5BF,0xF5EB07D1,0x29869D66,
+   0xA6E63D1D,0x7A8BA7AA,0x1AFC15C4,0xC6918F73,
+   0xDA137118,0x067EEBAF,0x660959C1,0xBA64C376,
+   0x5F0CA517,0x83613FA0,0xE3168DCE,0x3F7B1779,
+   0x23F9E912,0xFF9473A5,0x9FE3C1CB,0x438E5B7C,
+   0x51F210BE,0x8D9F8A09,0xEDE83867,0x3185A2D0,
+   0x2D075CBB,0xF16AC60C,0x911D7462,0x4D70EED5,
+   0xA81888B4,0x74751203,0x1402A06D,0xC86F3ADA,
+   0xD4EDC4B1,0x08805E06,0x68F7EC68,0xB49A76DF,
+   0x4C0F7BEC,0x9062E15B,0xF0155335,0x2C78C982,
+   0x30FA37E9,0xEC97AD5E,0x8CE01F30,0x508D8587,
+   0xB5E5E3E6,0x69887951,0x09FFCB3F,0xD5925188,
+   0xC910AFE3,0x157D3554,0x750A873A,0xA9671D8D,
+   0xBB1B564F,0x6776CCF8,0x07017E96,0xDB6CE421,
+   0xC7EE1A4A,0x1B8380FD,0x7BF43293,0xA799A824,
+   0x42F1CE45,0x9E9C54F2,0xFEEBE69C,0x22867C2B,
+   0x3E048240,0xE26918F7,0x821EAA99,0x5E73302E,
+   0x77F5AD48,0xAB9837FF,0xCBEF8591,0x17821F26,
+   0x0B00E14D,0xD76D7BFA,0xB71AC994,0x6B775323,
+   0x8E1F3542,0x5272AFF5,0x32051D9B,0xEE68872C,
+   0xF2EA7947,0x2E87E3F0,0x4EF0519E,0x929DCB29,
+   0x80E180EB,0x5C8C1A5C,0x3CFBA832,0xE0963285,
+   0xFC14CCEE,0x20795659,0x400EE437,0x9C637E80,
+   0x790B18E1,0xA5668256,0xC5113038,0x197CAA8F,
+   0x05FE54E4,0xD993CE53,0xB9E47C3D,0x6589E68A,
+   0x9D1CEBB9,0x4171710E,0x2106C360,0xFD6B59D7,
+   0xE1E9A7BC,0x3D843D0B,0x5DF38F65,0x819E15D2,
+   0x64F673B3,0xB89BE904,0xD8EC5B6A,0x0481C1DD,
+   0x18033FB6,0xC46EA501,0xA419176F,0x78748DD8,
+   0x6A08C61A,0xB6655CAD,0xD612EEC3,0x0A7F7474,
+   0x16FD8A1F,0xCA9010A8,0xAAE7A2C6,0x768A3871,
+   0x93E25E10,0x4F8FC4A7,0x2FF876C9,0xF395EC7E,
+   0xEF171215,0x337A88A2,0x530D3ACC,0x8F60A07B
+};
+#endif
+
+#endif
+
+unsigned int8 crc8_update(unsigned int8 crc, unsigned int8* data, unsigned int16 length)
+{
+   while(length--)
+   {
+#if CRC_ENGINE == CRC_ENGINE_NIBBLE
+      crc ^= *data++;
+      crc = (crc << 4) ^ crc8_nibble_table[crc >> 4];
+      crc = (crc << 4) ^ crc8_nibble_table[crc >> 4];
+#else
+      crc = crc8_table[crc ^ *data++];
+#endif
+   }
+   return crc;
+}
+
+unsigned int16 crc16_update(unsigned int16 crc, unsigned int8* data, unsigned int16 length)
+{
+   while(length--)
+   {
+#if CRC_ENGINE == CRC_ENGINE_NIBBLE
+      crc ^= make16(*data++, 0);
+      crc = (crc << 4) ^ crc16_nibble_table[make8(crc, 1) >> 4];
+      crc = (crc << 4) ^ crc16_nibble_table[make8(crc, 1) >> 4];
+#else
+      crc = (crc << 8) ^ crc16_table[make8(crc, 1) ^ *data++];
+#endif
+   }
+   return crc;
+}
+
+unsigned int32 crc32_update(unsigned int32 crc, unsigned int8* data, unsigned int16 length)
+{
+#if CRC_ENGINE == CRC_ENGINE_SLICE4
+   while(length >= 4)
+   {
+      crc ^= make32(data[0], data[1], data[2], data[3]);
+      crc = crc32_table3[make8(crc, 3)] ^ crc32_table2[make8(crc, 2)] ^
+            crc32_table1[make8(crc, 1)] ^ crc32_table[make8(crc, 0)];
+      data += 4;
+      length -= 4;
+   }
+#endif
+   while(length--)
+   {
+#if CRC_ENGINE == CRC_ENGINE_NIBBLE
+      crc ^= make32(*data++, 0, 0, 0);
+      crc = (crc << 4) ^ crc32_nibble_table[make8(crc, 3) >> 4];
+      crc = (crc << 4) ^ crc32_nibble_table[make8(crc, 3) >> 4];
+#else
+      crc = (crc << 8) ^ crc32_table[make8(crc, 3) ^ *data++];
+#endif
+   }
+   return crc;
+}
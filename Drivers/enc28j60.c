@@ -7,6 +7,11 @@
 // stack.  This driver only provides you with the MAC/PHY layers of a TCP/IP
 // stack.
 //
+// Checksums and copies of packet data can be done by the ENC28J60's DMA
+// engine, so the data doesn't have to be read back over SPI.  See
+// NICCalcRxChecksum(), NICCalcTxChecksum(), NICPutTxChecksum() and
+// NICCopyRxToTx().
+//
 ///////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 1996, 2003 Custom Computer Services          ////
 //// This source code may only be used by licensed users of the CCS C  ////
@@ -29,6 +34,13 @@
 #define MAC_USE_LOOPBACK      FALSE
 #define MAC_HALF_DUPLEX_ECHO  FALSE //if using half duplex, do you want a transmit echo?
 
+//Checksums are calculated by the DMA.  Some silicon revisions can corrupt the
+//DMA checksum if a packet is received while it's running, define this FALSE
+//to read the data over SPI and calculate the checksum in software instead.
+#ifndef ENC_MAC_DMA_CHECKSUM
+ #define ENC_MAC_DMA_CHECKSUM  TRUE
+#endif
+
 //if you are not using the Microchip TCP/IP stack, this will define functions
 //that would have been defined normally by MAC.H
 #ifndef MAC_H
@@ -66,6 +78,12 @@ typedef struct _ETH_HDR_ {
    int16 type;
 } ETHERNET_HEADER;
 
+//one block of a scatter-gather write, see NICPutSegments()
+typedef struct _NIC_SEGMENT_ {
+   int8 *ptr;
+   int16 len;
+} NIC_SEGMENT;
+
 /*~*~*~*~*~*~*~*~*~*~*~*~ SPI CONFIG *~*~*~*~*~*~*~*~*~*~*~*~*~*~*~*~*~*~*~*~*/
 
 //if you use SPI, you still need to define clock and reset pins
@@ -73,6 +91,21 @@ typedef struct _ETH_HDR_ {
 #define ENC_MAC_USE_SPI FALSE
 #endif
 
+//with hardware SPI, buffer memory reads and writes of ENC_MAC_SPI_DMA_MIN
+//bytes or more use the SPI DMA module on parts that have one (PIC18 J-series).
+//other transfers use a register level loop.
+#ifndef ENC_MAC_SPI_DMA
+ #if ENC_MAC_USE_SPI && !defined(__PCD__) && getenv("SFR_VALID:DMACON1")
+  #define ENC_MAC_SPI_DMA TRUE
+ #else
+  #define ENC_MAC_SPI_DMA FALSE
+ #endif
+#endif
+
+#ifndef ENC_MAC_SPI_DMA_MIN
+ #define ENC_MAC_SPI_DMA_MIN   16
+#endif
+
 #ifndef PIN_ENC_MAC_SO
    #define PIN_ENC_MAC_SO  PIN_B2   // PIC <<<< ENC
    #define PIN_ENC_MAC_SI  PIN_D3   // PIC >>>> ENC
@@ -142,6 +175,14 @@ typedef struct _ETH_HDR_ {
 #define ENC_MAC_ERXRDPTH   0x0D
 #define ENC_MAC_ERXWRPTL   0x0E
 #define ENC_MAC_ERXWRPTH   0x0F
+#define ENC_MAC_EDMASTL    0x10
+#define ENC_MAC_EDMASTH    0x11
+#define ENC_MAC_EDMANDL    0x12
+#define ENC_MAC_EDMANDH    0x13
+#define ENC_MAC_EDMADSTL   0x14
+#define ENC_MAC_EDMADSTH   0x15
+#define ENC_MAC_EDMACSL    0x16
+#define ENC_MAC_EDMACSH    0x17
 #define ENC_MAC_EIR        0x1C
 #define ENC_MAC_ESTAT      0x1D
 #define ENC_MAC_ECON2      0x1E
@@ -203,6 +244,8 @@ void enc_mac_spi_out_byte(int8 d);  //use spi to write a byte
 int8 enc_mac_spi_in_byte(void);  //use spi to read a byte
 void enc_mac_write_bytes(int8 oa, int8 *ptr, int16 len);  //write command (oa) then bytes to SPI
 void enc_mac_read_bytes(int8 oa, int8 *ptr, int16 len); //write command (oa) then read bytes from spi
+void enc_mac_spi_write_block(int8 *ptr, int16 len);   //write bytes to spi, CS already low
+void enc_mac_spi_read_block(int8 *ptr, int16 len); //read bytes from spi, CS already low
 void enc_mac_soft_reset(void);   //issue a spi command to reset the unit
 void enc_mac_control_bit_set(int8 address, int8 bit); //set a bit in a control register
 void enc_mac_control_bit_clear(int8 address, int8 bit);  //clear a bit in a control register
@@ -213,6 +256,8 @@ void enc_mac_write_phy_word(int8 address, int16 data);   //write a phy register
 int16 enc_mac_read_phy_word(int8 address);   //read a phy register
 void enc_mac_write_control_word(int8 address, int16 data);
 int16 enc_mac_read_control_word(int8 address, int8 needs_dummy_read);
+int16 enc_mac_dma_checksum(int16 start, int16 len);   //checksum of len bytes of buffer memory
+void enc_mac_dma_copy(int16 start, int16 len, int16 dest); //copy len bytes inside buffer memory
 
 void debug_print_mac(MAC_ADDR *mac) {
    debug_printf("%X:%X:%X:%X:%X:%X", mac->v[0], mac->v[1], mac->v[2],
@@ -249,6 +294,196 @@ int8 enc_mac_spi_exchange(int8 out) {
    return(in);
 }
 
+////////////////////////////////////////////////////////////////////////////
+//
+// Bulk transfers.  enc_mac_spi_write_block() and enc_mac_spi_read_block()
+// move a block of bytes while CS is already low, without a function call
+// per byte.  With hardware SPI they work on the SPI registers directly and
+// use the SPI DMA module for larger blocks when ENC_MAC_SPI_DMA is TRUE.
+// With the bit-bang interface a write doesn't sample SO and a read doesn't
+// drive SI for every bit.
+//
+////////////////////////////////////////////////////////////////////////////
+#if ENC_MAC_USE_SPI
+ #if defined(__PCD__)
+  #word ENC_MAC_SPIBUF = getenv("SFR:SPI1BUF")
+  #bit  ENC_MAC_SPIRBF = getenv("SFR:SPI1STAT").0
+ #elif getenv("SFR_VALID:SSP1BUF")
+  #byte ENC_MAC_SPIBUF = getenv("SFR:SSP1BUF")
+  #bit  ENC_MAC_SPIRBF = getenv("SFR:SSP1STAT").0
+ #else
+  #byte ENC_MAC_SPIBUF = getenv("SFR:SSPBUF")
+  #bit  ENC_MAC_SPIRBF = getenv("SFR:SSPSTAT").0
+ #endif
+
+ //one byte out and in through the SPI registers
+ #define ENC_MAC_SPI_PUT(d)    ENC_MAC_SPIBUF=(d); while(!ENC_MAC_SPIRBF); dummy=ENC_MAC_SPIBUF
+ #define ENC_MAC_SPI_GET(p)    ENC_MAC_SPIBUF=0; while(!ENC_MAC_SPIRBF); *(p)=ENC_MAC_SPIBUF
+#else
+ //one bit of the bit-bang interface, write only and read only
+ #define ENC_MAC_BB_PUT(d,b)   output_bit(PIN_ENC_MAC_SI, bit_test(d,b)); output_high(PIN_ENC_MAC_CLK); output_low(PIN_ENC_MAC_CLK)
+ #define ENC_MAC_BB_GET(d)     output_high(PIN_ENC_MAC_CLK); shift_left(&d, 1, input(PIN_ENC_MAC_SO)); output_low(PIN_ENC_MAC_CLK)
+#endif
+
+#if ENC_MAC_SPI_DMA
+#byte ENC_MAC_DMACON1 = getenv("SFR:DMACON1")
+#byte ENC_MAC_TXADDRH = getenv("SFR:TXADDRH")
+#byte ENC_MAC_TXADDRL = getenv("SFR:TXADDRL")
+#byte ENC_MAC_RXADDRH = getenv("SFR:RXADDRH")
+#byte ENC_MAC_RXADDRL = getenv("SFR:RXADDRL")
+#byte ENC_MAC_DMABCH  = getenv("SFR:DMABCH")
+#byte ENC_MAC_DMABCL  = getenv("SFR:DMABCL")
+
+int8 enc_mac_spi_dma_dummy;
+
+////////////////////////////////////////////////////////////////////////////
+//
+// enc_mac_spi_dma(int8 *tx, int8 *rx, int16 len)
+//
+// Moves len bytes with the SPI DMA module, transmit only from tx if tx
+// isn't 0, otherwise receive only into rx (rx of 0 throws the bytes away).
+// The DMA module moves up to 1024 bytes at a time.
+//
+////////////////////////////////////////////////////////////////////////////
+void enc_mac_spi_dma(int8 *tx, int8 *rx, int16 len) {
+   int16 n;
+   int8 dummy;
+
+   enc_mac_spi_dma_dummy=0;
+
+   while(len) {
+      n=len;
+      if (n > 1024)
+         n=1024;
+
+      ENC_MAC_DMABCH=make8(n-1,1);
+      ENC_MAC_DMABCL=make8(n-1,0);
+
+      if (tx) {
+         ENC_MAC_TXADDRH=make8((int16)tx,1);
+         ENC_MAC_TXADDRL=make8((int16)tx,0);
+         ENC_MAC_DMACON1=0x24;   //TXINC, transmit only
+         tx+=n;
+      }
+      else {
+         ENC_MAC_TXADDRH=make8((int16)&enc_mac_spi_dma_dummy,1);
+         ENC_MAC_TXADDRL=make8((int16)&enc_mac_spi_dma_dummy,0);
+         if (rx) {
+            ENC_MAC_RXADDRH=make8((int16)rx,1);
+            ENC_MAC_RXADDRL=make8((int16)rx,0);
+            ENC_MAC_DMACON1=0x10;   //RXINC, receive only
+            rx+=n;
+         }
+         else {
+            ENC_MAC_RXADDRH=make8((int16)&enc_mac_spi_dma_dummy,1);
+            ENC_MAC_RXADDRL=make8((int16)&enc_mac_spi_dma_dummy,0);
+            ENC_MAC_DMACON1=0x00;   //receive only, don't increment
+         }
+      }
+
+      dummy=ENC_MAC_SPIBUF;   //clear BF
+      bit_set(ENC_MAC_DMACON1,0);   //DMAEN
+      while(bit_test(ENC_MAC_DMACON1,0));
+
+      len-=n;
+   }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////
+void enc_mac_spi_write_block(int8 *ptr, int16 len) {
+ #if ENC_MAC_USE_SPI
+   int8 dummy;
+
+  #if ENC_MAC_SPI_DMA
+   if (len >= ENC_MAC_SPI_DMA_MIN) {
+      enc_mac_spi_dma(ptr, 0, len);
+      return;
+   }
+  #endif
+   while(len >= 4) {
+      ENC_MAC_SPI_PUT(ptr[0]);
+      ENC_MAC_SPI_PUT(ptr[1]);
+      ENC_MAC_SPI_PUT(ptr[2]);
+      ENC_MAC_SPI_PUT(ptr[3]);
+      ptr+=4;
+      len-=4;
+   }
+   while(len--) {
+      ENC_MAC_SPI_PUT(*ptr);
+      ptr++;
+   }
+ #else
+   int8 d;
+
+   while(len--) {
+      d=*ptr;
+      ENC_MAC_BB_PUT(d,7);
+      ENC_MAC_BB_PUT(d,6);
+      ENC_MAC_BB_PUT(d,5);
+      ENC_MAC_BB_PUT(d,4);
+      ENC_MAC_BB_PUT(d,3);
+      ENC_MAC_BB_PUT(d,2);
+      ENC_MAC_BB_PUT(d,1);
+      ENC_MAC_BB_PUT(d,0);
+      ptr++;
+   }
+ #endif
+}
+
+////////////////////////////////////////////////////////////////////////////
+//ptr of 0 throws the bytes away
+////////////////////////////////////////////////////////////////////////////
+void enc_mac_spi_read_block(int8 *ptr, int16 len) {
+ #if ENC_MAC_USE_SPI
+   int8 dummy;
+
+  #if ENC_MAC_SPI_DMA
+   if (len >= ENC_MAC_SPI_DMA_MIN) {
+      enc_mac_spi_dma(0, ptr, len);
+      return;
+   }
+  #endif
+   if (!ptr) {
+      while(len--) {
+         ENC_MAC_SPI_GET(&dummy);
+      }
+      return;
+   }
+   while(len >= 4) {
+      ENC_MAC_SPI_GET(&ptr[0]);
+      ENC_MAC_SPI_GET(&ptr[1]);
+      ENC_MAC_SPI_GET(&ptr[2]);
+      ENC_MAC_SPI_GET(&ptr[3]);
+      ptr+=4;
+      len-=4;
+   }
+   while(len--) {
+      ENC_MAC_SPI_GET(ptr);
+      ptr++;
+   }
+ #else
+   int8 d;
+
+   output_low(PIN_ENC_MAC_SI);
+   while(len--) {
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      ENC_MAC_BB_GET(d);
+      if (ptr) {
+         *ptr=d;
+         ptr++;
+      }
+   }
+ #endif
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //
 // enc_mac_spi_out_byte(int8 d)
@@ -294,10 +529,7 @@ void enc_mac_write_bytes(int8 oa, int8 *ptr, int16 len) {
    output_low(PIN_ENC_MAC_CS);
 
    enc_mac_spi_out_byte(oa);
-   while(len--) {
-      enc_mac_spi_out_byte(*ptr);
-      ptr++;
-   }
+   enc_mac_spi_write_block(ptr, len);
 
    output_high(PIN_ENC_MAC_CS);
 }
@@ -305,17 +537,10 @@ void enc_mac_write_bytes(int8 oa, int8 *ptr, int16 len) {
 ////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////
 void enc_mac_read_bytes(int8 oa, int8 *ptr, int16 len) {
-   char c;
    output_low(PIN_ENC_MAC_CS);
 
    enc_mac_spi_out_byte(oa);
-   while(len--) {
-      c=enc_mac_spi_in_byte();
-      if (ptr) {
-         *ptr=c;
-         ptr++;
-      }
-   }
+   enc_mac_spi_read_block(ptr, len);
 
    output_high(PIN_ENC_MAC_CS);
 }
@@ -657,6 +882,27 @@ int8 NICGet(void) {
 ////////////////////////////////////////////////////////////////////////////
 #define NICPutArray(ptr,size)  enc_mac_write_bytes(0x7A, ptr, size)
 
+////////////////////////////////////////////////////////////////////////////
+//
+// NICPutSegments(NIC_SEGMENT *seg, int8 count)
+//
+// Same as NICPutArray(), but writes count blocks one after the other
+// with one write buffer memory command and chip select, so a header and
+// payload in different places in RAM go out as one transfer.
+//
+////////////////////////////////////////////////////////////////////////////
+void NICPutSegments(NIC_SEGMENT *seg, int8 count) {
+   output_low(PIN_ENC_MAC_CS);
+
+   enc_mac_spi_out_byte(0x7A);
+   while(count--) {
+      enc_mac_spi_write_block(seg->ptr, seg->len);
+      seg++;
+   }
+
+   output_high(PIN_ENC_MAC_CS);
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //
 // NICPut(char c)
@@ -687,12 +933,18 @@ void NICPut(char c) {
 //  data in the receive buffer - this is unlikely to happen though.
 //
 ////////////////////////////////////////////////////////////////////////////
-void __NICSetRxBuffer(int16 offset) {
+int16 __NICRxLocation(int16 offset) {
    int16 location;
    location=__last_enc_header.packet_start + offset;
    if (location > ENC_MAC_RX_END) {
-      location-=ENC_MAC_RX_END - __last_enc_header.packet_start + 1;
+      location-=ENC_MAC_RX_SIZE;    //receive buffer wraps around
    }
+   return(location);
+}
+
+void __NICSetRxBuffer(int16 offset) {
+   int16 location;
+   location=__NICRxLocation(offset);
    enc_mac_write_control_word(ENC_MAC_ERDPTL,location);
    enc_mac_write_control_word(ENC_MAC_EWRPTL,location);
 }
@@ -912,8 +1164,8 @@ int NICIsTxReady(void) {
 // ENC28J60.
 //
 // NOTE - The read pointer is also set so you can use NICGet() and
-//  NICGetArray() to read from the transmit buffer - useful when you need to
-//  reread your packet to determine the checksum.
+//  NICGetArray() to read from the transmit buffer.  To checksum the packet
+//  use NICCalcTxChecksum() or NICPutTxChecksum() instead of rereading it.
 //
 // NOTE - assumes that the transmit buffer starts at 0
 //
@@ -971,6 +1223,33 @@ void NICDiscardTx(int8 buffer) {
    __mac_tx_buffers[buffer].isActive=FALSE;
 }
 
+////////////////////////////////////////////////////////////////////////////
+//
+// NICPutFrame(ETHERNET_HEADER *header, int8 *data, int16 len)
+//
+// Same as NICPutHeader() followed by NICPutArray(data,len), but the control
+// byte, header and data are written in one transfer.  Call NICFlush(len)
+// to send it.
+//
+// NOTE: Assumes that header.type is in big endian
+//
+////////////////////////////////////////////////////////////////////////////
+void NICPutFrame(ETHERNET_HEADER *header, int8 *data, int16 len) {
+   int8 control;
+   NIC_SEGMENT seg[3];
+
+   control=0;
+   seg[0].ptr=&control;
+   seg[0].len=1;
+   seg[1].ptr=header;
+   seg[1].len=sizeof(ETHERNET_HEADER);
+   seg[2].ptr=data;
+   seg[2].len=len;
+
+   __NICSetTxBuffer(NICCurrentTxBuffer,0);
+   NICPutSegments(seg, 3);
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //
 // NICPutHeader(ETHERNET_HEADER *header)
@@ -987,9 +1266,7 @@ void NICDiscardTx(int8 buffer) {
 void NICPutHeader(ETHERNET_HEADER *header) {
    debug_printf("\r\nPUT ETHERNET ");
    debug_print_eth_header(header);
-   __NICSetTxBuffer(NICCurrentTxBuffer,0);
-   NICPut(0);  //set control byte
-   NICPutArray(header,sizeof(ETHERNET_HEADER));
+   NICPutFrame(header, 0, 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -1063,6 +1340,195 @@ void debug_display_tx_status(void) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////
+///                                                                      ///
+///  DMA checksum and copy.  The data stays in the ENC28J60's buffer     ///
+///  memory and never crosses the SPI bus.                               ///
+///                                                                      ///
+////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////
+//
+// enc_mac_dma_end(int16 start, int16 len)
+//
+// Returns the address of the last byte of a block, wrapped around the
+// end of the receive buffer if the block starts in the receive buffer.
+//
+////////////////////////////////////////////////////////////////////////////
+int16 enc_mac_dma_end(int16 start, int16 len) {
+   int16 end;
+   end=start + len - 1;
+   if ((start >= ENC_MAC_RX_START) && (end > ENC_MAC_RX_END))
+      end-=ENC_MAC_RX_SIZE;
+   return(end);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// enc_mac_dma_run(int16 start, int16 len, int8 checksum)
+//
+// Loads EDMAST and EDMAND, starts the DMA (checksum if checksum is TRUE,
+// otherwise copy to EDMADST which must already be set) and waits for it
+// to finish.  Takes about 1 instruction cycle of the ENC28J60 per byte.
+//
+////////////////////////////////////////////////////////////////////////////
+void enc_mac_dma_run(int16 start, int16 len, int8 checksum) {
+   enc_mac_write_control_word(ENC_MAC_EDMASTL, start);
+   enc_mac_write_control_word(ENC_MAC_EDMANDL, enc_mac_dma_end(start, len));
+
+   if (checksum)
+      enc_mac_control_bit_set(ENC_MAC_ECON1, 4);   //CSUMEN
+   else
+      enc_mac_control_bit_clear(ENC_MAC_ECON1, 4);
+   enc_mac_control_bit_set(ENC_MAC_ECON1, 5);      //DMAST
+
+   while (bit_test(enc_mac_read_control_byte(ENC_MAC_ECON1,0),5)) {}
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// enc_mac_dma_checksum(int16 start, int16 len)
+//
+// Returns the IP checksum (one's complement of the one's complement sum)
+// of len bytes of buffer memory starting at start.  The checksum is
+// returned as a big endian number, so the high byte is put into the packet
+// first.  Returns 0xFFFF if len is 0.
+//
+// If ENC_MAC_DMA_CHECKSUM is FALSE the data is read over SPI instead.  The
+// read pointer is restored afterwards.
+//
+////////////////////////////////////////////////////////////////////////////
+int16 enc_mac_dma_checksum(int16 start, int16 len) {
+ #if ENC_MAC_DMA_CHECKSUM
+   if (!len)
+      return(0xFFFF);
+   enc_mac_dma_run(start, len, TRUE);
+   return(make16(enc_mac_read_control_byte(ENC_MAC_EDMACSH,0),
+                 enc_mac_read_control_byte(ENC_MAC_EDMACSL,0)));
+ #else
+   int16 erdpt;
+   unsigned int32 sum;
+   unsigned int8 c;
+   int1 odd;
+
+   erdpt=enc_mac_read_control_word(ENC_MAC_ERDPTL,0);
+   enc_mac_write_control_word(ENC_MAC_ERDPTL,start);
+
+   sum=0;
+   odd=FALSE;
+   output_low(PIN_ENC_MAC_CS);
+   enc_mac_spi_out_byte(0x3A);   //read buffer memory, AUTOINC wraps in receive buffer
+   while(len--) {
+      c=enc_mac_spi_in_byte();
+      if (odd)
+         sum+=c;
+      else
+         sum+=(unsigned int16)c<<8;
+      odd=!odd;
+   }
+   output_high(PIN_ENC_MAC_CS);
+
+   enc_mac_write_control_word(ENC_MAC_ERDPTL,erdpt);
+
+   while (sum>>16)
+      sum=(sum & 0xFFFF) + (sum>>16);
+   return(~(unsigned int16)sum);
+ #endif
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// enc_mac_dma_copy(int16 start, int16 len, int16 dest)
+//
+// Copies len bytes of buffer memory from start to dest.  A source block
+// in the receive buffer wraps around the end of the receive buffer.
+//
+////////////////////////////////////////////////////////////////////////////
+void enc_mac_dma_copy(int16 start, int16 len, int16 dest) {
+   if (!len)
+      return;
+   enc_mac_write_control_word(ENC_MAC_EDMADSTL, dest);
+   enc_mac_dma_run(start, len, FALSE);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// NICCalcRxChecksum(int16 offset, int16 len)
+//
+// Returns the IP checksum of len bytes of the received packet, starting
+// offset bytes into the packet (0 is the first byte of the ethernet
+// header).  The checksum is calculated by the ENC28J60 and the read
+// pointer isn't moved.  A received packet with a correct checksum field
+// returns 0.
+//
+// NOTE: NICGetHeader() must have been called and returned TRUE first.
+//
+////////////////////////////////////////////////////////////////////////////
+int16 NICCalcRxChecksum(int16 offset, int16 len) {
+   return(enc_mac_dma_checksum(__NICRxLocation(offset+6), len));
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// NICCalcTxChecksum(int16 offset, int16 len)
+//
+// Returns the IP checksum of len bytes of the current transmit buffer,
+// starting offset bytes into the packet (0 is the first byte of the
+// ethernet header, same as NICSetTxBuffer()).  The checksum field must be
+// 0 while the checksum is calculated.
+//
+////////////////////////////////////////////////////////////////////////////
+int16 NICCalcTxChecksum(int16 offset, int16 len) {
+   return(enc_mac_dma_checksum(ENC_MAC_TX_BUFFER_START(NICCurrentTxBuffer)+1+offset, len));
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// NICPutTxChecksum(int16 offset, int16 len, int16 seed, int16 csum_offset)
+//
+// Calculates the IP checksum of len bytes of the current transmit buffer
+// starting at offset and writes it, high byte first, to csum_offset.
+// seed is added to the sum first, use it for the UDP/TCP pseudo header
+// (one's complement sum, not complemented) or pass 0.  The checksum field
+// must be 0 before this is called.
+//
+// NOTE: Moves the write pointer, use NICSetTxBuffer() before writing more
+//  data to the transmit buffer.
+//
+////////////////////////////////////////////////////////////////////////////
+void NICPutTxChecksum(int16 offset, int16 len, int16 seed, int16 csum_offset) {
+   unsigned int32 sum;
+   unsigned int8 csum[2];
+
+   sum=(unsigned int16)~NICCalcTxChecksum(offset, len);
+   sum+=(unsigned int16)seed;
+   sum=(sum & 0xFFFF) + (sum>>16);
+   sum=(sum & 0xFFFF) + (sum>>16);
+   csum[0]=~make8(sum,1);
+   csum[1]=~make8(sum,0);
+
+   enc_mac_write_control_word(ENC_MAC_EWRPTL, ENC_MAC_TX_BUFFER_START(NICCurrentTxBuffer)+1+csum_offset);
+   NICPutArray(csum, 2);
+}
+
+////////////////////////////////////////////////////////////////////////////
+//
+// NICCopyRxToTx(int16 rx_offset, int16 tx_offset, int16 len)
+//
+// Copies len bytes of the received packet, starting rx_offset bytes into
+// it, to the current transmit buffer starting tx_offset bytes into it.
+// Offsets are from the first byte of the ethernet header.  Useful for
+// echoing or forwarding a packet without reading it over SPI.
+//
+// NOTE: NICGetHeader() must have been called and returned TRUE first, and
+//  the received packet must not have been discarded.
+//
+////////////////////////////////////////////////////////////////////////////
+void NICCopyRxToTx(int16 rx_offset, int16 tx_offset, int16 len) {
+   enc_mac_dma_copy(__NICRxLocation(rx_offset+6), len,
+      ENC_MAC_TX_BUFFER_START(NICCurrentTxBuffer)+1+tx_offset);
+}
+
 ////////////////////////////////////////////////////////////////////////////
 /*~*~*~ THE FOLLOWING FUNCTIONS ARE PORTS OF MICROCHIP'S REALTEK API ~*~*~*/
 ///  Therefore this driver should be a drop-in for the original Realtek  ///
@@ -1082,6 +1548,9 @@ void debug_display_tx_status(void) {
 #define MACDiscardTx    NICDiscardTx
 #define MACSetTxBuffer(b,a)  NICSetTxBuffer(b,a+sizeof(ETHERNET_HEADER))
 #define MACReserveTxBuffer NICReserveTxBuffer
+#define MACCalcRxChecksum(o,l)   NICCalcRxChecksum(o+sizeof(ETHERNET_HEADER),l)
+#define MACCalcTxChecksum(o,l)   NICCalcTxChecksum(o+sizeof(ETHERNET_HEADER),l)
+#define MACCopyRxToTx(r,t,l)     NICCopyRxToTx(r+sizeof(ETHERNET_HEADER),t+sizeof(ETHERNET_HEADER),l)
 
 int MACGetHeader(MAC_ADDR *remote, int8 *type) {
    ETHERNET_HEADER header;
@@ -111,9 +111,17 @@
 ////                                                                 ////
 //// fatread(void* buffer, int size, int32 num, FILE* fstream)       ////
 ////  Reads size*num chars from the stream, saves to buffer.         ////
+////  Whole sectors of a binary stream bypass the stream buffer.     ////
 ////                                                                 ////
 //// fatwrite(void* buffer, int size, int32 num, FILE* fstream)      //// 
 ////  Writes size*num chars from buffer to the stream.               ////
+////  Whole sectors bypass the stream buffer.                        ////
+////                                                                 ////
+//// fatprealloc(FILE *fstream, int32 bytes)                         ////
+////  Reserves a contiguous run of clusters for an empty file that   ////
+////  is open for writing.  Whole sectors written into the run go    ////
+////  straight to the card and seeking inside it doesn't touch the   ////
+////  FAT.  Whatever isn't used is given back by fatclose().         ////
 ////                                                                 ////
 //// fatflush(FILE *fstream)                                         ////
 ////  Flushes the buffer in a stream.                                ////
@@ -139,6 +147,10 @@
 //// mk_dir(char *dirname)                                           ////
 ////  Makes a directory.                                             ////
 ////                                                                 ////
+//// get_free_clusters(int32 *count)                                 ////
+////  Gets the number of free clusters.  On FAT32 this comes from    ////
+////  the FSInfo sector, otherwise the FAT is counted once.          ////
+////                                                                 ////
 //// format(int32 mediaSize)                                         ////
 ////  Formats the media into a FAT32 or FAT16 file system.           ////
 ////  If you specify a mediaSize larger than the actual media bad    ////
@@ -153,7 +165,7 @@
 ////                                                                 ////
 //// This library was written to use CCS's MMC/SD library as the     ////
 //// media source.  If you want to use a different media source,     ////
-//// you must provide the following 4 functions:                     ////
+//// you must provide the following 5 functions:                     ////
 ////                                                                 ////
 //// int8 mmcsd_init(void);                                          ////
 ////  Initializes the media.  This will be called by fat_init().     ////
@@ -170,7 +182,10 @@
 ////  If your write function is buffering writes, this will flush    ////
 ////  the buffer and write it to the media.                          ////
 ////                                                                 ////
-//// All four functions should return 0 if OK, non-zero if error.    ////
+//// int8 mmcsd_clear_blocks(int32 a, int16 n);                      ////
+////  Write zeros to n 512 byte blocks starting at address a.        ////
+////                                                                 ////
+//// All five functions should return 0 if OK, non-zero if error.    ////
 ////                                                                 ////
 /////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 2007 Custom Computer Services              ////
@@ -197,6 +212,32 @@
 //       this mode.
 //       THIS IS NOT TESTED VERY WELL YET!
 
+// NOTE Free clusters are found starting from a next-free hint, which is
+//       kept in the FAT32 FSInfo sector together with the free cluster
+//       count.  To also skip FAT sectors that are known to be full without
+//       reading them, define FAT_FULL_MAP_BYTES; each byte of RAM covers
+//       8 FAT sectors (1024 clusters on FAT32, 2048 on FAT16).
+
+// NOTE fatread() and fatwrite() move whole, sector aligned blocks straight
+//       between the caller's buffer and the card with multiple block
+//       commands; only the unaligned head and tail go through the stream
+//       buffer.  Binary streams only for fatread(), a text stream has to
+//       be checked byte by byte for its terminating 0x00.
+
+// NOTE Each stream remembers how many clusters from the start of its file
+//       are known to be contiguous (Extent_Clusters).  fatprealloc() sets
+//       this, and seeking through a file learns it.  Inside that run the
+//       stream moves from cluster to cluster without reading the FAT.
+
+// NOTE Files and directories that have been found before are remembered
+//       in a small lookup cache (FAT_PATH_CACHE_SIZE entries, default 4),
+//       so opening the same path again only has to check one entry instead
+//       of walking every directory on the way.  For directories holding a
+//       lot of files, define FAT_DIR_INDEX_SIZE as well.  Files found while
+//       scanning a directory then go into a hashed index of that directory,
+//       6 bytes of RAM per file.  Once the whole directory is in the index,
+//       a file can be found, or known not to be there, without scanning.
+
 // NOTE The current maximum file name length (full path) is 32 characters 
 //       long. If longer file names are desired, change the 
 //       MAX_FILE_NAME_LENGTH define below. Creating a file whose full path 
@@ -228,6 +269,14 @@
 #define MAX_FILE_NAME_LENGTH 0x20  // the maximum length of a file name for our FAT, including /0 terminator
 #define STREAM_BUF_SIZE 0x20       // how big the FILE buffer is. 0x20 is optimal
 
+#ifndef FAT_PATH_CACHE_SIZE
+#define FAT_PATH_CACHE_SIZE 4      // how many found files and directories to remember, 0 to turn it off
+#endif
+//#define FAT_DIR_INDEX_SIZE 128   // how many files of one directory to keep in the hashed index
+#ifdef FAST_FAT
+#undef FAT_DIR_INDEX_SIZE          // FAST_FAT doesn't look at names, so there's nothing to index
+#endif
+
 //////////////////////////////////////////////////////////////////
 
 #define EOF -1
@@ -237,6 +286,15 @@
 #define SEEK_END 1
 #define SEEK_SET 2
 
+#ifdef FAT32
+#define FAT_ENTRY_SIZE 4
+#else // FAT16
+#define FAT_ENTRY_SIZE 2
+#endif // #ifdef FAT32
+#define FAT_ENTRIES_PER_SECTOR (512 / FAT_ENTRY_SIZE)
+
+#define FREE_COUNT_UNKNOWN 0xFFFFFFFF
+
 ////////////////////////
 ///                  ///
 /// Global Variables ///
@@ -249,10 +307,48 @@ int16
 
 int32
    Data_Start,          // when data starts
+   End_Clust,           // one past the last cluster number
    FAT_Length,          // the length of one FAT
+   Free_Clusters,       // how many clusters are free, FREE_COUNT_UNKNOWN if not known
+   FSInfo_Addr,         // where the FAT32 FSInfo sector is, 0 if there isn't one
    Next_Free_Clust,     // where the next free cluster is
    Root_Dir;            // when the root directory starts
 
+int1 FSInfo_Changed;    // Free_Clusters or Next_Free_Clust need writing to FSInfo
+
+char* Stream_Data;      // the caller's buffer that read_sectors() or write_sectors() is using
+
+int1 FAT_Mounted = FALSE;  // fat_init() has run before, so there may be FSInfo changes to write back
+
+#if MMCSD_CACHE_SECTORS > 2
+int32
+   FAT_Pinned,          // the FAT sector kept in the mmcsd cache, 0 if there isn't one
+   Dir_Pinned;          // the directory sector kept in the mmcsd cache, 0 if there isn't one
+#endif // #if MMCSD_CACHE_SECTORS > 2
+
+#if FAT_PATH_CACHE_SIZE > 0
+int32
+   Path_Cache_Dir[FAT_PATH_CACHE_SIZE],     // start address of the directory the entry is in
+   Path_Cache_Entry[FAT_PATH_CACHE_SIZE];   // address of the entry, 0 if this spot is empty
+int16 Path_Cache_Hash[FAT_PATH_CACHE_SIZE]; // name_hash() of the entry's name
+int Path_Cache_Next;                        // the spot that gets replaced next
+#endif // #if FAT_PATH_CACHE_SIZE > 0
+
+#ifdef FAT_DIR_INDEX_SIZE
+int32
+   Dir_Index_Dir,                           // start address of the indexed directory, 0 if there isn't one
+   Dir_Index_Next,                          // every file entry before this one is in the index
+   Dir_Index_Entry[FAT_DIR_INDEX_SIZE];     // address of each file entry
+int16
+   Dir_Index_Count,                         // how many files are in the index
+   Dir_Index_Hash[FAT_DIR_INDEX_SIZE];      // name_hash() of each file's name
+int1 Dir_Index_Complete;                    // the whole directory is in the index
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+
+#ifdef FAT_FULL_MAP_BYTES
+int FAT_Full_Map[FAT_FULL_MAP_BYTES];  // one bit per FAT sector, set when it has no free entries
+#endif
+
 enum filetype
 {
    Data_File,  // the stream is pointing to a binary, data file
@@ -281,7 +377,8 @@ struct iobuf
       Entry_Addr,          // the entry address of the file that is associated with the stream
       Parent_Start_Addr,   // the parent's start adddress of the file that is associated with the stream
       Size,                // the size of the file that is associated with the stream
-      Start_Addr;          // the beginning of the data in the file that is associated with the stream
+      Start_Addr,          // the beginning of the data in the file that is associated with the stream
+      Extent_Clusters;     // how many clusters from Start_Addr are known to be contiguous, 0 if not known
 
    enum filetype File_Type;   // the type of file that is associated with the stream
 
@@ -325,9 +422,19 @@ signed int rm_file(char fname[]);
 signed int rm_dir(char dname[]);
 signed int mk_file(char fname[]);
 signed int mk_dir(char dname[]);
+signed int get_free_clusters(int32* count);
+signed int fatprealloc(FILE* stream, int32 bytes);
 
 /// Functions' Utility Functions ///
 signed int set_file(char fname[], int attrib, FILE* stream);
+signed int open_entry(int32 entry_addr, int attrib, FILE* stream);
+int16 name_hash(char name[]);
+signed int check_entry(int32 entry_addr, char fname[], int attrib);
+signed int find_known_entry(int32 dir_addr, char fname[], int16 hash, int attrib, int32* entry_addr);
+void remember_entry(int32 dir_addr, int16 hash, int32 entry_addr);
+void forget_entry(int32 entry_addr, int32 start_addr);
+void forget_entries();
+int1 dir_index_add(int32 dir_addr, int16 hash, int32 entry_addr);
 signed int get_file_name(int32 file_entry_addr, char name[]);
 signed int set_file_name(int32 parent_dir_addr, int32* entry_addr, char name[]);
 signed int get_short_file_name(int32 file_entry_addr, char sname[], int type);
@@ -337,16 +444,28 @@ signed int check_invalid_char(char fname[]);
 #ifdef FAT32
 signed int get_next_free_cluster(int32* my_cluster);
 signed int dealloc_clusters(int32 start_cluster);
-signed int alloc_clusters(int32 start_cluster, int32* new_cluster_addr);
+signed int alloc_clusters(int32 start_cluster, int32* new_cluster_addr, int1 clear);
 signed int clear_cluster(int32 cluster);
 signed int write_fat(int32 cluster, int32 data);
 #else // FAT16
 signed int get_next_free_cluster(int16* my_cluster);
 signed int dealloc_clusters(int16 start_cluster);
-signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr);
+signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr, int1 clear);
 signed int clear_cluster(int16 cluster);
 signed int write_fat(int16 cluster, int16 data);
 #endif // #ifdef FAT32
+signed int read_fat(int32 cluster, int32* data);
+void count_fat_change(int32 cluster, int32 old_data, int32 new_data);
+signed int write_fsinfo();
+#if MMCSD_CACHE_SECTORS > 2
+signed int pin_sector(int32* pinned, int32 addr);
+#endif // #if MMCSD_CACHE_SECTORS > 2
+signed int get_next_stream_addr(FILE* stream);
+signed int next_write_addr(FILE* stream);
+int32 get_direct_sectors(FILE* stream, int32 bytes);
+signed int read_sectors(FILE* stream, char* data, int32 count);
+signed int write_sectors(FILE* stream, char* data, int32 count);
+char* stream_block(int16 block);
 signed int get_next_file(FILE* stream);
 signed int get_prev_file(FILE* stream);
 signed int get_next_free_addr(int32* my_addr);
@@ -438,6 +557,7 @@ signed int fatopen(char fname[], char mode[], FILE* stream)
 
    // start looking for the file, start at root
    cur_stream.Start_Addr = cur_stream.Parent_Start_Addr = Root_Dir;
+   cur_stream.Extent_Clusters = 0;
 
    while(fname[fname_parse_pos] != '\0')
    {
@@ -479,6 +599,7 @@ signed int fatopen(char fname[], char mode[], FILE* stream)
 
    // start looking for the file, start at root
    cur_stream.Start_Addr = cur_stream.Parent_Start_Addr = Root_Dir;
+   cur_stream.Extent_Clusters = 0;
 
    // figure out how deep we have to go, count how many '/' we have in the string
    while(fname[fname_parse_pos] != '\0')
@@ -598,11 +719,39 @@ signed int fatclose(FILE* stream)
 {
    int ec = 0;
 
-   int32 first_cluster;
+   int32
+      first_cluster,
+      used;
 
    // commit data back to the stream's entry, if needed
    if((stream->Flags & Write) || (stream->Flags & Append))
    { 
+      // give back the part of a preallocated run that didn't get written to
+      if(stream->Extent_Clusters != 0)
+      {
+         used = (stream->Size + Bytes_Per_Cluster - 1) / Bytes_Per_Cluster;
+         if(used == 0)
+            used = 1;
+         if(used < stream->Extent_Clusters)
+         {
+            first_cluster = addr_to_cluster(stream->Start_Addr) + used;
+#ifdef FAT32
+            if(write_fat(first_cluster - 1, 0x0FFFFFFF) == EOF)
+#else // FAT16
+            if(write_fat(first_cluster - 1, 0xFFFF) == EOF)
+#endif // #ifdef FAT32
+            {
+               stream->Flags |= Write_Error;
+               return EOF;
+            }
+            if(dealloc_clusters(first_cluster) == EOF)
+            {
+               stream->Flags |= Write_Error;
+               return EOF;
+            }
+         }
+      }
+
       // write the new size of the file
       if(mmcsd_write_data(stream->Entry_Addr + 0x1C, 4, &(stream->Size)) != GOODEC)
       {
@@ -645,6 +794,7 @@ signed int fatclose(FILE* stream)
    stream->Entry_Addr = 0;
    stream->Size = 0;
    stream->Start_Addr = 0;
+   stream->Extent_Clusters = 0;
    stream->Flags = 0;
    return 0;
 }
@@ -682,7 +832,7 @@ signed int fatgetc(FILE* stream)
       }
 
       // get the next contiguous address of the stream
-      if(get_next_addr(&(stream->Cur_Char)) != GOODEC)
+      if(get_next_stream_addr(stream) != GOODEC)
          return EOF;
          
       // we just got 1 byte closer to the end of the file
@@ -705,24 +855,29 @@ Returns: The character that was put into the stream,
 */
 signed int fatputc(int ch, FILE* stream)
 {
+#ifdef FAT32
+   int32 new_cluster;   // the file's first cluster
+#else // FAT16
+   int16 new_cluster;
+#endif // #ifdef FAT32
+
    // check to see if the stream has proper permissions to write
    if(((stream->Flags & Write) || (stream->Flags & Append)) && (stream->File_Type == Data_File))
    {
       // if there isn't any space allocated yet, allocate some
       if(stream->Cur_Char < Data_Start)
       {
-         if(get_next_free_cluster(&Next_Free_Clust) == EOF)
+         new_cluster = Next_Free_Clust;
+         if(get_next_free_cluster(&new_cluster) == EOF)
             return EOF;
 #ifdef FAT32
-         if(write_fat(Next_Free_Clust, 0x0FFFFFFF) == EOF)
+         if(write_fat(new_cluster, 0x0FFFFFFF) == EOF)
             return EOF;
 #else // FAT16
-         if(write_fat(Next_Free_Clust, 0xFFFF) == EOF)
+         if(write_fat(new_cluster, 0xFFFF) == EOF)
             return EOF;
 #endif // #ifdef FAT32
-         if(clear_cluster(Next_Free_Clust) == EOF)
-            return EOF;
-         stream->Cur_Char = stream->Start_Addr = cluster_to_addr(Next_Free_Clust);
+         stream->Cur_Char = stream->Start_Addr = cluster_to_addr(new_cluster);
       }
 
       // write the next character to the buffer
@@ -730,18 +885,8 @@ signed int fatputc(int ch, FILE* stream)
          return EOF;
 
       // get the next address, increment Cur_Char
-      if(get_next_addr(&(stream->Cur_Char)) == EOF)
-      {
-         // write the current buffer to the end of the current cluster
-         if(mmcsd_write_data(stream->Cur_Char - STREAM_BUF_SIZE + 1, STREAM_BUF_SIZE, stream->Buf) != GOODEC)
-         {
-            stream->Flags |= Write_Error;
-            return EOF;
-         }
-         // start looking for a new cluster to allocate
-         if(alloc_clusters(addr_to_cluster(stream->Cur_Char), &(stream->Cur_Char)) == EOF)
-            return EOF;
-      }
+      if(next_write_addr(stream) == EOF)
+         return EOF;
 
       // our file just got bigger by 1 byte
       stream->Size += 1;
@@ -850,11 +995,17 @@ signed int fatsetpos(FILE* stream, fatpos_t* position)
 {
 #ifndef FAST_FAT
 #ifdef FAT32
-   int32 cur_cluster; // the current cluster we're pointing to
+   int32
+      cur_cluster,   // the current cluster we're pointing to
+      prev_cluster;  // the cluster we were pointing to before that
 #else // FAT16
-   int16 cur_cluster; // the current cluster we're pointing to
+   int16
+      cur_cluster,   // the current cluster we're pointing to
+      prev_cluster;  // the cluster we were pointing to before that
 #endif // #ifdef FAT32
-   int32 i;    // pointer to memory
+   int32
+      i,       // pointer to memory
+      run;     // how many clusters from the start have been contiguous
 #endif // #ifndef FAST_FAT
 
    // check to see if we want to just rewind the file
@@ -880,21 +1031,36 @@ signed int fatsetpos(FILE* stream, fatpos_t* position)
 #else // NO FAST_FAT
    // figure out how many clusters into the file the position is to be set to
    i = *position / Bytes_Per_Cluster;
-   cur_cluster = addr_to_cluster(stream->Start_Addr);
 
-   // head to that cluster
-   while(i > 0)
+   if(i < stream->Extent_Clusters)
+      // this part of the file is contiguous, so there's no need to walk the FAT
+      stream->Cur_Char = stream->Start_Addr + *position;
+   else
    {
-      if(get_next_cluster(&cur_cluster) != GOODEC)
-         return EOF;
-      i -= 1;
-   }
+      cur_cluster = addr_to_cluster(stream->Start_Addr);
+      run = 1;
 
-   // head to the correct cluster
-   stream->Cur_Char = cluster_to_addr(cur_cluster);
+      // head to that cluster, remembering how long the file stays contiguous
+      while(i > 0)
+      {
+         prev_cluster = cur_cluster;
+         if(get_next_cluster(&cur_cluster) != GOODEC)
+            return EOF;
+         if((run != 0) && (cur_cluster == prev_cluster + 1))
+            run += 1;
+         else
+            run = 0;
+         i -= 1;
+      }
+      if(run > stream->Extent_Clusters)
+         stream->Extent_Clusters = run;
 
-   // now that we're in the correct cluster, tack on the remaining position
-   stream->Cur_Char += (*position % Bytes_Per_Cluster);
+      // head to the correct cluster
+      stream->Cur_Char = cluster_to_addr(cur_cluster);
+
+      // now that we're in the correct cluster, tack on the remaining position
+      stream->Cur_Char += (*position % Bytes_Per_Cluster);
+   }
 
    if(stream->Flags & Read)
    {
@@ -980,11 +1146,38 @@ Returns: How many values were written to the array.
 */
 signed int fatread(void* buffer, int size, int32 num, FILE* stream)
 {
-   int32 i; // counter for loop
+   int32
+      i,       // counter for loop
+      n,       // how many whole sectors can come straight from the card
+      total;   // how many bytes to read
+
+   total = num * size;
 
    // fill up every byte
-   for(i = 0; i < (num * size); i += 1)
-      buffer[i] = fatgetc(stream);
+   for(i = 0; i < total; )
+   {
+      // a text file has to be looked at byte by byte for its terminating 0x00
+      n = 0;
+      if((stream->Flags & Read) && (stream->Flags & Binary))
+      {
+         if(stream->Bytes_Until_EOF < (total - i))
+            n = get_direct_sectors(stream, stream->Bytes_Until_EOF);
+         else
+            n = get_direct_sectors(stream, total - i);
+      }
+
+      if(n != 0)
+      {
+         if(read_sectors(stream, (char*)buffer + i, n) == EOF)
+            return EOF;
+         i += n * 512;
+      }
+      else
+      {
+         ((char*)buffer)[i] = fatgetc(stream);
+         i += 1;
+      }
+   }
 
    return i;
 }
@@ -1000,12 +1193,34 @@ Returns: How many values were written to the stream.
 */
 signed int fatwrite(void* buffer, int size, int32 count, FILE* stream )
 {
-   int32 i; // counter for loop
+   int32
+      i,       // counter for loop
+      n;       // how many whole sectors can go straight to the card
 
    // write every byte
-   for(i = 0; i < (count * (int32)size); i += 1)
-      if(fatputc(buffer[i], stream) == EOF)
-         return EOF;
+   for(i = 0; i < (count * (int32)size); )
+   {
+      // whole sectors don't need the stream buffer, and inside a preallocated run not the FAT either
+      n = 0;
+      if(((stream->Flags & Write) || (stream->Flags & Append)) && (stream->File_Type == Data_File))
+         n = get_direct_sectors(stream, (count * (int32)size) - i);
+
+      if(n != 0)
+      {
+         if(write_sectors(stream, (char*)buffer + i, n) == EOF)
+            return EOF;
+         i += n * 512;
+      }
+      else
+      {
+         // a 0xFF byte comes back as EOF too, only a stream that didn't grow failed
+         n = stream->Size;
+         fatputc(((char*)buffer)[i], stream);
+         if(stream->Size == n)
+            return EOF;
+         i += 1;
+      }
+   }
 
    return i;
 }
@@ -1022,10 +1237,12 @@ signed int fatflush(FILE* stream)
    if((stream->Flags & Write) || (stream->Flags & Append))
    {
       // check to see if we need to flush the buffer
+      //  at the start of a cluster the buffer was already written to the end of the last one
       if(stream->Cur_Char % STREAM_BUF_SIZE == 0)
       {
          // flush the buffer to the card
-         if(mmcsd_write_data(stream->Cur_Char - STREAM_BUF_SIZE, STREAM_BUF_SIZE, stream->Buf) != GOODEC)
+         if((stream->Cur_Char % Bytes_Per_Cluster != 0)
+            && (mmcsd_write_data(stream->Cur_Char - STREAM_BUF_SIZE, STREAM_BUF_SIZE, stream->Buf) != GOODEC))
          {
             stream->Flags |= Write_Error;
             return EOF;
@@ -1041,6 +1258,8 @@ signed int fatflush(FILE* stream)
             return EOF;
          }
       }
+      if(write_fsinfo() == EOF)
+         return EOF;
       return(mmcsd_flush_buffer());
    }
    return 0;
@@ -1153,6 +1372,9 @@ signed int rm_file(char fname[])
    i = stream.Entry_Addr;
    if(mmcsd_write_data(i, 1, &ulinked_entry) == EOF)
       return EOF;
+
+   // make sure the lookup cache and directory index don't hand it out again
+   forget_entry(i, stream.Start_Addr);
    
    // check to see if there is a long file name
    get_prev_entry(&i);
@@ -1303,6 +1525,12 @@ signed int mk_dir(char dname[])
 
    int32 i;   // pointer to memory
 
+#ifdef FAT32
+   int32 new_cluster;   // the directory's first cluster
+#else // FAT16
+   int16 new_cluster;
+#endif // #ifdef FAT32
+
    FILE stream;   // the stream that we'll be working with
 
    // attempt to open up to the directory
@@ -1331,15 +1559,16 @@ signed int mk_dir(char dname[])
       return EOF;
 
    // find and allocate an open cluster
-   if(get_next_free_cluster(&Next_Free_Clust) == EOF)
+   new_cluster = Next_Free_Clust;
+   if(get_next_free_cluster(&new_cluster) == EOF)
       return EOF;
-   if(clear_cluster(Next_Free_Clust) == EOF)
+   if(clear_cluster(new_cluster) == EOF)
       return EOF;
 #ifdef FAT32
-   if(write_fat(Next_Free_Clust, 0x0FFFFFFF) == EOF)
+   if(write_fat(new_cluster, 0x0FFFFFFF) == EOF)
       return EOF;
 #else // FAT16
-   if(write_fat(Next_Free_Cluster, 0xFFFF) == EOF)
+   if(write_fat(new_cluster, 0xFFFF) == EOF)
       return EOF;
 #endif // #ifdef FAT32
 
@@ -1350,11 +1579,11 @@ signed int mk_dir(char dname[])
    // this is a directory
    entire_entry[0x0B] = 0x10;
 
-   entire_entry[0x1A] = make8(Next_Free_Clust, 0);
-   entire_entry[0x1B] = make8(Next_Free_Clust, 1);
+   entire_entry[0x1A] = make8(new_cluster, 0);
+   entire_entry[0x1B] = make8(new_cluster, 1);
 #ifdef FAT32
-   entire_entry[0x14] = make8(Next_Free_Clust, 2);
-   entire_entry[0x15] = make8(Next_Free_Clust, 3);
+   entire_entry[0x14] = make8(new_cluster, 2);
+   entire_entry[0x15] = make8(new_cluster, 3);
 #endif // #ifdef FAT32
 
    if(mmcsd_read_data(i, 11, entire_entry) != GOODEC)
@@ -1365,7 +1594,7 @@ signed int mk_dir(char dname[])
       return EOF;
 
    // make the two links that point to the directory and the directory's parent
-   i = cluster_to_addr(Next_Free_Clust);
+   i = cluster_to_addr(new_cluster);
 
    // put in the first link that points to the directory itself
    for(j = 0; j < 0x20; j += 1)
@@ -1380,11 +1609,11 @@ signed int mk_dir(char dname[])
          entire_entry[j] = 0x00;
    }
 
-   entire_entry[0x1A] = make8(Next_Free_Clust, 0);
-   entire_entry[0x1B] = make8(Next_Free_Clust, 1);
+   entire_entry[0x1A] = make8(new_cluster, 0);
+   entire_entry[0x1B] = make8(new_cluster, 1);
 #ifdef FAT32
-   entire_entry[0x14] = make8(Next_Free_Clust, 2);
-   entire_entry[0x15] = make8(Next_Free_Clust, 3);
+   entire_entry[0x14] = make8(new_cluster, 2);
+   entire_entry[0x15] = make8(new_cluster, 3);
 #endif // #ifdef FAT32
 
    if(mmcsd_write_data(i, 0x20, entire_entry) != GOODEC)
@@ -1423,6 +1652,139 @@ signed int mk_dir(char dname[])
    return GOODEC;
 }
 
+/*
+signed int get_free_clusters(int32* count)
+Summary: Gets the number of free clusters on the media.
+Param: A pointer to a variable to put the number of free clusters into.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+Note: If the count isn't known yet (FAT16, or FSInfo doesn't have it) the FAT is counted once,
+       after that the count is kept up to date as clusters are allocated and freed.
+*/
+signed int get_free_clusters(int32* count)
+{
+   int32
+      cluster,
+      entry;
+
+   if(Free_Clusters == FREE_COUNT_UNKNOWN)
+   {
+      Free_Clusters = 0;
+      for(cluster = 2; cluster < End_Clust; cluster += 1)
+      {
+         if(read_fat(cluster, &entry) == EOF)
+         {
+            Free_Clusters = FREE_COUNT_UNKNOWN;
+            return EOF;
+         }
+         if(entry == 0)
+            Free_Clusters += 1;
+      }
+      FSInfo_Changed = TRUE;
+   }
+
+   *count = Free_Clusters;
+
+   return GOODEC;
+}
+
+/*
+signed int fatprealloc(FILE* stream, int32 bytes)
+Summary: Reserves a contiguous run of clusters for a file.
+Param stream: The stream to reserve space for. It has to be open for writing or appending and
+               nothing can have been written to the file yet.
+Param bytes: How many bytes to reserve. This is rounded up to whole clusters.
+Returns: EOF if there was a problem or there isn't a long enough run of free clusters, GOODEC if everything went okay.
+Note: The file's size doesn't change; fatclose() frees the clusters that didn't get written to.
+*/
+signed int fatprealloc(FILE* stream, int32 bytes)
+{
+   int32
+      cluster,       // the cluster the algorithm is on
+      entry,         // what the FAT says about cluster
+      left,          // how many clusters are left to look at
+      need,          // how many clusters we're after
+      run,           // how many free clusters in a row have been found
+      run_start;     // where that run started
+
+   // check to see if the stream has proper permissions to write
+   if(!(((stream->Flags & Write) || (stream->Flags & Append)) && (stream->File_Type == Data_File)))
+      return EOF;
+
+   // the file can't already have clusters linked to it
+   if(stream->Cur_Char >= Data_Start)
+      return EOF;
+
+   need = (bytes + Bytes_Per_Cluster - 1) / Bytes_Per_Cluster;
+   if(need == 0)
+      need = 1;
+
+   if((need > (End_Clust - 2))
+      || ((Free_Clusters != FREE_COUNT_UNKNOWN) && (need > Free_Clusters)))
+      return EOF;
+
+   // look for enough free clusters in a row, starting where the last search left off
+   cluster = Next_Free_Clust;
+   if((cluster < 2) || (cluster >= End_Clust))
+      cluster = 2;
+
+   run = 0;
+   run_start = cluster;
+
+   // go around once, plus enough to finish a run that started just before the hint
+   for(left = End_Clust - 2 + need; left > 0; left -= 1)
+   {
+      if(read_fat(cluster, &entry) == EOF)
+         return EOF;
+
+      if(entry == 0)
+      {
+         if(run == 0)
+            run_start = cluster;
+         run += 1;
+         if(run == need)
+            break;
+      }
+      else
+         run = 0;
+
+      cluster += 1;
+
+      // a run can't carry on past the end of the FAT
+      if(cluster >= End_Clust)
+      {
+         cluster = 2;
+         run = 0;
+      }
+   }
+
+   if(run != need)
+      return EOF;
+
+   // link the run together
+   for(cluster = run_start; cluster < (run_start + need - 1); cluster += 1)
+      if(write_fat(cluster, cluster + 1) == EOF)
+         return EOF;
+#ifdef FAT32
+   if(write_fat(cluster, 0x0FFFFFFF) == EOF)
+      return EOF;
+#else // FAT16
+   if(write_fat(cluster, 0xFFFF) == EOF)
+      return EOF;
+#endif // #ifdef FAT32
+
+   // the next search doesn't need to look through the run
+   if((Next_Free_Clust >= run_start) && (Next_Free_Clust <= cluster))
+   {
+      Next_Free_Clust = cluster + 1;
+      FSInfo_Changed = TRUE;
+   }
+
+   stream->Cur_Char = stream->Start_Addr = cluster_to_addr(run_start);
+   stream->Extent_Clusters = need;
+
+   return GOODEC;
+}
+
 /// Functions' Utility Functions ///
 /// NOTE: A library user should not need to use any of the functions in this section ///
 
@@ -1445,14 +1807,56 @@ signed int set_file(char fname[], int attrib, FILE* stream)
    int32 i;   // pointer to memory
 #ifndef FAST_FAT
    char name_buffer[MAX_FILE_NAME_LENGTH];   // buffer to hold in the most recently read in name
+
+   int16
+      hash,       // name_hash() of fname
+      cur_hash;   // name_hash() of the most recently read in name
+
+   int1 indexing = FALSE;  // the files this scan finds go into the directory index
 #endif // #ifndef FAST_FAT
 
    // set the memory pointer to the parent start address
    i = stream->Start_Addr;
 
+#ifndef FAST_FAT
+   hash = name_hash(fname);
+
+   // see if we already know where the entry is
+   if(find_known_entry(stream->Start_Addr, fname, hash, attrib, &i) == GOODEC)
+      return open_entry(i, attrib, stream);
+
+#ifdef FAT_DIR_INDEX_SIZE
+   // only files go into the index, so walking down through directories doesn't throw it away
+   if(attrib == 0x20)
+   {
+      if(Dir_Index_Dir != stream->Start_Addr)
+      {
+         Dir_Index_Dir = Dir_Index_Next = stream->Start_Addr;
+         Dir_Index_Count = 0;
+         Dir_Index_Complete = FALSE;
+      }
+      else if(Dir_Index_Complete)
+      {
+         // the whole directory is in the index and it isn't there
+         stream->Flags |= File_Not_Found;
+         return EOF;
+      }
+
+      // everything before Dir_Index_Next has already been looked at
+      i = Dir_Index_Next;
+      indexing = TRUE;
+   }
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+#endif // #ifndef FAST_FAT
+
    // search for the name of our target file inside of the parent directory
    do
    {
+#ifdef FAT_DIR_INDEX_SIZE
+      if(indexing)
+         Dir_Index_Next = i;
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+
       // read the state and the attribute of the current entry
       ec += mmcsd_read_data(i, 1, &cur_state);
       ec += mmcsd_read_data(i + 0x0B, 1, &cur_attrib);
@@ -1470,87 +1874,349 @@ signed int set_file(char fname[], int attrib, FILE* stream)
          if(get_file_name(i, name_buffer) == EOF)
             return EOF;
 
+         cur_hash = name_hash(name_buffer);
+
+#ifdef FAT_DIR_INDEX_SIZE
+         // once the index is full, the rest of the directory will have to be scanned every time
+         if(indexing)
+            indexing = dir_index_add(stream->Start_Addr, cur_hash, i);
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+
          // if the target entry and the long file name are equal, strcmp will return a zero
-         if(strcmp(fname, name_buffer) == 0)
+         if((cur_hash == hash) && (strcmp(fname, name_buffer) == 0))
 #endif // #ifndef FAST_FAT
          {
-            // we have found our target entry, set the current entry and break out of this function
-            // set stream's parent address
-            stream->Parent_Start_Addr = stream->Start_Addr;
+#ifndef FAST_FAT
+            remember_entry(stream->Start_Addr, hash, i);
+#endif // #ifndef FAST_FAT
+            return open_entry(i, attrib, stream);
+         }
+      }
+
+      // check to make sure that the next iteration will give us a contiguous cluster
+      if(get_next_entry(&i) == EOF)
+         return EOF;
 
-            ec += mmcsd_read_data(i + 0x1C, 4, &(stream->Size));
+   } while(cur_state != 0x00);
 
-            // stream->Start_Addr is going to temporarily have a cluster number
-            ec += mmcsd_read_data(i + 0x14, 2, (int16*)&stream->Start_Addr + 1);
-            ec += mmcsd_read_data(i + 0x1A, 2, &stream->Start_Addr);
+#ifdef FAT_DIR_INDEX_SIZE
+   // we made it to the end of the directory with everything going into the index
+   if(indexing)
+      Dir_Index_Complete = TRUE;
+#endif // #ifdef FAT_DIR_INDEX_SIZE
 
-            if(ec != GOODEC)
-            {
-               stream->Flags |= Read_Error;
+   // if we reach this point, we know that the file won't be found
+   stream->Flags |= File_Not_Found;
+   return EOF;
+}
+
+/*
+signed int open_entry(int32 entry_addr, int attrib, FILE* stream)
+Summary: Sets the stream to point to a file or directory entry that set_file() found.
+Param entry_addr: The address of the entry.
+Param attrib: The file attributes of the entry. 0x10 is a directory, 0x20 is a file.
+Param stream: The stream to set. It has to be pointing to the parent directory's start address.
+Returns: EOF if there was a problem, GOODEC if everything went okay.
+*/
+signed int open_entry(int32 entry_addr, int attrib, FILE* stream)
+{
+   int ec = 0;    // error checking byte
+
+   int32 i;   // pointer to memory
+
+   i = entry_addr;
+
+   // set stream's parent address
+   stream->Parent_Start_Addr = stream->Start_Addr;
+
+   ec += mmcsd_read_data(i + 0x1C, 4, &(stream->Size));
+
+   // stream->Start_Addr is going to temporarily have a cluster number
+   ec += mmcsd_read_data(i + 0x14, 2, (int16*)&stream->Start_Addr + 1);
+   ec += mmcsd_read_data(i + 0x1A, 2, &stream->Start_Addr);
+
+   if(ec != GOODEC)
+   {
+      stream->Flags |= Read_Error;
+      return EOF;
+   }
+
+   // convert stream->Start_Addr to an address
+   stream->Start_Addr = cluster_to_addr(stream->Start_Addr);
+
+   stream->Entry_Addr = i;
+   stream->Bytes_Until_EOF = stream->Size;
+
+#if MMCSD_CACHE_SECTORS > 2
+   // the entry gets rewritten when the file changes, keep its sector around
+   if(pin_sector(&Dir_Pinned, i) != GOODEC)
+   {
+      stream->Flags |= Read_Error;
+      return EOF;
+   }
+#endif // #if MMCSD_CACHE_SECTORS > 2
+
+   // set up some permission-specific parameters if we're at a file
+   if(attrib == 0x20)
+   {
+      stream->File_Type = Data_File;
+      if(stream->Flags & Write)
+      {
+         // delete all previous data in the file
+         stream->Bytes_Until_EOF = stream->Size = 0;
+
+         // if there is already space allocated, get rid of it
+         if(stream->Start_Addr >= Data_Start)
+            if(dealloc_clusters(addr_to_cluster(stream->Start_Addr)) == EOF)
                return EOF;
-            }
+         stream->Cur_Char = 0;
+      }
+
+      if((stream->Flags & Append) && (stream->Size != 0))
+      {
+         // set the position to the end of the file and fill the buffer with the contents of the end of the file
+         ec = fatsetpos(stream, &(stream->Size));
+         if(stream->Cur_Char % STREAM_BUF_SIZE == 0)
+            ec += mmcsd_read_data(stream->Cur_Char - STREAM_BUF_SIZE, STREAM_BUF_SIZE, stream->Buf);
+         else
+            ec += mmcsd_read_data(stream->Cur_Char - (stream->Cur_Char % STREAM_BUF_SIZE), STREAM_BUF_SIZE, stream->Buf);
+      }
+#ifndef FAST_FAT
+      if(stream->Flags & Read)
+      {
+         stream->Cur_Char = stream->Start_Addr;
+
+         // fill up the read buffer for reading
+         ec = mmcsd_read_data(stream->Cur_Char, STREAM_BUF_SIZE, stream->Buf);
+      }
+#endif // #ifndef FAST_FAT
+      if(ec != GOODEC)
+      {
+         stream->Flags |= Read_Error;
+         return EOF;
+      }               
+   }
+   else
+      stream->File_Type = Directory;
+   return GOODEC;
+}
+
+/*
+int16 name_hash(char name[])
+Summary: Boils a file name down to 16 bits for the lookup cache and the directory index.
+Param: The file name.
+Returns: The hash of the name.
+*/
+int16 name_hash(char name[])
+{
+   int i = 0;     // counter for loops
+
+   int16 hash = 0;
+
+   while(name[i] != '\0')
+   {
+      // rotate left by 5 and mix in the next character
+      hash = ((hash << 5) | (hash >> 11)) ^ name[i];
+      i += 1;
+   }
+
+   return hash;
+}
+
+/*
+signed int check_entry(int32 entry_addr, char fname[], int attrib)
+Summary: Checks that an entry that was remembered is still the file or directory being looked for.
+Param entry_addr: The address of the entry.
+Param fname: The name being looked for.
+Param attrib: The file attributes being looked for. 0x10 is a directory, 0x20 is a file.
+Returns: GOODEC if the entry matches, EOF if it doesn't or there was a problem with the media.
+*/
+signed int check_entry(int32 entry_addr, char fname[], int attrib)
+{
+   int
+      cur_attrib,    // the attribute of the entry
+      cur_state,     // the state of the entry
+      ec = 0;        // error checking byte
+
+   char name_buffer[MAX_FILE_NAME_LENGTH];   // buffer to hold the entry's name
+
+   ec += mmcsd_read_data(entry_addr, 1, &cur_state);
+   ec += mmcsd_read_data(entry_addr + 0x0B, 1, &cur_attrib);
+   if(ec != GOODEC)
+      return EOF;
+
+   if((cur_state == 0xE5) || (cur_state == 0x00) || (cur_attrib != attrib))
+      return EOF;
+
+   if(get_file_name(entry_addr, name_buffer) == EOF)
+      return EOF;
+
+   if(strcmp(fname, name_buffer) != 0)
+      return EOF;
+
+   return GOODEC;
+}
+
+/*
+signed int find_known_entry(int32 dir_addr, char fname[], int16 hash, int attrib, int32* entry_addr)
+Summary: Looks for an entry in the lookup cache and the directory index before set_file() has to scan for it.
+Param dir_addr: The start address of the directory the entry is in.
+Param fname: The name of the entry.
+Param hash: name_hash() of fname.
+Param attrib: The file attributes of the entry. 0x10 is a directory, 0x20 is a file.
+Param entry_addr: A pointer to a variable to put the address of the entry into.
+Returns: GOODEC if the entry was found, EOF if it wasn't.
+*/
+signed int find_known_entry(int32 dir_addr, char fname[], int16 hash, int attrib, int32* entry_addr)
+{
+   int16 i;    // counter for loops
+
+#if FAT_PATH_CACHE_SIZE > 0
+   for(i = 0; i < FAT_PATH_CACHE_SIZE; i += 1)
+   {
+      if((Path_Cache_Entry[i] != 0)
+         && (Path_Cache_Dir[i] == dir_addr)
+         && (Path_Cache_Hash[i] == hash)
+         && (check_entry(Path_Cache_Entry[i], fname, attrib) == GOODEC))
+      {
+         *entry_addr = Path_Cache_Entry[i];
+         return GOODEC;
+      }
+   }
+#endif // #if FAT_PATH_CACHE_SIZE > 0
+
+#ifdef FAT_DIR_INDEX_SIZE
+   if(Dir_Index_Dir == dir_addr)
+   {
+      for(i = 0; i < Dir_Index_Count; i += 1)
+      {
+         if((Dir_Index_Hash[i] == hash)
+            && (check_entry(Dir_Index_Entry[i], fname, attrib) == GOODEC))
+         {
+            *entry_addr = Dir_Index_Entry[i];
+            remember_entry(dir_addr, hash, *entry_addr);
+            return GOODEC;
+         }
+      }
+   }
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+
+   return EOF;
+}
+
+/*
+void remember_entry(int32 dir_addr, int16 hash, int32 entry_addr)
+Summary: Puts an entry that was just found into the lookup cache.
+Param dir_addr: The start address of the directory the entry is in.
+Param hash: name_hash() of the entry's name.
+Param entry_addr: The address of the entry.
+Returns: Nothing.
+*/
+void remember_entry(int32 dir_addr, int16 hash, int32 entry_addr)
+{
+#if FAT_PATH_CACHE_SIZE > 0
+   Path_Cache_Dir[Path_Cache_Next] = dir_addr;
+   Path_Cache_Hash[Path_Cache_Next] = hash;
+   Path_Cache_Entry[Path_Cache_Next] = entry_addr;
+
+   // the oldest entry gets replaced next
+   Path_Cache_Next += 1;
+   if(Path_Cache_Next >= FAT_PATH_CACHE_SIZE)
+      Path_Cache_Next = 0;
+#endif // #if FAT_PATH_CACHE_SIZE > 0
+}
+
+/*
+void forget_entry(int32 entry_addr, int32 start_addr)
+Summary: Takes an entry that is being deleted out of the lookup cache and the directory index.
+Param entry_addr: The address of the entry.
+Param start_addr: The start address of the entry's data. If it's a directory, anything remembered about what was in it goes too.
+Returns: Nothing.
+*/
+void forget_entry(int32 entry_addr, int32 start_addr)
+{
+   int16 i;    // counter for loops
+
+#if FAT_PATH_CACHE_SIZE > 0
+   for(i = 0; i < FAT_PATH_CACHE_SIZE; i += 1)
+      if((Path_Cache_Entry[i] == entry_addr) || (Path_Cache_Dir[i] == start_addr))
+         Path_Cache_Entry[i] = 0;
+#endif // #if FAT_PATH_CACHE_SIZE > 0
+
+#ifdef FAT_DIR_INDEX_SIZE
+   if(Dir_Index_Dir == start_addr)
+      Dir_Index_Dir = 0;
+
+   for(i = 0; i < Dir_Index_Count; i += 1)
+   {
+      if(Dir_Index_Entry[i] == entry_addr)
+      {
+         // move the last file into its spot
+         Dir_Index_Count -= 1;
+         Dir_Index_Hash[i] = Dir_Index_Hash[Dir_Index_Count];
+         Dir_Index_Entry[i] = Dir_Index_Entry[Dir_Index_Count];
+         break;
+      }
+   }
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+}
+
+/*
+void forget_entries()
+Summary: Empties the lookup cache and the directory index.
+Returns: Nothing.
+*/
+void forget_entries()
+{
+#if FAT_PATH_CACHE_SIZE > 0
+   int i;   // counter for loops
 
-            // convert stream->Start_Addr to an address
-            stream->Start_Addr = cluster_to_addr(stream->Start_Addr);
+   for(i = 0; i < FAT_PATH_CACHE_SIZE; i += 1)
+      Path_Cache_Entry[i] = 0;
+   Path_Cache_Next = 0;
+#endif // #if FAT_PATH_CACHE_SIZE > 0
 
-            stream->Entry_Addr = i;
-            stream->Bytes_Until_EOF = stream->Size;
+#ifdef FAT_DIR_INDEX_SIZE
+   Dir_Index_Dir = 0;
+   Dir_Index_Count = 0;
+   Dir_Index_Complete = FALSE;
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+}
 
-            // set up some permission-specific parameters if we're at a file
-            if(attrib == 0x20)
-            {
-               stream->File_Type = Data_File;
-               if(stream->Flags & Write)
-               {
-                  // delete all previous data in the file
-                  stream->Bytes_Until_EOF = stream->Size = 0;
-
-                  // if there is already space allocated, get rid of it
-                  if(stream->Start_Addr >= Data_Start)
-                     if(dealloc_clusters(addr_to_cluster(stream->Start_Addr)) == EOF)
-                        return EOF;
-                  stream->Cur_Char = 0;
-               }
-
-               if((stream->Flags & Append) && (stream->Size != 0))
-               {
-                  // set the position to the end of the file and fill the buffer with the contents of the end of the file
-                  ec = fatsetpos(stream, &(stream->Size));
-                  if(stream->Cur_Char % STREAM_BUF_SIZE == 0)
-                     ec += mmcsd_read_data(stream->Cur_Char - STREAM_BUF_SIZE, STREAM_BUF_SIZE, stream->Buf);
-                  else
-                     ec += mmcsd_read_data(stream->Cur_Char - (stream->Cur_Char % STREAM_BUF_SIZE), STREAM_BUF_SIZE, stream->Buf);
-               }
-#ifndef FAST_FAT
-               if(stream->Flags & Read)
-               {
-                  stream->Cur_Char = stream->Start_Addr;
+/*
+int1 dir_index_add(int32 dir_addr, int16 hash, int32 entry_addr)
+Summary: Puts a file into the directory index.
+Param dir_addr: The start address of the directory the file is in. Nothing happens if that directory isn't the indexed one.
+Param hash: name_hash() of the file's name.
+Param entry_addr: The address of the file's entry.
+Returns: FALSE if the index is full, TRUE otherwise.
+*/
+int1 dir_index_add(int32 dir_addr, int16 hash, int32 entry_addr)
+{
+#ifdef FAT_DIR_INDEX_SIZE
+   int16 i;    // counter for loops
 
-                  // fill up the read buffer for reading
-                  ec = mmcsd_read_data(stream->Cur_Char, STREAM_BUF_SIZE, stream->Buf);
-               }
-#endif // #ifndef FAST_FAT
-               if(ec != GOODEC)
-               {
-                  stream->Flags |= Read_Error;
-                  return EOF;
-               }               
-            }
-            else
-               stream->File_Type = Directory;
-            return GOODEC;
-         }
-      }
+   if(Dir_Index_Dir != dir_addr)
+      return TRUE;
 
-      // check to make sure that the next iteration will give us a contiguous cluster
-      if(get_next_entry(&i) == EOF)
-         return EOF;
+   // a scan picking up where the last one found its file will see that file again
+   for(i = 0; i < Dir_Index_Count; i += 1)
+      if(Dir_Index_Entry[i] == entry_addr)
+         return TRUE;
 
-   } while(cur_state != 0x00);
+   if(Dir_Index_Count >= FAT_DIR_INDEX_SIZE)
+   {
+      // this file isn't in the index, so the directory will have to be scanned again
+      Dir_Index_Complete = FALSE;
+      return FALSE;
+   }
 
-   // if we reach this point, we know that the file won't be found
-   stream->Flags |= File_Not_Found;
-   return EOF;
+   Dir_Index_Hash[Dir_Index_Count] = hash;
+   Dir_Index_Entry[Dir_Index_Count] = entry_addr;
+   Dir_Index_Count += 1;
+#endif // #ifdef FAT_DIR_INDEX_SIZE
+
+   return TRUE;
 }
 
 /*
@@ -1563,10 +2229,11 @@ Returns: EOF if there was a problem, GOODEC if everything went okay.
 signed int get_file_name(int32 file_entry_addr, char name[])
 {
    int
-      j,       // counter for loops
-      k = 0,   // current character in array
-      order,   // byte to hold the current long file name order
-      type;    // the type of entry that was just read in
+      entry[0x20],   // the long file name entry that was just read in
+      j,             // counter for loops
+      k = 0,         // current character in array
+      order,         // byte to hold the current long file name order
+      type;          // the type of entry that was just read in
 
    int32 i;          // pointer for memory
 
@@ -1591,19 +2258,21 @@ signed int get_file_name(int32 file_entry_addr, char name[])
       if(get_prev_entry(&i) == EOF)
          return EOF;
 
+      // read the whole entry at once rather than a character at a time
+      if(mmcsd_read_data(i, 0x20, entry) != GOODEC)
+         return EOF;
+
       for(j = 1; j < 0x20; j += 2, k += 1)
       {
          if(j == 11)
             j = 14;
          else if(j == 26)
             j = 28;
-         if(mmcsd_read_data(j + i, 1, &(name[k])) != GOODEC)
-            return EOF;
+         name[k] = entry[j];
       }
 
       // now that that's done with, get the entry's order
-      if(mmcsd_read_data(i, 1, &order) != GOODEC)
-         return EOF;
+      order = entry[0];
 
    } while(!(order & 0x40));  // the last entry will be 0b01xxxxxx
 
@@ -1720,6 +2389,9 @@ signed int set_file_name(int32 parent_dir_addr, int32* entry_addr, char name[])
    if(mmcsd_write_data(i, 11, sname) != GOODEC)
       return EOF;
 
+   // the directory index has to know about every file in its directory
+   dir_index_add(parent_dir_addr, name_hash(name), i);
+
    // set the new entry addr
    *entry_addr = i;
 
@@ -1789,6 +2461,8 @@ signed int make_short_file_name(int32 parent_dir_addr, char fname[], char sname[
       cur_fname[12] = "           ",
       cur_fnum[7] = "      ";
 
+   char* found;   // what strchr() found, turned into an index right away
+
    int
       buf,
       ext_pos,
@@ -1800,10 +2474,10 @@ signed int make_short_file_name(int32 parent_dir_addr, char fname[], char sname[
       i;
 
    // figure out where the extension position is
-   ext_pos = strchr(fname, '.');
+   found = strchr(fname, '.');
 
    // check to see if this file has an extension
-   if(ext_pos == 0)
+   if(found == 0)
    {
       while((val_parse_pos < 8) && (fname[fname_parse_pos] != '\0'))
       {
@@ -1818,7 +2492,7 @@ signed int make_short_file_name(int32 parent_dir_addr, char fname[], char sname[
    }
    else
    {
-      ext_pos -= fname - 1;
+      ext_pos = found - fname + 1;
       while((val_parse_pos < 11) && (fname[fname_parse_pos] != '\0'))
       {
          val[val_parse_pos] = toupper(fname[fname_parse_pos]);
@@ -1870,13 +2544,13 @@ signed int make_short_file_name(int32 parent_dir_addr, char fname[], char sname[
             fname_parse_pos = 0;
 
             // find out the last posiiton of a space
-            val_parse_pos = strchr(val, ' ');
-            if(val_parse_pos == 0)
+            found = strchr(val, ' ');
+            if(found == 0)
                // if there isn't a space, then we're going to have to put the ~x at the end of the short name
                val_parse_pos = 7 - strlen(cur_fnum);
             else
                // if there is a space, then put the ~x there
-               val_parse_pos -= val + 2;
+               val_parse_pos = found - val - 2;
 
             // make some room for extra digits
             buf = 10;
@@ -1907,7 +2581,7 @@ signed int make_short_file_name(int32 parent_dir_addr, char fname[], char sname[
       if(get_next_entry(&i) == EOF)
       {
          // we're going to have to allocate another cluster
-         if(alloc_clusters(addr_to_cluster(i), &i) == EOF)
+         if(alloc_clusters(addr_to_cluster(i), &i, TRUE) == EOF)
             return EOF;         
       }
       if(mmcsd_read_data(i + 0x0B, 1, &buf) != GOODEC)
@@ -1961,11 +2635,15 @@ signed int check_invalid_char(char fname[])
 
 /*
 signed int get_next_free_cluster(int16* my_cluster)
-Summary: Will go through the FAT and find the first unallocated cluster.
-Param: Pointer to a variable that will the the starting cluster of the serach.
+Summary: Finds an unallocated cluster.
+Param: Pointer to a variable that holds the cluster to search near.
         When a free cluster is found, the cluster number will be put into this variable.
 Returns: EOF if there was a problem, GOODEC if everything went okay.
-Note: This gets a little slow when dealing with a card with lots of stuff on it; sorry about that.
+Note: The rest of the given cluster's FAT sector is checked first so files stay contiguous,
+       then the search carries on from Next_Free_Clust and wraps around once. Since
+       Next_Free_Clust moves past every cluster handed out, allocated clusters are not
+       scanned over and over again as the card fills up.
+Note: Don't point my_cluster at Next_Free_Clust, this function moves the hint itself.
 */
 #ifdef FAT32
 signed int get_next_free_cluster(int32* my_cluster)
@@ -1975,71 +2653,103 @@ signed int get_next_free_cluster(int16* my_cluster)
 {
 #ifdef FAST_FAT
    *my_cluster += 1;
+   if(Next_Free_Clust <= *my_cluster)
+      Next_Free_Clust = *my_cluster;
    return GOODEC;
 #else // NO FAST_FAT
-
-#ifdef FAT32
-   int val[4];            // buffer to hold values
-
-   int32 cur_cluster;
-
    int32
-      FAT_addr,           // the current address that the algorithm is on
-      j;
+      cluster,       // the cluster the algorithm is on
+      end,           // where to stop looking
+      entry,         // what the FAT says about cluster
+      left;          // how many clusters haven't been looked at yet
 
-   // first, convert *my_cluster to an addressable location in the FAT
-   FAT_addr = (*my_cluster << 2) + FAT_Start;
+   int1 whole_sector;   // the current FAT sector has been looked at from its first entry
+
+#ifdef FAT_FULL_MAP_BYTES
+   int32 sector;
+#endif // #ifdef FAT_FULL_MAP_BYTES
 
    // the most logical place for the next free cluster would be next to the current cluster
-   for(j = 0; j < FAT_Length; j += 4)
+   cluster = *my_cluster;
+   if((cluster >= 2) && (cluster < End_Clust))
    {
-      if(mmcsd_read_data(FAT_addr + j, 4, val) != GOODEC)
-         return EOF;
+      // only look through the FAT sector that we're already in
+      end = cluster - (cluster % FAT_ENTRIES_PER_SECTOR) + FAT_ENTRIES_PER_SECTOR;
+      if(end > End_Clust)
+         end = End_Clust;
 
-      cur_cluster = make32(val[3], val[2], val[1], val[0]);
-
-      if(cur_cluster == 0)
+      for(; cluster < end; cluster += 1)
       {
-         // add on the last iteration of j, this is how far into the buffer we were when the algorithm terminated
-         FAT_addr += j;
+         if(read_fat(cluster, &entry) == EOF)
+            return EOF;
 
-         // convert *my_cluster back into a cluster number
-         *my_cluster = (FAT_addr - FAT_Start) >> 2;
-         return GOODEC;
+         if(entry == 0)
+         {
+            Next_Free_Clust = cluster + 1;
+            FSInfo_Changed = TRUE;
+            *my_cluster = cluster;
+            return GOODEC;
+         }
       }
    }
-#else // FAT16
-   int val[2];
-
-   int16 cur_cluster;
 
-   int32
-      FAT_addr,           // the current address that the algorithm is on
-      j;
+   // otherwise pick up where the last search left off
+   cluster = Next_Free_Clust;
+   if((cluster < 2) || (cluster >= End_Clust))
+      cluster = 2;
 
-   // first, convert *my_cluster to an addressable location in the FAT
-   FAT_addr = (*my_cluster << 1) + FAT_Start;
+   whole_sector = FALSE;
 
-   // the most logical place for the next free cluster would be next to the current cluster
-   for(j = 0; j < FAT_Length; j += 2)
+   for(left = End_Clust - 2; left > 0; left -= 1)
    {
-      if(mmcsd_read_data(FAT_addr + j, 2, val) != GOODEC)
+      if((cluster % FAT_ENTRIES_PER_SECTOR) == 0)
+      {
+#ifdef FAT_FULL_MAP_BYTES
+         // skip over FAT sectors that we already know are full
+         sector = cluster / FAT_ENTRIES_PER_SECTOR;
+         while((sector < (FAT_FULL_MAP_BYTES * 8))
+            && bit_test(FAT_Full_Map[sector >> 3], sector & 7)
+            && (left > FAT_ENTRIES_PER_SECTOR)
+            && ((cluster + FAT_ENTRIES_PER_SECTOR) < End_Clust))
+         {
+            cluster += FAT_ENTRIES_PER_SECTOR;
+            left -= FAT_ENTRIES_PER_SECTOR;
+            sector += 1;
+         }
+#endif // #ifdef FAT_FULL_MAP_BYTES
+         whole_sector = TRUE;
+      }
+
+      if(read_fat(cluster, &entry) == EOF)
          return EOF;
 
-      cur_cluster = make16(val[1], val[0]);
+      if(entry == 0)
+      {
+         Next_Free_Clust = cluster + 1;
+         FSInfo_Changed = TRUE;
+         *my_cluster = cluster;
+         return GOODEC;
+      }
+
+      cluster += 1;
 
-      if(cur_cluster == 0)
+#ifdef FAT_FULL_MAP_BYTES
+      // we went through a whole FAT sector without finding anything, remember that
+      if(whole_sector && ((cluster % FAT_ENTRIES_PER_SECTOR) == 0))
       {
-         // add on the last iteration of j, this is how far into the buffer we were when the algorithm terminated
-         FAT_addr += j;
+         sector = (cluster / FAT_ENTRIES_PER_SECTOR) - 1;
+         if(sector < (FAT_FULL_MAP_BYTES * 8))
+            bit_set(FAT_Full_Map[sector >> 3], sector & 7);
+      }
+#endif // #ifdef FAT_FULL_MAP_BYTES
 
-         // convert *my_cluster back into a cluster number
-         *my_cluster = (FAT_addr - FAT_Start) >> 1;
-         return GOODEC;
+      if(cluster >= End_Clust)
+      {
+         cluster = 2;
+         whole_sector = FALSE;
       }
    }
 
-#endif // #ifdef FAT32
    // if we reach this point, we are out of disk space
    return EOF;
 #endif // #ifdef FAST_FAT
@@ -2275,7 +2985,7 @@ signed int get_next_free_entry(int32* start_addr)
       i += 0x1F;
       // get the next address
       if(get_next_addr(&i) == EOF)
-         if(alloc_clusters(addr_to_cluster(i), &i) == EOF)
+         if(alloc_clusters(addr_to_cluster(i), &i, TRUE) == EOF)
             return EOF;
 
       if(mmcsd_read_data(i, 1, &buf) != GOODEC)
@@ -2288,16 +2998,17 @@ signed int get_next_free_entry(int32* start_addr)
 }
 
 /*
-signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr)
+signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr, int1 clear)
 Summary: Find, allocate, and link a free cluster.
 Param start_cluster: The cluster to begin looking for free clusters. This cluster will be linked to the newfound cluster in the FAT.
 Param new_cluster_addr: The address of the newly allocated cluster.
+Param clear: TRUE to zero the new cluster (directories need this), FALSE to leave whatever was there (file data).
 Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
 */
 #ifdef FAT32
-signed int alloc_clusters(int32 start_cluster, int32* new_cluster_addr)
+signed int alloc_clusters(int32 start_cluster, int32* new_cluster_addr, int1 clear)
 #else
-signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr)
+signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr, int1 clear)
 #endif
 {
 #ifdef FAT32
@@ -2331,8 +3042,9 @@ signed int alloc_clusters(int16 start_cluster, int32* new_cluster_addr)
 #endif // #ifdef FAT32
 
    // erase all of the data in the newly linked cluster
-   if(clear_cluster(next_cluster) == EOF)
-      return EOF;
+   if(clear)
+      if(clear_cluster(next_cluster) == EOF)
+         return EOF;
 
    // put the current character to this position
    *new_cluster_addr = cluster_to_addr(next_cluster);
@@ -2382,7 +3094,8 @@ signed int dealloc_clusters(int16 start_cluster)
     while(cur_cluster != 0xFFFF);
 #endif // #ifdef FAT32
 
-   return GOODEC;
+   // the freed clusters change the FSInfo counts
+   return write_fsinfo();
 }
 
 /*
@@ -2397,22 +3110,9 @@ signed int clear_cluster(int32 cluster)
 signed int clear_cluster(int16 cluster)
 #endif
 {
-   int
-      clear_entry[0x20],
-      j;
-
-   int16 i;
-
-   int32 start_addr;
-
-   start_addr = cluster_to_addr(cluster);
-   
-   for(j = 0; j < 0x20; j += 1)
-      clear_entry[j] = 0;
-
-   for(i = 0; i < Bytes_Per_Cluster; i += 0x20)
-      if(mmcsd_write_data(start_addr + i, 0x20, clear_entry) != GOODEC)
-         return EOF;
+   // clusters are always block aligned, so stream zeros over the whole thing in one go
+   if(mmcsd_clear_blocks(cluster_to_addr(cluster), Bytes_Per_Cluster / 512) != GOODEC)
+      return EOF;
 
    return GOODEC;
 }
@@ -2427,20 +3127,317 @@ Returns: EOF if there was a problem with the media, GOODEC if everything went ok
 #ifdef FAT32
 signed int write_fat(int32 cluster, int32 data)
 {
+   int32 old_data;
+
+   if(read_fat(cluster, &old_data) == EOF)
+      return EOF;
+
    if(mmcsd_write_data((cluster << 2) + FAT_Start, 4, &data) != GOODEC)
       return EOF;
 
+   count_fat_change(cluster, old_data, data & 0x0FFFFFFF);
+
    return GOODEC;
 }
 #else // FAT16
 signed int write_fat(int16 cluster, int16 data)
 {
+   int32 old_data;
+
+   if(read_fat(cluster, &old_data) == EOF)
+      return EOF;
+
    if(mmcsd_write_data((cluster << 1) + FAT_Start, 2, &data) != GOODEC)
       return EOF;
 
+   count_fat_change(cluster, old_data, data);
+
+   return GOODEC;
+}
+#endif // #ifdef FAT32
+
+/*
+signed int read_fat(int32 cluster, int32* data)
+Summary: Reads what the FAT says about a cluster.
+Param cluster: The cluster to look up in the FAT.
+Param data: A pointer to a variable to put the FAT entry into. 0 means the cluster is free.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+*/
+signed int read_fat(int32 cluster, int32* data)
+{
+   int32 addr;
+
+   *data = 0;
+
+   addr = (cluster * FAT_ENTRY_SIZE) + FAT_Start;
+
+#if MMCSD_CACHE_SECTORS > 2
+   // allocating goes back and forth between the FAT and the data, keep the FAT sector around
+   if(pin_sector(&FAT_Pinned, addr) != GOODEC)
+      return EOF;
+#endif // #if MMCSD_CACHE_SECTORS > 2
+
+   if(mmcsd_read_data(addr, FAT_ENTRY_SIZE, data) != GOODEC)
+      return EOF;
+
+#ifdef FAT32
+   // the top 4 bits are reserved
+   *data &= 0x0FFFFFFF;
+#endif // #ifdef FAT32
+
    return GOODEC;
 }
+
+/*
+void count_fat_change(int32 cluster, int32 old_data, int32 new_data)
+Summary: Keeps the free cluster count, the next free hint and the full sector map up to date after a FAT entry changes.
+Param cluster: The cluster whose FAT entry changed.
+Param old_data: What the FAT entry used to be.
+Param new_data: What the FAT entry is now.
+Returns: Nothing.
+*/
+void count_fat_change(int32 cluster, int32 old_data, int32 new_data)
+{
+#ifdef FAT_FULL_MAP_BYTES
+   int32 sector;
+#endif // #ifdef FAT_FULL_MAP_BYTES
+
+   if((old_data == 0) && (new_data != 0))
+   {
+      if(Free_Clusters != FREE_COUNT_UNKNOWN)
+         Free_Clusters -= 1;
+      FSInfo_Changed = TRUE;
+   }
+   else if((old_data != 0) && (new_data == 0))
+   {
+      if(Free_Clusters != FREE_COUNT_UNKNOWN)
+         Free_Clusters += 1;
+
+      // start the next search here so freed space gets reused first
+      if(cluster < Next_Free_Clust)
+         Next_Free_Clust = cluster;
+
+#ifdef FAT_FULL_MAP_BYTES
+      sector = cluster / FAT_ENTRIES_PER_SECTOR;
+      if(sector < (FAT_FULL_MAP_BYTES * 8))
+         bit_clear(FAT_Full_Map[sector >> 3], sector & 7);
+#endif // #ifdef FAT_FULL_MAP_BYTES
+
+      FSInfo_Changed = TRUE;
+   }
+}
+
+/*
+signed int write_fsinfo()
+Summary: Writes the free cluster count and the next free hint back to the FAT32 FSInfo sector.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+*/
+signed int write_fsinfo()
+{
+#ifdef FAT32
+   if(FSInfo_Changed && (FSInfo_Addr != 0))
+   {
+      if(mmcsd_write_data(FSInfo_Addr + 0x1E8, 4, &Free_Clusters) != GOODEC)
+         return EOF;
+      if(mmcsd_write_data(FSInfo_Addr + 0x1EC, 4, &Next_Free_Clust) != GOODEC)
+         return EOF;
+   }
 #endif // #ifdef FAT32
+   FSInfo_Changed = FALSE;
+
+   return GOODEC;
+}
+
+#if MMCSD_CACHE_SECTORS > 2
+/*
+signed int pin_sector(int32* pinned, int32 addr)
+Summary: Keeps the sector holding an address in the mmcsd cache, in place of the one pinned before.
+Param pinned: A pointer to the address of the sector pinned before, 0 if there isn't one. It gets the new sector's address.
+Param addr: An address in the sector to pin.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+*/
+signed int pin_sector(int32* pinned, int32 addr)
+{
+   addr -= addr % MMCSD_MAX_BLOCK_SIZE;
+
+   if(*pinned == addr)
+      return GOODEC;
+
+   if(*pinned != 0)
+      mmcsd_cache_unpin(*pinned);
+   *pinned = 0;
+
+   if(mmcsd_cache_pin(addr) != GOODEC)
+      return EOF;
+   *pinned = addr;
+
+   return GOODEC;
+}
+#endif // #if MMCSD_CACHE_SECTORS > 2
+
+/*
+signed int get_next_stream_addr(FILE* stream)
+Summary: Moves a stream to its next address.
+Param: The stream to move.
+Returns: EOF if there was a problem with the media or we've reached the last linked cluster in the FAT, GOODEC if everything went okay.
+Note: Inside the stream's contiguous run this is just an increment, the FAT is only read past the end of it.
+*/
+signed int get_next_stream_addr(FILE* stream)
+{
+   if((stream->Cur_Char >= stream->Start_Addr)
+      && ((stream->Cur_Char + 1) < (stream->Start_Addr + (stream->Extent_Clusters * Bytes_Per_Cluster))))
+   {
+      stream->Cur_Char += 1;
+      return GOODEC;
+   }
+
+   return get_next_addr(&(stream->Cur_Char));
+}
+
+/*
+signed int next_write_addr(FILE* stream)
+Summary: Moves a stream that is writing to its next address, linking in a new cluster at the end of the chain.
+Param: The stream to move.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+*/
+signed int next_write_addr(FILE* stream)
+{
+   // the next cluster might not be next to this one, so write the current buffer
+   //  to the end of the current cluster while we still know where that is
+   if(((stream->Cur_Char + 1) % Bytes_Per_Cluster) == 0)
+   {
+      if(mmcsd_write_data(stream->Cur_Char - STREAM_BUF_SIZE + 1, STREAM_BUF_SIZE, stream->Buf) != GOODEC)
+      {
+         stream->Flags |= Write_Error;
+         return EOF;
+      }
+   }
+
+   if(get_next_stream_addr(stream) == EOF)
+   {
+      // start looking for a new cluster to allocate
+      if(alloc_clusters(addr_to_cluster(stream->Cur_Char), &(stream->Cur_Char), FALSE) == EOF)
+         return EOF;
+   }
+
+   return GOODEC;
+}
+
+/*
+int32 get_direct_sectors(FILE* stream, int32 bytes)
+Summary: Figures out how many whole sectors can go straight between the card and the caller's buffer.
+Param stream: The stream that is being read from or written to.
+Param bytes: How many bytes there are left to transfer.
+Returns: The number of sectors, 0 if the stream isn't on a sector boundary or there isn't a whole sector to do.
+Note: The sectors have to be next to each other on the card, so this stops at the end of the
+       stream's contiguous run, or at the end of the current cluster outside of it.
+*/
+int32 get_direct_sectors(FILE* stream, int32 bytes)
+{
+   int32
+      end,     // one past the last contiguous byte
+      n;       // how many sectors will fit
+
+   if((stream->Cur_Char % 512) != 0)
+      return 0;
+
+   // there's nothing on the card yet, or this is the FAT16 root directory
+   if(stream->Cur_Char < Data_Start)
+      return 0;
+
+   end = stream->Start_Addr + (stream->Extent_Clusters * Bytes_Per_Cluster);
+   if((stream->Cur_Char < stream->Start_Addr) || (stream->Cur_Char >= end))
+      end = stream->Cur_Char - (stream->Cur_Char % Bytes_Per_Cluster) + Bytes_Per_Cluster;
+
+   n = (end - stream->Cur_Char) / 512;
+   if(n > (bytes / 512))
+      n = bytes / 512;
+
+   // mmcsd_write_blocks_preerase() takes a 16 bit count
+   if(n > 0xFFFF)
+      n = 0xFFFF;
+
+   return n;
+}
+
+/*
+signed int read_sectors(FILE* stream, char* data, int32 count)
+Summary: Reads whole sectors from the stream's position straight into the caller's buffer.
+Param stream: The stream to read from. get_direct_sectors() has to have said that count sectors will fit.
+Param data: Where to put the data.
+Param count: How many sectors to read.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+*/
+signed int read_sectors(FILE* stream, char* data, int32 count)
+{
+   Stream_Data = data;
+   if(mmcsd_read_blocks(stream->Cur_Char, count, stream_block) != GOODEC)
+   {
+      stream->Flags |= Read_Error;
+      return EOF;
+   }
+
+   stream->Bytes_Until_EOF -= count * 512;
+
+   // point at the last byte that was read and move on like fatgetc() would
+   //  read_buffer() refills the stream buffer on the next sector boundary
+   stream->Cur_Char += (count * 512) - 1;
+   if((get_next_stream_addr(stream) != GOODEC) && (stream->Bytes_Until_EOF != 0))
+      return EOF;
+
+   return GOODEC;
+}
+
+/*
+signed int write_sectors(FILE* stream, char* data, int32 count)
+Summary: Writes whole sectors from the stream's position straight to the card.
+Param stream: The stream to write to. get_direct_sectors() has to have said that count sectors will fit.
+Param data: Where the data is coming from.
+Param count: How many sectors to write.
+Returns: EOF if there was a problem with the media, GOODEC if everything went okay.
+*/
+signed int write_sectors(FILE* stream, char* data, int32 count)
+{
+   // the stream buffer still has the bytes right before this sector in it,
+   //  unless this is the start of a cluster where next_write_addr() already wrote them
+   if((stream->Cur_Char % Bytes_Per_Cluster) != 0)
+   {
+      if(mmcsd_write_data(stream->Cur_Char - STREAM_BUF_SIZE, STREAM_BUF_SIZE, stream->Buf) != GOODEC)
+      {
+         stream->Flags |= Write_Error;
+         return EOF;
+      }
+   }
+
+   // stream_block() hands out every one of the count sectors, so the card can
+   //  pre-erase them
+   Stream_Data = data;
+   if(mmcsd_write_blocks_preerase(stream->Cur_Char, count, stream_block) != GOODEC)
+   {
+      stream->Flags |= Write_Error;
+      return EOF;
+   }
+
+   // the buffer gets written back at the next boundary, so make it match what's on the card
+   memcpy(stream->Buf, data + (count * 512) - STREAM_BUF_SIZE, STREAM_BUF_SIZE);
+
+   stream->Size += count * 512;
+
+   // point at the last byte that was written and move on like fatputc() would
+   stream->Cur_Char += (count * 512) - 1;
+   return next_write_addr(stream);
+}
+
+/*
+char* stream_block(int16 block)
+Summary: Hands mmcsd_read_blocks() or mmcsd_write_blocks_preerase() the caller's buffer for each sector.
+Param: Which sector of the transfer this is.
+Returns: A pointer to the sector's place in the caller's buffer.
+*/
+char* stream_block(int16 block)
+{
+   return Stream_Data + ((int32)block * 512);
+}
 
 /*
 signed int read_buffer(FILE* stream, int* val)
@@ -2483,8 +3480,9 @@ Returns: EOF if there was a problem with the media, GOODEC if everything went ok
 signed int write_buffer(FILE* stream, int val)
 {
    // check to see if we should dump the buffer to the card
+   //  at the start of a cluster next_write_addr() has already done this
    if(((stream->Cur_Char % STREAM_BUF_SIZE) == 0)
-      && (stream->Cur_Char != stream->Start_Addr))
+      && ((stream->Cur_Char % Bytes_Per_Cluster) != 0))
    {
       // dump the buffer to the card
       if(mmcsd_write_data(stream->Cur_Char - STREAM_BUF_SIZE, STREAM_BUF_SIZE, stream->Buf) != GOODEC)
@@ -2590,16 +3588,32 @@ signed int fat_init()
       Large_Sectors;
 
 #ifdef FAT32
-   int32 Sectors_Per_FAT;
+   int16 FSInfo_Sector;
+
+   int32
+      FSInfo_Sig,
+      Sectors_Per_FAT;
 #else // FAT16
    int16
       Root_Entries,
       Sectors_Per_FAT;
 #endif // #ifdef FAT32
 
+   int32 Data_Sectors;
+
+   // the cache gets written back by mmcsd_init(), but the FSInfo values only live here
+   if(FAT_Mounted && (write_fsinfo() != GOODEC))
+      return EOF;
+
    // initialize the media
    ec += mmcsd_init();
 
+#if MMCSD_CACHE_SECTORS > 2
+   // mmcsd_init() unpinned everything
+   FAT_Pinned = 0;
+   Dir_Pinned = 0;
+#endif // #if MMCSD_CACHE_SECTORS > 2
+
    // start filling up variables
    ec += mmcsd_read_data(11, 2, &Bytes_Per_Sector);
    ec += mmcsd_read_data(13, 1, &Sectors_Per_Cluster);
@@ -2616,11 +3630,9 @@ signed int fat_init()
 #endif // #ifdef FAT32
    ec += mmcsd_read_data(28, 4, &Hidden_Sectors);
    ec += mmcsd_read_data(32, 4, &Large_Sectors);
-#ifdef FAT16
-   Next_Free_Clust = 2;
-#else
-   ec += mmcsd_read_data(0x3EC, 4, &Next_Free_Clust);
-#endif
+#ifdef FAT32
+   ec += mmcsd_read_data(48, 2, &FSInfo_Sector);
+#endif // #ifdef FAT32
    if(ec != GOODEC)
       return EOF;
 
@@ -2646,6 +3658,55 @@ signed int fat_init()
    Data_Start *= Bytes_Per_Sector;
 #endif // #ifdef FAT32
 
+   // figure out how many clusters there are, limited to what the FAT can hold
+   if(Small_Sectors != 0)
+      Data_Sectors = Small_Sectors;
+   else
+      Data_Sectors = Large_Sectors;
+#ifdef FAT32
+   Data_Sectors -= Root_Dir / Bytes_Per_Sector;
+#else // FAT16
+   Data_Sectors -= Data_Start / Bytes_Per_Sector;
+#endif // #ifdef FAT32
+   End_Clust = (Data_Sectors / Sectors_Per_Cluster) + 2;
+   if(End_Clust > (FAT_Length / FAT_ENTRY_SIZE))
+      End_Clust = FAT_Length / FAT_ENTRY_SIZE;
+
+   // pick up the free cluster count and next free hint, if the card has them
+   Free_Clusters = FREE_COUNT_UNKNOWN;
+   Next_Free_Clust = 2;
+   FSInfo_Addr = 0;
+   FSInfo_Changed = FALSE;
+#ifdef FAT32
+   if((FSInfo_Sector != 0) && (FSInfo_Sector != 0xFFFF))
+   {
+      ec += mmcsd_read_data((int32)FSInfo_Sector * Bytes_Per_Sector, 4, &FSInfo_Sig);
+      if(FSInfo_Sig == 0x41615252)
+      {
+         FSInfo_Addr = (int32)FSInfo_Sector * Bytes_Per_Sector;
+         ec += mmcsd_read_data(FSInfo_Addr + 0x1E8, 4, &Free_Clusters);
+         ec += mmcsd_read_data(FSInfo_Addr + 0x1EC, 4, &Next_Free_Clust);
+      }
+   }
+   if(ec != GOODEC)
+      return EOF;
+
+   // the FSInfo values are only hints, throw away anything that can't be right
+   if((Next_Free_Clust < 2) || (Next_Free_Clust >= End_Clust))
+      Next_Free_Clust = 2;
+   if(Free_Clusters > (End_Clust - 2))
+      Free_Clusters = FREE_COUNT_UNKNOWN;
+#endif // #ifdef FAT32
+
+#ifdef FAT_FULL_MAP_BYTES
+   memset(FAT_Full_Map, 0, FAT_FULL_MAP_BYTES);
+#endif // #ifdef FAT_FULL_MAP_BYTES
+
+   // nothing is known about the directories yet
+   forget_entries();
+
+   FAT_Mounted = TRUE;
+
    return GOODEC;
 }
 
@@ -2919,6 +3980,9 @@ signed int format(int32 DskSize)
    char BS_FilSysType[] = "FAT12   ";
 #endif // #ifdef FAT32
 
+   // every directory is about to be wiped out
+   forget_entries();
+
    // initialize variables
    // figure out total sectors
    BPB_TotSec = (DskSize * 0x400) / BPB_BytsPerSec;
@@ -3041,9 +4105,21 @@ signed int format(int32 DskSize)
    if(mmcsd_write_data(TmpVal1, 0x20, data) != GOODEC)
       return EOF;
       
-   // reset the last cluster
-   i = 2;
-   if(mmcsd_write_data(0x3EC, 4, &i) != GOODEC)
+   // write the FSInfo sector; the free count isn't known yet, fat_init() will leave it that way
+   TmpVal1 = 0x41615252;
+   if(mmcsd_write_data(BPB_FSInfo * BPB_BytsPerSec, 4, &TmpVal1) != GOODEC)
+      return EOF;
+   TmpVal1 = 0x61417272;
+   if(mmcsd_write_data((BPB_FSInfo * BPB_BytsPerSec) + 0x1E4, 4, &TmpVal1) != GOODEC)
+      return EOF;
+   TmpVal1 = FREE_COUNT_UNKNOWN;
+   if(mmcsd_write_data((BPB_FSInfo * BPB_BytsPerSec) + 0x1E8, 4, &TmpVal1) != GOODEC)
+      return EOF;
+   TmpVal1 = 2;
+   if(mmcsd_write_data((BPB_FSInfo * BPB_BytsPerSec) + 0x1EC, 4, &TmpVal1) != GOODEC)
+      return EOF;
+   i = 0xAA55;
+   if(mmcsd_write_data((BPB_FSInfo * BPB_BytsPerSec) + 0x1FE, 2, &i) != GOODEC)
       return EOF;
 #else
    data[17] = make8(BPB_RootEntCnt, 0);
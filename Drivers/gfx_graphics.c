@@ -91,6 +91,12 @@
 //       - Used to set the display's orientation to 90 degrees, not          //
 //         changeable.                                                       //
 //                                                                           //
+//    GFX_TILE_ROWS                                                          //
+//       - The number of image rows WriteImage() transposes and draws at     //
+//         once when the display is DISPLAY_VERTICAL, default is 8.  Uses    //
+//         GFX_TILE_ROWS * image width words of heap while drawing, halved   //
+//         until the allocation succeeds.                                    //
+//                                                                           //
 // Types:                                                                    //
 //                                                                           //
 //    AREA_STRUCT: - structure                                               //
@@ -1566,6 +1572,9 @@ int1 WriteImage(uint16_t ImageIndex, uint16_t StartX, uint16_t StartY)
    uint32_t Pixels;
    uint32_t Count;
    uint16_t *PixelData;
+   uint16_t *Tile;
+   uint16_t TileRows, Rows;
+   uint16_t k,n;
    uint16_t CurrentX, CurrentY, EndX, EndY;
    uint16_t Pixel;
    
@@ -1608,10 +1617,7 @@ int1 WriteImage(uint16_t ImageIndex, uint16_t StartX, uint16_t StartY)
          
       memcpy(&Address, &ImageData.BitmapAddress, sizeof(FLASH_ADDR));
      
-      if(gfx_DisplayOrientation == DISPLAY_HORIZONTAL)
-         PixelData = malloc(aWidth * 2);
-      else
-         PixelData = malloc(aHeight * 2);
+      PixelData = malloc(aWidth * 2);
          
       if(PixelData != NULL)
       {
@@ -1626,23 +1632,61 @@ int1 WriteImage(uint16_t ImageIndex, uint16_t StartX, uint16_t StartY)
          }
          else
          {
+            // Image rows are display columns.  Read a band of image rows, a
+            // whole row per burst like the horizontal path, transpose the
+            // band into Tile and draw it with one glcd_DrawPixels() call.
+            // If Tile can't be allocated each row is drawn on its own.
+            TileRows = GFX_TILE_ROWS;
+            
+            while(((Tile = malloc((uint32_t)TileRows * aWidth * 2)) == NULL) && (TileRows > 1))
+               TileRows /= 2;
+            
+            if(Tile == NULL)
+               TileRows = 1;
+            
             CurrentX = StartY;
             CurrentY = GLCD_LINES - StartX - aWidth;
-         
-            for(i=0;i<aWidth;i++)
+            
+            for(i=0;i<aHeight;i+=Rows)
             {
-               memcpy(&Address, &ImageData.BitmapAddress, sizeof(FLASH_ADDR));
-               flash_IncAddress(&Address, aWidth - i);
+               // keep the bands on TileRows boundaries of the display so the
+               // driver can use its aligned window writes
+               Rows = TileRows - (CurrentX % TileRows);
+               
+               if(Rows > (aHeight - i))
+                  Rows = aHeight - i;
                
-               for(j=0;j<aHeight;j++)
+               for(j=0;j<Rows;j++)
                {
-                  flash_ReadData(Address, &PixelData[j], 1);
+                  flash_ReadData(Address, PixelData, aWidth);
                   flash_IncAddress(&Address, ImageData.Header.Width);
+                  
+                  if(Tile != NULL)
+                  {
+                     for(k=0,n=j;k<aWidth;k++,n+=Rows)
+                        Tile[n] = PixelData[aWidth - 1 - k];
+                  }
+                  else
+                  {
+                     for(k=0,n=aWidth-1;k<n;k++,n--)
+                     {
+                        Pixel = PixelData[k];
+                        PixelData[k] = PixelData[n];
+                        PixelData[n] = Pixel;
+                     }
+                  }
                }
                
-               glcd_DrawPixels(CurrentX,CurrentY, aHeight, 1, PixelData);
-               CurrentY++;
-            }     
+               if(Tile != NULL)
+                  glcd_DrawPixels(CurrentX, CurrentY, Rows, aWidth, Tile);
+               else
+                  glcd_DrawPixels(CurrentX, CurrentY, 1, aWidth, PixelData);
+               
+               CurrentX += Rows;
+            }
+            
+            if(Tile != NULL)
+               free(Tile);
          }
          
          free(PixelData);
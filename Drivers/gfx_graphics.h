@@ -199,6 +199,10 @@ void TouchFunction(uint16_t HandleId, uint8_t AreaIndex, TOUCH_TYPE Kind, uint16
  #define TAB_CHARACTERS    3 
 #endif
 
+#ifndef GFX_TILE_ROWS
+ #define GFX_TILE_ROWS     8
+#endif
+
 #define DISPLAY_HORIZONTAL 0
 #define DISPLAY_VERTICAL   1
 
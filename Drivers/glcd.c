@@ -65,6 +65,19 @@
 ////     * Fills the entire LCD with the given color.                ////
 ////       - color can be ON or OFF                                  ////
 ////                                                                 ////
+////  glcd_update()                                                  ////
+////     * Only available when FAST_GLCD is defined.  Writes the     ////
+////       parts of the RAM buffer that changed since the last       ////
+////       update to the LCD.  Must be called to show what was       ////
+////       drawn.                                                    ////
+////                                                                 ////
+////  FAST_GLCD                                                      ////
+////     * Define before including this file to draw into a 1KB RAM  ////
+////       copy of the display instead of the LCD itself.  Drawing   ////
+////       then needs no LCD reads, and glcd_update() only writes    ////
+////       the changed columns of each page using the LCD's auto     ////
+////       incrementing column address.                              ////
+////                                                                 ////
 /////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 1996,2003 Custom Computer Services         ////
 //// This source code may only be used by licensed users of the CCS  ////
@@ -120,6 +133,34 @@ BYTE glcd_readByte(BYTE chip);
 void glcd_writeByte(BYTE chip, BYTE data);
 void glcd_fillScreen(int1 color);
 
+#ifdef FAST_GLCD
+void glcd_update(void);
+
+// RAM copy of the display, one byte per column of each 8 pixel page:
+// byte [page*64 + x] holds pixels (x, page*8) to (x, page*8+7)
+struct
+{
+   BYTE left[512];
+   BYTE right[512];
+} glcd_displayData;
+
+// First and last changed column of each page, left chip in 0-7 and right
+// chip in 8-15.  A clean page has first > last.
+BYTE glcd_dirtyFirst[16];
+BYTE glcd_dirtyLast[16];
+
+// Purpose:       Mark a column of a page as changed since the last update
+// Inputs:        page - page number, plus 8 for the right chip
+//                x - the column in that chip, 0 to 63
+void glcd_markDirty(BYTE page, BYTE x)
+{
+   if(x < glcd_dirtyFirst[page])
+      glcd_dirtyFirst[page] = x;
+   if(x > glcd_dirtyLast[page])
+      glcd_dirtyLast[page] = x;
+}
+#endif
+
 const BYTE TEXT[51][5] ={0x00, 0x00, 0x00, 0x00, 0x00, // SPACE
                          0x00, 0x00, 0x5F, 0x00, 0x00, // !
                          0x00, 0x03, 0x00, 0x03, 0x00, // "
@@ -251,6 +292,9 @@ void glcd_init(int1 mode)
    }
 
    glcd_fillScreen(OFF);               // Clear the display
+#ifdef FAST_GLCD
+   glcd_update();
+#endif
 }
 
 
@@ -258,12 +302,48 @@ void glcd_init(int1 mode)
 // Inputs:        x - the x coordinate of the pixel
 //                y - the y coordinate of the pixel
 //                color - ON or OFF
-// Output:        1 if coordinate out of range, 0 if in range
+// Output:        Nothing is drawn if the coordinate is out of range
+#ifdef FAST_GLCD
+void glcd_pixel(int x, int y, int1 color)
+{
+   BYTE *p;
+   BYTE data;
+   BYTE page;
+
+   if(x > 127 || y > 63)         // Off the screen
+      return;
+
+   page = y/8;
+   if(x > 63)  // Check for first or second display area
+   {
+      x -= 64;
+      p = &glcd_displayData.right[(int16)page*64 + x];
+      page += 8;
+   }
+   else
+      p = &glcd_displayData.left[(int16)page*64 + x];
+
+   data = *p;
+   if(color == ON)
+      bit_set(data, y%8);        // Turn the pixel on
+   else                          // or
+      bit_clear(data, y%8);      // turn the pixel off
+
+   if(data != *p)                // Only changed bytes need to be written
+   {
+      *p = data;
+      glcd_markDirty(page, x);
+   }
+}
+#else
 void glcd_pixel(int x, int y, int1 color)
 {
    BYTE data;
    BYTE chip = GLCD_CS1;  // Stores which chip to use on the LCD
 
+   if(x > 127 || y > 63)  // Off the screen
+      return;
+
    if(x > 63)  // Check for first or second display area
    {
       x -= 64;
@@ -287,6 +367,7 @@ void glcd_pixel(int x, int y, int1 color)
    output_high(GLCD_DI);         // Set for data
    glcd_writeByte(chip, data);   // Write the pixel data
 }
+#endif
 
 
 // Purpose:       Draw a line on a graphic LCD using Bresenham's
@@ -568,6 +649,64 @@ void glcd_text57(int x, int y, char* textptr, int size, int1 color)
 // Inputs:        ON - turn all the pixels on
 //                OFF - turn all the pixels off
 // Dependencies:  glcd_writeByte()
+#ifdef FAST_GLCD
+void glcd_fillScreen(int1 color)
+{
+   int i;
+
+   memset(glcd_displayData.left, 0xFF*color, sizeof(glcd_displayData.left));
+   memset(glcd_displayData.right, 0xFF*color, sizeof(glcd_displayData.right));
+
+   for(i = 0; i < 16; ++i)                      // Every column has to be written
+   {
+      glcd_dirtyFirst[i] = 0;
+      glcd_dirtyLast[i] = 63;
+   }
+}
+
+
+// Purpose:       Write the changed columns of one page of one chip
+// Inputs:        chip - GLCD_CS1 or GLCD_CS2
+//                page - the page number, 0 to 7
+//                data - the RAM copy of that chip
+//                dirty - page number in glcd_dirtyFirst/glcd_dirtyLast
+// Dependencies:  glcd_writeByte()
+void glcd_updatePage(BYTE chip, BYTE page, BYTE* data, BYTE dirty)
+{
+   BYTE x, last;
+
+   x = glcd_dirtyFirst[dirty];
+   last = glcd_dirtyLast[dirty];
+   if(x > last)                                 // Nothing changed
+      return;
+
+   output_low(GLCD_DI);                         // Set for instruction
+   glcd_writeByte(chip, x | 0b01000000);        // Set horizontal address
+   glcd_writeByte(chip, page | 0b10111000);     // Set page address
+   output_high(GLCD_DI);                        // Set for data
+
+   data += (int16)page*64 + x;
+   for(; x <= last; ++x)                        // The column address
+      glcd_writeByte(chip, *data++);            //   increments after each write
+
+   glcd_dirtyFirst[dirty] = 0xFF;               // Page is clean again
+   glcd_dirtyLast[dirty] = 0;
+}
+
+
+// Purpose:       Copy the changes in the RAM buffer to the LCD
+// Dependencies:  glcd_updatePage()
+void glcd_update(void)
+{
+   int i;
+
+   for(i = 0; i < 8; ++i)
+   {
+      glcd_updatePage(GLCD_CS1, i, glcd_displayData.left, i);
+      glcd_updatePage(GLCD_CS2, i, glcd_displayData.right, i + 8);
+   }
+}
+#else
 void glcd_fillScreen(int1 color)
 {
    int i, j;
@@ -590,6 +729,7 @@ void glcd_fillScreen(int1 color)
       }
    }
 }
+#endif
 
 // Purpose:       Write a byte of data to the specified chip
 // Inputs:        chipSelect - which chip to write the data to
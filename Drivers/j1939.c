@@ -25,6 +25,50 @@
 ////                         been claimed.  Use address global address 255  ////
 ////                         to receive a list of all claimed address.      ////
 ////                                                                        ////
+////  When J1939_SUBSCRIPTIONS isn't 0 (default 8) handlers can be          ////
+////  registered for individual PGNs, they're called directly from         ////
+////  J1939ReceiveTask() instead of the message going to the J1939 receive  ////
+////  buffer:                                                               ////
+////                                                                        ////
+//// J1939Subscribe() - Registers a handler for a PGN, from one or any      ////
+////                    source address.                                     ////
+////                                                                        ////
+//// J1939Unsubscribe() - Removes a handler.                                ////
+////                                                                        ////
+////  With J1939_SUBSCRIPTION_FILTERS TRUE (default) the CAN filters for    ////
+////  PDU Format 240 to 255 are set from the subscribed PGNs, once any PGN  ////
+////  is subscribed other broadcast PGNs aren't received.  If more than 4   ////
+////  broadcast PGNs are subscribed all broadcast PGNs are received and     ////
+////  filtered in software.                                                 ////
+////                                                                        ////
+////  When J1939_USE_TRANSPORT_PROTOCOL is TRUE (default) messages of 9 to  ////
+////  1785 bytes are sent and received with the J1939-21 Transport          ////
+////  Protocol, both BAM and RTS/CTS:                                       ////
+////                                                                        ////
+//// J1939TPPutMessage() - Starts sending a multi-packet message.  The data ////
+////                       isn't copied, so it must not change until        ////
+////                       J1939TPXmitBusy() returns FALSE.                 ////
+////                                                                        ////
+//// J1939TPXmitBusy() - Checks if a multi-packet message is being sent.    ////
+////                                                                        ////
+//// J1939TPXmitResult() - Returns 0 if the last multi-packet message was   ////
+////                       sent, otherwise the Connection Abort reason.     ////
+////                                                                        ////
+//// J1939TPKbhit() - Checks for a received multi-packet message.           ////
+////                                                                        ////
+//// J1939TPGetMessage() - Returns a pointer to a received multi-packet     ////
+////                       message, the message stays in its reassembly     ////
+////                       buffer until J1939TPFreeMessage() is called.     ////
+////                                                                        ////
+//// J1939TPFreeMessage() - Returns a reassembly buffer to the pool.        ////
+////                                                                        ////
+////  Multi-packet messages are reassembled directly into one of           ////
+////  J1939_TP_RECEIVE_SESSIONS buffers of J1939_TP_MAX_SIZE bytes, so a    ////
+////  BAM and one or more RTS/CTS sessions can be received at once.  They   ////
+////  aren't passed through the J1939 receive buffer.  The paced BAM and    ////
+////  RTS/CTS sender and the session timeouts are run from                  ////
+////  J1939XmitTask() and J1939ReceiveTask(), neither blocks.               ////
+////                                                                        ////
 ////  Requires:                                                             ////
 ////     J1939InitAddress - Macro to initialize the g_MyJ1939Adddress       ////
 ////                        variable, which is the preferred J1939 address  ////
@@ -57,6 +101,13 @@
 ////  May 19 15 - Fixed a typecasting issue when calling can_putd()         ////
 ////              function.                                                 ////
 ////                                                                        ////
+////  Oct 17 26 - Added Transport Protocol (BAM and RTS/CTS) for messages   ////
+////              up to 1785 bytes.  Fixed J1939_TP_CM_CTS value, RTS is    ////
+////              16 and CTS is 17.  Added PGN subscriptions with the CAN   ////
+////              broadcast filters set from the subscribed PGNs.  Received ////
+////              messages are no longer dropped when the J1939 receive     ////
+////              buffer is full, only messages that would go into it.      ////
+////                                                                        ////
 //////////////////////////////////////////////////////////////////////////////// 
 ////        (C) Copyright 1996,2015 Custom Computer Services                ////
 //// This source code may only be used by licensed users of the CCS         ////
@@ -77,9 +128,11 @@
       (getenv("DEVICE") == "DSPIC30F4011") || (getenv("DEVICE") == "DSPIC30F4012") || (getenv("DEVICE") == "DSPIC30F4013") 
     #include <can-dsPIC30.c>  //dsPIC30
     #define j1939can_getd  can_getd
+    #define J1939_MASK_EXT CAN_MASK_ACCEPT_ALL
   #else
    #include <can-PIC24.c>     //PIC24 and dsPIC33
    #define j1939can_getd   can_fifo_getd
+   #define J1939_MASK_EXT  CAN_USE_EXTENDED_ID
   #endif  
  #elif defined(__PCH__)
   #include <can-18F4580.c>    //PIC18
@@ -92,6 +145,10 @@
  #define j1939can_getd   can_getd
 #endif
 
+#define J1939_BROADCAST_MASK     0x00F00000  //upper nibble of PDU Format, accepts PDU Format 240 to 255
+#define J1939_PGN_MASK           0x03FFFF00  //Extended Data Page, Data Page, PDU Format and PDU Specific
+#define J1939_NO_PGN_FILTER      0x03FFFF00  //Extended Data Page and Data Page both set isn't used by J1939
+
 ////////////////////////////////////////////////////////////////////////////////  API
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -105,6 +162,15 @@ void J1939Init(void)
 {
    memset(&g_J1939Flags,0,sizeof(J1939_FLAGS_STRUCT));   //clear the J1939 Flag structure
    
+  #if J1939_SUBSCRIPTIONS > 0
+   g_J1939SubscriptionCount = 0;
+  #endif
+   
+  #if J1939_USE_TRANSPORT_PROTOCOL
+   memset(g_J1939TPReceive,0,sizeof(g_J1939TPReceive));  //all reassembly buffers free
+   memset(&g_J1939TPXmit,0,sizeof(J1939_TP_TX_SESSION_STRUCT));
+  #endif
+   
    J1939InitAddress();  //Initialize unit's J1939 Preferred Address
    J1939InitName();     //Initialize unit's J1939 Name
    
@@ -140,18 +206,30 @@ void J1939Init(void)
       can_set_id(&C1RXF0, 0x0000FF00, CAN_USE_EXTENDED_ID);    //Filter 0 set to look for messages to the Global Address 255
       can_set_id(&C1RXF1, 0x0000FF00, CAN_USE_EXTENDED_ID);    //Filter 1 set to look for messages to the Global Address 255 will change to unit's address once it gets one
       can_set_id(&C1RXF2, 0x00F00000, CAN_USE_EXTENDED_ID);    //Filter 2 set to look for Broadcast messages PDU 240 to 255
+      can_set_id(&C1RXF3, 0x00F00000, CAN_USE_EXTENDED_ID);    //Filter 3 set to look for Broadcast messages PDU 240 to 255
+      can_set_id(&C1RXF4, 0x00F00000, CAN_USE_EXTENDED_ID);    //Filter 4 set to look for Broadcast messages PDU 240 to 255
+      can_set_id(&C1RXF5, 0x00F00000, CAN_USE_EXTENDED_ID);    //Filter 5 set to look for Broadcast messages PDU 240 to 255
       
       can_associate_filter_to_mask(ACCEPTANCE_MASK_0, F0BP);   //Associate Mask 0 with filter 0
       can_associate_filter_to_mask(ACCEPTANCE_MASK_0, F1BP);   //Associate Mask 0 with filter 1
       can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F2BP);   //Associate Mask 1 with filter 2
+      can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F3BP);   //Associate Mask 1 with filter 3
+      can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F4BP);   //Associate Mask 1 with filter 4
+      can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F5BP);   //Associate Mask 1 with filter 5
       
       can_associate_filter_to_buffer(AFIFO, F0BP);    //Associate Filter 0 to FIFO buffer
       can_associate_filter_to_buffer(AFIFO, F1BP);    //Associate Filter 1 to FIFO buffer
       can_associate_filter_to_buffer(AFIFO, F2BP);    //Associate Filter 2 to FIFO buffer
+      can_associate_filter_to_buffer(AFIFO, F3BP);    //Associate Filter 3 to FIFO buffer
+      can_associate_filter_to_buffer(AFIFO, F4BP);    //Associate Filter 4 to FIFO buffer
+      can_associate_filter_to_buffer(AFIFO, F5BP);    //Associate Filter 5 to FIFO buffer
       
       can_enable_filter(FLTEN0);    //Enable Filter 0
       can_enable_filter(FLTEN1);    //Enable Filter 1
       can_enable_filter(FLTEN2);    //Enable Filter 2
+      can_enable_filter(FLTEN3);    //Enable Filter 3
+      can_enable_filter(FLTEN4);    //Enable Filter 4
+      can_enable_filter(FLTEN5);    //Enable Filter 5
       
       can_enable_b_transfer(TRB0);  //make buffer 0 a transmit buffer
       can_enable_b_transfer(TRB1);  //make buffer 1 a transmit buffer
@@ -167,12 +245,18 @@ void J1939Init(void)
       can_set_id(RXFILTER0, 0x0000FF00, CAN_USE_EXTENDED_ID);     //Filter 0 set to look for messages to the Global Address 255
       can_set_id(RXFILTER1, 0x0000FF00, CAN_USE_EXTENDED_ID);     //Filter 1 set to look for messages to the Global Address 255 will change to unit's address once it gets one
       can_set_id(RXFILTER2, 0x00F00000, CAN_USE_EXTENDED_ID);     //Filter 2 set to look for Broadcast messages PDU 240 to 255
+      can_set_id(RXFILTER3, 0x00F00000, CAN_USE_EXTENDED_ID);     //Filter 3 set to look for Broadcast messages PDU 240 to 255
+      can_set_id(RXFILTER4, 0x00F00000, CAN_USE_EXTENDED_ID);     //Filter 4 set to look for Broadcast messages PDU 240 to 255
+      can_set_id(RXFILTER5, 0x00F00000, CAN_USE_EXTENDED_ID);     //Filter 5 set to look for Broadcast messages PDU 240 to 255
       
       can_associate_filter_to_mask(ACCEPTANCE_MASK_0, F0BP);
       can_associate_filter_to_mask(ACCEPTANCE_MASK_0, F1BP);
       can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F2BP);
+      can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F3BP);
+      can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F4BP);
+      can_associate_filter_to_mask(ACCEPTANCE_MASK_1, F5BP);
       
-      can_enable_filter(RXF0EN | RXF1EN | RXF2EN);      
+      can_enable_filter(RXF0EN | RXF1EN | RXF2EN | RXF3EN | RXF4EN | RXF5EN);      
       
       can_set_mode(CAN_OP_NORMAL);  //put CAN in Normal mode
     #endif
@@ -201,6 +285,9 @@ void J1939Init(void)
 //  Parameters: None
 //  Returns:    Nothing
 //
+// Messages with a subscribed PGN are passed to their handler and don't use the
+// J1939 Receive Buffer.
+//
 // Warning - This function will continue to CAN buffers until all messages are
 //           retrieved from CAN buffers, if J1939 Receive buffer isn't large
 //           enough it will throw away any messages that will overflow the 
@@ -222,28 +309,38 @@ void J1939ReceiveTask(void)
    {
       j1939can_getd(ReceivedPDU,Data,length,Status);
       
-      if(g_J1939Flags.ReceiveBufferCount < J1939_RECEIVE_BUFFERS)
+     #if J1939_USE_TRANSPORT_PROTOCOL
+      if((ReceivedPDU.PDUFormat == J1939_PF_PT_CM) || (ReceivedPDU.PDUFormat == J1939_PF_PT_DT))
       {
-         switch(ReceivedPDU.PDUFormat)
-         {
-            case J1939_PF_ADDR_CLAIMED:
-               J1939HandleAddressClaim(ReceivedPDU,Data);
-               
-               if((ReceivedPDU.SourceAddress != g_MyJ1939Address) && (ReceivedPDU.SourceAddress != J1939_NULL_ADDRESS))
-               {
-                  J1939LoadReceiveBuffer(ReceivedPDU,Data,length);  //so you can keep a list of J1939Names to J1939Addresses, if desired
-               }
+         if(length == 8)
+            J1939TPReceive(ReceivedPDU,Data);   //reassembled in the pool, doesn't use J1939 receive buffer
+         continue;
+      }
+     #endif
+      
+      switch(ReceivedPDU.PDUFormat)
+      {
+         case J1939_PF_ADDR_CLAIMED:
+            J1939HandleAddressClaim(ReceivedPDU,Data);
+            
+            if((ReceivedPDU.SourceAddress != g_MyJ1939Address) && (ReceivedPDU.SourceAddress != J1939_NULL_ADDRESS))
+            {
+               J1939LoadReceiveBuffer(ReceivedPDU,Data,length);  //so you can keep a list of J1939Names to J1939Addresses, if desired
+            }
+            break;
+         case J1939_PF_REQUEST:
+            if((Data[0] == 0x00) && (Data[1] == 0xEE) && (Data[2] == 0x00))
+            {
+               J1939HandleAddressRequest(ReceivedPDU);
                break;
-            case J1939_PF_REQUEST:
-               if((Data[0] == 0x00) && (Data[1] == 0xEE) && (Data[2] == 0x00))
-               {
-                  J1939HandleAddressRequest(ReceivedPDU);
-                  break;
-               }
-            default:
-               J1939LoadReceiveBuffer(ReceivedPDU,Data,length);
+            }
+         default:
+           #if J1939_SUBSCRIPTIONS > 0
+            if(J1939Dispatch(&ReceivedPDU,Data,length))
                break;
-         }
+           #endif
+            J1939LoadReceiveBuffer(ReceivedPDU,Data,length);
+            break;
       }
    }
    
@@ -258,6 +355,10 @@ void J1939ReceiveTask(void)
                                                    //J1939 Messages sent to unit's address 
       }
    }
+   
+  #if J1939_USE_TRANSPORT_PROTOCOL
+   J1939TPTimeoutTask();
+  #endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -312,6 +413,11 @@ void J1939XmitTask(void)
          
        g_J1939Flags.XmitBufferCount--;
    }
+   
+  #if J1939_USE_TRANSPORT_PROTOCOL
+   if(g_J1939Flags.AddressClaimed == TRUE)
+      J1939TPXmitTask();
+  #endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -415,6 +521,240 @@ void J1939RequestAddress(uint8_t address)
    J1939PutMessage(PDU,data,3);
 }
 
+#if J1939_SUBSCRIPTIONS > 0
+////////////////////////////////////////////////////////////////////////////////
+//J1939Subscribe()
+// Registers a handler for a PGN.  Received messages with the PGN, including
+// multi-packet messages, are passed to the handler from J1939ReceiveTask()
+// instead of being loaded into the receive buffer.  A handler for a single
+// source address is used before a handler for any source address.  If
+// J1939_SUBSCRIPTION_FILTERS is TRUE the CAN filters are updated.  Should be
+// called after J1939Init().
+//  Parameters: PGN - Parameter Group Number, PDU Specific is ignored for PDU
+//                    Format 0 to 239
+//              Source - source address, J1939_GLOBAL_ADDRESS for any source
+//              Handler - function to call, replaces current handler if PGN
+//                        and Source are already subscribed
+//  Returns:    True - if handler was registered
+//              False - if subscription table is full
+////////////////////////////////////////////////////////////////////////////////
+int1 J1939Subscribe(uint32_t PGN, uint8_t Source, J1939_HANDLER Handler)
+{
+   uint32_t Key;
+   uint8_t i, j;
+   
+   PGN &= 0x3FFFF;
+   if(make8(PGN,1) < 240)
+      PGN &= 0x3FF00;
+   
+   Key = (PGN << 8) | Source;
+   i = J1939FindSubscription(Key);
+   
+   if((i < g_J1939SubscriptionCount) && (g_J1939Subscriptions[i].Key == Key))
+   {
+      g_J1939Subscriptions[i].Handler = Handler;
+      return(TRUE);
+   }
+   
+   if(g_J1939SubscriptionCount >= J1939_SUBSCRIPTIONS)
+      return(FALSE);
+   
+   for(j=g_J1939SubscriptionCount;j>i;j--)
+      memcpy(&g_J1939Subscriptions[j],&g_J1939Subscriptions[j-1],sizeof(J1939_SUBSCRIPTION_STRUCT));
+   
+   g_J1939Subscriptions[i].Key = Key;
+   g_J1939Subscriptions[i].Handler = Handler;
+   g_J1939SubscriptionCount++;
+   
+  #if J1939_SUBSCRIPTION_FILTERS
+   if(g_J1939Flags.AddressClaimed)
+      J1939SetCANFilter(g_MyJ1939Address);
+   else
+      J1939SetCANFilter(J1939_GLOBAL_ADDRESS);
+  #endif
+   
+   return(TRUE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939Unsubscribe()
+// Removes a handler registered with J1939Subscribe(), messages with the PGN go
+// to the receive buffer again.
+//  Parameters: PGN - Parameter Group Number
+//              Source - source address it was subscribed with
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939Unsubscribe(uint32_t PGN, uint8_t Source)
+{
+   uint32_t Key;
+   uint8_t i;
+   
+   PGN &= 0x3FFFF;
+   if(make8(PGN,1) < 240)
+      PGN &= 0x3FF00;
+   
+   Key = (PGN << 8) | Source;
+   i = J1939FindSubscription(Key);
+   
+   if((i >= g_J1939SubscriptionCount) || (g_J1939Subscriptions[i].Key != Key))
+      return;
+   
+   g_J1939SubscriptionCount--;
+   
+   for(;i<g_J1939SubscriptionCount;i++)
+      memcpy(&g_J1939Subscriptions[i],&g_J1939Subscriptions[i+1],sizeof(J1939_SUBSCRIPTION_STRUCT));
+   
+  #if J1939_SUBSCRIPTION_FILTERS
+   if(g_J1939Flags.AddressClaimed)
+      J1939SetCANFilter(g_MyJ1939Address);
+   else
+      J1939SetCANFilter(J1939_GLOBAL_ADDRESS);
+  #endif
+}
+#endif
+
+#if J1939_USE_TRANSPORT_PROTOCOL
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPPutMessage()
+// Starts sending a message with the Transport Protocol.  Messages sent to the
+// Global Address, or with a PDU Format of 240 or higher, are sent as a BAM,
+// others with RTS/CTS.  Messages of 8 bytes or less are passed to
+// J1939PutMessage().  The data isn't copied, it's sent from Data by
+// J1939XmitTask() and must not be changed until J1939TPXmitBusy() returns
+// FALSE.  Only one multi-packet message can be sent at a time.
+//  Parameters: PDU - PDU to send with message
+//              Data - pointer to data to send
+//              Bytes - number of bytes to send, 1 to 1785
+//  Returns:    True - if message was loaded into xmit buffer or session started
+//              False - if a message is already being sent or xmit buffer was full
+////////////////////////////////////////////////////////////////////////////////
+int1 J1939TPPutMessage(J1939_PDU_STRUCT PDU, uint8_t *Data, uint16_t Bytes)
+{
+   if(Bytes <= 8)
+      return(J1939PutMessage(PDU,Data,Bytes));
+   
+   if((Bytes > 1785) || (g_J1939TPXmit.State != J1939_TP_TX_IDLE))
+      return(FALSE);
+   
+   g_J1939TPXmit.PGN = make32(0,((uint8_t)PDU.ExtendedDataPage << 1) | PDU.DataPage,PDU.PDUFormat,0);
+   
+   if(PDU.PDUFormat >= 240)
+   {
+      g_J1939TPXmit.PGN |= PDU.DestinationAddress;  //Group Extension
+      g_J1939TPXmit.Destination = J1939_GLOBAL_ADDRESS;
+   }
+   else
+      g_J1939TPXmit.Destination = PDU.DestinationAddress;
+   
+   g_J1939TPXmit.Data = Data;
+   g_J1939TPXmit.Size = Bytes;
+   g_J1939TPXmit.Packets = (Bytes + 6) / 7;
+   g_J1939TPXmit.NextPacket = 1;
+   g_J1939TPXmit.Result = 0;
+   
+   if(g_J1939TPXmit.Destination == J1939_GLOBAL_ADDRESS)
+      g_J1939TPXmit.State = J1939_TP_TX_BAM;
+   else
+      g_J1939TPXmit.State = J1939_TP_TX_RTS;
+   
+   return(TRUE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPXmitBusy()
+// Checks if a multi-packet message is being sent
+//  Parameters: None
+//  Returns:    True - if a message is being sent, it's data must not be changed
+//              False - if a new message can be sent
+////////////////////////////////////////////////////////////////////////////////
+int1 J1939TPXmitBusy(void)
+{
+   if(g_J1939TPXmit.State != J1939_TP_TX_IDLE)
+      return(TRUE);
+   else
+      return(FALSE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPXmitResult()
+// Returns the result of the last multi-packet message sent
+//  Parameters: None
+//  Returns:    0 - if message was sent (and acknowledged for RTS/CTS)
+//              Connection Abort reason, J1939_TP_ABORT_TIMEOUT if receiver
+//              stopped responding
+////////////////////////////////////////////////////////////////////////////////
+uint8_t J1939TPXmitResult(void)
+{
+   return(g_J1939TPXmit.Result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPKbhit()
+// Checks for a received multi-packet message
+//  Parameters: None
+//  Returns:    True - if a message is waiting for J1939TPGetMessage()
+//              False - if no message is waiting
+////////////////////////////////////////////////////////////////////////////////
+int1 J1939TPKbhit(void)
+{
+   uint8_t i;
+   
+   for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+   {
+      if(g_J1939TPReceive[i].State == J1939_TP_RX_COMPLETE)
+         return(TRUE);
+   }
+   
+   return(FALSE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPGetMessage()
+// Retrieves a received multi-packet message.  The message isn't copied, the
+// returned pointer is to the reassembly buffer it was received into, which
+// isn't reused until it's passed to J1939TPFreeMessage().
+//  Parameters: PDU - PDU structure to return message's PDU to
+//              Length - variable to return message length to
+//  Returns:    pointer to message data, NULL if there was no new message
+////////////////////////////////////////////////////////////////////////////////
+uint8_t *J1939TPGetMessage(J1939_PDU_STRUCT &PDU, uint16_t &Length)
+{
+   uint8_t i;
+   
+   for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+   {
+      if(g_J1939TPReceive[i].State == J1939_TP_RX_COMPLETE)
+      {
+         J1939TPLoadPDU(&g_J1939TPReceive[i],&PDU);
+         Length = g_J1939TPReceive[i].Size;
+         g_J1939TPReceive[i].State = J1939_TP_RX_DELIVERED;
+         
+         return(g_J1939TPReceive[i].Data);
+      }
+   }
+   
+   return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPFreeMessage()
+// Returns a reassembly buffer to the pool once the message retrieved with
+// J1939TPGetMessage() is no longer needed.
+//  Parameters: Data - pointer returned by J1939TPGetMessage()
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPFreeMessage(uint8_t *Data)
+{
+   uint8_t i;
+   
+   for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+   {
+      if((g_J1939TPReceive[i].State == J1939_TP_RX_DELIVERED) && (g_J1939TPReceive[i].Data == Data))
+         g_J1939TPReceive[i].State = J1939_TP_RX_IDLE;
+   }
+}
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////  Internal Functions
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -486,7 +826,8 @@ void J1939HandleAddressRequest(J1939_PDU_STRUCT PDU)
 
 ////////////////////////////////////////////////////////////////////////////////
 //J1939LoadReceiveBuffer()
-// Loads g_J1939ReceiveBuffer with passed data and updates global indexes.
+// Loads g_J1939ReceiveBuffer with passed data and updates global indexes, 
+// message is thrown away if buffer is full.
 //  Parameters: ReceivedPDU - the PDU of the received CAN message
 //              Data - pointer to the received CAN data
 //              length - number of bytes received in CAN message
@@ -496,6 +837,9 @@ void J1939LoadReceiveBuffer(J1939_PDU_STRUCT ReceivedPDU,uint8_t *Data,uint8_t l
 {
    uint8_t i;
    
+   if(g_J1939Flags.ReceiveBufferCount >= J1939_RECEIVE_BUFFERS)
+      return;  //buffer full, throw away message
+   
    memcpy(&g_J1939ReceiveBuffer[g_J1939ReceiveNextIn].PDU,&ReceivedPDU,sizeof(J1939_PDU_STRUCT));
    g_J1939ReceiveBuffer[g_J1939ReceiveNextIn].Length = length;
    for(i=0;i<length;i++)
@@ -576,30 +920,680 @@ void J1939HandleAddressClaim(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Name)
    }
 }
       
+#if J1939_SUBSCRIPTIONS > 0
+////////////////////////////////////////////////////////////////////////////////
+//J1939FindSubscription()
+// Binary search of the subscription table.
+//  Parameters: Key - PGN << 8 | Source Address
+//  Returns:    index of subscription with Key, or of the first subscription
+//              with a higher Key if Key isn't subscribed
+////////////////////////////////////////////////////////////////////////////////
+uint8_t J1939FindSubscription(uint32_t Key)
+{
+   uint8_t Low, High, Mid;
+   
+   Low = 0;
+   High = g_J1939SubscriptionCount;
+   
+   while(Low < High)
+   {
+      Mid = (Low + High) / 2;
+      
+      if(g_J1939Subscriptions[Mid].Key < Key)
+         Low = Mid + 1;
+      else
+         High = Mid;
+   }
+   
+   return(Low);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939Dispatch()
+// Passes a received message to the handler subscribed to its PGN and source
+// address, or to its PGN from any source address.
+//  Parameters: PDU - pointer to the PDU of the received message
+//              Data - pointer to the received data
+//              Length - number of bytes received
+//  Returns:    True - if message was passed to a handler
+//              False - if PGN isn't subscribed
+////////////////////////////////////////////////////////////////////////////////
+int1 J1939Dispatch(J1939_PDU_STRUCT *PDU, uint8_t *Data, uint16_t Length)
+{
+   uint32_t Key;
+   uint8_t i;
+   
+   if(g_J1939SubscriptionCount == 0)
+      return(FALSE);
+   
+   Key = make32(0,((uint8_t)PDU->ExtendedDataPage << 1) | PDU->DataPage,PDU->PDUFormat,0);
+   if(PDU->PDUFormat >= 240)
+      Key |= PDU->DestinationAddress;     //Group Extension
+   
+   Key = (Key << 8) | PDU->SourceAddress;
+   i = J1939FindSubscription(Key);
+   
+   if((i >= g_J1939SubscriptionCount) || (g_J1939Subscriptions[i].Key != Key))
+   {
+      Key |= J1939_GLOBAL_ADDRESS;        //any source address
+      i = J1939FindSubscription(Key);
+      
+      if((i >= g_J1939SubscriptionCount) || (g_J1939Subscriptions[i].Key != Key))
+         return(FALSE);
+   }
+   
+   (*g_J1939Subscriptions[i].Handler)(PDU,Data,Length);
+   
+   return(TRUE);
+}
+#endif
+
+#if J1939_USE_TRANSPORT_PROTOCOL
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPReceive()
+// Passes a received TP.CM or TP.DT message to its handler, ignores messages
+// sent to other units.
+//  Parameters: ReceivedPDU - the PDU of the received CAN message
+//              Data - pointer to the 8 bytes of received CAN data
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPReceive(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data)
+{
+   if((ReceivedPDU.DestinationAddress != J1939_GLOBAL_ADDRESS) && 
+      ((ReceivedPDU.DestinationAddress != g_MyJ1939Address) || (g_J1939Flags.AddressClaimed == FALSE)))
+      return;
+   
+   if(ReceivedPDU.PDUFormat == J1939_PF_PT_CM)
+      J1939TPHandleCM(ReceivedPDU,Data);
+   else
+      J1939TPHandleDT(ReceivedPDU,Data);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPHandleCM()
+// Handles a received TP.CM message.  A RTS or BAM opens a receive session, a
+// CTS, End Of Message Ack or Abort from the unit being sent to updates the
+// transmit session.
+//  Parameters: ReceivedPDU - the PDU of the received TP.CM message
+//              Data - pointer to the 8 bytes of TP.CM data
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPHandleCM(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data)
+{
+   uint32_t PGN;
+   uint16_t WindowEnd;
+   uint8_t i;
+   
+   PGN = make32(0,Data[7],Data[6],Data[5]);
+   
+   switch(Data[0])
+   {
+      case J1939_TP_CM_RTS:
+         if(ReceivedPDU.DestinationAddress != J1939_GLOBAL_ADDRESS)
+            J1939TPOpen(ReceivedPDU,Data);
+         break;
+      case J1939_TP_CM_BAM:
+         if(ReceivedPDU.DestinationAddress == J1939_GLOBAL_ADDRESS)
+            J1939TPOpen(ReceivedPDU,Data);
+         break;
+      case J1939_TP_CM_CTS:
+         if(((g_J1939TPXmit.State == J1939_TP_TX_WAIT_CTS) || (g_J1939TPXmit.State == J1939_TP_TX_SEND_DATA)) &&
+            (ReceivedPDU.SourceAddress == g_J1939TPXmit.Destination) && (PGN == g_J1939TPXmit.PGN))
+         {
+            g_J1939TPXmit.Tick = J1939GetTick();
+            
+            if(Data[1] == 0)     //hold the connection open
+            {
+               g_J1939TPXmit.State = J1939_TP_TX_WAIT_CTS;
+               g_J1939TPXmit.Timeout = J1939_TP_TICKS(J1939_TP_T4);
+            }
+            else if((Data[2] == 0) || (Data[2] > g_J1939TPXmit.Packets))
+            {
+               J1939TPSendCM(g_J1939TPXmit.Destination,J1939_TP_CM_ABORT,J1939_TP_ABORT_SEQUENCE,0xFF,0xFF,0xFF,PGN);
+               g_J1939TPXmit.Result = J1939_TP_ABORT_SEQUENCE;
+               g_J1939TPXmit.State = J1939_TP_TX_IDLE;
+            }
+            else
+            {
+               WindowEnd = (uint16_t)Data[2] + Data[1] - 1;
+               if(WindowEnd > g_J1939TPXmit.Packets)
+                  WindowEnd = g_J1939TPXmit.Packets;
+               
+               g_J1939TPXmit.NextPacket = Data[2];
+               g_J1939TPXmit.WindowEnd = WindowEnd;
+               g_J1939TPXmit.State = J1939_TP_TX_SEND_DATA;
+            }
+         }
+         break;
+      case J1939_TP_CM_EOF:
+         if((g_J1939TPXmit.State == J1939_TP_TX_WAIT_ACK) && (ReceivedPDU.SourceAddress == g_J1939TPXmit.Destination) && (PGN == g_J1939TPXmit.PGN))
+         {
+            g_J1939TPXmit.Result = 0;
+            g_J1939TPXmit.State = J1939_TP_TX_IDLE;
+         }
+         break;
+      case J1939_TP_CM_ABORT:
+         if((g_J1939TPXmit.State != J1939_TP_TX_IDLE) && (ReceivedPDU.SourceAddress == g_J1939TPXmit.Destination) && (PGN == g_J1939TPXmit.PGN))
+         {
+            g_J1939TPXmit.Result = Data[1];
+            g_J1939TPXmit.State = J1939_TP_TX_IDLE;
+         }
+         
+         for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+         {
+            if((g_J1939TPReceive[i].State == J1939_TP_RX_RECEIVING) && (g_J1939TPReceive[i].Bam == FALSE) &&
+               (g_J1939TPReceive[i].Source == ReceivedPDU.SourceAddress) && (g_J1939TPReceive[i].PGN == PGN))
+               g_J1939TPReceive[i].State = J1939_TP_RX_IDLE;
+         }
+         break;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPOpen()
+// Opens a receive session for a RTS or BAM.  A new RTS or BAM from a unit that
+// is already sending replaces its old session, otherwise a free reassembly
+// buffer is taken from the pool.  If there isn't a free buffer, or the message
+// is too large, a RTS is aborted and a BAM is ignored.
+//  Parameters: ReceivedPDU - the PDU of the received TP.CM message
+//              Data - pointer to the 8 bytes of TP.CM data
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPOpen(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data)
+{
+   J1939_TP_RX_SESSION_STRUCT *Session;
+   uint16_t Size;
+   uint8_t i;
+   int1 Bam;
+   
+   Bam = (Data[0] == J1939_TP_CM_BAM);
+   Size = make16(Data[2],Data[1]);
+   Session = NULL;
+   
+   for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+   {
+      if((g_J1939TPReceive[i].State == J1939_TP_RX_RECEIVING) && (g_J1939TPReceive[i].Bam == Bam) && 
+         (g_J1939TPReceive[i].Source == ReceivedPDU.SourceAddress))
+      {
+         Session = &g_J1939TPReceive[i];
+         break;
+      }
+   }
+   
+   if(Session == NULL)
+   {
+      for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+      {
+         if(g_J1939TPReceive[i].State == J1939_TP_RX_IDLE)
+         {
+            Session = &g_J1939TPReceive[i];
+            break;
+         }
+      }
+   }
+   
+   if((Session == NULL) || (Size > J1939_TP_MAX_SIZE) || (Size < 9) || (Data[3] != (Size + 6) / 7))
+   {
+      if(Session != NULL)
+         Session->State = J1939_TP_RX_IDLE;
+      
+      if(Bam == FALSE)
+      {
+         if(Session == NULL)
+            i = J1939_TP_ABORT_BUSY;
+         else
+            i = J1939_TP_ABORT_RESOURCES;
+         
+         J1939TPSendCM(ReceivedPDU.SourceAddress,J1939_TP_CM_ABORT,i,0xFF,0xFF,0xFF,make32(0,Data[7],Data[6],Data[5]));
+      }
+      return;
+   }
+   
+   Session->Bam = Bam;
+   Session->Source = ReceivedPDU.SourceAddress;
+   Session->Destination = ReceivedPDU.DestinationAddress;
+   Session->Priority = ReceivedPDU.Priority;
+   Session->PGN = make32(0,Data[7],Data[6],Data[5]);
+   Session->Size = Size;
+   Session->Packets = Data[3];
+   Session->NextPacket = 1;
+   Session->MaxPackets = Data[4];
+   Session->State = J1939_TP_RX_RECEIVING;
+   
+   if(Bam)
+   {
+      Session->Tick = J1939GetTick();
+      Session->Timeout = J1939_TP_TICKS(J1939_TP_T1);
+   }
+   else
+      J1939TPSendCTS(Session);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPHandleDT()
+// Handles a received TP.DT message, the 7 data bytes are copied straight to
+// their place in the session's reassembly buffer.  Sends the next CTS, or the
+// End Of Message Ack, when needed.
+//  Parameters: ReceivedPDU - the PDU of the received TP.DT message
+//              Data - pointer to the 8 bytes of TP.DT data
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPHandleDT(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data)
+{
+   J1939_TP_RX_SESSION_STRUCT *Session;
+   uint16_t Offset;
+   uint16_t Count;
+   uint8_t i;
+   int1 Bam;
+   
+   Bam = (ReceivedPDU.DestinationAddress == J1939_GLOBAL_ADDRESS);
+   Session = NULL;
+   
+   for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+   {
+      if((g_J1939TPReceive[i].State == J1939_TP_RX_RECEIVING) && (g_J1939TPReceive[i].Bam == Bam) && 
+         (g_J1939TPReceive[i].Source == ReceivedPDU.SourceAddress))
+      {
+         Session = &g_J1939TPReceive[i];
+         break;
+      }
+   }
+   
+   if(Session == NULL)
+      return;
+   
+   if(Data[0] != Session->NextPacket)
+   {
+      if((Bam == FALSE) && (Data[0] < Session->NextPacket))
+         return;     //duplicate packet, ignore it
+      
+      if(Bam == FALSE)
+         J1939TPSendCM(Session->Source,J1939_TP_CM_ABORT,J1939_TP_ABORT_SEQUENCE,0xFF,0xFF,0xFF,Session->PGN);
+      
+      Session->State = J1939_TP_RX_IDLE;
+      return;
+   }
+   
+   Offset = (uint16_t)(Data[0] - 1) * 7;
+   Count = Session->Size - Offset;
+   if(Count > 7)
+      Count = 7;
+   
+   memcpy(&Session->Data[Offset],&Data[1],Count);
+   
+   Session->Tick = J1939GetTick();
+   Session->Timeout = J1939_TP_TICKS(J1939_TP_T1);
+   
+   if(Data[0] == Session->Packets)
+   {
+      if(Bam == FALSE)
+         J1939TPSendCM(Session->Source,J1939_TP_CM_EOF,make8(Session->Size,0),make8(Session->Size,1),Session->Packets,0xFF,Session->PGN);
+      
+      Session->State = J1939_TP_RX_COMPLETE;
+      
+     #if J1939_SUBSCRIPTIONS > 0
+      J1939TPLoadPDU(Session,&ReceivedPDU);
+      if(J1939Dispatch(&ReceivedPDU,Session->Data,Session->Size))
+         Session->State = J1939_TP_RX_IDLE;    //handler is done with it, buffer back to pool
+     #endif
+   }
+   else
+   {
+      Session->NextPacket++;
+      
+      if((Bam == FALSE) && (Data[0] == Session->WindowEnd))
+         J1939TPSendCTS(Session);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPLoadPDU()
+// Loads a PDU structure with the PGN, source and destination of a received
+// multi-packet message.
+//  Parameters: Session - pointer to receive session
+//              PDU - pointer to PDU structure to load
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPLoadPDU(J1939_TP_RX_SESSION_STRUCT *Session, J1939_PDU_STRUCT *PDU)
+{
+   PDU->SourceAddress = Session->Source;
+   PDU->PDUFormat = make8(Session->PGN,1);
+   PDU->DataPage = bit_test(Session->PGN,16);
+   PDU->ExtendedDataPage = bit_test(Session->PGN,17);
+   PDU->Priority = Session->Priority;
+   
+   if(PDU->PDUFormat >= 240)
+      PDU->DestinationAddress = make8(Session->PGN,0);  //Group Extension
+   else
+      PDU->DestinationAddress = Session->Destination;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPSendCTS()
+// Sends a CTS for the next packets of a RTS/CTS receive session.
+//  Parameters: Session - pointer to receive session
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPSendCTS(J1939_TP_RX_SESSION_STRUCT *Session)
+{
+   uint8_t Count;
+   
+   Count = Session->Packets - Session->NextPacket + 1;
+   if(Count > J1939_TP_CTS_PACKETS)
+      Count = J1939_TP_CTS_PACKETS;
+   if((Session->MaxPackets != 0) && (Count > Session->MaxPackets))
+      Count = Session->MaxPackets;
+   
+   Session->WindowEnd = Session->NextPacket + Count - 1;
+   Session->Tick = J1939GetTick();
+   Session->Timeout = J1939_TP_TICKS(J1939_TP_T2);
+   
+   J1939TPSendCM(Session->Source,J1939_TP_CM_CTS,Count,Session->NextPacket,0xFF,0xFF,Session->PGN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPSendCM()
+// Loads a TP.CM message into the J1939 transmit buffer
+//  Parameters: Destination - address to send message to
+//              Control - control byte, J1939_TP_CM_RTS, J1939_TP_CM_CTS, etc.
+//              b1 to b4 - bytes 1 to 4 of TP.CM message
+//              PGN - Parameter Group Number of multi-packet message
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPSendCM(uint8_t Destination, uint8_t Control, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4, uint32_t PGN)
+{
+   J1939_PDU_STRUCT PDU;
+   uint8_t data[8];
+   
+   PDU.SourceAddress = g_MyJ1939Address;
+   PDU.DestinationAddress = Destination;
+   PDU.PDUFormat = J1939_PF_PT_CM;
+   PDU.DataPage = 0;
+   PDU.ExtendedDataPage = 0;
+   PDU.Priority = J1939_TP_CM_PRIORITY;
+   
+   data[0] = Control;
+   data[1] = b1;
+   data[2] = b2;
+   data[3] = b3;
+   data[4] = b4;
+   data[5] = make8(PGN,0);
+   data[6] = make8(PGN,1);
+   data[7] = make8(PGN,2);
+   
+   J1939PutMessage(PDU,data,8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPPutFrame()
+// Loads a TP.CM or TP.DT message of the transmit session directly into a CAN
+// transmit buffer, so it isn't held up behind, or passed by, messages in the 
+// J1939 transmit buffer.
+//  Parameters: Destination - address to send message to
+//              PDUFormat - J1939_PF_PT_CM or J1939_PF_PT_DT
+//              Data - pointer to 8 bytes of data to send
+//  Returns:    True - if message was loaded into a CAN transmit buffer
+//              False - if CAN transmit buffers were full
+////////////////////////////////////////////////////////////////////////////////
+int1 J1939TPPutFrame(uint8_t Destination, uint8_t PDUFormat, uint8_t *Data)
+{
+   J1939_PDU_STRUCT PDU;
+   
+   if(!can_tbe())
+      return(FALSE);
+   
+   PDU.SourceAddress = g_MyJ1939Address;
+   PDU.DestinationAddress = Destination;
+   PDU.PDUFormat = PDUFormat;
+   PDU.DataPage = 0;
+   PDU.ExtendedDataPage = 0;
+   if(PDUFormat == J1939_PF_PT_CM)
+      PDU.Priority = J1939_TP_CM_PRIORITY;
+   else
+      PDU.Priority = J1939_TP_DT_PRIORITY;
+   
+   can_putd((uint32_t)PDU,Data,8,3,TRUE,FALSE);
+   
+   return(TRUE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPTimeoutTask()
+// Closes receive sessions whose sender stopped sending, a RTS/CTS session is
+// aborted.  Called from J1939ReceiveTask().
+//  Parameters: None
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPTimeoutTask(void)
+{
+   J1939_TICK_TYPE CurrentTick;
+   uint8_t i;
+   
+   CurrentTick = J1939GetTick();
+   
+   for(i=0;i<J1939_TP_RECEIVE_SESSIONS;i++)
+   {
+      if((g_J1939TPReceive[i].State == J1939_TP_RX_RECEIVING) && 
+         (J1939GetTickDifference(CurrentTick, g_J1939TPReceive[i].Tick) > g_J1939TPReceive[i].Timeout))
+      {
+         if(g_J1939TPReceive[i].Bam == FALSE)
+            J1939TPSendCM(g_J1939TPReceive[i].Source,J1939_TP_CM_ABORT,J1939_TP_ABORT_TIMEOUT,0xFF,0xFF,0xFF,g_J1939TPReceive[i].PGN);
+         
+         g_J1939TPReceive[i].State = J1939_TP_RX_IDLE;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//J1939TPXmitTask()
+// Runs the transmit session, called from J1939XmitTask().  Sends the RTS or
+// BAM, then at most one TP.DT message each time it's called, spaced by
+// J1939_TP_BAM_INTERVAL_MS for a BAM and J1939_TP_DT_INTERVAL_MS for RTS/CTS.
+// Returns right away if it's not time to send or the CAN transmit buffers are
+// full.
+//  Parameters: None
+//  Returns:    Nothing
+////////////////////////////////////////////////////////////////////////////////
+void J1939TPXmitTask(void)
+{
+   J1939_TICK_TYPE CurrentTick;
+   uint16_t Offset;
+   uint8_t data[8];
+   uint8_t i;
+   
+   CurrentTick = J1939GetTick();
+   
+   switch(g_J1939TPXmit.State)
+   {
+      case J1939_TP_TX_BAM:
+      case J1939_TP_TX_RTS:
+         if(g_J1939TPXmit.State == J1939_TP_TX_BAM)
+            data[0] = J1939_TP_CM_BAM;
+         else
+            data[0] = J1939_TP_CM_RTS;
+         data[1] = make8(g_J1939TPXmit.Size,0);
+         data[2] = make8(g_J1939TPXmit.Size,1);
+         data[3] = g_J1939TPXmit.Packets;
+         data[4] = 0xFF;      //no limit on packets per CTS
+         data[5] = make8(g_J1939TPXmit.PGN,0);
+         data[6] = make8(g_J1939TPXmit.PGN,1);
+         data[7] = make8(g_J1939TPXmit.PGN,2);
+         
+         if(J1939TPPutFrame(g_J1939TPXmit.Destination,J1939_PF_PT_CM,data))
+         {
+            g_J1939TPXmit.Tick = CurrentTick;
+            
+            if(g_J1939TPXmit.State == J1939_TP_TX_BAM)
+               g_J1939TPXmit.State = J1939_TP_TX_BAM_DATA;
+            else
+            {
+               g_J1939TPXmit.Timeout = J1939_TP_TICKS(J1939_TP_T3);
+               g_J1939TPXmit.State = J1939_TP_TX_WAIT_CTS;
+            }
+         }
+         break;
+      case J1939_TP_TX_BAM_DATA:
+      case J1939_TP_TX_SEND_DATA:
+         if(g_J1939TPXmit.State == J1939_TP_TX_BAM_DATA)
+         {
+            if(J1939GetTickDifference(CurrentTick, g_J1939TPXmit.Tick) < J1939_TP_TICKS(J1939_TP_BAM_INTERVAL_MS))
+               break;
+         }
+         else if(J1939GetTickDifference(CurrentTick, g_J1939TPXmit.Tick) < J1939_TP_TICKS(J1939_TP_DT_INTERVAL_MS))
+            break;
+         
+         data[0] = g_J1939TPXmit.NextPacket;
+         Offset = (uint16_t)(g_J1939TPXmit.NextPacket - 1) * 7;
+         for(i=1;i<8;i++)
+         {
+            if(Offset < g_J1939TPXmit.Size)
+               data[i] = g_J1939TPXmit.Data[Offset++];
+            else
+               data[i] = 0xFF;
+         }
+         
+         if(J1939TPPutFrame(g_J1939TPXmit.Destination,J1939_PF_PT_DT,data))
+         {
+            g_J1939TPXmit.Tick = CurrentTick;
+            
+            if(g_J1939TPXmit.State == J1939_TP_TX_BAM_DATA)
+            {
+               if(g_J1939TPXmit.NextPacket == g_J1939TPXmit.Packets)
+                  g_J1939TPXmit.State = J1939_TP_TX_IDLE;
+            }
+            else if(g_J1939TPXmit.NextPacket == g_J1939TPXmit.Packets)
+            {
+               g_J1939TPXmit.Timeout = J1939_TP_TICKS(J1939_TP_T3);
+               g_J1939TPXmit.State = J1939_TP_TX_WAIT_ACK;
+            }
+            else if(g_J1939TPXmit.NextPacket == g_J1939TPXmit.WindowEnd)
+            {
+               g_J1939TPXmit.Timeout = J1939_TP_TICKS(J1939_TP_T3);
+               g_J1939TPXmit.State = J1939_TP_TX_WAIT_CTS;
+            }
+            
+            g_J1939TPXmit.NextPacket++;
+         }
+         break;
+      case J1939_TP_TX_WAIT_CTS:
+      case J1939_TP_TX_WAIT_ACK:
+         if(J1939GetTickDifference(CurrentTick, g_J1939TPXmit.Tick) > g_J1939TPXmit.Timeout)
+         {
+            J1939TPSendCM(g_J1939TPXmit.Destination,J1939_TP_CM_ABORT,J1939_TP_ABORT_TIMEOUT,0xFF,0xFF,0xFF,g_J1939TPXmit.PGN);
+            g_J1939TPXmit.Result = J1939_TP_ABORT_TIMEOUT;
+            g_J1939TPXmit.State = J1939_TP_TX_IDLE;
+         }
+         break;
+   }
+}
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 //J1939SetCANFilter()
 // Sets filter 1 of CAN module to receive unit's address after unit it has
-// successfully claimed an address.
+// successfully claimed an address, and mask 1 and filters 2 to 5 from the
+// subscribed broadcast PGNs.
 //  Parameters: address - address to set filter to
 //  Returns:    Nothing
 ////////////////////////////////////////////////////////////////////////////////
 void J1939SetCANFilter(uint8_t address)
 {
+   uint32_t Filter[J1939_BROADCAST_FILTERS];
+   uint32_t Mask;
+   
+   Mask = J1939LoadBroadcastFilters(Filter);
+   
    can_set_mode(CAN_OP_CONFIG);  //put CAN in Config mode
 
    #if (USE_INTERNAL_CAN == TRUE)
     #if defined(__PCD__)   //PIC24, dsPIC33 and dsPIC30
       can_set_id(&C1RXF1, (uint32_t)address << 8, CAN_USE_EXTENDED_ID);       //Set Filter 1
+      can_set_id(&C1RXM1, Mask, J1939_MASK_EXT);                              //Set Mask 1
+      can_set_id(&C1RXF2, Filter[0], CAN_USE_EXTENDED_ID);                    //Set Filters 2 to 5
+      can_set_id(&C1RXF3, Filter[1], CAN_USE_EXTENDED_ID);
+      can_set_id(&C1RXF4, Filter[2], CAN_USE_EXTENDED_ID);
+      can_set_id(&C1RXF5, Filter[3], CAN_USE_EXTENDED_ID);
     #else
       can_set_id(RXFILTER1, (uint32_t)address << 8, CAN_USE_EXTENDED_ID);     //Set Filter 1
+      can_set_id(RX1MASK, Mask, CAN_USE_EXTENDED_ID);                         //Set Mask 1
+      can_set_id(RXFILTER2, Filter[0], CAN_USE_EXTENDED_ID);                  //Set Filters 2 to 5
+      can_set_id(RXFILTER3, Filter[1], CAN_USE_EXTENDED_ID);
+      can_set_id(RXFILTER4, Filter[2], CAN_USE_EXTENDED_ID);
+      can_set_id(RXFILTER5, Filter[3], CAN_USE_EXTENDED_ID);
     #endif
    #else
       can_set_id(RX0FILTER1, (uint32_t)address << 8, CAN_USE_EXTENDED_ID);    //Set Filter 1
+      can_set_id(RX1MASK, Mask, CAN_USE_EXTENDED_ID);                         //Set Mask 1
+      can_set_id(RX1FILTER2, Filter[0], CAN_USE_EXTENDED_ID);                 //Set Filters 2 to 5
+      can_set_id(RX1FILTER3, Filter[1], CAN_USE_EXTENDED_ID);
+      can_set_id(RX1FILTER4, Filter[2], CAN_USE_EXTENDED_ID);
+      can_set_id(RX1FILTER5, Filter[3], CAN_USE_EXTENDED_ID);
    #endif
    
    can_set_mode(CAN_OP_NORMAL);  //put CAN in Normal mode
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//J1939LoadBroadcastFilters()
+// Works out the CAN mask 1 and filters 2 to 5 for PDU Format 240 to 255.  With
+// no subscriptions, or more subscribed broadcast PGNs than filters, the mask
+// only checks the upper nibble of the PDU Format so all broadcast PGNs are
+// received.  Otherwise the mask checks the whole PGN and each filter is set to
+// a subscribed PGN, so other broadcast PGNs never reach the CPU.
+//  Parameters: Filter - pointer to J1939_BROADCAST_FILTERS filter ids to load
+//  Returns:    mask 1 id
+////////////////////////////////////////////////////////////////////////////////
+uint32_t J1939LoadBroadcastFilters(uint32_t *Filter)
+{
+   uint8_t i;
+  #if (J1939_SUBSCRIPTIONS > 0) && J1939_SUBSCRIPTION_FILTERS
+   uint8_t Count;
+   uint32_t Id;
+  #endif
+   
+   for(i=0;i<J1939_BROADCAST_FILTERS;i++)
+      Filter[i] = J1939_BROADCAST_MASK;
+   
+  #if (J1939_SUBSCRIPTIONS > 0) && J1939_SUBSCRIPTION_FILTERS
+   if(g_J1939SubscriptionCount == 0)
+      return(J1939_BROADCAST_MASK);
+   
+   Count = 0;
+   Filter[0] = J1939_NO_PGN_FILTER;    //used if no broadcast PGNs are subscribed
+   
+   for(i=0;i<g_J1939SubscriptionCount;i++)
+   {
+      if(make8(g_J1939Subscriptions[i].Key,2) < 240)  //PDU Format
+         continue;
+      
+      Id = g_J1939Subscriptions[i].Key & J1939_PGN_MASK;
+      
+      if((Count > 0) && (Filter[Count - 1] == Id))    //same PGN from another source, table is sorted
+         continue;
+      
+      if(Count == J1939_BROADCAST_FILTERS)
+      {
+         for(Count=0;Count<J1939_BROADCAST_FILTERS;Count++)
+            Filter[Count] = J1939_BROADCAST_MASK;
+         
+         return(J1939_BROADCAST_MASK);
+      }
+      
+      Filter[Count++] = Id;
+   }
+   
+   for(i=1;i<J1939_BROADCAST_FILTERS;i++)
+   {
+      if(i >= Count)
+         Filter[i] = Filter[0];
+   }
+   
+   return(J1939_PGN_MASK);
+  #else
+   return(J1939_BROADCAST_MASK);
+  #endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //xor8()
 // Generates a pseudo-random 8-bit number.  rand_seed is used as a seed
@@ -39,6 +39,51 @@
 #define J1939_TRANSMIT_BUFFERS   1
 #endif
 
+#ifndef J1939_SUBSCRIPTIONS
+#define J1939_SUBSCRIPTIONS      8     //PGN handlers that can be registered with J1939Subscribe(), 0 to disable
+#endif
+
+#ifndef J1939_SUBSCRIPTION_FILTERS
+#define J1939_SUBSCRIPTION_FILTERS  TRUE  //set CAN broadcast filters to only accept subscribed PGNs
+#endif
+
+#define J1939_BROADCAST_FILTERS  4     //CAN filters 2 to 5, used for PDU Format 240 to 255
+
+#ifndef J1939_USE_TRANSPORT_PROTOCOL
+#define J1939_USE_TRANSPORT_PROTOCOL   TRUE  //multi-packet messages (TP.CM/TP.DT), see J1939TPPutMessage()
+#endif
+
+#if J1939_USE_TRANSPORT_PROTOCOL
+#ifndef J1939_TP_RECEIVE_SESSIONS
+#define J1939_TP_RECEIVE_SESSIONS   2     //multi-packet messages that can be received or held at the same time
+#endif
+
+#if J1939_TP_RECEIVE_SESSIONS == 0
+#undef J1939_TP_RECEIVE_SESSIONS
+#define J1939_TP_RECEIVE_SESSIONS   1
+#endif
+
+#ifndef J1939_TP_MAX_SIZE
+#define J1939_TP_MAX_SIZE           256   //largest multi-packet message that can be received, 9 to 1785 bytes
+#endif
+
+#if J1939_TP_MAX_SIZE > 1785
+#error J1939_TP_MAX_SIZE can't be larger than 1785 bytes
+#endif
+
+#ifndef J1939_TP_CTS_PACKETS
+#define J1939_TP_CTS_PACKETS        8     //packets requested with each Clear To Send
+#endif
+
+#ifndef J1939_TP_BAM_INTERVAL_MS
+#define J1939_TP_BAM_INTERVAL_MS    50    //time between BAM data packets, 50 to 200ms
+#endif
+
+#ifndef J1939_TP_DT_INTERVAL_MS
+#define J1939_TP_DT_INTERVAL_MS     2     //time between RTS/CTS data packets, keeps consecutive packets from
+#endif                                    //waiting in the CAN transmit buffers together, which may send them out of order
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////  Global variables
 
 //global variables containing unit's J1939 Address and Name
@@ -92,6 +137,61 @@ typedef struct _J1939_FLAGS_STRUCT {
 //global J1939 Flag structure variable
 J1939_FLAGS_STRUCT g_J1939Flags;
 
+#if J1939_SUBSCRIPTIONS > 0
+//J1939 PGN handler, Data is only valid until the handler returns
+typedef void (*J1939_HANDLER)(J1939_PDU_STRUCT *PDU, uint8_t *Data, uint16_t Length);
+
+//J1939 PGN subscription
+typedef struct _J1939_SUBSCRIPTION_STRUCT {
+   uint32_t Key;                 //PGN << 8 | Source Address, J1939_GLOBAL_ADDRESS for any source
+   J1939_HANDLER Handler;
+} J1939_SUBSCRIPTION_STRUCT;
+
+//global J1939 subscription table, sorted by Key
+J1939_SUBSCRIPTION_STRUCT g_J1939Subscriptions[J1939_SUBSCRIPTIONS];
+uint8_t g_J1939SubscriptionCount;
+#endif
+
+#if J1939_USE_TRANSPORT_PROTOCOL
+//J1939 Transport Protocol receive session, the message is reassembled in Data
+typedef struct _J1939_TP_RX_SESSION_STRUCT {
+   uint8_t  State;               //J1939_TP_RX_IDLE, J1939_TP_RX_RECEIVING, J1939_TP_RX_COMPLETE or J1939_TP_RX_DELIVERED
+   int1     Bam;                 //TRUE for a Broadcast Announce Message, FALSE for RTS/CTS
+   uint8_t  Source;              //address of sender
+   uint8_t  Destination;         //unit's address, or J1939_GLOBAL_ADDRESS for a BAM
+   uint8_t  Priority;
+   uint32_t PGN;
+   uint16_t Size;                //bytes in message
+   uint8_t  Packets;             //TP.DT packets in message
+   uint8_t  NextPacket;          //sequence number expected next
+   uint8_t  WindowEnd;           //last packet of current Clear To Send
+   uint8_t  MaxPackets;          //largest Clear To Send the sender accepts
+   J1939_TICK_TYPE Tick;         //time of last packet
+   J1939_TICK_TYPE Timeout;
+   uint8_t  Data[J1939_TP_MAX_SIZE];
+} J1939_TP_RX_SESSION_STRUCT;
+
+//J1939 Transport Protocol transmit session, Data points to the caller's buffer
+typedef struct _J1939_TP_TX_SESSION_STRUCT {
+   uint8_t  State;               //J1939_TP_TX_IDLE ... J1939_TP_TX_WAIT_ACK
+   uint8_t  Destination;         //receiver's address, or J1939_GLOBAL_ADDRESS for a BAM
+   uint8_t  Result;              //0 if last message was sent, otherwise the abort reason
+   uint32_t PGN;
+   uint8_t  *Data;
+   uint16_t Size;
+   uint8_t  Packets;
+   uint8_t  NextPacket;
+   uint8_t  WindowEnd;
+   J1939_TICK_TYPE Tick;
+   J1939_TICK_TYPE Timeout;
+} J1939_TP_TX_SESSION_STRUCT;
+
+//global J1939 Transport Protocol sessions, the receive sessions are the
+//reassembly buffer pool
+J1939_TP_RX_SESSION_STRUCT g_J1939TPReceive[J1939_TP_RECEIVE_SESSIONS];
+J1939_TP_TX_SESSION_STRUCT g_J1939TPXmit;
+#endif
+
 //global variable used in generating pseudo-random 8-bit number
 uint8_t rand_seed;
 
@@ -122,12 +222,41 @@ uint8_t rand_seed;
 #define J1939_TP_DT_PRIORITY           7
 
 //Defines used with Transport Protocol Messages (refer to J1939-21 for spec)
-#define J1939_TP_CM_CTS          16
+#define J1939_TP_CM_RTS          16
+#define J1939_TP_CM_CTS          17
 #define J1939_TP_CM_DTS          17
 #define J1939_TP_CM_EOF          19
 #define J1939_TP_CM_ABORT        255
 #define J1939_TP_CM_BAM          32
 
+//Transport Protocol Connection Abort reasons
+#define J1939_TP_ABORT_BUSY         1     //already in a session, can't support another
+#define J1939_TP_ABORT_RESOURCES    2     //not enough resources (message too large)
+#define J1939_TP_ABORT_TIMEOUT      3
+#define J1939_TP_ABORT_SEQUENCE     7     //bad sequence number
+
+//Transport Protocol timeouts in ms
+#define J1939_TP_T1                 750   //between data packets
+#define J1939_TP_T2                 1250  //from Clear To Send to data packet
+#define J1939_TP_T3                 1250  //from last data packet to Clear To Send or End Of Message Ack
+#define J1939_TP_T4                 1050  //from Clear To Send of 0 packets (hold) to next Clear To Send
+
+#define J1939_TP_TICKS(ms)          ((J1939_TICK_TYPE)(((uint32_t)J1939_TICKS_PER_SECOND * (ms)) / 1000))
+
+//Transport Protocol session states
+#define J1939_TP_RX_IDLE            0
+#define J1939_TP_RX_RECEIVING       1
+#define J1939_TP_RX_COMPLETE        2     //waiting for J1939TPGetMessage()
+#define J1939_TP_RX_DELIVERED       3     //waiting for J1939TPFreeMessage()
+
+#define J1939_TP_TX_IDLE            0
+#define J1939_TP_TX_BAM             1     //BAM TP.CM waiting to be sent
+#define J1939_TP_TX_RTS             2     //RTS TP.CM waiting to be sent
+#define J1939_TP_TX_BAM_DATA        3
+#define J1939_TP_TX_WAIT_CTS        4
+#define J1939_TP_TX_SEND_DATA       5
+#define J1939_TP_TX_WAIT_ACK        6
+
 //J1939 Address Defines
 #define J1939_NULL_ADDRESS       254
 #define J1939_GLOBAL_ADDRESS     255
@@ -357,6 +486,33 @@ void J1939HandleAddressRequest(J1939_PDU_STRUCT PDU);
 void J1939LoadReceiveBuffer(J1939_PDU_STRUCT ReceivedPDU,uint8_t *Data,uint8_t length);
 void J1939HandleAddressClaim(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Name);
 void J1939SetCANFilter(uint8_t address);
+uint32_t J1939LoadBroadcastFilters(uint32_t *Filter);
 uint8_t xor8(void);
 
+#if J1939_SUBSCRIPTIONS > 0
+int1 J1939Subscribe(uint32_t PGN, uint8_t Source, J1939_HANDLER Handler);
+void J1939Unsubscribe(uint32_t PGN, uint8_t Source);
+uint8_t J1939FindSubscription(uint32_t Key);
+int1 J1939Dispatch(J1939_PDU_STRUCT *PDU, uint8_t *Data, uint16_t Length);
+#endif
+
+#if J1939_USE_TRANSPORT_PROTOCOL
+int1 J1939TPPutMessage(J1939_PDU_STRUCT PDU, uint8_t *Data, uint16_t Bytes);
+int1 J1939TPXmitBusy(void);
+uint8_t J1939TPXmitResult(void);
+int1 J1939TPKbhit(void);
+uint8_t *J1939TPGetMessage(J1939_PDU_STRUCT &PDU, uint16_t &Length);
+void J1939TPFreeMessage(uint8_t *Data);
+void J1939TPLoadPDU(J1939_TP_RX_SESSION_STRUCT *Session, J1939_PDU_STRUCT *PDU);
+void J1939TPReceive(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data);
+void J1939TPHandleCM(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data);
+void J1939TPHandleDT(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data);
+void J1939TPOpen(J1939_PDU_STRUCT ReceivedPDU, uint8_t *Data);
+void J1939TPSendCTS(J1939_TP_RX_SESSION_STRUCT *Session);
+void J1939TPSendCM(uint8_t Destination, uint8_t Control, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4, uint32_t PGN);
+int1 J1939TPPutFrame(uint8_t Destination, uint8_t PDUFormat, uint8_t *Data);
+void J1939TPTimeoutTask(void);
+void J1939TPXmitTask(void);
+#endif
+
 #endif
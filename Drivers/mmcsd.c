@@ -5,7 +5,11 @@
 ////                                                                 ////
 //// --User Functions--                                              ////
 ////                                                                 ////
-//// mmcsd_init(): Initializes the media.                            ////
+//// mmcsd_init(): Initializes the media.  Pages changed in the      ////
+////  cache since an earlier mmcsd_init() are written back first; if ////
+////  that fails the error is returned and they are kept.  Call      ////
+////  mmcsd_cache_init() before it to throw them away instead, for   ////
+////  example after the card was swapped.                            ////
 ////                                                                 ////
 //// mmcsd_read_byte(a, p)                                           ////
 ////  Reads a byte from the MMC/SD card at location a, saves to      ////
@@ -17,15 +21,46 @@
 ////  error.                                                         ////
 ////                                                                 ////
 //// mmcsd_flush_buffer()                                            ////
-////  The two user write functions (mmcsd_write_byte() and           ////
-////  mmcsd_write_data()) maintain a buffer to speed up the writing  ////
-////  process.  Whenever a read or write is performed, the write     ////
-////  buffer is loaded with the specified page and only the          ////
-////  contents of this buffer is changed.  If any future writes      ////
-////  cross a page boundary then the buffer in RAM is written        ////
-////  to the MMC/SD and then the next page is loaded into the        ////
-////  buffer.  mmcsd_flush_buffer() forces the contents in RAM       ////
-////  to the MMC/SD card.  Returns 0 if OK, non-zero if errror.      ////
+////  The byte and data read/write functions go through a cache of   ////
+////  MMCSD_CACHE_SECTORS pages in RAM.  Whenever a read or write is ////
+////  performed, the page is loaded into the cache (if it isn't      ////
+////  there already) and only the cached copy is changed.  When a    ////
+////  new page is needed the least recently used page is replaced,   ////
+////  and written back to the MMC/SD first if it was changed.        ////
+////  mmcsd_flush_buffer() forces every changed page in RAM to the   ////
+////  MMC/SD card.  Returns 0 if OK, non-zero if errror.             ////
+////                                                                 ////
+//// mmcsd_cache_pin(a)                                              ////
+////  Loads the page holding address a into the cache and keeps it   ////
+////  there; pinned pages are only replaced when every page in the   ////
+////  cache is pinned.  Useful for FAT and directory pages that get  ////
+////  revisited between data pages.  Returns 0 if OK, non-zero if    ////
+////  error.                                                         ////
+////                                                                 ////
+//// mmcsd_cache_unpin(a)                                            ////
+////  Lets the page holding address a be replaced again.             ////
+////                                                                 ////
+//// MMCSD_CACHE_SECTORS (default 1) sets how many 512 byte pages    ////
+//// are cached.  3 keeps a FAT page, a directory page and a data    ////
+//// page in RAM at once.  If MMCSD_CACHE_STATS is defined the hits  ////
+//// and misses are counted in g_mmcsd_cache_hits and                ////
+//// g_mmcsd_cache_misses so the cache can be sized for a device.    ////
+////                                                                 ////
+//// MMCSD_STATS, if defined, counts the traffic to the card so the  ////
+//// cost of a file system operation can be measured:                ////
+////    g_mmcsd_spi_bytes      bytes clocked over SPI                ////
+////    g_mmcsd_cmds           commands sent                         ////
+////    g_mmcsd_busy_polls     bytes spent waiting for the card to   ////
+////                           finish programming                    ////
+////    g_mmcsd_blocks_read    512 byte blocks read                  ////
+////    g_mmcsd_blocks_written 512 byte blocks written               ////
+//// mmcsd_stats_reset() zeroes them.  Bus time is roughly           ////
+//// g_mmcsd_spi_bytes * 8 / SPI clock.                              ////
+////                                                                 ////
+//// MMCSD_SPI_XFER(x) can be defined before including this file to  ////
+//// move the card somewhere else than the SPI peripheral, for       ////
+//// example a model of a card that runs on a PC.  It has to send x  ////
+//// and return the byte received at the same time.                  ////
 ////                                                                 ////
 //// mmcsd_write_byte(a, d)                                          ////
 ////  Writes data byte d to the MMC/SD address a.  Intelligently     ////
@@ -54,6 +89,40 @@
 ////  more effecient to use mmcsd_write_data() or mmcsd_write_byte().////
 ////  Returns 0 if successful, non-zero if error.                    ////
 ////                                                                 ////
+//// mmcsd_read_blocks(a, n, cb)                                     ////
+////  Reads n consecutive blocks starting at block aligned address a ////
+////  with one READ_MULTIPLE_BLOCK command.  cb(i) is called before  ////
+////  block i and returns where to put its 512 bytes, or NULL to     ////
+////  stop early.  Returns 0 if successful, non-zero if error.       ////
+////                                                                 ////
+//// mmcsd_write_blocks(a, n, cb)                                    ////
+////  Writes n consecutive blocks starting at block aligned address  ////
+////  a with one WRITE_MULTIPLE_BLOCK command.  cb(i) is called      ////
+////  before block i and returns where its 512 bytes come from, or   ////
+////  NULL to stop early.  Returns 0 if successful, non-zero if      ////
+////  error.                                                         ////
+////                                                                 ////
+//// mmcsd_write_blocks_preerase(a, n, cb)                           ////
+////  Same as mmcsd_write_blocks(), but SD cards are first told      ////
+////  (ACMD23) to erase all n blocks, which makes long writes        ////
+////  faster.  Pre-erased blocks that are not written have undefined ////
+////  contents, so only use it when cb supplies every block.  If cb  ////
+////  returns NULL anyway the write stops and MMCSD_PARAM_ERR is     ////
+////  returned.                                                      ////
+////                                                                 ////
+//// mmcsd_clear_blocks(a, n)                                        ////
+////  Same as mmcsd_write_blocks_preerase() but writes zeros, so no  ////
+////  source buffer is needed.                                       ////
+////                                                                 ////
+////  The multiple block functions don't go through the RAM buffer.  ////
+////  It is flushed before the transfer and reloaded afterwards if   ////
+////  it holds one of the written blocks.                            ////
+////                                                                 ////
+////  The write functions read the card status (CMD13) at the end,   ////
+////  so a block the card failed to program is reported even if its  ////
+////  data response was good.  After an error, ACMD22 gives the      ////
+////  number of blocks that were written.                            ////
+////                                                                 ////
 //// mmcsd_print_cid(): Displays all data in the Card Identification ////
 ////                     Register. Note this only works on SD cards. ////
 ////                                                                 ////
@@ -79,6 +148,10 @@
 ////                   works on SD cards and is used just before any ////
 ////                   SD-only command (e.g. send_op_cond()).        ////
 //// mmcsd_read_ocr(): Sends the READ_OCR command to the SD/MMC.     ////
+//// mmcsd_stop_transmission(): Sends the STOP_TRANSMISSION command  ////
+////                      and waits for the card to go not busy.     ////
+//// mmcsd_set_wr_blk_erase_count(): Sends the SET_WR_BLK_ERASE_COUNT////
+////                      command to the SD.  Must follow APP_CMD.   ////
 //// mmcsd_crc_on_off(): Sends the CRC_ON_OFF command to the SD/MMC  ////
 ////                      along with a bit to turn the CRC on/off.   ////
 //// mmcsd_send_cmd(): Sends a command and argument to the SD/MMC.   ////
@@ -135,6 +208,15 @@
    #define MMCSD_SPI_XFER(x)  spi_xfer(mmcsd_spi, x)
 #endif
 
+// every transfer in this driver goes through MMCSD_XFER() so it can be counted
+#ifdef MMCSD_STATS
+   #define MMCSD_XFER(x)         mmcsd_stats_xfer(x)
+   #define MMCSD_STATS_INC(v)    v++
+#else
+   #define MMCSD_XFER(x)         MMCSD_SPI_XFER(x)
+   #define MMCSD_STATS_INC(v)
+#endif
+
 ////////////////////////
 ////                ////
 //// Useful Defines ////
@@ -157,11 +239,15 @@ enum MMCSD_err
 #define SEND_IF_COND 8
 #define SEND_CSD 9
 #define SEND_CID 10
+#define STOP_TRANSMISSION 12
 #define SD_STATUS 13
 #define SEND_STATUS 13
 #define SET_BLOCKLEN 16
 #define READ_SINGLE_BLOCK 17
+#define READ_MULTIPLE_BLOCK 18
+#define SET_WR_BLK_ERASE_COUNT 23
 #define WRITE_BLOCK 24
+#define WRITE_MULTIPLE_BLOCK 25
 #define SD_SEND_OP_COND 41
 #define APP_CMD 55
 #define READ_OCR 58
@@ -169,24 +255,61 @@ enum MMCSD_err
 
 #define IDLE_TOKEN 0x01
 #define DATA_START_TOKEN 0xFE
+#define MULTI_DATA_START_TOKEN 0xFC
+#define STOP_TRAN_TOKEN 0xFD
 
 #define MMCSD_MAX_BLOCK_SIZE 512
 
+#ifndef MMCSD_CACHE_SECTORS
+   #define MMCSD_CACHE_SECTORS 1
+#endif
+
+// g_mmcsd_cache_flags
+#define MMCSD_CACHE_VALID  0x01
+#define MMCSD_CACHE_DIRTY  0x02
+#define MMCSD_CACHE_PINNED 0x04
+
 ////////////////////////
 ///                  ///
 /// Global Variables ///
 ///                  ///
 ////////////////////////
 
-uint8_t g_mmcsd_buffer[MMCSD_MAX_BLOCK_SIZE];
+uint8_t g_mmcsd_cache[MMCSD_CACHE_SECTORS][MMCSD_MAX_BLOCK_SIZE];
+uint32_t g_mmcsd_cache_addr[MMCSD_CACHE_SECTORS];
+uint8_t g_mmcsd_cache_flags[MMCSD_CACHE_SECTORS];
+uint8_t g_mmcsd_cache_lru[MMCSD_CACHE_SECTORS];   // page numbers, most recently used first
+
+#ifdef MMCSD_CACHE_STATS
+uint32_t
+   g_mmcsd_cache_hits,
+   g_mmcsd_cache_misses;
+#endif
+
+#ifdef MMCSD_STATS
+uint32_t
+   g_mmcsd_spi_bytes,
+   g_mmcsd_cmds,
+   g_mmcsd_busy_polls,
+   g_mmcsd_blocks_read,
+   g_mmcsd_blocks_written;
+#endif
 
 int1 g_CRC_enabled;
-int1 g_MMCSDBufferChanged;
 
+// mmcsd_cache_init() has run, so the cache flags can be trusted
+int1 g_mmcsd_cache_ready = FALSE;
+
+// the page that was used last, checked first on every byte access
+uint8_t g_mmcsd_cur;
+uint8_t* g_mmcsd_buffer;
 uint32_t g_mmcsdBufferAddress;
 
 enum _card_type{SD, MMC} g_card_type;
 
+// called by mmcsd_read_blocks()/mmcsd_write_blocks*() for every block
+typedef uint8_t* (*MMCSD_BLOCK_CALLBACK)(uint16_t block);
+
 /////////////////////////////
 ////                     ////
 //// Function Prototypes ////
@@ -198,6 +321,10 @@ MMCSD_err mmcsd_read_data(uint32_t address, uint16_t size, uint8_t* ptr);
 MMCSD_err mmcsd_read_block(uint32_t address, uint16_t size, uint8_t* ptr);
 MMCSD_err mmcsd_write_data(uint32_t address, uint16_t size, uint8_t* ptr);
 MMCSD_err mmcsd_write_block(uint32_t address, uint16_t size, uint8_t* ptr);
+MMCSD_err mmcsd_read_blocks(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb);
+MMCSD_err mmcsd_write_blocks(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb);
+MMCSD_err mmcsd_write_blocks_preerase(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb);
+MMCSD_err mmcsd_clear_blocks(uint32_t address, uint16_t count);
 MMCSD_err mmcsd_go_idle_state(void);
 MMCSD_err mmcsd_send_op_cond(void);
 MMCSD_err mmcsd_send_if_cond(uint8_t r7[]);
@@ -208,6 +335,10 @@ MMCSD_err mmcsd_send_status(uint8_t r2[]);
 MMCSD_err mmcsd_set_blocklen(uint32_t blocklen);
 MMCSD_err mmcsd_read_single_block(uint32_t address);
 MMCSD_err mmcsd_write_single_block(uint32_t address);
+MMCSD_err mmcsd_read_multiple_block(uint32_t address);
+MMCSD_err mmcsd_write_multiple_block(uint32_t address);
+MMCSD_err mmcsd_stop_transmission(void);
+MMCSD_err mmcsd_set_wr_blk_erase_count(uint32_t count);
 MMCSD_err mmcsd_sd_send_op_cond(void);
 MMCSD_err mmcsd_app_cmd(void);
 MMCSD_err mmcsd_read_ocr(uint8_t* r1);
@@ -218,6 +349,7 @@ MMCSD_err mmcsd_get_r2(uint8_t r2[]);
 MMCSD_err mmcsd_get_r3(uint8_t r3[]);
 MMCSD_err mmcsd_get_r7(uint8_t r7[]);
 MMCSD_err mmcsd_wait_for_token(uint8_t token);
+void mmcsd_wait_busy(void);
 uint8_t mmcsd_crc7(char *data, uint8_t length);
 uint16_t mmcsd_crc16(char *data, uint8_t length);
 void mmcsd_select();
@@ -228,6 +360,16 @@ void mmcsd_deselect();
 MMCSD_err mmcsd_load_buffer(void);
 MMCSD_err mmcsd_flush_buffer(void);
 MMCSD_err mmcsd_move_buffer(uint32_t new_addr);
+MMCSD_err mmcsd_cache_pin(uint32_t addr);
+void mmcsd_cache_unpin(uint32_t addr);
+void mmcsd_cache_init(void);
+void mmcsd_stats_reset(void);
+#ifdef MMCSD_STATS
+uint8_t mmcsd_stats_xfer(uint8_t data);
+#endif
+void mmcsd_cache_select(uint8_t page);
+uint8_t mmcsd_cache_victim(void);
+MMCSD_err mmcsd_cache_write_back(uint8_t page);
 MMCSD_err mmcsd_read_byte(uint32_t addr, char* data);
 MMCSD_err mmcsd_write_byte(uint32_t addr, char data);
 
@@ -243,8 +385,17 @@ MMCSD_err mmcsd_init()
       i,
       r1;
 
+   // don't lose what an earlier session left in the cache
+   if(g_mmcsd_cache_ready)
+   {
+      r1 = mmcsd_flush_buffer();
+      if(r1 != MMCSD_GOODEC)
+         return r1;
+   }
+
    g_CRC_enabled = TRUE;
-   g_mmcsdBufferAddress = 0;
+   mmcsd_cache_init();
+   mmcsd_stats_reset();
 
   #if defined(MMCSD_PIN_SCL)
    output_drive(MMCSD_PIN_SCL);
@@ -338,7 +489,7 @@ MMCSD_err mmcsd_init()
    }
    mmcsd_deselect();
 
-   r1 = mmcsd_load_buffer();
+   r1 = mmcsd_move_buffer(0);
 
    return r1;
 }
@@ -382,12 +533,13 @@ MMCSD_err mmcsd_read_block(uint32_t address, uint16_t size, uint8_t* ptr)
    
    // read in the data
    for(i = 0; i < size; i += 1)
-      ptr[i] = MMCSD_SPI_XFER(0xFF);
+      ptr[i] = MMCSD_XFER(0xFF);
+   MMCSD_STATS_INC(g_mmcsd_blocks_read);
 
    if(g_CRC_enabled)
    {
       /* check the crc */
-      if(make16(MMCSD_SPI_XFER(0xFF), MMCSD_SPI_XFER(0xFF)) != mmcsd_crc16(g_mmcsd_buffer, MMCSD_MAX_BLOCK_SIZE))
+      if(make16(MMCSD_XFER(0xFF), MMCSD_XFER(0xFF)) != mmcsd_crc16(ptr, MMCSD_MAX_BLOCK_SIZE))
       {
          mmcsd_deselect();
          return MMCSD_CRC_ERR;
@@ -396,8 +548,8 @@ MMCSD_err mmcsd_read_block(uint32_t address, uint16_t size, uint8_t* ptr)
    else
    {
       /* have the card transmit the CRC, but ignore it */
-      MMCSD_SPI_XFER(0xFF);
-      MMCSD_SPI_XFER(0xFF);
+      MMCSD_XFER(0xFF);
+      MMCSD_XFER(0xFF);
    }
    mmcsd_deselect();
 
@@ -434,21 +586,22 @@ MMCSD_err mmcsd_write_block(uint32_t address, uint16_t size, uint8_t* ptr)
    }
    
    // send a data start token
-   MMCSD_SPI_XFER(DATA_START_TOKEN);
+   MMCSD_XFER(DATA_START_TOKEN);
    
    // send all the data
    for(i = 0; i < size; i += 1)
    {
-      MMCSD_SPI_XFER(ptr[i]);
+      MMCSD_XFER(ptr[i]);
    }
+   MMCSD_STATS_INC(g_mmcsd_blocks_written);
 
    // if the CRC is enabled we have to calculate it, otherwise just send an 0xFFFF
    if(g_CRC_enabled)
-      MMCSD_SPI_XFER(mmcsd_crc16(ptr, size));
+      MMCSD_XFER(mmcsd_crc16(ptr, size));
    else
    {
-      MMCSD_SPI_XFER(0xFF);
-      MMCSD_SPI_XFER(0xFF);
+      MMCSD_XFER(0xFF);
+      MMCSD_XFER(0xFF);
    }
    
    // get the error code back from the card; "data accepted" is 0bXXX00101
@@ -460,12 +613,215 @@ MMCSD_err mmcsd_write_block(uint32_t address, uint16_t size, uint8_t* ptr)
    }
    
    // wait for the line to go back high, this indicates that the write is complete
-   while(MMCSD_SPI_XFER(0xFF) == 0);
+   mmcsd_wait_busy();
    mmcsd_deselect();
 
    return MMCSD_GOODEC;
 }
 
+MMCSD_err mmcsd_read_blocks(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb)
+{
+   MMCSD_err ec;
+   uint16_t
+      block,
+      i;
+   uint8_t* ptr;
+
+   // the cache may hold data that hasn't made it to the card yet
+   ec = mmcsd_flush_buffer();
+   if(ec != MMCSD_GOODEC)
+      return ec;
+
+   // send command
+   mmcsd_select();
+   ec = mmcsd_read_multiple_block(address);
+   if(ec != MMCSD_GOODEC)
+   {
+      mmcsd_deselect();
+      return ec;
+   }
+
+   // the card streams one data packet after another until told to stop
+   for(block = 0; block < count; block++)
+   {
+      ptr = cb(block);
+      if(ptr == NULL)
+         break;
+
+      ec = mmcsd_wait_for_token(DATA_START_TOKEN);
+      if(ec != MMCSD_GOODEC)
+         break;
+
+      for(i = 0; i < MMCSD_MAX_BLOCK_SIZE; i += 1)
+         ptr[i] = MMCSD_XFER(0xFF);
+      MMCSD_STATS_INC(g_mmcsd_blocks_read);
+
+      if(g_CRC_enabled)
+      {
+         /* check the crc */
+         if(make16(MMCSD_XFER(0xFF), MMCSD_XFER(0xFF)) != mmcsd_crc16(ptr, MMCSD_MAX_BLOCK_SIZE))
+         {
+            ec = MMCSD_CRC_ERR;
+            break;
+         }
+      }
+      else
+      {
+         /* have the card transmit the CRC, but ignore it */
+         MMCSD_XFER(0xFF);
+         MMCSD_XFER(0xFF);
+      }
+   }
+
+   mmcsd_stop_transmission();
+   mmcsd_deselect();
+
+   return ec;
+}
+
+// shared by the mmcsd_write_blocks() functions and mmcsd_clear_blocks(), a NULL
+//  cb writes zeros
+MMCSD_err mmcsd_stream_blocks(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb, int1 pre_erase)
+{
+   MMCSD_err
+      ec,
+      r1;
+   uint16_t
+      block,
+      i;
+   uint8_t* ptr;
+   uint8_t status[2];
+
+   ec = mmcsd_flush_buffer();
+   if(ec != MMCSD_GOODEC)
+      return ec;
+
+   // tell an SD card how many blocks are coming so it can erase them up front,
+   //  only done when the caller has promised to write every one of them
+   if(pre_erase && (g_card_type == SD))
+   {
+      mmcsd_select();
+      mmcsd_app_cmd();
+      mmcsd_set_wr_blk_erase_count(count);
+      mmcsd_deselect();
+   }
+
+   // send command
+   mmcsd_select();
+   ec = mmcsd_write_multiple_block(address);
+   if(ec != MMCSD_GOODEC)
+   {
+      mmcsd_deselect();
+      return ec;
+   }
+
+   for(block = 0; block < count; block++)
+   {
+      ptr = NULL;
+      if(cb != NULL)
+      {
+         ptr = cb(block);
+         if(ptr == NULL)
+         {
+            // the rest of the pre-erased range is now garbage
+            if(pre_erase)
+               ec = MMCSD_PARAM_ERR;
+            break;
+         }
+      }
+
+      // send a data start token
+      MMCSD_XFER(MULTI_DATA_START_TOKEN);
+
+      // send all the data
+      if(ptr == NULL)
+      {
+         for(i = 0; i < MMCSD_MAX_BLOCK_SIZE; i += 1)
+            MMCSD_XFER(0);
+      }
+      else
+      {
+         for(i = 0; i < MMCSD_MAX_BLOCK_SIZE; i += 1)
+            MMCSD_XFER(ptr[i]);
+      }
+
+      // CRCs are turned off by mmcsd_init(), the card ignores these two bytes
+      MMCSD_XFER(0xFF);
+      MMCSD_XFER(0xFF);
+      MMCSD_STATS_INC(g_mmcsd_blocks_written);
+
+      // get the error code back from the card; "data accepted" is 0bXXX00101
+      r1 = mmcsd_get_r1();
+      if(r1 & 0x0A)
+      {
+         ec = r1;
+         break;
+      }
+
+      // the card only holds the line low here while its write buffer is full,
+      //  programming goes on in the background while the next block is sent
+      mmcsd_wait_busy();
+   }
+
+   // end the transfer and wait for the card to finish programming.  In SPI
+   //  mode a multiple block write is ended with the stop token, also after a
+   //  rejected block; CMD12 only ends reads.
+   MMCSD_XFER(STOP_TRAN_TOKEN);
+   MMCSD_XFER(0xFF);
+   mmcsd_wait_busy();
+
+   // programming errors only show up in the card status, and reading it
+   //  clears the error left by a rejected block
+   mmcsd_send_status(status);
+   mmcsd_deselect();
+
+   if(ec == MMCSD_GOODEC)
+   {
+      if(status[1] != MMCSD_GOODEC)
+         ec = status[1];
+      else if(status[0] & 0xA0)           // out of range or write protect violation
+         ec = MMCSD_ADDR_ERR;
+      else if(status[0] != 0)
+         ec = MMCSD_PARAM_ERR;
+   }
+
+   // reload any cached pages we just wrote over
+   for(i = 0; i < MMCSD_CACHE_SECTORS; i++)
+   {
+      if((g_mmcsd_cache_flags[i] & MMCSD_CACHE_VALID)
+         && (g_mmcsd_cache_addr[i] >= address)
+         && (g_mmcsd_cache_addr[i] < (address + ((uint32_t)count * MMCSD_MAX_BLOCK_SIZE))))
+      {
+         r1 = mmcsd_read_block(g_mmcsd_cache_addr[i], MMCSD_MAX_BLOCK_SIZE, g_mmcsd_cache[i]);
+         if(r1 != MMCSD_GOODEC)
+         {
+            g_mmcsd_cache_flags[i] = 0;
+            if(i == g_mmcsd_cur)
+               g_mmcsdBufferAddress = 0xFFFFFFFF;
+            if(ec == MMCSD_GOODEC)
+               ec = r1;
+         }
+      }
+   }
+
+   return ec;
+}
+
+MMCSD_err mmcsd_write_blocks(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb)
+{
+   return mmcsd_stream_blocks(address, count, cb, FALSE);
+}
+
+MMCSD_err mmcsd_write_blocks_preerase(uint32_t address, uint16_t count, MMCSD_BLOCK_CALLBACK cb)
+{
+   return mmcsd_stream_blocks(address, count, cb, TRUE);
+}
+
+MMCSD_err mmcsd_clear_blocks(uint32_t address, uint16_t count)
+{
+   return mmcsd_stream_blocks(address, count, NULL, TRUE);
+}
+
 MMCSD_err mmcsd_go_idle_state(void)
 {
    mmcsd_send_cmd(GO_IDLE_STATE, 0);
@@ -515,7 +871,7 @@ MMCSD_err mmcsd_print_csd()
    }
 
    for(i = 0; i < 16; i++)
-      buf[i] = MMCSD_SPI_XFER(0xFF);
+      buf[i] = MMCSD_XFER(0xFF);
    mmcsd_deselect();
 /*
    printf("\r\nCSD_STRUCTURE: %X", (buf[0] & 0x0C) >> 2);
@@ -578,7 +934,7 @@ MMCSD_err mmcsd_print_cid()
    }
    
    for(i = 0; i < 16; i++)
-      buf[i] = MMCSD_SPI_XFER(0xFF);
+      buf[i] = MMCSD_XFER(0xFF);
    mmcsd_deselect();
    /*
    printf("\r\nManufacturer ID: %X", buf[0]);
@@ -605,7 +961,7 @@ MMCSD_err mmcsd_sd_status(uint8_t r2[])
    mmcsd_send_cmd(SD_STATUS, 0);
 
    for(i = 0; i < 64; i++)
-      MMCSD_SPI_XFER(0xFF);      
+      MMCSD_XFER(0xFF);      
 
    mmcsd_deselect();
 
@@ -640,6 +996,44 @@ MMCSD_err mmcsd_write_single_block(uint32_t address)
    return mmcsd_get_r1();
 }
 
+MMCSD_err mmcsd_read_multiple_block(uint32_t address)
+{
+   mmcsd_send_cmd(READ_MULTIPLE_BLOCK, address);
+
+   return mmcsd_get_r1();
+}
+
+MMCSD_err mmcsd_write_multiple_block(uint32_t address)
+{
+   mmcsd_send_cmd(WRITE_MULTIPLE_BLOCK, address);
+
+   return mmcsd_get_r1();
+}
+
+MMCSD_err mmcsd_stop_transmission(void)
+{
+   MMCSD_err r1;
+
+   mmcsd_send_cmd(STOP_TRANSMISSION, 0);
+
+   // skip the stuff byte that follows the command
+   MMCSD_XFER(0xFF);
+
+   r1 = mmcsd_get_r1();
+
+   // R1b, wait for the busy signal to go away
+   mmcsd_wait_busy();
+
+   return r1;
+}
+
+MMCSD_err mmcsd_set_wr_blk_erase_count(uint32_t count)
+{
+   mmcsd_send_cmd(SET_WR_BLK_ERASE_COUNT, count);
+
+   return mmcsd_get_r1();
+}
+
 MMCSD_err mmcsd_sd_send_op_cond(void)
 {
    mmcsd_send_cmd(SD_SEND_OP_COND, 0);
@@ -688,13 +1082,15 @@ MMCSD_err mmcsd_send_cmd(uint8_t cmd, uint32_t arg)
    else
       packet[5] = 0xFF;
 
+   MMCSD_STATS_INC(g_mmcsd_cmds);
+
    // transfer the command and argument, with an extra 0xFF hacked in there
-   MMCSD_SPI_XFER(packet[0]);
-   MMCSD_SPI_XFER(packet[1]);
-   MMCSD_SPI_XFER(packet[2]);
-   MMCSD_SPI_XFER(packet[3]);
-   MMCSD_SPI_XFER(packet[4]);
-   MMCSD_SPI_XFER(packet[5]);
+   MMCSD_XFER(packet[0]);
+   MMCSD_XFER(packet[1]);
+   MMCSD_XFER(packet[2]);
+   MMCSD_XFER(packet[3]);
+   MMCSD_XFER(packet[4]);
+   MMCSD_XFER(packet[5]);
 //!   spi_write2(packet[0]);
 //!   spi_write2(packet[1]);
 //!   spi_write2(packet[2]);
@@ -717,8 +1113,8 @@ MMCSD_err mmcsd_get_r1(void)
    {
       // read what's on the SPI line
       //  the SD/MMC requires that you leave the line high when you're waiting for data from it
-      response = MMCSD_SPI_XFER(0xFF);
-      //response = MMCSD_SPI_XFER(0x00);//leave the line idle
+      response = MMCSD_XFER(0xFF);
+      //response = MMCSD_XFER(0x00);//leave the line idle
       
       // check to see if we got a response
       if(response != 0xFF)
@@ -740,7 +1136,7 @@ MMCSD_err mmcsd_get_r2(uint8_t r2[])
 {
    r2[1] = mmcsd_get_r1();
    
-   r2[0] = MMCSD_SPI_XFER(0xFF);
+   r2[0] = MMCSD_XFER(0xFF);
    
    return 0;
 }
@@ -759,7 +1155,7 @@ MMCSD_err mmcsd_get_r7(uint8_t r7[])
    
    // fill in the other 4 bytes
    for(i = 0; i < 4; i++)
-      r7[3 - i] = MMCSD_SPI_XFER(0xFF);
+      r7[3 - i] = MMCSD_XFER(0xFF);
 
    return r7[4];
 }
@@ -779,6 +1175,13 @@ MMCSD_err mmcsd_wait_for_token(uint8_t token)
    return r1;   
 }
 
+// waits for the card to let go of the data line after programming
+void mmcsd_wait_busy(void)
+{
+   while(MMCSD_XFER(0xFF) == 0)
+      MMCSD_STATS_INC(g_mmcsd_busy_polls);
+}
+
 unsigned int8 mmcsd_crc7(char *data,uint8_t length)
 {
    uint8_t i, ibit, c, crc;
@@ -838,57 +1241,202 @@ void mmcsd_select()
 
 void mmcsd_deselect()
 {
-   MMCSD_SPI_XFER(0xFF);
+   MMCSD_XFER(0xFF);
    output_high(MMCSD_PIN_SELECT);
 }
 
+void mmcsd_cache_init(void)
+{
+   uint8_t i;
+
+   for(i = 0; i < MMCSD_CACHE_SECTORS; i++)
+   {
+      g_mmcsd_cache_flags[i] = 0;
+      g_mmcsd_cache_lru[i] = i;
+   }
+
+   g_mmcsd_cur = 0;
+   g_mmcsd_buffer = g_mmcsd_cache[0];
+   g_mmcsdBufferAddress = 0xFFFFFFFF;   // never matches a block address
+   g_mmcsd_cache_ready = TRUE;
+
+#ifdef MMCSD_CACHE_STATS
+   g_mmcsd_cache_hits = 0;
+   g_mmcsd_cache_misses = 0;
+#endif
+}
+
+void mmcsd_stats_reset(void)
+{
+#ifdef MMCSD_STATS
+   g_mmcsd_spi_bytes = 0;
+   g_mmcsd_cmds = 0;
+   g_mmcsd_busy_polls = 0;
+   g_mmcsd_blocks_read = 0;
+   g_mmcsd_blocks_written = 0;
+#endif
+}
+
+#ifdef MMCSD_STATS
+uint8_t mmcsd_stats_xfer(uint8_t data)
+{
+   g_mmcsd_spi_bytes++;
+   return MMCSD_SPI_XFER(data);
+}
+#endif
+
+void mmcsd_cache_select(uint8_t page)
+{
+   uint8_t i;
+
+   g_mmcsd_cur = page;
+   g_mmcsd_buffer = g_mmcsd_cache[page];
+   g_mmcsdBufferAddress = g_mmcsd_cache_addr[page];
+
+   // move the page to the front of the LRU list
+   for(i = 0; g_mmcsd_cache_lru[i] != page; i++);
+   for(; i > 0; i--)
+      g_mmcsd_cache_lru[i] = g_mmcsd_cache_lru[i - 1];
+   g_mmcsd_cache_lru[0] = page;
+}
+
+uint8_t mmcsd_cache_victim(void)
+{
+   uint8_t
+      i,
+      page;
+
+   // an empty page if there is one, otherwise the least recently used unpinned page
+   for(i = 0; i < MMCSD_CACHE_SECTORS; i++)
+      if(!(g_mmcsd_cache_flags[i] & MMCSD_CACHE_VALID))
+         return i;
+
+   i = MMCSD_CACHE_SECTORS;
+   do
+   {
+      i--;
+      page = g_mmcsd_cache_lru[i];
+      if(!(g_mmcsd_cache_flags[page] & MMCSD_CACHE_PINNED))
+         return page;
+   } while(i);
+
+   // everything is pinned
+   return g_mmcsd_cache_lru[MMCSD_CACHE_SECTORS - 1];
+}
+
+MMCSD_err mmcsd_cache_write_back(uint8_t page)
+{
+   MMCSD_err ec;
+
+   if(g_mmcsd_cache_flags[page] & MMCSD_CACHE_DIRTY)
+   {
+      ec = mmcsd_write_block(g_mmcsd_cache_addr[page], MMCSD_MAX_BLOCK_SIZE, g_mmcsd_cache[page]);
+      if(ec != MMCSD_GOODEC)
+         return ec;
+      g_mmcsd_cache_flags[page] &= ~MMCSD_CACHE_DIRTY;
+   }
+   return MMCSD_GOODEC;
+}
+
 MMCSD_err mmcsd_load_buffer(void)
 {
-   g_MMCSDBufferChanged = FALSE;
-   return(mmcsd_read_block(g_mmcsdBufferAddress, MMCSD_MAX_BLOCK_SIZE, g_mmcsd_buffer));
+   MMCSD_err ec;
+
+   g_mmcsd_cache_flags[g_mmcsd_cur] &= MMCSD_CACHE_PINNED;
+   ec = mmcsd_read_block(g_mmcsdBufferAddress, MMCSD_MAX_BLOCK_SIZE, g_mmcsd_buffer);
+   if(ec == MMCSD_GOODEC)
+      g_mmcsd_cache_flags[g_mmcsd_cur] |= MMCSD_CACHE_VALID;
+   else
+      g_mmcsdBufferAddress = 0xFFFFFFFF;
+   return ec;
 }
 
 MMCSD_err mmcsd_flush_buffer(void)
 {
-   if (g_MMCSDBufferChanged)
+   MMCSD_err ec;
+   uint8_t i;
+
+   for(i = 0; i < MMCSD_CACHE_SECTORS; i++)
    {
-      g_MMCSDBufferChanged = FALSE;
-      return(mmcsd_write_block(g_mmcsdBufferAddress, MMCSD_MAX_BLOCK_SIZE, g_mmcsd_buffer));
+      ec = mmcsd_cache_write_back(i);
+      if(ec != MMCSD_GOODEC)
+         return ec;
    }
    return(0);  //ok
 }
 
 MMCSD_err mmcsd_move_buffer(uint32_t new_addr)
 {
-   MMCSD_err ec = MMCSD_GOODEC;
-   uint32_t
-      //cur_block,
-      new_block;
+   MMCSD_err ec;
+   uint32_t new_block;
+   uint8_t i;
    
-   // make sure we're still on the same block
-   //cur_block = g_mmcsdBufferAddress - (g_mmcsdBufferAddress % MMCSD_MAX_BLOCK_SIZE);
    new_block = new_addr - (new_addr % MMCSD_MAX_BLOCK_SIZE);
    
-   //if(cur_block != new_block)
-   if(g_mmcsdBufferAddress != new_block)
+   // most accesses land in the same page as the last one
+   if(g_mmcsdBufferAddress == new_block)
+   {
+   #ifdef MMCSD_CACHE_STATS
+      g_mmcsd_cache_hits++;
+   #endif
+      return MMCSD_GOODEC;
+   }
+
+#if MMCSD_CACHE_SECTORS > 1
+   for(i = 0; i < MMCSD_CACHE_SECTORS; i++)
    {
-      // dump the old buffer
-      if (g_MMCSDBufferChanged)
+      if((g_mmcsd_cache_flags[i] & MMCSD_CACHE_VALID) && (g_mmcsd_cache_addr[i] == new_block))
       {
-         ec = mmcsd_flush_buffer();
-         if(ec != MMCSD_GOODEC)
-            return ec;
-         g_MMCSDBufferChanged = FALSE;
+      #ifdef MMCSD_CACHE_STATS
+         g_mmcsd_cache_hits++;
+      #endif
+         mmcsd_cache_select(i);
+         return MMCSD_GOODEC;
       }
-         
-      // figure out the best place for a block
-      g_mmcsdBufferAddress = new_block;
-
-      // load up a new buffer
-      ec = mmcsd_load_buffer();
    }
-   
-   return ec;
+#endif
+
+#ifdef MMCSD_CACHE_STATS
+   g_mmcsd_cache_misses++;
+#endif
+
+   // dump the page we're replacing
+   i = mmcsd_cache_victim();
+   ec = mmcsd_cache_write_back(i);
+   if(ec != MMCSD_GOODEC)
+      return ec;
+
+   // load up the new page
+   g_mmcsd_cache_addr[i] = new_block;
+   g_mmcsd_cache_flags[i] = 0;
+   mmcsd_cache_select(i);
+
+   return mmcsd_load_buffer();
+}
+
+MMCSD_err mmcsd_cache_pin(uint32_t addr)
+{
+   MMCSD_err ec;
+
+   ec = mmcsd_move_buffer(addr);
+   if(ec != MMCSD_GOODEC)
+      return ec;
+
+   g_mmcsd_cache_flags[g_mmcsd_cur] |= MMCSD_CACHE_PINNED;
+
+   return MMCSD_GOODEC;
+}
+
+void mmcsd_cache_unpin(uint32_t addr)
+{
+   uint32_t block;
+   uint8_t i;
+
+   block = addr - (addr % MMCSD_MAX_BLOCK_SIZE);
+
+   for(i = 0; i < MMCSD_CACHE_SECTORS; i++)
+      if(g_mmcsd_cache_addr[i] == block)
+         g_mmcsd_cache_flags[i] &= ~MMCSD_CACHE_PINNED;
 }
 
 MMCSD_err mmcsd_read_byte(uint32_t addr, char* data)
@@ -915,7 +1463,7 @@ MMCSD_err mmcsd_write_byte(uint32_t addr, char data)
    
    g_mmcsd_buffer[addr % MMCSD_MAX_BLOCK_SIZE] = data;
    
-   g_MMCSDBufferChanged = TRUE;
+   g_mmcsd_cache_flags[g_mmcsd_cur] |= MMCSD_CACHE_DIRTY;
 
    return MMCSD_GOODEC;
 }
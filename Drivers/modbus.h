@@ -22,12 +22,49 @@
 ////  MODBUS_SERIAL_ENABLE_PIN      Valid pin for serial enable, rs485 only           ////
 ////  MODBUS_SERIAL_RX_ENABLE       Valid pin for serial rcv enable, rs485 only       ////
 ////  MODBUS_SERAIL_RX_BUFFER_SIZE  Size of the receive buffer                        ////
+////  MODBUS_SERIAL_TX_BUFFER_SIZE  Size of the RTU transmit ring, hardware UART      ////
+////                                   only (default 32).  It holds one byte less,    ////
+////                                   longer frames wait for room as they are sent.  ////
+////                                   257 holds any RTU frame, PIC18 and PCD only.   ////
+////  MODBUS_POLL_TIMEOUT           Response timeout of the master poll scheduler, in ////
+////                                   the units passed to modbus_poll_task().  The   ////
+////                                   default is in ms: the longest reply that fits  ////
+////                                   the receive buffer at MODBUS_SERIAL_BAUD, with ////
+////                                   the gaps around it, plus                       ////
+////                                   MODBUS_POLL_TURNAROUND.  Define it when the    ////
+////                                   clock runs in other units.                     ////
+////  MODBUS_POLL_TURNAROUND        Time a slave takes to start its reply, in ms      ////
+////                                   (default 10)                                   ////
+////  MODBUS_POLL_MAX_SLAVES        Slaves the poll scheduler keeps statistics for    ////
+////                                   (default 32)                                   ////
+////  MODBUS_SERIAL_STATS           If defined, counts characters, frames, CRC/LRC    ////
+////                                   errors, overruns and master timeouts in the    ////
+////                                   g_modbus_* variables (modbus_phy_layer.h)      ////
+////  MODBUS_SERIAL_GETC()          Reads a character, default fgetc(MODBUS_SERIAL)   ////
+////  MODBUS_SERIAL_PUTC(c)         Writes a character, default fputc()               ////
+////  MODBUS_SERIAL_KBHIT()         TRUE if a character is waiting, default kbhit()   ////
+////  MODBUS_GET_TICKS()            RTU 0.1ms tick, default get_ticks()               ////
+////  MODBUS_SET_TICKS(t)           Sets the RTU tick, default set_ticks()            ////
+////  MODBUS_SERIAL_IDLE()          Called in every loop that waits for the           ////
+////                                   transmitter, default nothing                   ////
+////  MODBUS_TX_TIMER_START()       Starts a 0.1ms interrupt for the RTU gap and bus  ////
+////                                   turnaround, default Timer 2                    ////
+////  MODBUS_TX_TIMER_STOP()        Stops it again                                    ////
+////                                   These eight replace the UART and timers, for   ////
+////                                   example with a simulated line and clock.  The  ////
+////                                   receive ISR must then be called for every      ////
+////                                   character, the transmit ISR while its          ////
+////                                   interrupt is enabled and modbus_tx_timer_isr() ////
+////                                   every 0.1ms while the timer runs, with TRMT    ////
+////                                   showing when the last character is out.        ////
 ////                                                                                  ////
 //// TCP/IP DEFINES:                                                                  ////
 ////  MODBUS_TYPE                   MODBYS_TYPE_CLIENT or MODBUS_TYPE_SERVER          ////
 ////  MODBUS_SERVER_LISTEN_PORT     Port server/client listens/sends messages to      ////
 ////                                   (default 502)                                  ////
 ////  MODBUS_LISTEN_SOCKETS         Number of sockets server listens to (default 1)   ////
+////  MODBUS_MAX_PENDING            Requests per connection the server application    ////
+////                                   may hold unanswered, 1 to 8 (default 4)        ////
 ////  MODBUS_BUFFER_SIZE            Size of receive and transmit buffers (default 64) ////
 ////  MODBUS_SERVER_TIMEOUT         Time is seconds client will wait for response     ////
 ////                                   from server before setting TIMEOUT exception   ////
@@ -137,6 +174,28 @@
   #define MODBUS_SERIAL_RX_BUFFER_SIZE  64      //size of send/rcv buffer
  #endif
 
+ #ifndef MODBUS_SERIAL_TX_BUFFER_SIZE
+  #define MODBUS_SERIAL_TX_BUFFER_SIZE  32      //size of RTU transmit ring
+ #endif
+
+ #ifndef MODBUS_POLL_TURNAROUND
+  #define MODBUS_POLL_TURNAROUND        10      //in ms
+ #endif
+
+ #ifndef MODBUS_POLL_TIMEOUT
+  //characters from the end of the request to the end of the longest reply
+  #if (MODBUS_SERIAL_TYPE == MODBUS_ASCII)
+   #define MODBUS_POLL_REPLY_CHARS      (2*MODBUS_SERIAL_RX_BUFFER_SIZE+5)
+  #else
+   #define MODBUS_POLL_REPLY_CHARS      (MODBUS_SERIAL_RX_BUFFER_SIZE+9)
+  #endif
+  #define MODBUS_POLL_TIMEOUT           ((MODBUS_POLL_REPLY_CHARS*((110000/MODBUS_SERIAL_BAUD)+1))/10+MODBUS_POLL_TURNAROUND)  //in ms
+ #endif
+
+ #ifndef MODBUS_POLL_MAX_SLAVES
+  #define MODBUS_POLL_MAX_SLAVES        32
+ #endif
+
  #ifndef MODBUS_TIMER_UPDATE
   #define MODBUS_TIMER_UPDATE MODBUS_TIMER_ISR
  #endif
@@ -158,6 +217,10 @@
   #ifndef MODBUS_LISTEN_SOCKETS
    #define MODBUS_LISTEN_SOCKETS     1
   #endif
+
+  #ifndef MODBUS_MAX_PENDING
+   #define MODBUS_MAX_PENDING        4
+  #endif
  #endif
 
  #ifndef MODBUS_BUFFER_SIZE
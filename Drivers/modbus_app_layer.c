@@ -32,6 +32,10 @@ void modbus_init()
 {
    output_low(MODBUS_SERIAL_ENABLE_PIN);
 
+   #ifdef MODBUS_SERIAL_STATS
+   modbus_serial_stats_reset();
+   #endif
+
    RCV_ON();
 
    #if defined(__PCD__)
@@ -556,6 +560,334 @@ exception modbus_read_FIFO_queue(unsigned int8 address, unsigned int16 FIFO_addr
    return modbus_rx.error;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Master Poll Scheduler                                                            ////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/* Largest reads whose reply still fits modbus_rx with its byte count and CRC */
+#if (((MODBUS_SERIAL_RX_BUFFER_SIZE)-3)/2 > 125)
+ #define MODBUS_POLL_MAX_REGS  125
+#else
+ #define MODBUS_POLL_MAX_REGS  (((MODBUS_SERIAL_RX_BUFFER_SIZE)-3)/2)
+#endif
+#if (((MODBUS_SERIAL_RX_BUFFER_SIZE)-3)*8 > 2000)
+ #define MODBUS_POLL_MAX_BITS  2000
+#else
+ #define MODBUS_POLL_MAX_BITS  (((MODBUS_SERIAL_RX_BUFFER_SIZE)-3)*8)
+#endif
+
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU) && (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
+ #define MODBUS_POLL_TX_BUSY() modbus_serial_tx_busy()
+#else
+ #define MODBUS_POLL_TX_BUSY() FALSE
+#endif
+
+/* States of the transaction in progress */
+enum {MODBUS_POLL_IDLE=0, MODBUS_POLL_SENDING=1, MODBUS_POLL_WAITING=2} modbus_poll_state = 0;
+
+modbus_poll_entry *modbus_poll_table = NULL;
+unsigned int8 modbus_poll_entries = 0;
+unsigned int8 modbus_poll_current;          //group entry of the running transaction
+unsigned int16 modbus_poll_sent;            //time the request left the UART
+int1 modbus_poll_start;                     //set every due time on the next task call
+
+modbus_poll_stats modbus_poll_slaves[MODBUS_POLL_MAX_SLAVES];
+unsigned int8 modbus_poll_nslaves = 0;
+
+/*
+poll_init
+Input:     modbus_poll_entry*  table         Table of polls
+           int8                entries       Number of entries in the table
+Output:    int1                              TRUE if the table is usable
+*/
+int1 modbus_poll_init(modbus_poll_entry *table, unsigned int8 entries)
+{
+   modbus_poll_entry *p, *q;
+   unsigned int8 i, j;
+   unsigned int32 end;
+   int1 merged;
+
+   modbus_poll_table = NULL;
+   modbus_poll_entries = 0;
+   modbus_poll_state = MODBUS_POLL_IDLE;
+   modbus_poll_nslaves = 0;
+
+   for(i=0; i < entries; ++i)
+   {
+      p = &table[i];
+
+      if(p->address == 0 || p->func < FUNC_READ_COILS || p->func > FUNC_READ_INPUT_REGISTERS ||
+         p->quantity == 0 || p->period > 0x7FFF)
+         return FALSE;
+
+      if(p->quantity > ((p->func <= FUNC_READ_DISCRETE_INPUT) ? MODBUS_POLL_MAX_BITS : MODBUS_POLL_MAX_REGS))
+         return FALSE;
+
+      for(j=0; j < modbus_poll_nslaves; ++j)
+         if(modbus_poll_slaves[j].address == p->address)
+            break;
+
+      if(j == modbus_poll_nslaves)
+      {
+         if(j == MODBUS_POLL_MAX_SLAVES)
+            return FALSE;
+         modbus_poll_slaves[j].address = p->address;
+         modbus_poll_slaves[j].latency = 0;
+         modbus_poll_slaves[j].latency_max = 0;
+         modbus_poll_slaves[j].latency_avg8 = 0;
+         modbus_poll_slaves[j].responses = 0;
+         modbus_poll_slaves[j].exceptions = 0;
+         modbus_poll_slaves[j].timeouts = 0;
+         modbus_poll_nslaves++;
+      }
+
+      p->slave = j;
+      p->group = i;
+      p->req_start = p->start;
+      p->req_quantity = p->quantity;
+   }
+
+   //Merge register reads of the same slave, function and period whose
+   //ranges touch.  Repeat until nothing changes, since a merged range can
+   //reach entries that did not touch it before.
+   for(i=0; i < entries; ++i)
+   {
+      p = &table[i];
+
+      if(p->group != i || p->func < FUNC_READ_HOLDING_REGISTERS)
+         continue;
+
+      do
+      {
+         merged = FALSE;
+
+         for(j=i+1; j < entries; ++j)
+         {
+            q = &table[j];
+
+            if(q->group != j || q->address != p->address || q->func != p->func ||
+               q->period != p->period)
+               continue;
+
+            //touching or overlapping
+            if((unsigned int32)q->start > (unsigned int32)p->req_start + p->req_quantity ||
+               (unsigned int32)q->start + q->quantity < p->req_start)
+               continue;
+
+            end = (unsigned int32)p->req_start + p->req_quantity;
+            if((unsigned int32)q->start + q->quantity > end)
+               end = (unsigned int32)q->start + q->quantity;
+            if(q->start < p->req_start)
+               end -= q->start;
+            else
+               end -= p->req_start;
+
+            if(end > MODBUS_POLL_MAX_REGS)
+               continue;
+
+            if(q->start < p->req_start)
+               p->req_start = q->start;
+            p->req_quantity = end;
+            q->group = i;
+            merged = TRUE;
+         }
+      } while(merged);
+   }
+
+   modbus_poll_table = table;
+   modbus_poll_entries = entries;
+   modbus_poll_current = entries - 1;
+   modbus_poll_start = TRUE;
+
+   return TRUE;
+}
+
+// Purpose:    Hand the result of a transaction to every entry of the group
+// Inputs:     1) Group entry
+//             2) Exception, 0 if the reply is good
+// Outputs:    None
+void modbus_poll_deliver(unsigned int8 group, exception error)
+{
+   modbus_poll_entry *p, *g;
+   unsigned int8 i;
+   unsigned int8 *data;
+
+   g = &modbus_poll_table[group];
+
+   for(i=group; i < modbus_poll_entries; ++i)
+   {
+      p = &modbus_poll_table[i];
+
+      if(p->group != group || p->callback == NULL)
+         continue;
+
+      if(error)
+         data = NULL;
+      else if(p->func >= FUNC_READ_HOLDING_REGISTERS)
+         data = &modbus_rx.data[1 + (p->start - g->req_start)*2];
+      else
+         data = &modbus_rx.data[1];
+
+      (*p->callback)(p, error, data);
+   }
+}
+
+// Purpose:    Finish the running transaction and schedule the next poll
+// Inputs:     1) Current time
+//             2) Exception, 0 if the reply is good
+// Outputs:    None
+void modbus_poll_finish(unsigned int16 now, exception error)
+{
+   modbus_poll_entry *g;
+
+   g = &modbus_poll_table[modbus_poll_current];
+
+   g->due += g->period;
+   if((signed int16)(now - g->due) >= 0)
+      g->due = now + g->period;         //fell behind, don't make up for lost polls
+
+   modbus_poll_state = MODBUS_POLL_IDLE;
+
+   modbus_poll_deliver(modbus_poll_current, error);
+}
+
+/*
+poll_task
+Input:     int16      now                Current time
+Output:    void
+*/
+void modbus_poll_task(unsigned int16 now)
+{
+   modbus_poll_entry *g;
+   modbus_poll_stats *st;
+   unsigned int8 i, expected;
+   unsigned int16 latency;
+
+   if(modbus_poll_table == NULL || modbus_poll_entries == 0)
+      return;
+
+   if(modbus_poll_start)
+   {
+      for(i=0; i < modbus_poll_entries; ++i)
+         modbus_poll_table[i].due = now;
+      modbus_poll_start = FALSE;
+   }
+
+   if(modbus_poll_state == MODBUS_POLL_IDLE)
+   {
+      //round robin from the last group polled so no slave is starved
+      i = modbus_poll_current;
+      do
+      {
+         if(++i >= modbus_poll_entries)
+            i = 0;
+         g = &modbus_poll_table[i];
+         if(g->group == i && (signed int16)(now - g->due) >= 0)
+            break;
+      } while(i != modbus_poll_current);
+
+      if(g->group != i || (signed int16)(now - g->due) < 0)
+         return;
+
+      modbus_poll_current = i;
+
+      modbus_serial_send_start(g->address, g->func);
+
+      modbus_serial_putc(make8(g->req_start,1));
+      modbus_serial_putc(make8(g->req_start,0));
+
+      modbus_serial_putc(make8(g->req_quantity,1));
+      modbus_serial_putc(make8(g->req_quantity,0));
+
+      modbus_serial_send_stop();
+
+      modbus_rx.error = 0;
+      modbus_poll_state = MODBUS_POLL_SENDING;
+   }
+
+   if(modbus_poll_state == MODBUS_POLL_SENDING)
+   {
+      if(MODBUS_POLL_TX_BUSY())
+         return;
+
+      #if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+      modbus_timeout_enabled = 0;
+      #endif
+      modbus_poll_sent = now;
+      modbus_poll_state = MODBUS_POLL_WAITING;
+      return;
+   }
+
+   g = &modbus_poll_table[modbus_poll_current];
+   st = &modbus_poll_slaves[g->slave];
+
+   if(modbus_kbhit())
+   {
+      //a reply from someone else is not ours, keep waiting
+      if(modbus_rx.address != g->address || (modbus_rx.func & 0x7F) != g->func)
+         return;
+
+      latency = now - modbus_poll_sent;
+      st->latency = latency;
+      if(latency > st->latency_max)
+         st->latency_max = latency;
+      st->latency_avg8 += latency - (st->latency_avg8 >> 3);
+
+      if(modbus_rx.func & 0x80)
+      {
+         st->exceptions++;
+         modbus_poll_finish(now, modbus_rx.error);
+         return;
+      }
+
+      if(g->func >= FUNC_READ_HOLDING_REGISTERS)
+         expected = g->req_quantity*2;
+      else
+         expected = (g->req_quantity+7)/8;
+
+      if(modbus_rx.data[0] != expected || modbus_rx.len < expected+1)
+      {
+         st->exceptions++;
+         modbus_poll_finish(now, ILLEGAL_DATA_VALUE);
+         return;
+      }
+
+      st->responses++;
+      modbus_poll_finish(now, 0);
+   }
+   else if((unsigned int16)(now - modbus_poll_sent) >= MODBUS_POLL_TIMEOUT)
+   {
+      st->timeouts++;
+      modbus_poll_finish(now, TIMEOUT);
+   }
+}
+
+/*
+poll_idle
+Input:     void
+Output:    int1                          TRUE if no transaction is running
+*/
+int1 modbus_poll_idle(void)
+{
+   return(modbus_poll_state == MODBUS_POLL_IDLE);
+}
+
+/*
+poll_get_stats
+Input:     int8       address            Slave Address
+Output:    modbus_poll_stats*            Statistics, NULL if the slave is not polled
+*/
+modbus_poll_stats* modbus_poll_get_stats(unsigned int8 address)
+{
+   unsigned int8 i;
+
+   for(i=0; i < modbus_poll_nslaves; ++i)
+      if(modbus_poll_slaves[i].address == address)
+         return &modbus_poll_slaves[i];
+
+   return NULL;
+}
+
 #else
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Slave API                                                                        ////
@@ -1041,5 +1373,385 @@ void modbus_exception_rsp(unsigned int8 address, unsigned int16 func, exception
    modbus_serial_send_stop();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Slave Register Map API                                                           ////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+modbus_map_entry *modbus_map = NULL;
+
+/* First entry and number of entries of each type, set up by modbus_map_init() */
+unsigned int8 modbus_map_first[4];
+unsigned int8 modbus_map_count[4];
+
+/*
+map_init
+Input:     modbus_map_entry*  map            Table of ranges
+           int8               entries        Number of entries in the table
+Output:    int1                              TRUE if the table is usable
+*/
+int1 modbus_map_init(modbus_map_entry *map, unsigned int8 entries)
+{
+   unsigned int8 i, type;
+
+   modbus_map = NULL;
+
+   for(type=0; type < 4; ++type)
+      modbus_map_count[type] = 0;
+
+   for(i=0; i < entries; ++i)
+   {
+      type = map[i].type;
+
+      if(type > MODBUS_MAP_INPUT_REGISTERS || map[i].count == 0)
+         return FALSE;
+
+      if(modbus_map_count[type] == 0)
+      {
+         //every type has to be in one group, in type order
+         if(i && type < map[i-1].type)
+            return FALSE;
+         modbus_map_first[type] = i;
+      }
+      else if(map[i-1].type != type ||
+              (unsigned int32)map[i-1].start + map[i-1].count > map[i].start)
+         return FALSE;
+
+      modbus_map_count[type]++;
+   }
+
+   modbus_map = map;
+
+   return TRUE;
+}
+
+// Purpose:    Find the entry holding an address
+// Inputs:     1) Entry type
+//             2) Address
+// Outputs:    Index of the entry, 0xFF if the address is not mapped
+unsigned int8 modbus_map_find(unsigned int8 type, unsigned int16 address)
+{
+   unsigned int8 lo, hi, mid;
+
+   if(modbus_map_count[type] == 0)
+      return 0xFF;
+
+   lo = modbus_map_first[type];
+   hi = lo + modbus_map_count[type] - 1;
+
+   //find the last entry starting at or below address
+   while(lo < hi)
+   {
+      mid = lo + ((hi - lo + 1) >> 1);
+      if(modbus_map[mid].start <= address)
+         lo = mid;
+      else
+         hi = mid - 1;
+   }
+
+   if(address < modbus_map[lo].start ||
+      address - modbus_map[lo].start >= modbus_map[lo].count)
+      return 0xFF;
+
+   return lo;
+}
+
+// Purpose:    Check that a whole range is mapped
+// Inputs:     1) Entry type
+//             2) First address
+//             3) Number of addresses
+// Outputs:    Index of the entry holding the first address, 0xFF if any
+//             address in the range is not mapped
+unsigned int8 modbus_map_range(unsigned int8 type, unsigned int16 start, unsigned int16 quantity)
+{
+   unsigned int8 first, i, last;
+   unsigned int32 end, next;
+
+   first = modbus_map_find(type, start);
+   if(first == 0xFF)
+      return 0xFF;
+
+   end = (unsigned int32)start + quantity;
+   last = modbus_map_first[type] + modbus_map_count[type] - 1;
+
+   for(i=first; ; ++i)
+   {
+      next = (unsigned int32)modbus_map[i].start + modbus_map[i].count;
+      if(next >= end)
+         return first;
+      if(i == last || modbus_map[i+1].start != next)
+         return 0xFF;
+   }
+}
+
+// Purpose:    Check that every entry of a range can be written
+// Inputs:     1) Index of the entry holding the first address
+//             2) First address
+//             3) Number of addresses
+// Outputs:    TRUE if the range is writable
+int1 modbus_map_writable(unsigned int8 i, unsigned int16 start, unsigned int16 quantity)
+{
+   unsigned int32 end;
+
+   end = (unsigned int32)start + quantity;
+
+   for(;;)
+   {
+      if(modbus_map[i].read != NULL && modbus_map[i].write == NULL)
+         return FALSE;
+      if((unsigned int32)modbus_map[i].start + modbus_map[i].count >= end)
+         return TRUE;
+      i++;
+   }
+}
+
+// Purpose:    Read one coil, input or register from an entry
+// Inputs:     1) Entry
+//             2) Address
+// Outputs:    The value
+unsigned int16 modbus_map_get(modbus_map_entry *e, unsigned int16 address)
+{
+   unsigned int16 i;
+   unsigned int8 *bits;
+
+   if(e->read != NULL)
+      return (*e->read)(address);
+
+   if(e->data == NULL)
+      return 0;
+
+   i = address - e->start;
+
+   if(e->type >= MODBUS_MAP_HOLDING_REGISTERS)
+      return ((unsigned int16 *)e->data)[i];
+
+   bits = e->data;
+   return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+// Purpose:    Write one coil or register to an entry
+// Inputs:     1) Entry
+//             2) Address
+//             3) Value, 0 or 1 for coils
+// Outputs:    None
+void modbus_map_set(modbus_map_entry *e, unsigned int16 address, unsigned int16 value)
+{
+   unsigned int16 i;
+   unsigned int8 *bits;
+
+   if(e->write != NULL)
+   {
+      (*e->write)(address, value);
+      return;
+   }
+
+   if(e->data == NULL)
+      return;
+
+   i = address - e->start;
+
+   if(e->type >= MODBUS_MAP_HOLDING_REGISTERS)
+   {
+      ((unsigned int16 *)e->data)[i] = value;
+      return;
+   }
+
+   bits = e->data;
+   if(value)
+      bits[i >> 3] |= 1 << (i & 7);
+   else
+      bits[i >> 3] &= ~(1 << (i & 7));
+}
+
+// Purpose:    Answer a read of coils, inputs or registers
+// Inputs:     1) Slave address
+//             2) Entry type, the function code is type+1
+//             3) Index of the entry holding the first address
+//             4) First address
+//             5) Number of addresses
+// Outputs:    None
+// Note:       Values go from the bound variables straight to the serial line.
+void modbus_map_read_rsp(unsigned int8 address, unsigned int8 type, unsigned int8 i,
+                        unsigned int16 start, unsigned int16 quantity)
+{
+   modbus_map_entry *e;
+   unsigned int16 reg, value;
+   unsigned int8 bits, n;
+
+   e = &modbus_map[i];
+
+   modbus_serial_send_start(address, type+1);
+
+   if(type >= MODBUS_MAP_HOLDING_REGISTERS)
+   {
+      modbus_serial_putc(quantity*2);
+
+      for(reg=start; quantity; ++reg, --quantity)
+      {
+         if(reg - e->start >= e->count)
+            e++;
+         value = modbus_map_get(e, reg);
+         modbus_serial_putc(make8(value,1));
+         modbus_serial_putc(make8(value,0));
+      }
+   }
+   else
+   {
+      modbus_serial_putc((quantity+7)/8);
+
+      bits = 0;
+      n = 0;
+      for(reg=start; quantity; ++reg, --quantity)
+      {
+         if(reg - e->start >= e->count)
+            e++;
+         if(modbus_map_get(e, reg))
+            bits |= 1 << n;
+         if(++n == 8)
+         {
+            modbus_serial_putc(bits);
+            bits = 0;
+            n = 0;
+         }
+      }
+      if(n)
+         modbus_serial_putc(bits);
+   }
+
+   modbus_serial_send_stop();
+}
+
+/*
+map_process
+Input:     int8       address            Slave Address
+Output:    int1                          TRUE if the message was handled
+*/
+int1 modbus_map_process(unsigned int8 address)
+{
+   modbus_map_entry *e;
+   unsigned int8 i, type, func;
+   unsigned int16 start, quantity, value, reg, n;
+   exception error;
+
+   if(modbus_map == NULL)
+      return FALSE;
+
+   if(modbus_rx.address != address && modbus_rx.address != 0)
+      return FALSE;
+
+   func = modbus_rx.func;
+
+   switch(func)
+   {
+      case FUNC_READ_COILS:
+      case FUNC_READ_DISCRETE_INPUT:
+      case FUNC_READ_HOLDING_REGISTERS:
+      case FUNC_READ_INPUT_REGISTERS:
+      case FUNC_WRITE_MULTIPLE_COILS:
+      case FUNC_WRITE_MULTIPLE_REGISTERS:
+         if(modbus_rx.len < 4)
+            return FALSE;
+         quantity = make16(modbus_rx.data[2],modbus_rx.data[3]);
+         break;
+      case FUNC_WRITE_SINGLE_COIL:
+      case FUNC_WRITE_SINGLE_REGISTER:
+         if(modbus_rx.len < 4)
+            return FALSE;
+         quantity = 1;
+         value = make16(modbus_rx.data[2],modbus_rx.data[3]);
+         break;
+      default:
+         return FALSE;
+   }
+
+   start = make16(modbus_rx.data[0],modbus_rx.data[1]);
+
+   if(func <= FUNC_READ_INPUT_REGISTERS)
+      type = func - 1;
+   else if(func == FUNC_WRITE_SINGLE_COIL || func == FUNC_WRITE_MULTIPLE_COILS)
+      type = MODBUS_MAP_COILS;
+   else
+      type = MODBUS_MAP_HOLDING_REGISTERS;
+
+   error = 0;
+
+   //quantity limits from the MODBUS specification
+   if(quantity == 0)
+      error = ILLEGAL_DATA_VALUE;
+   else if(func <= FUNC_READ_DISCRETE_INPUT && quantity > 2000)
+      error = ILLEGAL_DATA_VALUE;
+   else if(func <= FUNC_READ_INPUT_REGISTERS && func >= FUNC_READ_HOLDING_REGISTERS && quantity > 125)
+      error = ILLEGAL_DATA_VALUE;
+   else if(func == FUNC_WRITE_SINGLE_COIL && value != 0xFF00 && value != 0x0000)
+      error = ILLEGAL_DATA_VALUE;
+   else if(func == FUNC_WRITE_MULTIPLE_COILS &&
+           (quantity > 1968 || modbus_rx.len < 5 || modbus_rx.data[4] != (quantity+7)/8 ||
+            modbus_rx.len < 5 + (unsigned int16)modbus_rx.data[4]))
+      error = ILLEGAL_DATA_VALUE;
+   else if(func == FUNC_WRITE_MULTIPLE_REGISTERS &&
+           (quantity > 123 || modbus_rx.len < 5 || modbus_rx.data[4] != quantity*2 ||
+            modbus_rx.len < 5 + (unsigned int16)modbus_rx.data[4]))
+      error = ILLEGAL_DATA_VALUE;
+   else
+   {
+      i = modbus_map_range(type, start, quantity);
+      if(i == 0xFF)
+         error = ILLEGAL_DATA_ADDRESS;
+      else if(func > FUNC_READ_INPUT_REGISTERS && !modbus_map_writable(i, start, quantity))
+         error = ILLEGAL_DATA_ADDRESS;
+   }
+
+   if(error)
+   {
+      if(modbus_rx.address)
+         modbus_exception_rsp(address, func, error);
+      return TRUE;
+   }
+
+   if(func <= FUNC_READ_INPUT_REGISTERS)
+   {
+      //reads are not allowed as broadcasts, there is nobody to answer
+      if(modbus_rx.address)
+         modbus_map_read_rsp(address, type, i, start, quantity);
+      return TRUE;
+   }
+
+   e = &modbus_map[i];
+
+   if(func == FUNC_WRITE_SINGLE_COIL || func == FUNC_WRITE_SINGLE_REGISTER)
+   {
+      modbus_map_set(e, start, (func == FUNC_WRITE_SINGLE_COIL) ? (value != 0) : value);
+
+      if(modbus_rx.address == 0)
+         return TRUE;
+
+      if(func == FUNC_WRITE_SINGLE_COIL)
+         modbus_write_single_coil_rsp(address, start, value);
+      else
+         modbus_write_single_register_rsp(address, start, value);
+      return TRUE;
+   }
+
+   for(reg=start, n=0; n < quantity; ++reg, ++n)
+   {
+      if(reg - e->start >= e->count)
+         e++;
+      if(type == MODBUS_MAP_COILS)
+         value = (modbus_rx.data[5 + (n >> 3)] >> (n & 7)) & 1;
+      else
+         value = make16(modbus_rx.data[5 + n*2],modbus_rx.data[6 + n*2]);
+      modbus_map_set(e, reg, value);
+   }
+
+   if(modbus_rx.address == 0)
+      return TRUE;
+
+   if(type == MODBUS_MAP_COILS)
+      modbus_write_multiple_coils_rsp(address, start, quantity);
+   else
+      modbus_write_multiple_registers_rsp(address, start, quantity);
+
+   return TRUE;
+}
+
 #endif
 #endif //MODBUS_APP_LAYER_C
@@ -312,6 +312,104 @@ Output:    exception                    0 if no error, else the exception
 */
 exception modbus_read_FIFO_queue(unsigned int8 address, unsigned int16 FIFO_address);
 
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Master Poll Scheduler                                                            ////
+////                                                                                  ////
+////  Polls a table of slaves without blocking.  Each modbus_poll_entry reads a range ////
+////  of coils, inputs or registers (functions 0x01-0x04) from one slave every period ////
+////  and hands the result to its callback.  Register reads of the same slave,        ////
+////  function and period whose ranges touch are merged into one request.             ////
+////                                                                                  ////
+////  int1 modbus_poll_init(*table,entries)                                           ////
+////    - Sets the table to use, merges ranges and makes every entry due at once.     ////
+////      Returns FALSE if an entry has a bad function, slave 0 or a range that does  ////
+////      not fit the receive buffer, or if there are more than                       ////
+////      MODBUS_POLL_MAX_SLAVES different slaves.                                    ////
+////                                                                                  ////
+////  void modbus_poll_task(now)                                                      ////
+////    - Call from the main loop with a free running 16 bit clock, in the same units ////
+////      as the periods and MODBUS_POLL_TIMEOUT (ms for the default timeout).  Sends ////
+////      the next due request, or checks for its reply or timeout, and returns.  The ////
+////      timeout runs from the end of the request to the end of the reply, so it has ////
+////      to cover the longest reply in the table.                                    ////
+////                                                                                  ////
+////  int1 modbus_poll_idle()                                                         ////
+////    - TRUE between transactions.  The blocking master API above may only be       ////
+////      used while this is TRUE.                                                    ////
+////                                                                                  ////
+////  modbus_poll_stats* modbus_poll_get_stats(address)                               ////
+////    - Round trip latency and timeout counts of one slave, NULL if it is not       ////
+////      polled.                                                                     ////
+////                                                                                  ////
+////  The callback gets the entry, the exception (0 on success, TIMEOUT if the slave  ////
+////  did not answer) and a pointer to the data in modbus_rx: big endian registers    ////
+////  starting at the entry's own start address, or packed bits as sent by the slave. ////
+////  The pointer is NULL on errors and is only valid during the callback.            ////
+////                                                                                  ////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct _modbus_poll_entry modbus_poll_entry;
+
+typedef void (*modbus_poll_callback)(modbus_poll_entry *entry, exception error,
+                                     unsigned int8 *data);
+
+struct _modbus_poll_entry
+{
+   unsigned int8 address;                   //slave address
+   unsigned int8 func;                      //FUNC_READ_COILS..FUNC_READ_INPUT_REGISTERS
+   unsigned int16 start;                    //first coil/input/register
+   unsigned int16 quantity;                 //number of coils/inputs/registers
+   unsigned int16 period;                   //time between polls, max 32767
+   modbus_poll_callback callback;           //called with every result
+
+   //filled in by the scheduler
+   unsigned int8 group;                     //index of the entry that sends the request
+   unsigned int8 slave;                     //index into the statistics
+   unsigned int16 req_start;                //merged range, only used in the group entry
+   unsigned int16 req_quantity;
+   unsigned int16 due;                      //time of the next poll
+};
+
+typedef struct _modbus_poll_stats
+{
+   unsigned int8 address;
+   unsigned int16 latency;                  //last round trip time
+   unsigned int16 latency_max;
+   unsigned int16 latency_avg8;             //running average times 8
+   unsigned int16 responses;
+   unsigned int16 exceptions;
+   unsigned int16 timeouts;
+} modbus_poll_stats;
+
+/*
+poll_init
+Input:     modbus_poll_entry*  table         Table of polls
+           int8                entries       Number of entries in the table
+Output:    int1                              TRUE if the table is usable
+*/
+int1 modbus_poll_init(modbus_poll_entry *table, unsigned int8 entries);
+
+/*
+poll_task
+Input:     int16      now                Current time
+Output:    void
+*/
+void modbus_poll_task(unsigned int16 now);
+
+/*
+poll_idle
+Input:     void
+Output:    int1                          TRUE if no transaction is running
+*/
+int1 modbus_poll_idle(void);
+
+/*
+poll_get_stats
+Input:     int8       address            Slave Address
+Output:    modbus_poll_stats*            Statistics, NULL if the slave is not polled
+*/
+modbus_poll_stats* modbus_poll_get_stats(unsigned int8 address);
+
 #else
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Slave API                                                                        ////
@@ -591,6 +689,76 @@ Output:    void
 void modbus_read_FIFO_queue_rsp(unsigned int8 address, unsigned int16 FIFO_len, unsigned int16 *data);
 
 void modbus_exception_rsp(unsigned int8 address, unsigned int16 func, exception error);
+
+//////////////////////////////////////////////////////////////////////////////////////////
+//// Slave Register Map API                                                           ////
+////                                                                                  ////
+////  Instead of decoding modbus_rx by hand, a slave can describe its data as a table ////
+////  of modbus_map_entry ranges bound to variables or callbacks and let              ////
+////  modbus_map_process() answer functions 0x01-0x06, 0x0F and 0x10.  Values are     ////
+////  sent straight from the bound variables, nothing is copied into a temporary      ////
+////  array first.                                                                    ////
+////                                                                                  ////
+////  int1 modbus_map_init(*map,entries)                                              ////
+////    - Sets the table to use.  Entries must be grouped by type, in type order, and ////
+////      sorted by start address without overlapping.  Returns FALSE if they are     ////
+////      not.                                                                        ////
+////                                                                                  ////
+////  int1 modbus_map_process(address)                                                ////
+////    - Call after modbus_kbhit() returns TRUE.  Answers the request if it is for   ////
+////      this slave address (or broadcast) and uses one of the functions above,      ////
+////      sending an exception response for bad addresses or values.  Returns FALSE   ////
+////      if the message was left for the application to handle.                      ////
+////                                                                                  ////
+////  Each entry binds one range:                                                     ////
+////    - data, read and write NULL: addresses read as 0 and ignore writes            ////
+////    - data set: coils/discrete inputs are packed 8 to a byte, LSB first, in an    ////
+////      int8 array.  Registers are an int16 array.                                  ////
+////    - read set: called for each address instead of using data                     ////
+////    - write set: called for each address written instead of storing to data.  A   ////
+////      coil or register with read set and write NULL is read only.                 ////
+////  A request may span several entries as long as they are adjacent.                ////
+////                                                                                  ////
+//////////////////////////////////////////////////////////////////////////////////////////
+
+/********************************************************************
+Register map entry types.  The order matches the read function codes,
+0x01 to 0x04.
+********************************************************************/
+#ifndef NULL
+#define NULL 0
+#endif
+
+enum {MODBUS_MAP_COILS=0, MODBUS_MAP_DISCRETE_INPUTS=1,
+MODBUS_MAP_HOLDING_REGISTERS=2, MODBUS_MAP_INPUT_REGISTERS=3};
+
+typedef unsigned int16 (*modbus_map_read_fn)(unsigned int16 address);
+typedef void (*modbus_map_write_fn)(unsigned int16 address, unsigned int16 value);
+
+typedef struct _modbus_map_entry
+{
+   unsigned int8 type;                      //MODBUS_MAP_COILS..MODBUS_MAP_INPUT_REGISTERS
+   unsigned int16 start;                    //first address of the range
+   unsigned int16 count;                    //number of coils/inputs/registers
+   void *data;                              //bound variable, see above
+   modbus_map_read_fn read;                 //getter, NULL to use data
+   modbus_map_write_fn write;               //setter, NULL to store to data
+} modbus_map_entry;
+
+/*
+map_init
+Input:     modbus_map_entry*  map            Table of ranges
+           int8               entries        Number of entries in the table
+Output:    int1                              TRUE if the table is usable
+*/
+int1 modbus_map_init(modbus_map_entry *map, unsigned int8 entries);
+
+/*
+map_process
+Input:     int8       address            Slave Address
+Output:    int1                          TRUE if the message was handled
+*/
+int1 modbus_map_process(unsigned int8 address);
 #endif //MODBUS_TYPE
 
 #endif //MODBUS_APP_LAYER_H
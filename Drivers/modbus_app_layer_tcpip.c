@@ -27,10 +27,6 @@
 #include "tcpip\TCPIP Stack\tcp.h"
 #include "tcpip\TCPIP Stack\tick.h"
 
-#if (MODBUS_TYPE == MODBUS_TYPE_SERVER)
-TCP_SOCKET socket[MODBUS_LISTEN_SOCKETS];
-#endif
-
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Shared API                                                                       ////
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -48,7 +44,13 @@ void modbus_init(void)
    unsigned int8 i;
    
    for(i=0;i<MODBUS_LISTEN_SOCKETS;i++)
+   {
       socket[i] = INVALID_SOCKET;
+      ModbusConnectionInit(i);
+   }
+   
+   modbus_tx_socket = INVALID_SOCKET;
+   modbus_tx_left = 0;
   #endif
 }
 
@@ -124,22 +126,30 @@ Output         int1                       TRUE if new data was retrieved from RX
 */
 int1 modbus_getd(MBAP_HEADER &MBAPHeader, function &func, unsigned int8 &length, unsigned int8 *data)
 {
+   static unsigned int8 last = 0;
    unsigned int8 which,i;
    
-   for(which=0;which<MODBUS_LISTEN_SOCKETS;which++)
+   //start after the socket served last so one busy client can't starve the others
+   which = last;
+   for(i=0;i<MODBUS_LISTEN_SOCKETS;i++)
    {
+      if(++which >= MODBUS_LISTEN_SOCKETS)
+         which = 0;
       if(modbus_rx_new[which] == TRUE)
          break;
    }
    
-   if(which >= MODBUS_LISTEN_SOCKETS)
+   if(i >= MODBUS_LISTEN_SOCKETS)
       return(FALSE);
+   
+   last = which;
       
    MBAPHeader.TransactionIdentifier = modbus_rx[which].MBAPHeader.TransactionIdentifier;
    MBAPHeader.ProtocolIdentifier = modbus_rx[which].MBAPHeader.ProtocolIdentifier;
    MBAPHeader.Length = modbus_rx[which].MBAPHeader.Length;
    MBAPHeader.UnitIdentifier = modbus_rx[which].MBAPHeader.UnitIdentifier;
    MBAPHeader.WhichSocket = which;
+   MBAPHeader.Connection = modbus_rx[which].MBAPHeader.Connection;
    
    func = modbus_rx[which].func;
    length = modbus_rx[which].len;
@@ -626,17 +636,12 @@ int1 modbus_read_coils_rsp(MBAP_HEADER MBAPHeader, unsigned int8 byte_count, uns
 {
    unsigned int8 i;
    
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_READ_COILS, MBAPHeader, 3 + byte_count))
    {
-      MobusLoadTxBufferStart(FUNC_READ_COILS, MBAPHeader, 3 + byte_count);
-      
       modbus_putc(MBAPHeader.WhichSocket,byte_count,TRUE);
 
       for(i=1; i < (byte_count+1); i++)
       {
-         if(i >= MODBUS_BUFFER_SIZE)   //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-      
          modbus_putc(MBAPHeader.WhichSocket,*coil_data++);
       }
       
@@ -658,17 +663,12 @@ int1 modbus_read_discrete_input_rsp(MBAP_HEADER MBAPHeader, unsigned int8 byte_c
 {
    unsigned int8 i;
    
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_READ_DISCRETE_INPUT, MBAPHeader, 3 + byte_count))
    {
-      MobusLoadTxBufferStart(FUNC_READ_DISCRETE_INPUT, MBAPHeader, 3 + byte_count);
-      
       modbus_putc(MBAPHeader.WhichSocket,byte_count,TRUE);
       
       for(i=1; i < (byte_count+1); i++)
       {
-         if(i >= MODBUS_BUFFER_SIZE)   //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-      
          modbus_putc(MBAPHeader.WhichSocket,*input_data++);
       }
    
@@ -690,17 +690,12 @@ int1 modbus_read_holding_registers_rsp(MBAP_HEADER MBAPHeader, unsigned int8 byt
 {
    unsigned int8 i;
    
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_READ_HOLDING_REGISTERS,MBAPHeader,3+byte_count))
    {
-      MobusLoadTxBufferStart(FUNC_READ_HOLDING_REGISTERS,MBAPHeader,3+byte_count);
-      
       modbus_putc(MBAPHeader.WhichSocket,byte_count,TRUE);
       
       for(i=1; i < (byte_count+1); i+=2)
       {
-         if(i >= (MODBUS_BUFFER_SIZE-1))  //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-      
          modbus_putc(MBAPHeader.WhichSocket,make8(*reg_data,1));
          modbus_putc(MBAPHeader.WhichSocket,make8(*reg_data++,0));
       }
@@ -723,17 +718,12 @@ int1 modbus_read_input_registers_rsp(MBAP_HEADER MBAPHeader, unsigned int8 byte_
 {
    unsigned int8 i;
    
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_READ_INPUT_REGISTERS,MBAPHeader,3+byte_count))
    {
-      MobusLoadTxBufferStart(FUNC_READ_INPUT_REGISTERS,MBAPHeader,3+byte_count);
-      
       modbus_putc(MBAPHeader.WhichSocket,byte_count,TRUE);
 
       for(i=1; i < (byte_count+1); i+=2)
       {
-         if(i >= (MODBUS_BUFFER_SIZE-1))  //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-            
          modbus_putc(MBAPHeader.WhichSocket,make8(*input_data,1));
          modbus_putc(MBAPHeader.WhichSocket,make8(*input_data++,0));
       }
@@ -754,10 +744,8 @@ Output:    int1                          0 if successfully placed in TX buffer,
 */
 int1 modbus_write_single_coil_rsp(MBAP_HEADER MBAPHeader, unsigned int16 output_address, unsigned int16 output_value)
 {
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_WRITE_SINGLE_COIL,MBAPHeader,6))
    {
-      MobusLoadTxBufferStart(FUNC_WRITE_SINGLE_COIL,MBAPHeader,6);
-      
       modbus_putc(MBAPHeader.WhichSocket,make8(output_address,1),TRUE);
       modbus_putc(MBAPHeader.WhichSocket,make8(output_address,0));
    
@@ -780,10 +768,8 @@ Output:    int1                          0 if successfully placed in TX buffer,
 */
 int1 modbus_write_single_register_rsp(MBAP_HEADER MBAPHeader, unsigned int16 reg_address, unsigned int16 reg_value)
 {
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_WRITE_SINGLE_REGISTER,MBAPHeader,6))
    {
-      MobusLoadTxBufferStart(FUNC_WRITE_SINGLE_REGISTER,MBAPHeader,6);
-
       modbus_putc(MBAPHeader.WhichSocket,make8(reg_address,1),TRUE);
       modbus_putc(MBAPHeader.WhichSocket,make8(reg_address,0));
    
@@ -806,10 +792,8 @@ Output:    int1                          0 if successfully placed in TX buffer,
 */
 int1 modbus_write_multiple_coils_rsp(MBAP_HEADER MBAPHeader, unsigned int16 start_address, unsigned int16 quantity)
 {
-  if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_WRITE_MULTIPLE_COILS,MBAPHeader,6))
    {
-      MobusLoadTxBufferStart(FUNC_WRITE_MULTIPLE_COILS,MBAPHeader,6);
-
       modbus_putc(MBAPHeader.WhichSocket,make8(start_address,1),TRUE);
       modbus_putc(MBAPHeader.WhichSocket,make8(start_address,0));
    
@@ -832,10 +816,8 @@ Output:    int1                          0 if successfully placed in TX buffer,
 */
 int1 modbus_write_multiple_registers_rsp(MBAP_HEADER MBAPHeader, unsigned int16 start_address, unsigned int16 quantity)
 {
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_WRITE_MULTIPLE_REGISTERS,MBAPHeader,6))
    {
-      MobusLoadTxBufferStart(FUNC_WRITE_MULTIPLE_REGISTERS,MBAPHeader,6);
-
       modbus_putc(MBAPHeader.WhichSocket,make8(start_address,1),TRUE);
       modbus_putc(MBAPHeader.WhichSocket,make8(start_address,0));
    
@@ -860,17 +842,12 @@ int1 modbus_read_file_record_rsp(MBAP_HEADER MBAPHeader, unsigned int8 byte_coun
 {
    unsigned int8 i=1,j;
 
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_READ_FILE_RECORD,MBAPHeader,3 + byte_count))
    {
-      MobusLoadTxBufferStart(FUNC_READ_FILE_RECORD,MBAPHeader,3 + byte_count);
-
       modbus_putc(MBAPHeader.WhichSocket,byte_count,TRUE);
    
       while(i < (byte_count+1))
       {
-         if(i >= (MODBUS_BUFFER_SIZE - 1 - (request->record_length*2))) //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-      
          modbus_putc(MBAPHeader.WhichSocket,request->record_length);
          modbus_putc(MBAPHeader.WhichSocket,request->reference_type);
    
@@ -902,17 +879,12 @@ int1 modbus_write_file_record_rsp(MBAP_HEADER MBAPHeader, unsigned int8 byte_cou
 {
    unsigned int8 i, j=0;
 
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_WRITE_FILE_RECORD,MBAPHeader,3 + byte_count))
    {
-      MobusLoadTxBufferStart(FUNC_WRITE_FILE_RECORD,MBAPHeader,3 + byte_count);
-
       modbus_putc(MBAPHeader.WhichSocket,byte_count,TRUE);
    
       for(i=1; i < (byte_count+1); i+=(7+(j*2)))
       {
-         if(i >= (MODBUS_BUFFER_SIZE - 6 -((request->record_length)*2))) //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-      
          modbus_putc(MBAPHeader.WhichSocket,request->reference_type);
          modbus_putc(MBAPHeader.WhichSocket,make8(request->file_number, 1));
          modbus_putc(MBAPHeader.WhichSocket,make8(request->file_number, 0));
@@ -945,10 +917,8 @@ Output:    int1                           0 if successfully placed in TX buffer,
 */
 int1 modbus_mask_write_register_rsp(MBAP_HEADER MBAPHeader, unsigned int16 reference_address, unsigned int16 AND_mask, unsigned int16 OR_mask)
 {
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_MASK_WRITE_REGISTER,MBAPHeader,8))
    {
-      MobusLoadTxBufferStart(FUNC_MASK_WRITE_REGISTER,MBAPHeader,8);
-
       modbus_putc(MBAPHeader.WhichSocket,make8(reference_address,1),TRUE);
       modbus_putc(MBAPHeader.WhichSocket,make8(reference_address,0));
    
@@ -976,17 +946,12 @@ int1 modbus_read_write_multiple_registers_rsp(MBAP_HEADER MBAPHeader, unsigned i
 {
    unsigned int8 i;
 
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(FUNC_READ_WRITE_MULTIPLE_REGISTERS,MBAPHeader,3 + data_len))
    {
-      MobusLoadTxBufferStart(FUNC_READ_WRITE_MULTIPLE_REGISTERS,MBAPHeader,3 + data_len);
-
       modbus_putc(MBAPHeader.WhichSocket,data_len,TRUE);
    
       for(i=1; i < (data_len+1); i+=2)
       {
-         if(i >= (MODBUS_BUFFER_SIZE - 1))   //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-            
          modbus_putc(MBAPHeader.WhichSocket,make8(data[i], 1));
          modbus_putc(MBAPHeader.WhichSocket,make8(data[i], 0));
       }
@@ -1010,12 +975,10 @@ int1 modbus_read_FIFO_queue_rsp(MBAP_HEADER MBAPHeader, unsigned int16 FIFO_len,
    unsigned int8 i;
    unsigned int16 byte_count;
    
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   byte_count = ((FIFO_len*2)+2);
+   
+   if(MobusLoadTxBufferStart(FUNC_READ_FIFO_QUEUE,MBAPHeader,4+byte_count))
    {
-      byte_count = ((FIFO_len*2)+2);
-      
-      MobusLoadTxBufferStart(FUNC_READ_FIFO_QUEUE,MBAPHeader,4+byte_count);
-
       modbus_putc(MBAPHeader.WhichSocket,make8(byte_count, 1),TRUE);
       modbus_putc(MBAPHeader.WhichSocket,make8(byte_count, 0));
    
@@ -1024,9 +987,6 @@ int1 modbus_read_FIFO_queue_rsp(MBAP_HEADER MBAPHeader, unsigned int16 FIFO_len,
    
       for(i=4; i < (FIFO_len+4); i+=2)
       {
-         if(i >= (MODBUS_BUFFER_SIZE - 1))   //check to make sure the TX buffer wasn't overran
-            return(TRUE);
-         
          modbus_putc(MBAPHeader.WhichSocket,make8(data[i], 1));
          modbus_putc(MBAPHeader.WhichSocket,make8(data[i], 0));
       }
@@ -1047,10 +1007,8 @@ Output:    int1                           0 if successfully placed in TX buffer,
 */
 int1 modbus_exception_rsp(MBAP_HEADER MBAPHeader, function func, exception error)
 {
-   if(!modbus_tx_new[MBAPHeader.WhichSocket])
+   if(MobusLoadTxBufferStart(func|0x80,MBAPHeader,3))
    {
-      MobusLoadTxBufferStart(func|0x80,MBAPHeader,3);
-
       modbus_putc(MBAPHeader.WhichSocket,error,TRUE);
       
       modbus_tx_new[MBAPHeader.WhichSocket] = TRUE;
@@ -1300,6 +1258,7 @@ void ModbusTCPTask(void)
          case MODBUS_TCP_STATE_LISTENING:
             if (TCPIsConnected(socket[i])) 
             {
+               ModbusConnectionInit(i);
                state[i]=MODBUS_TCP_STATE_CONNECTED;
                debug_printf("\n\rCONNECTED!");
                lastTick[i]=currTick;
@@ -1317,7 +1276,14 @@ void ModbusTCPTask(void)
                }
                else 
                {
-                  ModbusConnectedTask(socket[i],i);
+                  if (TCPIsGetReady(socket[i]))
+                     lastTick[i]=currTick;
+                  
+                  if (!ModbusConnectedTask(socket[i],i))
+                  {
+                     debug_printf("\n\rBAD FRAME\n\rDISCONNECTING");
+                     state[i]=MODBUS_TCP_STATE_FORCE_DISCONNECT;
+                  }
                }
             }
             else 
@@ -1345,138 +1311,136 @@ void ModbusTCPTask(void)
    }
 }
 
+/* Where each socket is in parsing the request coming in */
+MODBUS_RX_STATE modbus_rx_state[MODBUS_LISTEN_SOCKETS];
+unsigned int16 modbus_rx_count[MODBUS_LISTEN_SOCKETS];
+
+/*
+ModbusConnectionInit
+Input:               int8        which    Socket index
+Output:              void
+*/
+void ModbusConnectionInit(unsigned int8 which)
+{
+   modbus_connection[which]++;
+   modbus_pending_used[which] = 0;
+   modbus_pending_next[which] = 0;
+   modbus_rx_new[which] = FALSE;
+   modbus_tx_new[which] = FALSE;
+   modbus_rx_state[which] = MODBUS_RX_TRANSACTION_IDENTIFIER;
+   modbus_rx_count[which] = 0;
+}
+
 /*
 ModbusConnectedTask
 Input:               TCP_SOCKET  socket   Socket to receive or transmit message on
-                     int8        which    Which TX/RX buffer to transmit/receive message from/on
-Output:              void
+                     int8        which    Which RX buffer to receive message on
+Output:              int1                 FALSE if the client sent something that is not a MODBUS message
 */
-void ModbusConnectedTask(TCP_SOCKET socket,unsigned int8 which)
+int1 ModbusConnectedTask(TCP_SOCKET socket,unsigned int8 which)
 {
-   static MODBUS_STATE state[MODBUS_LISTEN_SOCKETS];
-   int1 execute = TRUE;
-   unsigned int8 count;
-   MODBUS_RX_STATE rx_state;
    unsigned int8 data;
+   unsigned int16 count;
+   
+   //responses were written straight into the socket, send them
+   ModbusTxEnd();
+   if(modbus_tx_new[which])
+   {
+      TCPFlush(socket);
+      modbus_tx_new[which] = FALSE;
+   }
    
-   while(execute)
+   //Requests wait in the socket's RX buffer until the application has taken
+   //the previous one with modbus_getd(), so a client may pipeline as many as
+   //its TCP window holds.  Exactly one message is read at a time, using the
+   //MBAP Length, so requests arriving back to back are not run together.
+   count = modbus_rx_count[which];
+   
+   while(!modbus_rx_new[which] && TCPGet(socket,&data))
    {
-      switch(state[which])
+      debug_printf("%X ",data);
+      
+      switch(modbus_rx_state[which])
       {
-         case MODBUS_IDLE:
-            if(TCPIsGetReady(socket))
+         case MODBUS_RX_TRANSACTION_IDENTIFIER:
+            if(count == 0)
             {
-               state[which] = MODBUS_GET_MESSAGE;
-               continue;
+               modbus_rx[which].MBAPHeader.TransactionIdentifier = (unsigned int16)data << 8;
+               count++;
             }
-               
-            if(modbus_tx_new[which])
+            else
             {
-               state[which] = MODBUS_SEND_RESPONSE;
+               modbus_rx[which].MBAPHeader.TransactionIdentifier |= data;
+               count = 0;
+               modbus_rx_state[which] = MODBUS_RX_PROTOCOL_IDENTIFER;
             }
-            
-            execute = FALSE;
             break;
-         case MODBUS_GET_MESSAGE:
-            count = 0;
-            rx_state = MODBUS_RX_TRANSACTION_IDENTIFIER;
-            
-            debug_printf("\n\n\r");
-            
-            while(TCPGet(socket,&data))
+         case MODBUS_RX_PROTOCOL_IDENTIFER:
+            if(count == 0)
             {
-               debug_printf("%X ",data);
-            
-               switch(rx_state)
-               {
-                  case MODBUS_RX_TRANSACTION_IDENTIFIER:
-                     if(count == 0)
-                     {
-                        modbus_rx[which].MBAPHeader.TransactionIdentifier = (unsigned int16)data << 8;
-                        count++;
-                     }
-                     else
-                     {
-                        modbus_rx[which].MBAPHeader.TransactionIdentifier |= data;
-                        count = 0;
-                        rx_state = MODBUS_RX_PROTOCOL_IDENTIFER;
-                     }
-                     break;
-                  case MODBUS_RX_PROTOCOL_IDENTIFER:
-                     if(count == 0)
-                     {
-                        modbus_rx[which].MBAPHeader.ProtocolIdentifier = (unsigned int16)data << 8;
-                        count++;
-                     }
-                     else
-                     {
-                        modbus_rx[which].MBAPHeader.ProtocolIdentifier |= data;
-                        count = 0;
-                        rx_state = MODBUS_RX_LENGTH;
-                     }
-                     break;
-                  case MODBUS_RX_LENGTH:
-                     if(count == 0)
-                     {
-                        modbus_rx[which].MBAPHeader.Length = (unsigned int16)data << 8;
-                        count++;
-                     }
-                     else
-                     {
-                        modbus_rx[which].MBAPHeader.Length |= data;
-                        modbus_rx[which].len = modbus_rx[which].MBAPHeader.Length - 2;  //subtact 2 off for Unit Identifier and Function Code
-                        count = 0;
-                        rx_state = MODBUS_RX_UNIT_IDENTIFIER;
-                     }
-                     break;
-                  case MODBUS_RX_UNIT_IDENTIFIER:
-                     modbus_rx[which].MBAPHeader.UnitIdentifier = data;
-                     rx_state = MODBUS_RX_FUNCTION_CODE;
-                     break;
-                  case MODBUS_RX_FUNCTION_CODE:
-                     modbus_rx[which].func = data;
-                     rx_state = MODBUS_RX_DATA;
-                     break;
-                  case MODBUS_RX_DATA:
-                     if(count >= MODBUS_BUFFER_SIZE)
-                        count = MODBUS_BUFFER_SIZE - 1;
-                        
-                     modbus_rx[which].data[count] = data;
-                     count++;
-                     break;
-               }
+               modbus_rx[which].MBAPHeader.ProtocolIdentifier = (unsigned int16)data << 8;
+               count++;
+            }
+            else
+            {
+               modbus_rx[which].MBAPHeader.ProtocolIdentifier |= data;
+               count = 0;
+               modbus_rx_state[which] = MODBUS_RX_LENGTH;
             }
-            
-            debug_printf("\n\n\r");
-            
-            modbus_rx[which].MBAPHeader.WhichSocket = which;
-            modbus_rx_new[which] = TRUE;            
-            state[which] = MODBUS_IDLE;
-            execute = FALSE;
             break;
-         case MODBUS_SEND_RESPONSE:
-            TCPDiscard(socket);
-            
-            if(TCPIsPutReady(socket))
+         case MODBUS_RX_LENGTH:
+            if(count == 0)
             {
-               TCPPut(socket,make8(modbus_tx[which].MBAPHeader.TransactionIdentifier,1));
-               TCPPut(socket,make8(modbus_tx[which].MBAPHeader.TransactionIdentifier,0));
-               TCPPut(socket,make8(modbus_tx[which].MBAPHeader.ProtocolIdentifier,1));
-               TCPPut(socket,make8(modbus_tx[which].MBAPHeader.ProtocolIdentifier,0));
-               TCPPut(socket,make8(modbus_tx[which].MBAPHeader.Length,1));
-               TCPPut(socket,make8(modbus_tx[which].MBAPHeader.Length,0));
-               TCPPut(socket,modbus_tx[which].MBAPHeader.UnitIdentifier);
-               TCPPut(socket,modbus_tx[which].func);
-               TCPPutArray(socket,modbus_tx[which].data,modbus_tx[which].MBAPHeader.Length-2);
-               TCPFlush(socket);
-               modbus_tx_new[which] = FALSE;
-               state[which] = MODBUS_IDLE;
+               modbus_rx[which].MBAPHeader.Length = (unsigned int16)data << 8;
+               count++;
             }
-            
-            execute = FALSE;
+            else
+            {
+               modbus_rx[which].MBAPHeader.Length |= data;
+               count = 0;
+               
+               //without a sane header there is no way to find the next message,
+               //and a length the buffer can't hold would be trusted for the rest of the stream
+               if(modbus_rx[which].MBAPHeader.ProtocolIdentifier != 0 || modbus_rx[which].MBAPHeader.Length < 2 || modbus_rx[which].MBAPHeader.Length > MODBUS_BUFFER_SIZE + 2)
+                  return(FALSE);
+               
+               modbus_rx[which].len = modbus_rx[which].MBAPHeader.Length - 2;  //subtact 2 off for Unit Identifier and Function Code
+               modbus_rx_state[which] = MODBUS_RX_UNIT_IDENTIFIER;
+            }
+            break;
+         case MODBUS_RX_UNIT_IDENTIFIER:
+            modbus_rx[which].MBAPHeader.UnitIdentifier = data;
+            modbus_rx_state[which] = MODBUS_RX_FUNCTION_CODE;
+            break;
+         case MODBUS_RX_FUNCTION_CODE:
+            modbus_rx[which].func = data;
+            modbus_rx_state[which] = MODBUS_RX_DATA;
             break;
+         case MODBUS_RX_DATA:
+            if(count < MODBUS_BUFFER_SIZE)
+               modbus_rx[which].data[count] = data;
+            else
+               modbus_rx[which].data[MODBUS_BUFFER_SIZE - 1] = data;
+            count++;
+            break;
+      }
+      
+      if(modbus_rx_state[which] == MODBUS_RX_DATA && count >= modbus_rx[which].len)
+      {
+         debug_printf("\n\n\r");
+         
+         modbus_rx[which].MBAPHeader.WhichSocket = which;
+         modbus_rx[which].MBAPHeader.Connection = modbus_connection[which];
+         ModbusPendingAdd(which, modbus_rx[which].MBAPHeader.TransactionIdentifier);
+         modbus_rx_new[which] = TRUE;
+         
+         modbus_rx_state[which] = MODBUS_RX_TRANSACTION_IDENTIFIER;
+         count = 0;
       }
    }
+   
+   modbus_rx_count[which] = count;
+   return(TRUE);
 }
 
 #endif
@@ -300,6 +300,14 @@ int1 modbus_read_FIFO_queue(unsigned int8 address, unsigned int16 FIFO_address);
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Server API                                                                       ////
 ////                                                                                  ////
+////  Up to MODBUS_LISTEN_SOCKETS clients are served at once, and each may pipeline   ////
+////  requests.  modbus_getd() takes one request at a time, round robin between the   ////
+////  sockets, and the application may hold up to MODBUS_MAX_PENDING requests per     ////
+////  connection before answering them, in any order.  Keep the MBAPHeader returned   ////
+////  by modbus_getd() and pass it to the response function.  Responses are written   ////
+////  straight into the socket; a response function returns 1 if the socket has no    ////
+////  room for it yet, call it again later.                                           ////
+////                                                                                  ////
 ////  int1 modbus_read_coils_rsp(MBAPHeader,byte_count,*coil_data)                    ////
 ////    - Wrapper to respond to 0x01(read coils) in the MODBUS specification.         ////
 ////                                                                                  ////
@@ -534,13 +542,20 @@ Output:              void
 void ModbusConnectedTask(TCP_SOCKET socket);
 
 #else
+/*
+ModbusConnectionInit
+Input:               int8        which    Socket index
+Output:              void
+*/
+void ModbusConnectionInit(unsigned int8 which);
+
 /*
 ModbusConnectedTask
 Input:               TCP_SOCKET  socket   Socket to receive or transmit message on
-                     int8        which    Which TX/RX buffer to transmit/receive message from/on
-Output:              void
+                     int8        which    Which RX buffer to receive message on
+Output:              int1                 FALSE if the client sent something that is not a MODBUS message
 */
-void ModbusConnectedTask(TCP_SOCKET socket,unsigned int8 which);
+int1 ModbusConnectedTask(TCP_SOCKET socket,unsigned int8 which);
 
 #endif
 
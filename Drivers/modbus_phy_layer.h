@@ -25,16 +25,37 @@
 #define MODBUS_PHY_LAYER_H
 
 #if (MODBUS_TYPE == MODBUS_TYPE_MASTER)
-#if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU) && (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
 #define MODBUS_SERIAL_WAIT_FOR_RESPONSE()\
 {\
    modbus_timeout_enabled = 0;\
    if(address)\
    {\
+      while(modbus_serial_tx_busy())\
+         MODBUS_SERIAL_IDLE();\
       while(!modbus_kbhit() && --modbus_serial_wait)\
          delay_us(1);\
       if(!modbus_serial_wait)\
+      {\
          modbus_rx.error=TIMEOUT;\
+         MODBUS_STATS_INC(g_modbus_timeouts);\
+      }\
+   }\
+   modbus_serial_wait = MODBUS_SERIAL_TIMEOUT;\
+}
+#elif (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+#define MODBUS_SERIAL_WAIT_FOR_RESPONSE()\
+{\
+   modbus_timeout_enabled = 0;\
+   if(address)\
+   {\
+      while(!modbus_kbhit() && --modbus_serial_wait)\
+         delay_us(1);\
+      if(!modbus_serial_wait)\
+      {\
+         modbus_rx.error=TIMEOUT;\
+         MODBUS_STATS_INC(g_modbus_timeouts);\
+      }\
    }\
    modbus_serial_wait = MODBUS_SERIAL_TIMEOUT;\
 }
@@ -46,7 +67,10 @@
       while(!modbus_kbhit() && --modbus_serial_wait)\
          delay_us(1);\
       if(!modbus_serial_wait)\
+      {\
          modbus_rx.error=TIMEOUT;\
+         MODBUS_STATS_INC(g_modbus_timeouts);\
+      }\
    }\
    modbus_serial_wait = MODBUS_SERIAL_TIMEOUT;\
 }
@@ -103,10 +127,57 @@
 #if (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
 #define WAIT_FOR_HW_BUFFER()\
 {\
-   while(!TRMT);\
+   while(!TRMT)\
+      MODBUS_SERIAL_IDLE();\
 }
 #endif
 
+/*Serial line and tick source.  Define these before including modbus.c to run
+  the driver over something else than the UART and timer, for example a
+  simulated line and clock when timing the protocol code.  MODBUS_SERIAL_IDLE()
+  is called in every loop that waits for the transmitter, a simulation uses it
+  to let time pass and run the interrupts.*/
+#ifndef MODBUS_SERIAL_GETC
+ #define MODBUS_SERIAL_GETC()     fgetc(MODBUS_SERIAL)
+#endif
+
+#ifndef MODBUS_SERIAL_PUTC
+ #define MODBUS_SERIAL_PUTC(c)    fputc(c, MODBUS_SERIAL)
+#endif
+
+#ifndef MODBUS_SERIAL_KBHIT
+ #define MODBUS_SERIAL_KBHIT()    kbhit(MODBUS_SERIAL)
+#endif
+
+#ifndef MODBUS_GET_TICKS
+ #define MODBUS_GET_TICKS()       get_ticks()       //0.1ms, 16 bits
+#endif
+
+#ifndef MODBUS_SET_TICKS
+ #define MODBUS_SET_TICKS(t)      set_ticks(t)
+#endif
+
+#ifndef MODBUS_SERIAL_IDLE
+ #define MODBUS_SERIAL_IDLE()
+#endif
+
+#ifdef MODBUS_SERIAL_STATS
+unsigned int32
+   g_modbus_rx_bytes,      //characters received
+   g_modbus_tx_bytes,      //characters sent
+   g_modbus_rx_frames,     //frames received with a good CRC/LRC
+   g_modbus_tx_frames,     //frames sent
+   g_modbus_rx_errors,     //frames dropped for a bad CRC/LRC or too short
+   g_modbus_rx_overruns,   //characters that did not fit in modbus_rx.data
+   g_modbus_timeouts;      //master requests that got no answer
+
+ #define MODBUS_STATS_INC(v)      v++
+ #define MODBUS_PUTC(c)           {MODBUS_SERIAL_PUTC(c); g_modbus_tx_bytes++;}
+#else
+ #define MODBUS_STATS_INC(v)
+ #define MODBUS_PUTC(c)           MODBUS_SERIAL_PUTC(c)
+#endif
+
 int1 modbus_serial_new=0;
 
 /********************************************************************
@@ -165,6 +236,16 @@ struct
 ////  modbus_serial_putc(unsigned int8 c)                                             ////
 ////    - Sends a character onto the serial line                                      ////
 ////                                                                                  ////
+////  modbus_serial_tx_busy()                                                         ////
+////    - RTU on a hardware UART only.  The send functions queue the frame in a       ////
+////      ring drained by the transmit interrupt and return at once, the gaps are     ////
+////      timed by the timer interrupt.  Returns TRUE until the last byte is out, the ////
+////      RS485 driver is off and reception is back on.                               ////
+////                                                                                  ////
+////  modbus_serial_stats_reset()                                                     ////
+////    - MODBUS_SERIAL_STATS only.  Zeroes the g_modbus_* traffic counters.  Called  ////
+////      by modbus_init().                                                           ////
+////                                                                                  ////
 //////////////////////////////////////////////////////////////////////////////////////////
 
 // Purpose:    Send a message over the RS485 bus
@@ -187,6 +268,27 @@ void modbus_serial_send_stop();
 // Outputs:    None
 void modbus_serial_putc(unsigned int8 c);
 
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU) && (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
+// Purpose:    Ends the gap in front of a frame and turns the bus around
+//             after it, every 0.1ms while the transmitter's timer runs
+// Inputs:     None
+// Outputs:    None
+void modbus_tx_timer_isr(void);
+
+// Purpose:    Check if a frame is still being sent
+// Inputs:     None
+// Outputs:    TRUE if the transmitter is busy
+//             FALSE if the last frame is completely out
+int1 modbus_serial_tx_busy(void);
+#endif
+
+#ifdef MODBUS_SERIAL_STATS
+// Purpose:    Zeroes the traffic counters
+// Inputs:     None
+// Outputs:    None
+void modbus_serial_stats_reset(void);
+#endif
+
 //////////////////////////////////////////////////////////////////////////////////////////
 ////  For Init                                                                        ////
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -87,7 +87,7 @@ unsigned int8 modbus_serial_lrc;
 void RCV_ON(void)
 {
    #if (MODBUS_SERIAL_INT_SOURCE!=MODBUS_INT_EXT)
-      while(kbhit(MODBUS_SERIAL)) {fgetc(MODBUS_SERIAL);}  //Clear RX buffer. Clear RDA interrupt flag. Clear overrun error flag.
+      while(MODBUS_SERIAL_KBHIT()) {MODBUS_SERIAL_GETC();}  //Clear RX buffer. Clear RDA interrupt flag. Clear overrun error flag.
       #if (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA)
         clear_interrupt(INT_RDA);
       #elif (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA2)
@@ -140,6 +140,22 @@ void modbus_calc_crc(char data)
    modbus_serial_lrc+=data;
 }
 
+#ifdef MODBUS_SERIAL_STATS
+// Purpose:    Zeroes the traffic counters
+// Inputs:     None
+// Outputs:    None
+void modbus_serial_stats_reset(void)
+{
+   g_modbus_rx_bytes = 0;
+   g_modbus_tx_bytes = 0;
+   g_modbus_rx_frames = 0;
+   g_modbus_tx_frames = 0;
+   g_modbus_rx_errors = 0;
+   g_modbus_rx_overruns = 0;
+   g_modbus_timeouts = 0;
+}
+#endif
+
 #if defined(__PCD__)
 // Purpose :   Calculate the parity bit (bit 7) when using PCD Compiler
 // Input:      Character to send before parity bit is set
@@ -195,11 +211,11 @@ void modbus_serial_putc(unsigned int8 c)
   #if defined(__PCD__)
    asciih = calculate_parity(asciih);
   #endif
-   fputc(asciih,MODBUS_SERIAL);
+   MODBUS_PUTC(asciih);
   #if defined(__PCD__)
    asciil = calculate_parity(asciil);
   #endif
-   fputc(asciil,MODBUS_SERIAL);
+   MODBUS_PUTC(asciil);
    modbus_calc_crc(c);
 }
 
@@ -222,7 +238,7 @@ void modbus_serial_send_start(unsigned int8 to, unsigned int8 func)
    output_high(MODBUS_SERIAL_ENABLE_PIN);
 #endif
 
-   fputc(':',MODBUS_SERIAL);
+   MODBUS_PUTC(':');
 
    modbus_serial_putc(to);
    modbus_serial_putc(func);
@@ -242,8 +258,9 @@ void modbus_serial_send_stop()
    modbus_serial_lrc++;
 
    modbus_serial_putc(modbus_serial_lrc);
-   fputc('\r',MODBUS_SERIAL);
-   fputc('\n',MODBUS_SERIAL);
+   MODBUS_PUTC('\r');
+   MODBUS_PUTC('\n');
+   MODBUS_STATS_INC(g_modbus_tx_frames);
 
 #if (MODBUS_SERIAL_INT_SOURCE!=MODBUS_INT_EXT)
    WAIT_FOR_HW_BUFFER();
@@ -279,7 +296,8 @@ void incomming_modbus_serial() {
    static int1 two_characters=0;
    static unsigned int8 datah,datal,data;
 
-   c = fgetc(MODBUS_SERIAL) & 0x7F;
+   c = MODBUS_SERIAL_GETC() & 0x7F;
+   MODBUS_STATS_INC(g_modbus_rx_bytes);
 
    if (!modbus_serial_new)
    {
@@ -309,7 +327,7 @@ void incomming_modbus_serial() {
             modbus_calc_crc(data);
             modbus_serial_state++;
          }
-         two_characters++;
+         two_characters = !two_characters;
       }
       else if(modbus_serial_state == MODBUS_GETFUNC)
       {
@@ -333,7 +351,7 @@ void incomming_modbus_serial() {
             modbus_rx.len=0;
             modbus_rx.error=0;
          }
-         two_characters++;
+         two_characters = !two_characters;
       }
       else if(modbus_serial_state == MODBUS_GETDATA)
       {
@@ -349,7 +367,7 @@ void incomming_modbus_serial() {
                datah=((c-0x37)<<4);
             else
                datah=((c-0x30)<<4);
-            two_characters++;
+            two_characters = !two_characters;
          }
          else
          {
@@ -359,11 +377,14 @@ void incomming_modbus_serial() {
                datal=c-0x30;
             data=(datah | datal);
             if (modbus_rx.len>=MODBUS_SERIAL_RX_BUFFER_SIZE)
+            {
+               MODBUS_STATS_INC(g_modbus_rx_overruns);
                modbus_rx.len=MODBUS_SERIAL_RX_BUFFER_SIZE-1;
+            }
             modbus_rx.data[modbus_rx.len]=data;
             modbus_rx.len++;
             modbus_calc_crc(data);
-            two_characters++;
+            two_characters = !two_characters;
          }
       }
       else if(modbus_serial_state==MODBUS_STOP)
@@ -372,8 +393,15 @@ void incomming_modbus_serial() {
          {
             modbus_serial_lrc=((0xFF-modbus_serial_lrc)+1);
             if(modbus_serial_lrc==data)
+            {
                modbus_serial_new=TRUE;
+               MODBUS_STATS_INC(g_modbus_rx_frames);
+            }
+            else
+               MODBUS_STATS_INC(g_modbus_rx_errors);
          }
+         else
+            MODBUS_STATS_INC(g_modbus_rx_errors);
          modbus_serial_state=MODBUS_START;
          two_characters=0;
       }
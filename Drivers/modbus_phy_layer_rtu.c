@@ -36,6 +36,14 @@
 
 #define MODBUS_GETDATA_TIMEOUT 40
 
+// Inter-frame gap of 3.5 characters (11 bits each) in timer ticks, rounded
+// up.  Above 19200 baud the protocol fixes it at 1750us.
+#if (MODBUS_SERIAL_BAUD > 19200)
+  #define MODBUS_T35_TICKS 18
+#else
+  #define MODBUS_T35_TICKS ((385000/MODBUS_SERIAL_BAUD)+1)
+#endif
+
 #if( MODBUS_SERIAL_INT_SOURCE == MODBUS_INT_RDA )
   #if MODBUS_PARITY == "EVEN"
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART1, bits=8, stop=1, parity=E, stream=MODBUS_SERIAL, errors)
@@ -45,6 +53,7 @@
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART1, bits=8, stop=2, parity=N, stream=MODBUS_SERIAL, errors)
   #endif
    #define RCV_OFF() {disable_interrupts(INT_RDA);}
+   #define MODBUS_INT_TBE INT_TBE
 #elif( MODBUS_SERIAL_INT_SOURCE == MODBUS_INT_RDA2 )
   #if MODBUS_PARITY == "EVEN"
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART2, bits=8, stop=1, parity=E, stream=MODBUS_SERIAL, errors)
@@ -54,6 +63,7 @@
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART2, bits=8, stop=2, parity=N, stream=MODBUS_SERIAL, errors)
   #endif
    #define RCV_OFF() {disable_interrupts(INT_RDA2);}
+   #define MODBUS_INT_TBE INT_TBE2
 #elif( MODBUS_SERIAL_INT_SOURCE == MODBUS_INT_RDA3 )
   #if MODBUS_PARITY == "EVEN"
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART3, bits=8, stop=1, parity=E, stream=MODBUS_SERIAL, errors)
@@ -63,6 +73,7 @@
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART3, bits=8, stop=2, parity=N, stream=MODBUS_SERIAL, errors)
   #endif
    #define RCV_OFF() {disable_interrupts(INT_RDA3);}
+   #define MODBUS_INT_TBE INT_TBE3
 #elif( MODBUS_SERIAL_INT_SOURCE == MODBUS_INT_RDA4 )
   #if MODBUS_PARITY == "EVEN"
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART4, bits=8, stop=1, parity=E, stream=MODBUS_SERIAL, errors)
@@ -72,6 +83,7 @@
    #use rs232(baud=MODBUS_SERIAL_BAUD, UART4, bits=8, stop=2, parity=N, stream=MODBUS_SERIAL, errors)
   #endif
    #define RCV_OFF() {disable_interrupts(INT_RDA4);}
+   #define MODBUS_INT_TBE INT_TBE4
 #elif( MODBUS_SERIAL_INT_SOURCE == MODBUS_INT_EXT )
   #if MODBUS_PARITY == "EVEN"
    #use rs232(baud=MODBUS_SERIAL_BAUD, xmit=MODBUS_SERIAL_TX_PIN, rcv=MODBUS_SERIAL_RX_PIN, bits=8, stop=1, parity=E, stream=MODBUS_SERIAL, disable_ints)
@@ -96,6 +108,58 @@ int1 modbus_timeout_enabled = false;
 unsigned int32 modbus_serial_wait=MODBUS_SERIAL_TIMEOUT;
 #endif
 
+#if (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
+// One character (11 bits) in timer ticks, rounded up.  The bus is turned
+// around this long after the last character went from the transmit holding
+// register into the shift register.
+#define MODBUS_T1_TICKS ((110000/MODBUS_SERIAL_BAUD)+1)
+
+// The transmitter's timer.  Timer 2 interrupts every 0.1ms while the gap in
+// front of a frame or the bus turnaround after it is being timed, and is
+// off the rest of the time.  Define MODBUS_TX_TIMER_START() and
+// MODBUS_TX_TIMER_STOP() to use another timer; its interrupt must then call
+// modbus_tx_timer_isr().
+#ifndef MODBUS_TX_TIMER_START
+  #if (MODBUS_TIMER_USED == MODBUS_TIMER_T2)
+    #error The RTU transmitter uses Timer 2, pick MODBUS_TIMER_T1 or define MODBUS_TX_TIMER_START() and MODBUS_TX_TIMER_STOP()
+  #endif
+  #if defined(__PCD__)
+    #define MODBUS_TX_TIMER_SETUP()  setup_timer2(TMR_INTERNAL | TMR_DIV_BY_1, (getenv("CLOCK")/20000)-1)
+  #elif (getenv("CLOCK") <= 10240000)
+    #define MODBUS_TX_TIMER_SETUP()  setup_timer_2(T2_DIV_BY_1, (getenv("CLOCK")/40000)-1, 1)
+  #elif (getenv("CLOCK") <= 40960000)
+    #define MODBUS_TX_TIMER_SETUP()  setup_timer_2(T2_DIV_BY_4, (getenv("CLOCK")/160000)-1, 1)
+  #else
+    #define MODBUS_TX_TIMER_SETUP()  setup_timer_2(T2_DIV_BY_16, (getenv("CLOCK")/640000)-1, 1)
+  #endif
+  #define MODBUS_TX_TIMER_START()    {MODBUS_TX_TIMER_SETUP(); set_timer2(0); clear_interrupt(INT_TIMER2); enable_interrupts(INT_TIMER2);}
+  #define MODBUS_TX_TIMER_STOP()     {disable_interrupts(INT_TIMER2);}
+  #define MODBUS_TX_TIMER_INT_TIMER2
+#endif
+
+/*Stages of MODBUS transmission.  The timer interrupt ends MODBUS_TX_GAP
+  and MODBUS_TX_TURN, the transmit interrupt drains the ring in
+  MODBUS_TX_SEND.*/
+enum {MODBUS_TX_IDLE=0, MODBUS_TX_GAP=1, MODBUS_TX_SEND=2, MODBUS_TX_TURN=3} modbus_tx_state = 0;
+
+/*Transmit ring.  Written by modbus_serial_putc(), read by the TBE ISR.
+  It holds one byte less than its size.*/
+#if (MODBUS_SERIAL_TX_BUFFER_SIZE > 256)
+typedef unsigned int16 modbus_tx_index;
+#else
+typedef unsigned int8 modbus_tx_index;
+#endif
+unsigned int8 modbus_tx_buffer[MODBUS_SERIAL_TX_BUFFER_SIZE];
+modbus_tx_index modbus_tx_head = 0;
+modbus_tx_index modbus_tx_tail = 0;
+
+/*Set by modbus_serial_send_stop() once the whole frame is in the ring.*/
+int1 modbus_tx_closed = FALSE;
+
+/*Timer ticks left in MODBUS_TX_GAP or MODBUS_TX_TURN.*/
+unsigned int16 modbus_tx_ticks;
+#endif
+
 /*Stages of MODBUS reception.  Used to keep our ISR fast enough.*/
 enum {MODBUS_GETADDY=0, MODBUS_GETFUNC=1, MODBUS_GETDATA=2} modbus_serial_state = 0;
 
@@ -158,7 +222,7 @@ const unsigned char modbus_auchCRCLo[] = {
 void RCV_ON(void)
 {
    #if (MODBUS_SERIAL_INT_SOURCE!=MODBUS_INT_EXT)
-      while(kbhit(MODBUS_SERIAL)) {fgetc(MODBUS_SERIAL);}  //Clear RX buffer. Clear RDA interrupt flag. Clear overrun error flag.
+      while(MODBUS_SERIAL_KBHIT()) {MODBUS_SERIAL_GETC();}  //Clear RX buffer. Clear RDA interrupt flag. Clear overrun error flag.
       #if (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA)
          clear_interrupt(INT_RDA);
       #elif (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA2)
@@ -210,7 +274,7 @@ void RCV_ON(void)
 void modbus_enable_timeout(int1 enable)
 {
    modbus_timeout_enabled = enable;
-   set_ticks(0);
+   MODBUS_SET_TICKS(0);
 }
 
 // Purpose:    Handles a timeout when waiting for a response
@@ -223,7 +287,10 @@ void modbus_timeout_now(void)
    {
       modbus_rx.len-=2;
       modbus_serial_new=TRUE;
+      MODBUS_STATS_INC(g_modbus_rx_frames);
    } else {
+      if(modbus_serial_state != MODBUS_GETADDY)
+         MODBUS_STATS_INC(g_modbus_rx_errors);
       modbus_serial_new=FALSE;
    }
 
@@ -239,15 +306,16 @@ void modbus_timeout_now(void)
 void modbus_check_timeout(void)
 {
    #if (MODBUS_TIMER_UPDATE == MODBUS_TIMER_NOISR)
-   //get_ticks() must be called more often than the timer overflow
-   //rate, and the get_ticks() below will not always be called
+   //MODBUS_GET_TICKS() must be called more often than the timer overflow
+   //rate, and the MODBUS_GET_TICKS() below will not always be called
    //due to short circuit evaluation
-   get_ticks();
+   MODBUS_GET_TICKS();
    #endif
-   //modbus_timeout_enabled must be checked before get_ticks()
+
+   //modbus_timeout_enabled must be checked before MODBUS_GET_TICKS()
    //so that if an interrupt happens it cannot be enabled after
    //an old timer value is used in comparison
-   if(modbus_timeout_enabled && (get_ticks() > MODBUS_GETDATA_TIMEOUT))
+   if(modbus_timeout_enabled && (MODBUS_GET_TICKS() > MODBUS_GETDATA_TIMEOUT))
    {
      modbus_timeout_now();
    }
@@ -265,12 +333,123 @@ void modbus_calc_crc(char data)
    modbus_serial_crc.b[0] = modbus_auchCRCLo[uIndex];
 }
 
+#ifdef MODBUS_SERIAL_STATS
+// Purpose:    Zeroes the traffic counters
+// Inputs:     None
+// Outputs:    None
+void modbus_serial_stats_reset(void)
+{
+   g_modbus_rx_bytes = 0;
+   g_modbus_tx_bytes = 0;
+   g_modbus_rx_frames = 0;
+   g_modbus_tx_frames = 0;
+   g_modbus_rx_errors = 0;
+   g_modbus_rx_overruns = 0;
+   g_modbus_timeouts = 0;
+}
+#endif
+
+#if (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
+// Purpose:    Check if a frame is still being sent
+// Inputs:     None
+// Outputs:    TRUE if the transmitter is busy
+//             FALSE if the last frame is completely out
+int1 modbus_serial_tx_busy(void)
+{
+   return(modbus_tx_state != MODBUS_TX_IDLE);
+}
+
+// Purpose:    Puts a character onto the serial line
+// Inputs:     Character
+// Outputs:    None
+// Note:       Only waits if the transmit ring is full.
+void modbus_serial_putc(unsigned int8 c)
+{
+   modbus_tx_index next;
+
+   modbus_calc_crc(c);
+
+   next = modbus_tx_head + 1;
+   if(next >= MODBUS_SERIAL_TX_BUFFER_SIZE)
+      next = 0;
+
+   while(next == modbus_tx_tail)
+      MODBUS_SERIAL_IDLE();
+
+   modbus_tx_buffer[modbus_tx_head] = c;
+   modbus_tx_head = next;
+
+   if(modbus_tx_state == MODBUS_TX_SEND)
+      enable_interrupts(MODBUS_INT_TBE);
+}
+
+// Purpose:    Send a message over the RS485 bus
+// Inputs:     1) The destination address
+//             2) The number of bytes of data to send
+//             3) A pointer to the data to send
+//             4) The length of the data
+// Outputs:    TRUE if successful
+//             FALSE if failed
+// Note:       Format:  source | destination | data-length | data | checksum
+//             Waits for a previous frame to finish, then returns as soon
+//             as the bytes are queued.  The 3.5 character gap is timed
+//             by the timer interrupt.
+void modbus_serial_send_start(unsigned int8 to, unsigned int8 func)
+{
+   while(modbus_serial_tx_busy())
+      MODBUS_SERIAL_IDLE();
+
+   modbus_serial_crc.d=0xFFFF;
+   modbus_serial_new=FALSE;
+
+   RCV_OFF();
+
+#if (MODBUS_SERIAL_ENABLE_PIN!=0)
+   output_high(MODBUS_SERIAL_ENABLE_PIN);
+#endif
+
+   modbus_tx_head = 0;
+   modbus_tx_tail = 0;
+   modbus_tx_closed = FALSE;
+   modbus_tx_ticks = MODBUS_T35_TICKS;
+   modbus_tx_state = MODBUS_TX_GAP;
+   MODBUS_TX_TIMER_START();
+
+   modbus_serial_putc(to);
+   modbus_serial_putc(func);
+}
+
+// Purpose:    Ends a message over the RS485 Bus
+// Inputs:     Character
+// Outputs:    None
+// Note:       Returns as soon as the CRC is queued.  Use
+//             modbus_serial_tx_busy() to find out when the frame is out.
+void modbus_serial_send_stop()
+{
+   unsigned int8 crc_low, crc_high;
+
+   crc_high=modbus_serial_crc.b[1];
+   crc_low=modbus_serial_crc.b[0];
+
+   modbus_serial_putc(crc_high);
+   modbus_serial_putc(crc_low);
+   MODBUS_STATS_INC(g_modbus_tx_frames);
+
+   // the transmit interrupt may have run the ring empty before the frame
+   //  was closed, start it again so it sees the end
+   modbus_tx_closed = TRUE;
+   if(modbus_tx_state == MODBUS_TX_SEND)
+      enable_interrupts(MODBUS_INT_TBE);
+
+   modbus_serial_crc.d=0xFFFF;
+}
+#else
 // Purpose:    Puts a character onto the serial line
 // Inputs:     Character
 // Outputs:    None
 void modbus_serial_putc(unsigned int8 c)
 {
-   fputc(c, MODBUS_SERIAL);
+   MODBUS_PUTC(c);
    modbus_calc_crc(c);
    delay_us(1000000/MODBUS_SERIAL_BAUD); //one stop bit.  not exact
 }
@@ -312,6 +491,7 @@ void modbus_serial_send_stop()
 
    modbus_serial_putc(crc_high);
    modbus_serial_putc(crc_low);
+   MODBUS_STATS_INC(g_modbus_tx_frames);
 
 #if (MODBUS_SERIAL_INT_SOURCE!=MODBUS_INT_EXT)
    WAIT_FOR_HW_BUFFER();
@@ -327,6 +507,7 @@ void modbus_serial_send_stop()
 
    modbus_serial_crc.d=0xFFFF;
 }
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////////////
 //// Interrupts                                                                       ////
@@ -352,7 +533,8 @@ void modbus_serial_send_stop()
 void incomming_modbus_serial() {
    char c;
 
-   c=fgetc(MODBUS_SERIAL);
+   c=MODBUS_SERIAL_GETC();
+   MODBUS_STATS_INC(g_modbus_rx_bytes);
 
    if (!modbus_serial_new)
    {
@@ -373,6 +555,7 @@ void incomming_modbus_serial() {
       {
          if (modbus_rx.len>=MODBUS_SERIAL_RX_BUFFER_SIZE)
        {
+         MODBUS_STATS_INC(g_modbus_rx_overruns);
          modbus_rx.len=MODBUS_SERIAL_RX_BUFFER_SIZE-1;
        }
          modbus_rx.data[modbus_rx.len]=c;
@@ -386,4 +569,74 @@ void incomming_modbus_serial() {
       modbus_serial_wait=MODBUS_SERIAL_TIMEOUT;
    #endif
 }
+
+#if (MODBUS_SERIAL_INT_SOURCE != MODBUS_INT_EXT)
+#if (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA)
+#int_tbe
+#elif (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA2)
+#int_tbe2
+#elif (MODBUS_SERIAL_INT_SOURCE==MODBUS_INT_RDA3)
+#int_tbe3
+#else
+#int_tbe4
+#endif
+void outgoing_modbus_serial() {
+   if(modbus_tx_head == modbus_tx_tail)
+   {
+      disable_interrupts(MODBUS_INT_TBE);
+
+      // The last character just went into the shift register, its stop
+      // bit is out one character from now
+      if(modbus_tx_closed && (modbus_tx_state == MODBUS_TX_SEND))
+      {
+         modbus_tx_ticks = MODBUS_T1_TICKS;
+         modbus_tx_state = MODBUS_TX_TURN;
+         MODBUS_TX_TIMER_START();
+      }
+      return;
+   }
+
+   MODBUS_PUTC(modbus_tx_buffer[modbus_tx_tail]);
+
+   if(++modbus_tx_tail >= MODBUS_SERIAL_TX_BUFFER_SIZE)
+      modbus_tx_tail = 0;
+}
+
+#ifdef MODBUS_TX_TIMER_INT_TIMER2
+#int_timer2
+#endif
+void modbus_tx_timer_isr() {
+   if(modbus_tx_ticks > 1)
+   {
+      modbus_tx_ticks--;
+      return;
+   }
+
+   if(modbus_tx_state == MODBUS_TX_GAP)
+   {
+      MODBUS_TX_TIMER_STOP();
+      modbus_tx_state = MODBUS_TX_SEND;
+      enable_interrupts(MODBUS_INT_TBE);
+   }
+   else if(modbus_tx_state == MODBUS_TX_TURN)
+   {
+      // a slow baud rate generator can leave part of the stop bit, look
+      //  again on the next tick
+      if(!TRMT)
+         return;
+
+      MODBUS_TX_TIMER_STOP();
+
+   #if (MODBUS_SERIAL_ENABLE_PIN!=0)
+      output_low(MODBUS_SERIAL_ENABLE_PIN);
+   #endif
+
+      RCV_ON();
+
+      modbus_tx_state = MODBUS_TX_IDLE;
+   }
+   else
+      MODBUS_TX_TIMER_STOP();
+}
+#endif
 #endif //MODBUS_PHY_LAYER_RTU_C
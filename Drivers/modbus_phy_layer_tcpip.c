@@ -61,39 +61,126 @@ void modbus_putc(unsigned int8 data,int1 new = FALSE)
 }
 
 #else
+/*
+ModbusPendingFind
+Purpose: To find a Transaction Identifier among the requests waiting for a response on a socket
+Input:   int8        which    Socket index
+         int16       tid      Transaction Identifier
+Output:  int8                 Index into modbus_pending, 0xFF if it is not pending
+*/
+unsigned int8 ModbusPendingFind(unsigned int8 which, unsigned int16 tid)
+{
+   unsigned int8 i;
+   
+   for(i=0;i<MODBUS_MAX_PENDING;i++)
+   {
+      if((modbus_pending_used[which] & (1 << i)) && (modbus_pending[which][i] == tid))
+         return(i);
+   }
+   
+   return(0xFF);
+}
+
+/*
+ModbusPendingAdd
+Purpose: To remember a request handed to the application.  If MODBUS_MAX_PENDING requests are already waiting
+         the oldest is forgotten, the client will have given up on it by then.
+Input:   int8        which    Socket index
+         int16       tid      Transaction Identifier
+Output:  void
+*/
+void ModbusPendingAdd(unsigned int8 which, unsigned int16 tid)
+{
+   unsigned int8 i;
+   
+   i = modbus_pending_next[which];
+   
+   modbus_pending[which][i] = tid;
+   modbus_pending_used[which] |= (1 << i);
+   
+   if(++i >= MODBUS_MAX_PENDING)
+      i = 0;
+   modbus_pending_next[which] = i;
+}
+
+/*
+ModbusTxEnd
+Purpose: To finish the response being written, padding it with zeros if fewer bytes than its length were written
+Input:   none
+Output:  void
+*/
+void ModbusTxEnd(void)
+{
+   while(modbus_tx_left)
+   {
+      TCPPut(modbus_tx_socket,0);
+      modbus_tx_left--;
+   }
+   
+   modbus_tx_socket = INVALID_SOCKET;
+}
+
 /*
 ModbusLoadTxBufferStart
-Purpose: To load the MPAB Header and function code into the TX Buffer
+Purpose: To write the MPAB Header and function code of a response into the socket's TX buffer
 Input:   function    func        The function code to send with message
-         MBAP_HEADER MBAPHeader  Contains the Transaction Identifier and Unit Identifier of MBAP Header to send with message
+         MBAP_HEADER MBAPHeader  Header of the request being answered, as returned by modbus_getd()
          int16       length      The number of bytes of the message
-Output:  void
+Output:  int1                    TRUE if the rest of the response can be written with modbus_putc(), FALSE if
+                                 the socket does not have room for it yet.  A response to a request that is
+                                 not pending, for example because the client disconnected, returns TRUE and
+                                 is dropped.
 */
-void MobusLoadTxBufferStart(function func, MBAP_HEADER MBAPHeader, unsigned int16 length)
+int1 MobusLoadTxBufferStart(function func, MBAP_HEADER MBAPHeader, unsigned int16 length)
 {
-   modbus_tx[MBAPHeader.WhichSocket].MBAPHeader.TransactionIdentifier = MBAPHeader.TransactionIdentifier;
-   modbus_tx[MBAPHeader.WhichSocket].MBAPHeader.ProtocolIdentifier = 0;
-   modbus_tx[MBAPHeader.WhichSocket].MBAPHeader.Length = length;
-   modbus_tx[MBAPHeader.WhichSocket].MBAPHeader.UnitIdentifier = MBAPHeader.UnitIdentifier;
-   modbus_tx[MBAPHeader.WhichSocket].func = func;
+   unsigned int8 which, i;
+   
+   ModbusTxEnd();
+   
+   which = MBAPHeader.WhichSocket;
+   
+   if(which >= MODBUS_LISTEN_SOCKETS || MBAPHeader.Connection != modbus_connection[which])
+      return(TRUE);
+   
+   i = ModbusPendingFind(which, MBAPHeader.TransactionIdentifier);
+   if(i == 0xFF)
+      return(TRUE);
+   
+   //the whole response must fit, a partial one would break the framing
+   if(TCPIsPutReady(socket[which]) < (length + 6))
+      return(FALSE);
+   
+   modbus_pending_used[which] &= ~(1 << i);
+   
+   TCPPut(socket[which],make8(MBAPHeader.TransactionIdentifier,1));
+   TCPPut(socket[which],make8(MBAPHeader.TransactionIdentifier,0));
+   TCPPut(socket[which],0);
+   TCPPut(socket[which],0);
+   TCPPut(socket[which],make8(length,1));
+   TCPPut(socket[which],make8(length,0));
+   TCPPut(socket[which],MBAPHeader.UnitIdentifier);
+   TCPPut(socket[which],func);
+   
+   modbus_tx_socket = socket[which];
+   modbus_tx_left = length - 2;
+   return(TRUE);
 }
 
 /*
 modbus_putc
-Purpose: To load a byte of data into the TX Buffer
-Input:   int8        which    Selects which TX Buffer to load data into
-         int8        data     The byte of data to load into the buffer
-         int1        new      If TRUE it resets the index and loads the data into index 0, If FALSE loads data into next index location
+Purpose: To write a byte of the response started by MobusLoadTxBufferStart() into the socket
+Input:   int8        which    Not used, the socket was selected by MobusLoadTxBufferStart()
+         int8        data     The byte of data to write
+         int1        new      Not used
 Output:  void
 */
 void modbus_putc(unsigned int8 which, unsigned int8 data, int1 new = FALSE)
 {
-   static unsigned int8 i;
-   
-   if(new)
-      i = 0;
-      
-   modbus_tx[which].data[i++] = data;
+   if(modbus_tx_left)
+   {
+      TCPPut(modbus_tx_socket,data);
+      modbus_tx_left--;
+   }
 }
 
 #endif
@@ -23,12 +23,23 @@
 #ifndef MODBUS_PHY_LAYER_TCPIP_H
 #define MODBUS_PHY_LAYER_TCPIP_H
 
+#include "tcpip\TCPIP Stack\tcp.h"
+
 #if (MODBUS_TYPE == MODBUS_TYPE_CLIENT)
 int1 modbus_rx_new = FALSE;   //Flag to indicating if new message is waiting in RX buffer to receive
 int1 modbus_tx_new = FALSE;   //Flag to indicate if new message is waiting in TX buffer to send
 #else
 static int1 modbus_rx_new[MODBUS_LISTEN_SOCKETS];  //Flag to indicating if new message is waiting in RX buffer to receive
-static int1 modbus_tx_new[MODBUS_LISTEN_SOCKETS];  //Flag to indicate if new message is waiting in TX buffer to send
+static int1 modbus_tx_new[MODBUS_LISTEN_SOCKETS];  //Flag to indicate if responses are waiting in the socket to be flushed
+
+TCP_SOCKET socket[MODBUS_LISTEN_SOCKETS];
+
+unsigned int8 modbus_connection[MODBUS_LISTEN_SOCKETS];  //Bumped for every new connection on a socket
+
+/* Transaction Identifiers handed to the application and not yet answered */
+unsigned int16 modbus_pending[MODBUS_LISTEN_SOCKETS][MODBUS_MAX_PENDING];
+unsigned int8 modbus_pending_used[MODBUS_LISTEN_SOCKETS];  //one bit per modbus_pending entry
+unsigned int8 modbus_pending_next[MODBUS_LISTEN_SOCKETS];  //entry to fill next, oldest is reused
 #endif
 
 /********************************************************************
@@ -90,6 +101,7 @@ typedef struct _MBAP_HEADER {
    unsigned int16 Length;                    //Number of bytes in message including Unit Identifier
    unsigned int8  UnitIdentifier;            //Unit Identifier of message
    unsigned int8  WhichSocket;               //Not part of MBAP Header, added to determine which socket the server is to send response to
+   unsigned int8  Connection;                //Not part of MBAP Header, added so a late response is not sent to the next client on the socket
 } MBAP_HEADER;
 
 struct {
@@ -99,11 +111,13 @@ struct {
    unsigned int8 data[MODBUS_BUFFER_SIZE];   //Data of the received message
 } modbus_rx[MODBUS_LISTEN_SOCKETS];
 
-struct {
-   MBAP_HEADER MBAPHeader;                   //MBAP Header of transmit message
-   function func;                            //The function of the transmit message
-   unsigned int8 data[MODBUS_BUFFER_SIZE];   //Data of the transmit mesage
-} modbus_tx[MODBUS_LISTEN_SOCKETS];
+/********************************************************************
+The server has no TX buffers.  Responses are written straight into
+the socket's TX buffer, which lives in the NIC, so nothing is copied
+twice.  These track the response being written.
+********************************************************************/
+TCP_SOCKET modbus_tx_socket;                 //Socket the response goes to, INVALID_SOCKET if it is dropped
+unsigned int16 modbus_tx_left;               //Bytes of the response still to be written
 
 #endif
 
@@ -130,24 +144,35 @@ void modbus_putc(unsigned int8 data,int1 new = FALSE);
 #else
 /*
 ModbusLoadTxBufferStart
-Purpose: To load the MPAB Header and function code into the TX Buffer
+Purpose: To write the MPAB Header and function code of a response into the socket's TX buffer
 Input:   function    func        The function code to send with message
-         MBAP_HEADER MBAPHeader  Contains the Transaction Identifier and Unit Identifier of MBAP Header to send with message
+         MBAP_HEADER MBAPHeader  Header of the request being answered, as returned by modbus_getd()
          int16       length      The number of bytes of the message
-Output:  void
+Output:  int1                    TRUE if the rest of the response can be written with modbus_putc(), FALSE if
+                                 the socket does not have room for it yet.  A response to a request that is
+                                 not pending, for example because the client disconnected, returns TRUE and
+                                 is dropped.
 */
-void MobusLoadTxBufferStart(function func, MBAP_HEADER MBAPHeader, unsigned int16 length);
+int1 MobusLoadTxBufferStart(function func, MBAP_HEADER MBAPHeader, unsigned int16 length);
 
 /*
 modbus_putc
-Purpose: To load a byte of data into the TX Buffer
-Input:   int8        which    Selects which TX Buffer to load data into
-         int8        data     The byte of data to load into the buffer
-         int1        new      If TRUE it resets the index and loads the data into index 0, If FALSE loads data into next index location
+Purpose: To write a byte of the response started by MobusLoadTxBufferStart() into the socket
+Input:   int8        which    Not used, the socket was selected by MobusLoadTxBufferStart()
+         int8        data     The byte of data to write
+         int1        new      Not used
 Output:  void
 */
 void modbus_putc(unsigned int8 which, unsigned int8 data, int1 new = FALSE);
 
+/*
+ModbusTxEnd
+Purpose: To finish the response being written, padding it with zeros if fewer bytes than its length were written
+Input:   none
+Output:  void
+*/
+void ModbusTxEnd(void);
+
 #endif
 
 #endif
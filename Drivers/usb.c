@@ -33,6 +33,10 @@
 ////                                                                   ////
 //// Version History:                                                  ////
 ////                                                                   ////
+//// Oct 17th, 2026                                                    ////
+////     Added usb_stream_put() and usb_stream_get(), see              ////
+////        USB_STREAM_DEVICE in usb.h.                                ////
+////                                                                   ////
 //// March 20, 2015                                                    ////
 ////     USB_STRING_DESC_OFFSET no longer used.                        ////
 ////                                                                   ////
@@ -645,6 +649,235 @@ unsigned int16 usb_gets(unsigned int8 endpoint, int8 * ptr, unsigned int16 max,
    return(ret);
 }
 
+#if USB_STREAM_DEVICE
+#if USB_STREAM_OUT_ENDPOINT && defined(__USBN960X_H__)
+ #error The OUT stream needs the PIC USB peripheral, set USB_STREAM_OUT_ENDPOINT to 0
+#endif
+
+typedef struct
+{
+   unsigned int8 *ptr;
+   unsigned int16 len;
+} USB_STREAM_BUFFER;
+
+//head is only moved by usb_stream_put()/usb_stream_get(), tail is only moved
+//by the USB ISR.
+USB_STREAM_BUFFER usb_stream_in_queue[USB_STREAM_QUEUE_SIZE];
+unsigned int8 usb_stream_in_head;
+unsigned int8 usb_stream_in_tail;
+unsigned int16 usb_stream_in_sent;     //bytes of the tail buffer handed to the SIE
+int1 usb_stream_in_zlp;                //last packet was full size
+
+#if USB_STREAM_OUT_ENDPOINT
+USB_STREAM_BUFFER usb_stream_out_queue[USB_STREAM_QUEUE_SIZE];
+unsigned int8 usb_stream_out_head;
+unsigned int8 usb_stream_out_tail;
+unsigned int16 usb_stream_out_got;     //bytes received into the tail buffer
+int1 usb_stream_out_held;              //packet waiting in the endpoint, no buffer for it
+#endif
+
+void usb_stream_init(void)
+{
+   usb_stream_in_head = 0;
+   usb_stream_in_tail = 0;
+   usb_stream_in_sent = 0;
+   usb_stream_in_zlp = FALSE;
+  #if USB_STREAM_OUT_ENDPOINT
+   usb_stream_out_head = 0;
+   usb_stream_out_tail = 0;
+   usb_stream_out_got = 0;
+   usb_stream_out_held = FALSE;
+  #endif
+}
+
+// Puts the next packet of the tail IN buffer on the endpoint.  Must be called
+// from the USB ISR or with the USB ISR paused.
+static void usb_stream_in_send(void)
+{
+   USB_STREAM_BUFFER *b;
+   unsigned int16 n;
+
+   if (!usb_tbe(USB_STREAM_IN_ENDPOINT))
+      return;
+
+   if (usb_stream_in_head == usb_stream_in_tail)
+   {
+      if (usb_stream_in_zlp)
+      {
+         if (usb_put_packet(USB_STREAM_IN_ENDPOINT, 0, 0, USB_DTS_TOGGLE))
+            usb_stream_in_zlp = FALSE;
+      }
+      return;
+   }
+
+   b = &usb_stream_in_queue[usb_stream_in_tail];
+   if (usb_stream_in_sent >= b->len)
+      return;  //last packet still in flight, the ISR will retire this buffer
+   n = b->len - usb_stream_in_sent;
+   if (n > usb_ep_tx_size[USB_STREAM_IN_ENDPOINT])
+      n = usb_ep_tx_size[USB_STREAM_IN_ENDPOINT];
+
+   if (usb_put_packet(USB_STREAM_IN_ENDPOINT, b->ptr + usb_stream_in_sent, n, USB_DTS_TOGGLE))
+   {
+      usb_stream_in_sent += n;
+      usb_stream_in_zlp = (n == usb_ep_tx_size[USB_STREAM_IN_ENDPOINT]);
+   }
+}
+
+//handle IN token done interrupt on the stream endpoint
+void usb_isr_tok_in_stream_dne(void)
+{
+   USB_STREAM_BUFFER *b;
+
+   if (usb_stream_in_head != usb_stream_in_tail)
+   {
+      b = &usb_stream_in_queue[usb_stream_in_tail];
+      if (usb_stream_in_sent >= b->len)
+      {
+        #if defined(USB_STREAM_IN_DONE)
+         USB_STREAM_IN_DONE(b->ptr, b->len);
+        #endif
+         usb_stream_in_sent = 0;
+         usb_stream_in_tail = (usb_stream_in_tail + 1) & (USB_STREAM_QUEUE_SIZE - 1);
+      }
+   }
+
+   usb_stream_in_send();
+}
+
+// see usb.h for documentation
+int1 usb_stream_put(unsigned int8 * ptr, unsigned int16 len)
+{
+   unsigned int8 next;
+
+   next = (usb_stream_in_head + 1) & (USB_STREAM_QUEUE_SIZE - 1);
+   if ((next == usb_stream_in_tail) || !len)
+      return(FALSE);
+
+   usb_stream_in_queue[usb_stream_in_head].ptr = ptr;
+   usb_stream_in_queue[usb_stream_in_head].len = len;
+   usb_stream_in_head = next;
+
+   //if the endpoint is idle nothing will come back through the ISR, start it
+   //here.  if it is busy the ISR will pick this buffer up.
+   if (usb_tbe(USB_STREAM_IN_ENDPOINT))
+   {
+      __USB_PAUSE_ISR();
+
+      usb_stream_in_send();
+
+      __USB_RESTORE_ISR();
+   }
+
+   return(TRUE);
+}
+
+// see usb.h for documentation
+unsigned int8 usb_stream_in_pending(void)
+{
+   return((usb_stream_in_head - usb_stream_in_tail) & (USB_STREAM_QUEUE_SIZE - 1));
+}
+
+#if USB_STREAM_OUT_ENDPOINT
+// Moves the packet waiting in the OUT endpoint into the queued buffers and
+// re-arms the endpoint, or leaves it there if no buffer is queued.  Must be
+// called from the USB ISR or with the USB ISR paused.
+static void usb_stream_out_load(void)
+{
+   USB_STREAM_BUFFER *b;
+   unsigned int16 len, room;
+
+   len = usb_rx_packet_size(USB_STREAM_OUT_ENDPOINT);
+
+   if (usb_stream_out_head == usb_stream_out_tail)
+   {
+      usb_stream_out_held = TRUE;
+      return;
+   }
+
+   b = &usb_stream_out_queue[usb_stream_out_tail];
+   room = b->len - usb_stream_out_got;
+
+   //doesn't fit in what is left, hand over this buffer and use the next
+   //one.  a packet bigger than an empty buffer is truncated.
+   if ((len > room) && usb_stream_out_got)
+   {
+     #if defined(USB_STREAM_OUT_DONE)
+      USB_STREAM_OUT_DONE(b->ptr, usb_stream_out_got);
+     #endif
+      usb_stream_out_got = 0;
+      usb_stream_out_tail = (usb_stream_out_tail + 1) & (USB_STREAM_QUEUE_SIZE - 1);
+
+      if (usb_stream_out_head == usb_stream_out_tail)
+      {
+         usb_stream_out_held = TRUE;
+         return;
+      }
+      b = &usb_stream_out_queue[usb_stream_out_tail];
+      room = b->len;
+   }
+   if (len > room)
+      len = room;
+
+   usb_get_packet_buffer(USB_STREAM_OUT_ENDPOINT, b->ptr + usb_stream_out_got, len);
+   usb_stream_out_got += len;
+   usb_stream_out_held = FALSE;
+   usb_flush_out(USB_STREAM_OUT_ENDPOINT, USB_DTS_TOGGLE);
+
+   //full buffer, or a short packet ended the transfer.  a 0 length packet
+   //into an empty buffer has nothing to hand over.
+   if ((usb_stream_out_got >= b->len) ||
+       ((len < usb_ep_rx_size[USB_STREAM_OUT_ENDPOINT]) && usb_stream_out_got))
+   {
+     #if defined(USB_STREAM_OUT_DONE)
+      USB_STREAM_OUT_DONE(b->ptr, usb_stream_out_got);
+     #endif
+      usb_stream_out_got = 0;
+      usb_stream_out_tail = (usb_stream_out_tail + 1) & (USB_STREAM_QUEUE_SIZE - 1);
+   }
+}
+
+//handle OUT token done interrupt on the stream endpoint
+void usb_isr_tok_out_stream_dne(void)
+{
+   usb_stream_out_load();
+}
+
+// see usb.h for documentation
+int1 usb_stream_get(unsigned int8 * ptr, unsigned int16 max)
+{
+   unsigned int8 next;
+
+   next = (usb_stream_out_head + 1) & (USB_STREAM_QUEUE_SIZE - 1);
+   if (next == usb_stream_out_tail)
+      return(FALSE);
+
+   usb_stream_out_queue[usb_stream_out_head].ptr = ptr;
+   usb_stream_out_queue[usb_stream_out_head].len = max;
+   usb_stream_out_head = next;
+
+   //a packet was held off waiting for a buffer, take it now.
+   if (usb_stream_out_held)
+   {
+      __USB_PAUSE_ISR();
+
+      if (usb_stream_out_held)
+         usb_stream_out_load();
+
+      __USB_RESTORE_ISR();
+   }
+
+   return(TRUE);
+}
+
+// see usb.h for documentation
+unsigned int8 usb_stream_out_pending(void)
+{
+   return((usb_stream_out_head - usb_stream_out_tail) & (USB_STREAM_QUEUE_SIZE - 1));
+}
+#endif
+#endif
+
 /// END User Functions
 
 
@@ -669,6 +902,10 @@ void usb_token_reset(void)
    usb_cdc_init();
   #endif
 
+  #if USB_STREAM_DEVICE
+   usb_stream_init();
+  #endif
+
    USB_stack_status.curr_config = 0;      //unconfigured device
 
    USB_stack_status.status_device = 1;    //previous state.  init at none
@@ -720,6 +957,11 @@ void usb_isr_tok_in_dne(unsigned int8 endpoint) {
       usb_isr_tok_in_cdc_data_dne();
   }
   #endif
+  #if USB_STREAM_DEVICE
+  else if (endpoint==USB_STREAM_IN_ENDPOINT) { //see usb_stream_put()
+      usb_isr_tok_in_stream_dne();
+  }
+  #endif
 }
 
 // see usb.h for documentation
@@ -738,6 +980,11 @@ void usb_isr_tok_out_dne(unsigned int8 endpoint)
    else if (endpoint==USB_CDC_DATA_OUT_ENDPOINT) { //see ex_usb_serial.c example and usb_cdc.h driver
       usb_isr_tok_out_cdc_data_dne();
    }
+  #endif
+  #if USB_STREAM_DEVICE && USB_STREAM_OUT_ENDPOINT
+   else if (endpoint==USB_STREAM_OUT_ENDPOINT) { //see usb_stream_get()
+      usb_isr_tok_out_stream_dne();
+   }
   #endif
    //else {
    //   bit_set(__usb_kbhit_status,endpoint);
@@ -102,6 +102,23 @@
 ////        messages.  This is documented in more detail above the     ////
 ////        prototype in USB.H.                                        ////
 ////                                                                   ////
+//// usb_stream_put(ptr, len) - Queues 'len' bytes at 'ptr' to be      ////
+////        streamed to the host on USB_STREAM_IN_ENDPOINT.  Returns   ////
+////        FALSE if the queue is full.  Buffers are sent back to back ////
+////        by the USB ISR, the first queued buffer is started right   ////
+////        away.  The buffer must not be touched until it completes,  ////
+////        see USB_STREAM_IN_DONE() below.  Needs USB_STREAM_DEVICE.  ////
+////                                                                   ////
+//// usb_stream_get(ptr, max) - Queues a buffer of 'max' bytes to      ////
+////        receive data from the host on USB_STREAM_OUT_ENDPOINT.     ////
+////        Returns FALSE if the queue is full.  The USB ISR fills the ////
+////        buffers in order and re-arms the endpoint as soon as the   ////
+////        packet is copied.  A buffer completes when it is full or a ////
+////        short packet ends the transfer.  Needs USB_STREAM_DEVICE.  ////
+////                                                                   ////
+//// usb_stream_in_pending(), usb_stream_out_pending() - Number of     ////
+////        buffers queued and not completed yet.                      ////
+////                                                                   ////
 ////                                                                   ////
 ////        ********* DEFINITIONS / CONFIGURATION **********           ////
 ////                                                                   ////
@@ -191,12 +208,38 @@
 ////                         device you must provide your own O/S      ////
 ////                         (Windows) driver.                         ////
 ////                                                                   ////
+//// USB_STREAM_DEVICE (FALSE) - Set to TRUE to add the                ////
+////                         usb_stream_put() and usb_stream_get()     ////
+////                         API.  The following can also be defined:  ////
+////                           USB_STREAM_IN_ENDPOINT (1)              ////
+////                           USB_STREAM_OUT_ENDPOINT (1), set to 0   ////
+////                              if only the IN stream is used.       ////
+////                           USB_STREAM_QUEUE_SIZE (4), buffers that ////
+////                              can be queued in each direction,     ////
+////                              power of 2.                          ////
+////                           USB_STREAM_IN_DONE(ptr, len) and        ////
+////                           USB_STREAM_OUT_DONE(ptr, len), called   ////
+////                              from the USB ISR each time a buffer  ////
+////                              completes.  'len' is the number of   ////
+////                              bytes sent or received.              ////
+////                         Data is copied straight between the       ////
+////                         queued buffer and the endpoint buffer,    ////
+////                         one packet at a time.  A bus reset drops  ////
+////                         all queued buffers.                       ////
+////                                                                   ////
+////                                                                   ////
 //// The other definitions should not be changed.                      ////
 ////                                                                   ////
 ///////////////////////////////////////////////////////////////////////////
 ////                                                                   ////
 //// Version History:                                                  ////
 ////                                                                   ////
+////  Oct 17th, 2026                                                   ////
+////     Added USB_STREAM_DEVICE, asynchronous queued bulk streaming   ////
+////        with usb_stream_put() and usb_stream_get().                ////
+////     __USB_PAUSE_ISR() and __USB_RESTORE_ISR() moved here from     ////
+////        usb_cdc.h.                                                 ////
+////                                                                   ////
 ////  Feb 18th, 2013                                                   ////
 ////     Added some extra checks to make sure packet size are legal    ////
 ////        for USB speed.                                             ////
@@ -324,6 +367,26 @@
    #DEFINE USB_CDC_DEVICE FALSE
 #ENDIF
 
+//should the compiler add the usb_stream_put()/usb_stream_get() code?
+#IFNDEF USB_STREAM_DEVICE
+   #DEFINE USB_STREAM_DEVICE FALSE
+#ENDIF
+
+#if USB_STREAM_DEVICE
+ #ifndef USB_STREAM_IN_ENDPOINT
+  #define USB_STREAM_IN_ENDPOINT   1
+ #endif
+ #ifndef USB_STREAM_OUT_ENDPOINT
+  #define USB_STREAM_OUT_ENDPOINT  1
+ #endif
+ #ifndef USB_STREAM_QUEUE_SIZE
+  #define USB_STREAM_QUEUE_SIZE    4
+ #endif
+ #if (USB_STREAM_QUEUE_SIZE & (USB_STREAM_QUEUE_SIZE-1))
+  #error USB_STREAM_QUEUE_SIZE has to be a power of 2
+ #endif
+#endif
+
 //set to false to opt for less RAM, true to opt for less ROM
 #ifndef USB_OPT_FOR_ROM
    #define USB_OPT_FOR_ROM TRUE
@@ -421,12 +484,69 @@ int1 usb_puts(unsigned int8 endpoint, int8 * ptr, unsigned int16 len, unsigned i
 /***************************************************************/
 int1 usb_endpoint_is_valid(unsigned int8 endpoint);
 
+#if USB_STREAM_DEVICE
+/****************************************************************************
+/* usb_stream_put(ptr, len)
+/*
+/* Inputs: ptr - data to send, must stay valid until USB_STREAM_IN_DONE()
+/*         len - amount of data to send
+/*
+/* Outputs: Returns TRUE if the buffer was queued, FALSE if the queue was full
+/*    or len was 0.
+/*
+/* Summary: Queues a buffer for USB_STREAM_IN_ENDPOINT and returns at once.
+/*       The USB ISR splits it into packets and starts the next queued buffer
+/*       as soon as the last packet of this one has been sent, so the endpoint
+/*       is never left idle while data is queued.  A 0 length packet is sent
+/*       if the queue runs empty right after a full packet.
+/*
+/*****************************************************************************/
+int1 usb_stream_put(unsigned int8 * ptr, unsigned int16 len);
+
+/****************************************************************************
+/* usb_stream_get(ptr, max)
+/*
+/* Inputs: ptr - where to save received data, must stay valid until
+/*               USB_STREAM_OUT_DONE()
+/*         max - size of ptr
+/*
+/* Outputs: Returns TRUE if the buffer was queued, FALSE if the queue was full.
+/*
+/* Summary: Queues a receive buffer for USB_STREAM_OUT_ENDPOINT and returns at
+/*       once.  If no buffer is queued when a packet arrives the packet is
+/*       left in the endpoint (host is NAKed) until one is.  A packet that
+/*       doesn't fit in what is left of the current buffer completes that
+/*       buffer and goes into the next one.
+/*
+/*****************************************************************************/
+int1 usb_stream_get(unsigned int8 * ptr, unsigned int16 max);
+
+/****************************************************************************
+/* usb_stream_in_pending(), usb_stream_out_pending()
+/*
+/* Outputs: Number of buffers queued that haven't completed yet.
+/*
+/*****************************************************************************/
+unsigned int8 usb_stream_in_pending(void);
+unsigned int8 usb_stream_out_pending(void);
+#endif
+
 
 ////// END USER-LEVEL API /////////////////////////////////////////////////////
 
 
 ////// STACK-LEVEL API USED BY HW DRIVERS ////////////////////////////////////
 
+//used by code that shares state with the USB ISR, pauses the USB interrupt
+//for the rest of the calling block.
+#if defined(USB_ISR_POLLING)
+#define __USB_PAUSE_ISR()
+#define __USB_RESTORE_ISR()
+#else
+#define __USB_PAUSE_ISR()  int1 old_usbie; old_usbie = USBIE; USBIE = 0
+#define __USB_RESTORE_ISR() if (old_usbie) USBIE = 1
+#endif
+
 enum USB_STATES {GET_DESCRIPTOR=1,SET_ADDRESS=2,NONE=0};
 
 enum USB_GETDESC_TYPES {USB_GETDESC_CONFIG_TYPE=0,USB_GETDESC_HIDREPORT_TYPE=1,USB_GETDESC_STRING_TYPE=2,USB_GETDESC_DEVICE_TYPE=3};
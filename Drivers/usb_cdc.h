@@ -21,6 +21,11 @@
 ////      to wait in an infinit loop, use usb_cdc_kbhit() first to   ////
 ////      check if there is data before calling usb_cdc_getc().      ////
 ////                                                                 ////
+//// usb_cdc_getd(*ptr, max) - Copies up to 'max' received bytes to  ////
+////      'ptr' and returns the number of bytes copied.  Never       ////
+////      waits, returns 0 if nothing has been received.  Faster     ////
+////      than calling usb_cdc_getc() for every byte.                ////
+////                                                                 ////
 //// usb_cdc_putc(char c) - Puts a character into the transmit       ////
 ////      buffer.  If the transmit buffer is full it will wait until ////
 ////      the transmit buffer is not full before putting the char    ////
@@ -53,6 +58,9 @@
 ////     Will stop copying characters from ptr to the endpoint       ////
 ////     buffer once it is full (but it will still return TRUE).     ////
 ////     'len' needs to be smaller than the transmit buffer.         ////
+////     If the transmit buffer is empty the data is copied straight ////
+////     into the endpoint buffer, without going through the local   ////
+////     transmit buffer.                                            ////
 ////                                                                 ////
 //// usb_cdc_putready() - Returns the number of bytes available      ////
 ////     in the TX buffer for storing characters.  If this returns   ////
@@ -73,6 +81,7 @@
 ////                                                                 ////
 //// usb_cdc_putc_fast(char c) - Similar to usb_cdc_putc(), except   ////
 ////      if the transmit buffer is full it will skip the char.      ////
+////      Characters already in the buffer are never overwritten.    ////
 ////                                                                 ////
 //// usb_cdc_line_coding - A structure used for Set_Line_Coding and  ////
 ////       Get_Line_Coding.  Most of the time you can ignore this.   ////
@@ -153,7 +162,7 @@
 //// BUFFER SIZES                                                    ////
 //// -------------------------------------------------------------   ////
 //// USB_CDC_DATA_IN_SIZE controls the PIC->PC buffer size.  The     ////
-////  total buffer size will be ((USB_CDC_DATA_IN_SIZE*2)-1).        ////
+////  total buffer size will be (USB_CDC_DATA_IN_SIZE*2).            ////
 ////  Full speed devices limit this value to be 64.  To increase     ////
 ////  the size of the local PIC buffer you can also define           ////
 ////  USB_CDC_DATA_LOCAL_SIZE.  If USB_CDC_DATA_LOCAL_SIZE is        ////
@@ -163,6 +172,25 @@
 ////  of 64 is used.  If USB_CDC_DATA_LOCAL_SIZE is not defined      ////
 ////  then this option isn't used.                                   ////
 ////                                                                 ////
+//// The local PIC->PC buffer is a ring buffer.  usb_cdc_putc() and  ////
+////  friends only move the head, the USB ISR only moves the tail,   ////
+////  so the USB interrupt isn't masked for every character.  The    ////
+////  ISR copies the ring straight into the endpoint buffer and      ////
+////  always sends full USB_CDC_DATA_IN_SIZE packets when enough     ////
+////  data is waiting.  If the last packet of a transfer was full    ////
+////  size a zero length packet is sent to end the transfer.         ////
+////                                                                 ////
+//// USB_CDC_DATA_OUT_SIZE controls the PC->PIC packet size.  By     ////
+////  default the received packet is read straight out of the        ////
+////  endpoint buffer, and the endpoint isn't re-armed (the host is  ////
+////  NAKed) until every byte of it has been read.  Define           ////
+////  USB_CDC_DATA_OUT_LOCAL_SIZE to add a PC->PIC FIFO of that      ////
+////  many bytes.  The USB ISR copies every packet into the FIFO     ////
+////  and re-arms the endpoint at once, so the host can keep sending ////
+////  while the application parses.  The endpoint is only held off   ////
+////  when the FIFO doesn't have room for a whole packet.  Must be   ////
+////  at least USB_CDC_DATA_OUT_SIZE and less than 255.              ////
+////                                                                 ////
 ////                                                                 ////
 //// INTERRUPT LIMITATIONS                                           ////
 //// -------------------------------------------------------------   ////
@@ -193,6 +221,20 @@
 ////                                                                 ////
 //// VERSION HISTORY                                                 ////
 ////                                                                 ////
+//// Oct 17th, 2026:                                                 ////
+////  Added USB_CDC_DATA_OUT_LOCAL_SIZE, a PC->PIC FIFO that can     ////
+////     hold several OUT packets.                                   ////
+////  Added usb_cdc_getd().                                          ////
+////  Local TX buffer is now a ring buffer.  The USB interrupt is    ////
+////     no longer disabled for every character put, and             ////
+////     usb_cdc_putc_fast() skips the char when the buffer is full  ////
+////     instead of overwriting the last char in the buffer.         ////
+////  TX sends full size packets, followed by a 0 length packet if   ////
+////     the transfer ended on a full packet.                        ////
+////  TX data is copied from the ring straight into the endpoint     ////
+////     buffer.  usb_cdc_putd() copies straight into the endpoint   ////
+////     buffer when nothing is waiting in the ring.                 ////
+////                                                                 ////
 //// Nov 20th, 2014:                                                 ////
 ////  While usb_cdc_putc() waits for local buffer to be free, also   ////
 ////     check the endpoint buffer in case there was a situation     ////
@@ -307,14 +349,19 @@ BYTE gethex1_usb();
 #if !defined(__USB_CDC_HELPERS_ONLY__)
 
 //api for the user:
+#if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+#define usb_cdc_kbhit() (usb_cdc_get_fifo_nextin!=usb_cdc_get_fifo_nextout)
+#else
 #define usb_cdc_kbhit() (usb_cdc_get_buffer_status.got)
-#define usb_cdc_putempty() ((usb_cdc_put_buffer_nextin==0) && usb_cdc_put_buffer_free())
-#define usb_cdc_putready() (sizeof(usb_cdc_put_buffer)-usb_cdc_put_buffer_nextin)
+#endif
+#define usb_cdc_putempty() ((usb_cdc_put_buffer_nextin==usb_cdc_put_buffer_nextout) && !usb_cdc_put_zlp && usb_cdc_put_buffer_free())
 #define usb_cdc_connected() (usb_cdc_got_set_line_coding)
 void usb_cdc_putc_fast(char c);
 char usb_cdc_getc(void);
 void usb_cdc_putc(char c);
 void usb_cdc_get_discard(void);
+unsigned int16 usb_cdc_getd(unsigned int8 *ptr, unsigned int16 max);
+unsigned int8 usb_cdc_putready(void);
 
 //functions automatically called by USB handler code
 void usb_isr_tkn_cdc(void);
@@ -386,10 +433,12 @@ struct {
 //if ==0xFFFF, send break signal until we receive a 0x0000.
 unsigned int16 usb_cdc_break;
 
+//one entry of the ring is always left empty so a full ring can be told apart
+//from an empty ring without a shared counter.
 #ifndef USB_CDC_DATA_LOCAL_SIZE
-unsigned int8 usb_cdc_put_buffer[USB_CDC_DATA_IN_SIZE-1];
+unsigned int8 usb_cdc_put_buffer[USB_CDC_DATA_IN_SIZE+1];
 #else
-unsigned int8 usb_cdc_put_buffer[USB_CDC_DATA_LOCAL_SIZE];
+unsigned int8 usb_cdc_put_buffer[USB_CDC_DATA_LOCAL_SIZE+1];
 #endif
 
 #define usb_cdc_put_buffer_free()  usb_tbe(USB_CDC_DATA_IN_ENDPOINT)
@@ -400,9 +449,18 @@ unsigned int8 usb_cdc_put_buffer[USB_CDC_DATA_LOCAL_SIZE];
  typedef unsigned int8 usb_cdc_tx_t;
 #endif
 
-usb_cdc_tx_t usb_cdc_put_buffer_nextin;
+usb_cdc_tx_t usb_cdc_put_buffer_nextin;   //only written by usb_cdc_putc()
+usb_cdc_tx_t usb_cdc_put_buffer_nextout;  //only written by usb_cdc_flush_tx_buffer()
 //#locate usb_cdc_put_buffer_nextin=0x1800
 
+//last packet sent was full size, a 0 length packet has to follow if no more
+//data is waiting.
+int1 usb_cdc_put_zlp;
+
+#if __USB_PIC_PERIF__
+ #define usb_cdc_put_endpoint_buffer usb_ep2_tx_buffer
+#endif
+
 
 #if defined(__PIC__)
  #define usb_cdc_get_buffer_status_buffer usb_ep2_rx_buffer
@@ -410,6 +468,22 @@ usb_cdc_tx_t usb_cdc_put_buffer_nextin;
  unsigned int8 usb_cdc_get_buffer_status_buffer[USB_CDC_DATA_OUT_SIZE];
 #endif
 
+#if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+ #if USB_CDC_DATA_OUT_LOCAL_SIZE < USB_CDC_DATA_OUT_SIZE
+  #error USB_CDC_DATA_OUT_LOCAL_SIZE has to hold at least one USB_CDC_DATA_OUT_SIZE packet.
+ #endif
+//one entry is always left empty, same as usb_cdc_put_buffer.
+unsigned int8 usb_cdc_get_fifo[USB_CDC_DATA_OUT_LOCAL_SIZE+1];
+ #if sizeof(usb_cdc_get_fifo)>=0x100
+  #error This is not supported.  That is because ISR may change this 16bit value while your non-ISR code is reading this.
+ #endif
+unsigned int8 usb_cdc_get_fifo_nextin;   //only written by the USB ISR
+unsigned int8 usb_cdc_get_fifo_nextout;  //only written by usb_cdc_getc()/usb_cdc_getd()
+//a packet is waiting in the endpoint buffer because the FIFO didn't have
+//room for it, the endpoint hasn't been re-armed.
+int1 usb_cdc_get_fifo_pending;
+#endif
+
 int1 usb_cdc_got_set_line_coding;
 
 struct  {
@@ -519,8 +593,73 @@ void usb_isr_tkn_cdc(void) {
    }
 }
 
+#include <string.h>
+
+#if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+// Producer side of the RX FIFO, moves usb_cdc_get_fifo_nextin.  Copies the
+// packet waiting in the OUT endpoint into the FIFO and re-arms the endpoint.
+// If the FIFO doesn't have room for the whole packet the endpoint isn't
+// re-armed (host gets NAKed) and usb_cdc_get_fifo_pending is set, the
+// consumer calls this again once it has freed some room.  Without the PIC's
+// USB peripheral the packet has already been read out of the endpoint, so
+// it waits in usb_cdc_get_buffer_status_buffer with its length in
+// usb_cdc_get_buffer_status.len.  Must be called from the USB ISR or with
+// the USB ISR paused.
+static void _usb_cdc_get_fifo_load(void)
+{
+   unsigned int16 len, first, in;
+   unsigned int8 out, room;
+
+  #if (defined(__PIC__) && __PIC__)
+   len = usb_rx_packet_size(USB_CDC_DATA_OUT_ENDPOINT);
+  #else
+   if (usb_cdc_get_fifo_pending)
+      len = usb_cdc_get_buffer_status.len;   //read out last time, still waiting
+   else
+   {
+      len = usb_get_packet_buffer(
+         USB_CDC_DATA_OUT_ENDPOINT,&usb_cdc_get_buffer_status_buffer[0],USB_CDC_DATA_OUT_SIZE);
+      usb_cdc_get_buffer_status.len = len;
+   }
+  #endif
+
+   in = usb_cdc_get_fifo_nextin;
+   out = usb_cdc_get_fifo_nextout;  //snapshot, getc may move it at any time
+
+   if (in >= out)
+      room = sizeof(usb_cdc_get_fifo) - 1 - (in - out);
+   else
+      room = out - in - 1;
+
+   if (len > room)
+   {
+      usb_cdc_get_fifo_pending = TRUE;
+      return;
+   }
+
+   first = sizeof(usb_cdc_get_fifo) - in;
+   if (first > len)
+      first = len;
+
+   memcpy(&usb_cdc_get_fifo[in], usb_cdc_get_buffer_status_buffer, first);
+   if (len != first)
+      memcpy(usb_cdc_get_fifo, &usb_cdc_get_buffer_status_buffer[first], len - first);
+
+   in += len;
+   if (in >= sizeof(usb_cdc_get_fifo))
+      in -= sizeof(usb_cdc_get_fifo);
+   usb_cdc_get_fifo_nextin = in;
+
+   usb_cdc_get_fifo_pending = FALSE;
+   usb_flush_out(USB_CDC_DATA_OUT_ENDPOINT, USB_DTS_TOGGLE);
+}
+#endif
+
 //handle OUT token done interrupt on endpoint 2 [buffer incoming received chars]
 void usb_isr_tok_out_cdc_data_dne(void) {
+  #if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+   _usb_cdc_get_fifo_load();
+  #else
    usb_cdc_get_buffer_status.got=TRUE;
    usb_cdc_get_buffer_status.index=0;
 #if (defined(__PIC__) && __PIC__)
@@ -541,41 +680,76 @@ void usb_isr_tok_out_cdc_data_dne(void) {
    }
   #endif
   */
+  #endif
 }
 
-//handle IN token done interrupt on endpoint 2 [transmit buffered characters]
-void usb_isr_tok_in_cdc_data_dne(void) 
+// Consumer side of the TX ring, moves usb_cdc_put_buffer_nextout.  Must be
+// called from the USB ISR or with the USB ISR paused.
+static void _usb_cdc_flush_tx_buffer(void)
 {
-   usb_cdc_flush_tx_buffer();
-}
+   unsigned int16 n, first, out;
+   usb_cdc_tx_t in;
 
-#include <string.h>
+   if (!usb_cdc_put_buffer_free())
+      return;
 
-void usb_cdc_flush_tx_buffer(void) 
-{
-  #ifdef USB_CDC_DATA_LOCAL_SIZE
-   usb_cdc_tx_t n;
-  #endif
-  
-   if (usb_cdc_put_buffer_nextin != 0)
+   in = usb_cdc_put_buffer_nextin;  //snapshot, putc may move it at any time
+   out = usb_cdc_put_buffer_nextout;
+
+   if (in == out)
    {
-     #ifndef USB_CDC_DATA_LOCAL_SIZE
-      if (usb_put_packet(USB_CDC_DATA_IN_ENDPOINT,usb_cdc_put_buffer,usb_cdc_put_buffer_nextin,USB_DTS_TOGGLE))
+      if (usb_cdc_put_zlp)
       {
-         usb_cdc_put_buffer_nextin = 0;
+         if (usb_put_packet(USB_CDC_DATA_IN_ENDPOINT,usb_cdc_put_buffer,0,USB_DTS_TOGGLE))
+            usb_cdc_put_zlp = FALSE;
       }
-     #else
-      n = usb_cdc_put_buffer_nextin;
-      if (n > (USB_CDC_DATA_IN_SIZE-1)) //always send one less than packet size so we don't have to deal with 0 len packets
-         n = USB_CDC_DATA_IN_SIZE-1;
-      if (usb_put_packet(USB_CDC_DATA_IN_ENDPOINT,usb_cdc_put_buffer,n,USB_DTS_TOGGLE))
-      {
-         //pull the buffer back
-         memmove(usb_cdc_put_buffer, &usb_cdc_put_buffer[n], usb_cdc_put_buffer_nextin-n);
-         usb_cdc_put_buffer_nextin -= n;
-      }      
-     #endif
+      return;
    }
+
+   if (in > out)
+      n = in - out;
+   else
+      n = sizeof(usb_cdc_put_buffer) - out + in;
+   if (n > USB_CDC_DATA_IN_SIZE)
+      n = USB_CDC_DATA_IN_SIZE;
+
+   first = sizeof(usb_cdc_put_buffer) - out;
+   if (first > n)
+      first = n;
+
+  #if __USB_PIC_PERIF__
+   memcpy(usb_cdc_put_endpoint_buffer, &usb_cdc_put_buffer[out], first);
+   if (n != first)
+      memcpy(&usb_cdc_put_endpoint_buffer[first], usb_cdc_put_buffer, n - first);
+   usb_flush_in(USB_CDC_DATA_IN_ENDPOINT, n, USB_DTS_TOGGLE);
+  #else
+   //no direct access to the endpoint buffer, send up to the end of the ring
+   //and let the next IN token send the wrapped part.
+   n = first;
+   usb_put_packet(USB_CDC_DATA_IN_ENDPOINT,&usb_cdc_put_buffer[out],n,USB_DTS_TOGGLE);
+  #endif
+
+   usb_cdc_put_zlp = (n == USB_CDC_DATA_IN_SIZE);
+
+   out += n;
+   if (out >= sizeof(usb_cdc_put_buffer))
+      out -= sizeof(usb_cdc_put_buffer);
+   usb_cdc_put_buffer_nextout = out;
+}
+
+//handle IN token done interrupt on endpoint 2 [transmit buffered characters]
+void usb_isr_tok_in_cdc_data_dne(void) 
+{
+   _usb_cdc_flush_tx_buffer();
+}
+
+void usb_cdc_flush_tx_buffer(void) 
+{
+   __USB_PAUSE_ISR();
+
+   _usb_cdc_flush_tx_buffer();
+
+   __USB_RESTORE_ISR();
 }
 
 void usb_cdc_init(void) 
@@ -588,7 +762,14 @@ void usb_cdc_init(void)
    usb_cdc_got_set_line_coding = FALSE;
    usb_cdc_break = 0;
    usb_cdc_put_buffer_nextin = 0;
+   usb_cdc_put_buffer_nextout = 0;
+   usb_cdc_put_zlp = FALSE;
    usb_cdc_get_buffer_status.got = 0;
+  #if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+   usb_cdc_get_fifo_nextin = 0;
+   usb_cdc_get_fifo_nextout = 0;
+   usb_cdc_get_fifo_pending = FALSE;
+  #endif
    __usb_cdc_state = 0;
 }
 
@@ -654,15 +835,43 @@ int1 usb_cdc_serial_state(cdc_serial_state_t state)
    return(TRUE);
 }
 
+#if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+// Consumer side of the RX FIFO, moves usb_cdc_get_fifo_nextout.  If a packet
+// was held off in the endpoint because the FIFO was full, try to load it
+// now that there is more room.
+static void _usb_cdc_get_fifo_release(unsigned int8 out)
+{
+   usb_cdc_get_fifo_nextout = out;
+
+   if (usb_cdc_get_fifo_pending)
+   {
+      __USB_PAUSE_ISR();
+
+      if (usb_cdc_get_fifo_pending)
+         _usb_cdc_get_fifo_load();
+
+      __USB_RESTORE_ISR();
+   }
+}
+
+void usb_cdc_get_discard(void)
+{
+   _usb_cdc_get_fifo_release(usb_cdc_get_fifo_nextin);
+}
+#else
 void usb_cdc_get_discard(void)
 {
    usb_cdc_get_buffer_status.got = FALSE;
    usb_flush_out(USB_CDC_DATA_OUT_ENDPOINT, USB_DTS_TOGGLE);
 }
+#endif
 
 char usb_cdc_getc(void) 
 {
    char c;
+  #if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+   unsigned int8 out;
+  #endif
 
    while (!usb_cdc_kbhit()) 
    {
@@ -671,42 +880,120 @@ char usb_cdc_getc(void)
      #endif
    }
 
+  #if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+   out = usb_cdc_get_fifo_nextout;
+   c = usb_cdc_get_fifo[out];
+   if (++out >= sizeof(usb_cdc_get_fifo))
+      out = 0;
+   _usb_cdc_get_fifo_release(out);
+  #else
    c=usb_cdc_get_buffer_status_buffer[usb_cdc_get_buffer_status.index++];
 
    if (usb_cdc_get_buffer_status.index >= usb_cdc_get_buffer_status.len) 
    {
       usb_cdc_get_discard();
    }
+  #endif
 
    return(c);
 }
 
-#if defined(USB_ISR_POLLING)
-#define __USB_PAUSE_ISR()
-#define __USB_RESTORE_ISR()
-#else
-#define __USB_PAUSE_ISR()  int1 old_usbie; old_usbie = USBIE; USBIE = 0
-#define __USB_RESTORE_ISR() if (old_usbie) USBIE = 1
-#endif
+unsigned int16 usb_cdc_getd(unsigned int8 *ptr, unsigned int16 max)
+{
+   unsigned int16 n, total;
+  #if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+   unsigned int16 out;
+   unsigned int8 in;
+  #endif
+
+   total = 0;
+
+  #if defined(USB_CDC_DATA_OUT_LOCAL_SIZE)
+   //copies up to the end of the FIFO per pass, the next pass picks up the
+   //part that wrapped around and anything the ISR loaded meanwhile.
+   while (max && usb_cdc_kbhit())
+   {
+      in = usb_cdc_get_fifo_nextin;  //snapshot, ISR may move it at any time
+      out = usb_cdc_get_fifo_nextout;
+
+      if (in > out)
+         n = in - out;
+      else
+         n = sizeof(usb_cdc_get_fifo) - out;
+      if (n > max)
+         n = max;
+
+      memcpy(ptr, &usb_cdc_get_fifo[out], n);
+      ptr += n;
+      max -= n;
+      total += n;
+
+      out += n;
+      if (out >= sizeof(usb_cdc_get_fifo))
+         out = 0;
+      _usb_cdc_get_fifo_release(out);
+   }
+  #else
+   while (max && usb_cdc_kbhit())
+   {
+      n = usb_cdc_get_buffer_status.len - usb_cdc_get_buffer_status.index;
+      if (n > max)
+         n = max;
+
+      memcpy(ptr, &usb_cdc_get_buffer_status_buffer[usb_cdc_get_buffer_status.index], n);
+      ptr += n;
+      max -= n;
+      total += n;
 
-static void _usb_cdc_putc_fast_noflush(char c)
+      usb_cdc_get_buffer_status.index += n;
+      if (usb_cdc_get_buffer_status.index >= usb_cdc_get_buffer_status.len) 
+      {
+         usb_cdc_get_discard();
+      }
+   }
+  #endif
+
+   return(total);
+}
+
+unsigned int8 usb_cdc_putready(void)
 {
-   __USB_PAUSE_ISR();
+   usb_cdc_tx_t in, out;
+
+   in = usb_cdc_put_buffer_nextin;
+   out = usb_cdc_put_buffer_nextout;  //snapshot, ISR may move it at any time
+
+   if (in >= out)
+      return(sizeof(usb_cdc_put_buffer) - 1 - (in - out));
+   return(out - in - 1);
+}
+
+// Producer side of the TX ring, moves usb_cdc_put_buffer_nextin.  The char
+// is stored before the index is moved so the ISR never sees a slot that
+// hasn't been written yet.  Returns FALSE if the ring was full and the char
+// was dropped.
+static int1 _usb_cdc_putc_fast_noflush(char c)
+{
+   usb_cdc_tx_t next;
+
+   next = usb_cdc_put_buffer_nextin + 1;
+   if (next >= sizeof(usb_cdc_put_buffer))
+      next = 0;
 
   #if defined(USB_CDC_DELAYED_FLUSH)
-   if (usb_cdc_put_buffer_nextin >= sizeof(usb_cdc_put_buffer)) 
+   if (next == usb_cdc_put_buffer_nextout) 
    {
       usb_cdc_flush_tx_buffer();
    }
   #endif
 
-   if (usb_cdc_put_buffer_nextin >= sizeof(usb_cdc_put_buffer)) {
-      usb_cdc_put_buffer_nextin = sizeof(usb_cdc_put_buffer)-1;  //we just overflowed the buffer!
-   }
-   
-   usb_cdc_put_buffer[usb_cdc_put_buffer_nextin++] = c;
+   if (next == usb_cdc_put_buffer_nextout)
+      return(FALSE);
 
-   __USB_RESTORE_ISR();
+   usb_cdc_put_buffer[usb_cdc_put_buffer_nextin] = c;
+   usb_cdc_put_buffer_nextin = next;
+
+   return(TRUE);
 }
 
 void usb_cdc_putc_fast(char c)
@@ -763,6 +1050,30 @@ int1 usb_cdc_putd(unsigned char *ptr, unsigned int8 len)
    
    if (!usb_cdc_put_buffer_free())
       return(FALSE);
+
+  #if __USB_PIC_PERIF__
+   if (len && (usb_cdc_put_buffer_nextin == usb_cdc_put_buffer_nextout))
+   {
+      //nothing queued ahead of us, skip the ring and fill the endpoint directly.
+      __USB_PAUSE_ISR();
+
+      if (len > USB_CDC_DATA_IN_SIZE)
+         len = USB_CDC_DATA_IN_SIZE;
+
+      if (usb_cdc_put_buffer_free())
+      {
+         memcpy(usb_cdc_put_endpoint_buffer, ptr, len);
+         usb_flush_in(USB_CDC_DATA_IN_ENDPOINT, len, USB_DTS_TOGGLE);
+         usb_cdc_put_zlp = (len == USB_CDC_DATA_IN_SIZE);
+         len = 0;
+      }
+
+      __USB_RESTORE_ISR();
+
+      if (!len)
+         return(TRUE);
+   }
+  #endif
    
    while(len--)
    {
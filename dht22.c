@@ -0,0 +1,344 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                              dht22.c                              ////
+////                                                                   ////
+//// Interrupt driven DHT22/DHT11 reader.  Instead of spinning on the  ////
+//// data pin with delay_us() for ~5ms per reading, every falling edge ////
+//// of the sensor line is timestamped with Timer1 from an interrupt   ////
+//// and the 40 data bits are decoded from the edge to edge period:    ////
+////                                                                   ////
+////    '0' bit = 50us low + 26us high  = ~76us between falling edges  ////
+////    '1' bit = 50us low + 70us high  = ~120us between falling edges ////
+////                                                                   ////
+//// Completed readings (checksum already verified) are queued in a    ////
+//// small ring and handed back through dht22_get(), or through the    ////
+//// DHT22_CALLBACK() macro if the application defines one.            ////
+////                                                                   ////
+//// dht22_init()                                                      ////
+////     Sets up Timer1 and the capture interrupt.  Global interrupts  ////
+////     must be enabled by the main program.                          ////
+////                                                                   ////
+//// dht22_task()                                                      ////
+////     Call from the main loop.  Starts a conversion every           ////
+////     DHT22_SAMPLE_PERIOD_MS, generates the start pulse without     ////
+////     blocking and times out a sensor that stops answering.  Must   ////
+////     be called more often than the Timer1 overflow period (~105ms  ////
+////     at 20MHz).                                                    ////
+////                                                                   ////
+//// dht22_kbhit()                                                     ////
+////     Returns TRUE if a completed reading is waiting.               ////
+////                                                                   ////
+//// dht22_get(&sample)                                                ////
+////     Copies the oldest reading into sample.  Returns FALSE if the  ////
+////     ring is empty.                                                ////
+////                                                                   ////
+//// dht22_temperature(&sample), dht22_humidity(&sample)               ////
+////     DHT22 format readings in tenths of a degree / percent.  For a ////
+////     DHT11 use sample.t_hi and sample.rh_hi directly.              ////
+////                                                                   ////
+//// dht22_decode_reset(), dht22_edge(period)                          ////
+////     The decoder itself.  Touches no hardware, so recorded edge    ////
+////     traces can be replayed through it.                            ////
+////                                                                   ////
+//// Options (define before including this file):                      ////
+////    DHT22_PIN               sensor data pin, default PIN_B0        ////
+////    DHT22_USE_CCP1          timestamp with the CCP1 capture        ////
+////                            hardware (sensor wired to the CCP1     ////
+////                            pin) instead of the RB0/INT interrupt  ////
+////    DHT22_SAMPLE_PERIOD_MS  time between readings, default 2000    ////
+////    DHT22_RING_SIZE         queued readings, power of 2, default 4 ////
+////    DHT22_CALLBACK(p)       called from dht22_task() for every     ////
+////                            reading, p is a DHT22_SAMPLE pointer   ////
+////    DHT22_MASK_INT          interrupt masked while a frame is      ////
+////                            captured, e.g. INT_TIMER2.  With the   ////
+////                            RB0/INT capture an ISR that is         ////
+////                            running when an edge arrives adds its  ////
+////                            length to that bit period, and the     ////
+////                            bit decision margin is only ~22us      ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __DHT22_C__
+#define __DHT22_C__
+
+#ifndef DHT22_PIN
+ #define DHT22_PIN               PIN_B0
+#endif
+
+#ifndef DHT22_SAMPLE_PERIOD_MS
+ #define DHT22_SAMPLE_PERIOD_MS  2000
+#endif
+
+#ifndef DHT22_RING_SIZE
+ #define DHT22_RING_SIZE         4
+#endif
+
+#ifdef DHT22_USE_CCP1
+ #define DHT22_INT               INT_CCP1
+#else
+ #define DHT22_INT               INT_EXT
+#endif
+
+// Timer1 runs from the instruction clock divided by 8.  One tick is 1.6us
+// at 20MHz, and the counter overflows every ~105ms.
+#define DHT22_T1_PRESCALE        8
+#define DHT22_TICKS(us)          ((unsigned int16)(((unsigned int32)(us) * (getenv("CLOCK") / 1000000)) / (4 * DHT22_T1_PRESCALE)))
+
+#define DHT22_PERIOD_OVF         ((unsigned int8)(((unsigned int32)DHT22_SAMPLE_PERIOD_MS * (getenv("CLOCK") / 1000)) / (4L * DHT22_T1_PRESCALE * 65536) + 1))
+
+#define DHT22_START_US           18000    //host start pulse, 1ms is enough for a DHT22, DHT11 needs 18ms
+#define DHT22_FRAME_TIMEOUT_US   10000    //whole response takes ~5ms
+#define DHT22_RESPONSE_MIN_US    120      //sensor response is 80us low + 80us high
+#define DHT22_RESPONSE_MAX_US    200
+#define DHT22_BIT_THRESHOLD_US   98       //halfway between 76us and 120us
+#define DHT22_BIT_MAX_US         200
+
+#define DHT22_EDGES              42       //response start, response end, 40 bits
+
+// dht22_state
+#define DHT22_IDLE               0
+#define DHT22_START              1        //host is holding the line low
+#define DHT22_CAPTURE            2        //line released, ISR is collecting edges
+
+typedef struct
+{
+   unsigned int8 rh_hi;
+   unsigned int8 rh_lo;
+   unsigned int8 t_hi;
+   unsigned int8 t_lo;
+} DHT22_SAMPLE;
+
+unsigned int8 dht22_state;
+unsigned int8 dht22_overflows;
+unsigned int16 dht22_t0;
+unsigned int16 dht22_last_edge;
+
+unsigned int8 dht22_nedges;
+unsigned int8 dht22_frame[5];
+
+DHT22_SAMPLE dht22_ring[DHT22_RING_SIZE];
+unsigned int8 dht22_head;
+unsigned int8 dht22_tail;
+
+// Diagnostics: bad frames (timeout, glitch or checksum) and readings lost
+// because the ring was full.
+unsigned int16 dht22_errors;
+unsigned int16 dht22_overruns;
+
+void dht22_decode_reset(void)
+{
+   dht22_nedges = 0;
+   dht22_frame[0] = 0;
+   dht22_frame[1] = 0;
+   dht22_frame[2] = 0;
+   dht22_frame[3] = 0;
+   dht22_frame[4] = 0;
+   dht22_state = DHT22_CAPTURE;
+}
+
+void dht22_commit(void)
+{
+   unsigned int8 next;
+
+   dht22_state = DHT22_IDLE;
+
+   if((unsigned int8)(dht22_frame[0] + dht22_frame[1] + dht22_frame[2] + dht22_frame[3]) != dht22_frame[4])
+   {
+      dht22_errors++;
+      return;
+   }
+
+   next = (dht22_head + 1) & (DHT22_RING_SIZE - 1);
+   if(next == dht22_tail)
+   {
+      dht22_overruns++;
+      return;
+   }
+
+   dht22_ring[dht22_head].rh_hi = dht22_frame[0];
+   dht22_ring[dht22_head].rh_lo = dht22_frame[1];
+   dht22_ring[dht22_head].t_hi = dht22_frame[2];
+   dht22_ring[dht22_head].t_lo = dht22_frame[3];
+   dht22_head = next;
+}
+
+// Feeds one falling edge into the decoder.  period is the time since the
+// previous falling edge in Timer1 ticks.  The first edge is the start of the
+// sensor response, so its period is ignored.
+void dht22_edge(unsigned int16 period)
+{
+   unsigned int8 i;
+
+   if(dht22_state != DHT22_CAPTURE)
+      return;
+
+   if(dht22_nedges == 1)
+   {
+      if((period < DHT22_TICKS(DHT22_RESPONSE_MIN_US)) || (period > DHT22_TICKS(DHT22_RESPONSE_MAX_US)))
+      {
+         dht22_state = DHT22_IDLE;
+         dht22_errors++;
+         return;
+      }
+   }
+   else if(dht22_nedges > 1)
+   {
+      if(period > DHT22_TICKS(DHT22_BIT_MAX_US))
+      {
+         dht22_state = DHT22_IDLE;
+         dht22_errors++;
+         return;
+      }
+      i = (dht22_nedges - 2) >> 3;
+      dht22_frame[i] <<= 1;
+      if(period > DHT22_TICKS(DHT22_BIT_THRESHOLD_US))
+         dht22_frame[i] |= 1;
+   }
+
+   if(++dht22_nedges == DHT22_EDGES)
+      dht22_commit();
+}
+
+#ifdef DHT22_USE_CCP1
+#int_ccp1
+void dht22_capture_isr(void)
+{
+   unsigned int16 now;
+
+   now = CCP_1;
+#else
+#int_ext
+void dht22_capture_isr(void)
+{
+   unsigned int16 now;
+
+   now = get_timer1();
+#endif
+   dht22_edge(now - dht22_last_edge);
+   dht22_last_edge = now;
+
+   if(dht22_state != DHT22_CAPTURE)
+   {
+      disable_interrupts(DHT22_INT);
+#ifdef DHT22_MASK_INT
+      enable_interrupts(DHT22_MASK_INT);
+#endif
+   }
+}
+
+#int_timer1
+void dht22_timer1_isr(void)
+{
+   if(dht22_overflows != 0xFF)
+      dht22_overflows++;
+}
+
+void dht22_init(void)
+{
+   output_float(DHT22_PIN);
+
+   dht22_state = DHT22_IDLE;
+   dht22_overflows = 0;
+   dht22_head = 0;
+   dht22_tail = 0;
+   dht22_errors = 0;
+   dht22_overruns = 0;
+
+   setup_timer_1(T1_INTERNAL | T1_DIV_BY_8);
+#ifdef DHT22_USE_CCP1
+   setup_ccp1(CCP_CAPTURE_FE);
+#else
+   ext_int_edge(H_TO_L);
+#endif
+   disable_interrupts(DHT22_INT);
+   clear_interrupt(INT_TIMER1);
+   enable_interrupts(INT_TIMER1);
+}
+
+int1 dht22_kbhit(void)
+{
+   return(dht22_head != dht22_tail);
+}
+
+int1 dht22_get(DHT22_SAMPLE *s)
+{
+   if(dht22_head == dht22_tail)
+      return(FALSE);
+
+   *s = dht22_ring[dht22_tail];
+   dht22_tail = (dht22_tail + 1) & (DHT22_RING_SIZE - 1);
+   return(TRUE);
+}
+
+// Temperature in tenths of a degree C, DHT22 sign/magnitude format.
+signed int16 dht22_temperature(DHT22_SAMPLE *s)
+{
+   signed int16 t;
+
+   t = make16(s->t_hi & 0x7F, s->t_lo);
+   if(bit_test(s->t_hi, 7))
+      t = -t;
+   return(t);
+}
+
+// Relative humidity in tenths of a percent.
+unsigned int16 dht22_humidity(DHT22_SAMPLE *s)
+{
+   return(make16(s->rh_hi, s->rh_lo));
+}
+
+void dht22_task(void)
+{
+#ifdef DHT22_CALLBACK
+   DHT22_SAMPLE s;
+#endif
+
+   switch(dht22_state)
+   {
+      case DHT22_IDLE:
+         if(dht22_overflows >= DHT22_PERIOD_OVF)
+         {
+            dht22_overflows = 0;
+            output_low(DHT22_PIN);
+            dht22_t0 = get_timer1();
+            dht22_state = DHT22_START;
+         }
+         break;
+
+      case DHT22_START:
+         if((unsigned int16)(get_timer1() - dht22_t0) >= DHT22_TICKS(DHT22_START_US))
+         {
+            dht22_decode_reset();
+#ifdef DHT22_MASK_INT
+            disable_interrupts(DHT22_MASK_INT);
+#endif
+            clear_interrupt(DHT22_INT);
+            enable_interrupts(DHT22_INT);
+            output_float(DHT22_PIN);
+            dht22_t0 = get_timer1();
+         }
+         break;
+
+      case DHT22_CAPTURE:
+         if((unsigned int16)(get_timer1() - dht22_t0) >= DHT22_TICKS(DHT22_FRAME_TIMEOUT_US))
+         {
+            disable_interrupts(DHT22_INT);
+            if(dht22_state == DHT22_CAPTURE)
+            {
+               dht22_state = DHT22_IDLE;
+               dht22_errors++;
+            }
+#ifdef DHT22_MASK_INT
+            enable_interrupts(DHT22_MASK_INT);
+#endif
+         }
+         break;
+   }
+
+#ifdef DHT22_CALLBACK
+   while(dht22_get(&s))
+      DHT22_CALLBACK(&s);
+#endif
+}
+
+#endif
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                             led7seg.c                             ////
+////                                                                   ////
+//// Multiplexed 7-segment display refreshed from the Timer2 interrupt.////
+//// The driver owns a frame buffer of segment patterns, one byte per  ////
+//// digit.  Every Timer2 tick switches off the current digit, puts    ////
+//// the next pattern on the segment port and switches that digit on,  ////
+//// so the refresh rate no longer depends on what the main loop is    ////
+//// doing.  The main loop only writes into the frame buffer.          ////
+////                                                                   ////
+//// The ISR writes both ports directly as registers, with no variable ////
+//// pin I/O or TRIS updates, so it stays short enough (~10us at 20MHz ////
+//// including the interrupt entry) not to upset edge timing done by   ////
+//// other interrupts, such as the RB0/INT capture in dht22.c.  Other  ////
+//// bits of the digit port are left alone.                            ////
+////                                                                   ////
+//// led7_init()                                                       ////
+////     Sets up Timer2 and blanks the display.  Global interrupts     ////
+////     must be enabled by the main program.                          ////
+////                                                                   ////
+//// led7_put(pos, pattern)                                            ////
+////     Writes a raw segment pattern to digit pos (0 = leftmost).     ////
+////                                                                   ////
+//// led7_putd(pos, value)                                             ////
+////     Writes decimal digit value (0-9) to digit pos using Maled[].  ////
+////                                                                   ////
+//// led7_clear()                                                      ////
+////     Blanks every digit.                                           ////
+////                                                                   ////
+//// Options (define before including this file):                      ////
+////    LED7_DIGITS       number of digits, 1 to 8, default 4          ////
+////    LED7_DIGIT_PORT   register the digit enables are on, default   ////
+////                      LATC, or PORTC if there is no LATC           ////
+////    LED7_DIGIT_TRIS   TRIS register of the digit port, default     ////
+////                      TRISC                                        ////
+////    LED7_DIGIT_BITS   enable bit of each digit, leftmost first,    ////
+////                      default 0x01,0x02,0x04,0x08 (RC0-RC3)        ////
+////    LED7_SEG_PORT     register the segments are on, default LATD,  ////
+////                      or PORTD if there is no LATD                 ////
+////    LED7_SEG_TRIS     TRIS register of the segment port, default   ////
+////                      TRISD                                        ////
+////    LED7_BLANK        pattern with every segment off, default 0xFF ////
+////                      (common anode)                               ////
+////    LED7_DIGIT_HZ     digit switch rate, default 1000.  Each digit ////
+////                      is refreshed LED7_DIGIT_HZ/LED7_DIGITS times ////
+////                      a second.                                    ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __LED7SEG_C__
+#define __LED7SEG_C__
+
+#ifndef LED7_DIGITS
+ #define LED7_DIGITS      4
+#endif
+
+#ifndef LED7_DIGIT_PORT
+ #if getenv("SFR_VALID:LATC")
+  #define LED7_DIGIT_PORT  getenv("SFR:LATC")
+ #else
+  #define LED7_DIGIT_PORT  getenv("SFR:PORTC")
+ #endif
+#endif
+
+#ifndef LED7_DIGIT_TRIS
+ #define LED7_DIGIT_TRIS  getenv("SFR:TRISC")
+#endif
+
+#ifndef LED7_DIGIT_BITS
+ #define LED7_DIGIT_BITS  0x01,0x02,0x04,0x08
+#endif
+
+#ifndef LED7_SEG_PORT
+ #if getenv("SFR_VALID:LATD")
+  #define LED7_SEG_PORT    getenv("SFR:LATD")
+ #else
+  #define LED7_SEG_PORT    getenv("SFR:PORTD")
+ #endif
+#endif
+
+#ifndef LED7_SEG_TRIS
+ #define LED7_SEG_TRIS    getenv("SFR:TRISD")
+#endif
+
+#ifndef LED7_BLANK
+ #define LED7_BLANK       0xFF
+#endif
+
+#ifndef LED7_DIGIT_HZ
+ #define LED7_DIGIT_HZ    1000
+#endif
+
+// Timer2 runs from the instruction clock / 16 with a postscaler of 2.  The
+// period must fit in PR2, so LED7_DIGIT_HZ can't go below ~600Hz at 20MHz.
+#define LED7_PR2          ((unsigned int8)(getenv("CLOCK") / (4L * 16 * 2 * LED7_DIGIT_HZ) - 1))
+
+// Segment patterns for 0-9, common anode (segment on = 0).
+unsigned int8 const Maled[10] = {0xC0,0xF9,0xA4,0xB0,0x99,0x92,0x82,0xF8,0x80,0x90};
+
+#byte led7_digit_port = LED7_DIGIT_PORT
+#byte led7_digit_tris = LED7_DIGIT_TRIS
+#byte led7_seg_port = LED7_SEG_PORT
+#byte led7_seg_tris = LED7_SEG_TRIS
+
+// Kept in RAM rather than const, a const table read is a call on PCM.
+unsigned int8 led7_bits[LED7_DIGITS] = {LED7_DIGIT_BITS};
+unsigned int8 led7_digit_mask;
+
+unsigned int8 led7_buf[LED7_DIGITS];
+unsigned int8 led7_digit;
+
+#int_timer2
+void led7_isr(void)
+{
+   led7_digit_port &= ~led7_digit_mask;
+
+   if(++led7_digit >= LED7_DIGITS)
+      led7_digit = 0;
+
+   led7_seg_port = led7_buf[led7_digit];
+   led7_digit_port |= led7_bits[led7_digit];
+}
+
+void led7_clear(void)
+{
+   unsigned int8 i;
+
+   for(i = 0; i < LED7_DIGITS; i++)
+      led7_buf[i] = LED7_BLANK;
+}
+
+void led7_put(unsigned int8 pos, unsigned int8 pattern)
+{
+   if(pos < LED7_DIGITS)
+      led7_buf[pos] = pattern;
+}
+
+void led7_putd(unsigned int8 pos, unsigned int8 value)
+{
+   if(value < 10)
+      led7_put(pos, Maled[value]);
+   else
+      led7_put(pos, LED7_BLANK);
+}
+
+void led7_init(void)
+{
+   unsigned int8 i;
+
+   led7_digit_mask = 0;
+   for(i = 0; i < LED7_DIGITS; i++)
+      led7_digit_mask |= led7_bits[i];
+
+   led7_digit_port &= ~led7_digit_mask;
+   led7_digit_tris &= ~led7_digit_mask;
+   led7_seg_port = LED7_BLANK;
+   led7_seg_tris = 0;
+
+   led7_clear();
+   led7_digit = 0;
+
+   setup_timer_2(T2_DIV_BY_16, LED7_PR2, 2);
+   clear_interrupt(INT_TIMER2);
+   enable_interrupts(INT_TIMER2);
+}
+
+#endif
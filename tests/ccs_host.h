@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                            ccs_host.h                             ////
+////                                                                   ////
+//// The CCS C built-ins the host builds in this directory need.  The  ////
+//// driver sources are first run through ccs2c.sed, which takes care  ////
+//// of the directives and integer types, so this only supplies what   ////
+//// is left: TRUE/FALSE in either case, getenv("CLOCK"), the make/bit ////
+//// functions, shift_left()/rotate_right() and isamoung().            ////
+//// Hardware functions (output_x(), timers, interrupts) are stubbed   ////
+//// by each test, since what they should do depends on the test.      ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __CCS_HOST_H__
+#define __CCS_HOST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef TRUE
+ #define TRUE   1
+ #define FALSE  0
+#endif
+
+// Identifiers are case-insensitive in CCS unless #case is used
+#ifndef true
+ #define true   TRUE
+ #define false  FALSE
+#endif
+
+#ifndef CCS_CLOCK
+ #define CCS_CLOCK 20000000
+#endif
+
+static inline long ccs_getenv(const char *s)
+{
+   if(strcmp(s, "CLOCK") == 0)
+      return(CCS_CLOCK);
+   return(0);
+}
+#define getenv(s)          ccs_getenv(s)
+
+#define make8(x,n)         ((uint8_t)((uint32_t)(x) >> (8 * (n))))
+#define make16(h,l)        ((uint16_t)(((uint16_t)(uint8_t)(h) << 8) | (uint8_t)(l)))
+#define _make32_2(h,l)     ((uint32_t)(((uint32_t)(uint16_t)(h) << 16) | (uint16_t)(l)))
+#define _make32_4(a,b,c,d) ((uint32_t)(((uint32_t)(uint8_t)(a) << 24) | ((uint32_t)(uint8_t)(b) << 16) | ((uint32_t)(uint8_t)(c) << 8) | (uint8_t)(d)))
+#define _make32_sel(_1,_2,_3,_4,n,...) n
+#define make32(...)        _make32_sel(__VA_ARGS__, _make32_4, _, _make32_2, _)(__VA_ARGS__)
+
+#define bit_test(x,b)      ((((x) >> (b)) & 1) != 0)
+#define bit_set(x,b)       ((x) |= (1UL << (b)))
+#define bit_clear(x,b)     ((x) &= ~(1UL << (b)))
+
+// Multi-byte shifts work on the bytes in RAM order, lowest byte first, the
+// same as on the PIC.
+static inline int shift_left(void *p, int bytes, int value)
+{
+   uint8_t *b = p;
+   int i, out = 0;
+
+   for(i = 0; i < bytes; i++)
+   {
+      out = b[i] >> 7;
+      b[i] = (uint8_t)((b[i] << 1) | (value & 1));
+      value = out;
+   }
+   return(out);
+}
+
+static inline void rotate_right(void *p, int bytes)
+{
+   uint8_t *b = p;
+   int i, first = b[0] & 1;
+
+   for(i = 0; i < bytes - 1; i++)
+      b[i] = (uint8_t)((b[i] >> 1) | (b[i + 1] << 7));
+   b[bytes - 1] = (uint8_t)((b[bytes - 1] >> 1) | (first << 7));
+}
+
+#define isamoung(c,s)      (((c) != 0) && (strchr((s), (c)) != NULL))
+
+#endif
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                            crc_test.c                             ////
+////                                                                   ////
+//// Conformance test and benchmark for the table driven functions in  ////
+//// crc.c.  Built once per CRC_ENGINE and CRC16_PATTERN, with the PCM ////
+//// (unsigned) and PCD (signed) integer types.                        ////
+////                                                                   ////
+////    crc_test        check values for "123456789", every length     ////
+////                    and split point against a bitwise reference,   ////
+////                    and against generate_xxbit_crc()               ////
+////    crc_test -b     adds the time per 4KB block                    ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include <time.h>
+#include "ccs_host.h"
+
+#include "crc.c"
+
+#define BUF_SIZE     300
+#define BENCH_SIZE   4096
+
+static int failures;
+
+static void check(const char *what, unsigned long got, unsigned long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: got 0x%lX, want 0x%lX\n", what, got, want);
+      failures++;
+   }
+}
+
+// Plain bitwise crc, msb first, no reflection or final xor
+static uint32_t ref_crc(int width, uint32_t poly, uint32_t crc, const uint8_t *data, int len)
+{
+   uint32_t top = 1UL << (width - 1);
+   uint32_t mask = (width == 32) ? 0xFFFFFFFFUL : ((1UL << width) - 1);
+   int i;
+
+   while(len--)
+   {
+      crc ^= (uint32_t)*data++ << (width - 8);
+      for(i = 0; i < 8; i++)
+         crc = (crc & top) ? (((crc << 1) ^ poly) & mask) : ((crc << 1) & mask);
+   }
+   return(crc);
+}
+
+static void check_vectors(void)
+{
+   uint8_t v[] = "123456789";
+
+   check("crc8 check", crc8_update(0, v, 9), 0xF4);
+#if CRC16_PATTERN == CRC_CCITT
+   check("crc16 check", crc16_update(0, v, 9), 0x31C3);
+   check("crc16 init 0xFFFF check", crc16_update(0xFFFF, v, 9), 0x29B1);
+#else
+   check("crc16 check", crc16_update(0, v, 9), 0xFEE8);
+#endif
+   check("crc32 check", crc32_update(0, v, 9), 0x89A1897FUL);
+   check("crc32 init 0xFFFFFFFF check", crc32_update(0xFFFFFFFFUL, v, 9), 0x0376E6E7UL);
+}
+
+static void check_buffers(void)
+{
+   uint8_t buf[BUF_SIZE];
+   char what[64];
+   int len, split;
+   uint32_t want;
+
+   // every byte value, so table indexes from 0x80 up are covered
+   for(len = 0; len < BUF_SIZE; len++)
+      buf[len] = (uint8_t)(len * 167 + 13);
+
+   for(len = 0; len <= BUF_SIZE; len++)
+   {
+      sprintf(what, "crc8 length %d", len);
+      check(what, crc8_update(0, buf, len), ref_crc(8, CRC_8, 0, buf, len));
+      sprintf(what, "crc16 length %d", len);
+      check(what, crc16_update(0x1D0F, buf, len), ref_crc(16, CRC16_PATTERN, 0x1D0F, buf, len));
+      sprintf(what, "crc32 length %d", len);
+      check(what, crc32_update(0xFFFFFFFFUL, buf, len), ref_crc(32, CRC_32, 0xFFFFFFFFUL, buf, len));
+
+      // The bitwise functions need at least one register's worth of data,
+      // and return signed types on PCD
+      if(len >= 4)
+      {
+         sprintf(what, "generate_8bit_crc length %d", len);
+         check(what, crc8_update(0, buf, len), (uint8_t)generate_8bit_crc((char *)buf, len, CRC_8));
+         sprintf(what, "generate_16bit_crc length %d", len);
+         check(what, crc16_update(0, buf, len), (uint16_t)generate_16bit_crc((char *)buf, len, CRC16_PATTERN));
+         sprintf(what, "generate_32bit_crc length %d", len);
+         check(what, crc32_update(0, buf, len), (uint32_t)generate_32bit_crc((char *)buf, len, CRC_32));
+      }
+   }
+
+   // Streaming, the result must not depend on how the data is split
+   want = ref_crc(32, CRC_32, 0, buf, BUF_SIZE);
+   for(split = 0; split <= BUF_SIZE; split++)
+   {
+      sprintf(what, "crc32 split at %d", split);
+      check(what, crc32_update(crc32_update(0, buf, split), buf + split, BUF_SIZE - split), want);
+      sprintf(what, "crc16 split at %d", split);
+      check(what, crc16_update(crc16_update(0, buf, split), buf + split, BUF_SIZE - split),
+            ref_crc(16, CRC16_PATTERN, 0, buf, BUF_SIZE));
+      sprintf(what, "crc8 split at %d", split);
+      check(what, crc8_update(crc8_update(0, buf, split), buf + split, BUF_SIZE - split),
+            ref_crc(8, CRC_8, 0, buf, BUF_SIZE));
+   }
+}
+
+static double now(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return(t.tv_sec + t.tv_nsec * 1e-9);
+}
+
+#define BENCH(name, expr)                                            \
+   do {                                                              \
+      double t0 = now();                                             \
+      for(i = 0; i < n; i++)                                         \
+         sink ^= (expr);                                             \
+      printf("   %-22s %8.2f us/block\n", name, (now() - t0) * 1e6 / n); \
+   } while(0)
+
+static void bench(void)
+{
+   static uint8_t buf[BENCH_SIZE];
+   volatile uint32_t sink = 0;
+   int i, n = 2000;
+
+   for(i = 0; i < BENCH_SIZE; i++)
+      buf[i] = (uint8_t)rand();
+
+   printf("   %d byte blocks:\n", BENCH_SIZE);
+   BENCH("crc8_update", crc8_update(0, buf, BENCH_SIZE));
+   BENCH("crc16_update", crc16_update(0, buf, BENCH_SIZE));
+   BENCH("crc32_update", crc32_update(0, buf, BENCH_SIZE));
+#ifndef __PCD__
+   n = 100;
+   BENCH("generate_8bit_crc", generate_8bit_crc((char *)buf, BENCH_SIZE, CRC_8));
+   BENCH("generate_16bit_crc", generate_16bit_crc((char *)buf, BENCH_SIZE, CRC16_PATTERN));
+   BENCH("generate_32bit_crc", generate_32bit_crc((char *)buf, BENCH_SIZE, CRC_32));
+#endif
+}
+
+int main(int argc, char **argv)
+{
+   printf("engine %d, crc16 pattern 0x%04X, %s types\n", CRC_ENGINE, CRC16_PATTERN,
+#ifdef __PCD__
+          "PCD");
+#else
+          "PCM");
+#endif
+
+   check_vectors();
+   check_buffers();
+
+   if((argc > 1) && (strcmp(argv[1], "-b") == 0))
+      bench();
+
+   printf("%d failures\n", failures);
+   return(failures ? 1 : 0);
+}
@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                          dht22_replay.c                           ////
+////                                                                   ////
+//// Replays the edge traces in dht22_traces.txt through dht22_edge()  ////
+//// and checks each frame decodes to the expected bytes, or is        ////
+//// rejected.  Also checks the ring overrun count.                    ////
+////                                                                   ////
+////    dht22_replay [trace file]                                      ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include <ctype.h>
+#include "ccs_host.h"
+
+// Hardware dht22.c touches.  The decoder doesn't use any of it.
+#define PIN_B0                   0
+#define T1_INTERNAL              0
+#define T1_DIV_BY_8              0
+#define H_TO_L                   0
+#define INT_EXT                  0
+#define INT_TIMER1               0
+#define output_float(p)
+#define output_low(p)
+#define setup_timer_1(m)
+#define ext_int_edge(e)
+#define enable_interrupts(i)
+#define disable_interrupts(i)
+#define clear_interrupt(i)
+#define get_timer1()             0
+
+#include "dht22.c"
+
+#define MAX_NAME  32
+
+static int failures;
+
+static void fail(const char *name, const char *why)
+{
+   printf("FAIL %s: %s\n", name, why);
+   failures++;
+}
+
+// Feeds one trace, periods in us, through the decoder the way the capture
+// ISR does.
+static void replay(unsigned int *us)
+{
+   unsigned int i;
+
+   dht22_decode_reset();
+   for(i = 0; i < DHT22_EDGES; i++)
+      dht22_edge(DHT22_TICKS(us[i]));
+}
+
+static int read_trace(FILE *f, char *name, int *expect_ok, unsigned int *bytes, unsigned int *us)
+{
+   char tok[MAX_NAME];
+   int c, i;
+
+   // skip comments
+   while((c = fgetc(f)) != EOF)
+   {
+      if(c == '#')
+      {
+         while(((c = fgetc(f)) != EOF) && (c != '\n'));
+      }
+      else if(!isspace(c))
+      {
+         ungetc(c, f);
+         break;
+      }
+   }
+
+   if(fscanf(f, "%31s %31s", name, tok) != 2)
+      return(0);
+
+   if(strcmp(tok, "error") == 0)
+      *expect_ok = 0;
+   else
+   {
+      *expect_ok = 1;
+      bytes[0] = strtoul(tok, NULL, 16);
+      if(fscanf(f, "%x %x %x", &bytes[1], &bytes[2], &bytes[3]) != 3)
+         return(-1);
+   }
+
+   for(i = 0; i < DHT22_EDGES; i++)
+      if(fscanf(f, "%u", &us[i]) != 1)
+         return(-1);
+
+   return(1);
+}
+
+int main(int argc, char **argv)
+{
+   FILE *f;
+   char name[MAX_NAME];
+   unsigned int bytes[4], us[DHT22_EDGES], room[DHT22_EDGES];
+   int expect_ok, r, traces = 0, have_room = 0;
+   uint16_t errors;
+   DHT22_SAMPLE s;
+
+   f = fopen((argc > 1) ? argv[1] : "dht22_traces.txt", "r");
+   if(f == NULL)
+   {
+      perror("dht22_traces.txt");
+      return(2);
+   }
+
+   dht22_init();
+
+   while((r = read_trace(f, name, &expect_ok, bytes, us)) > 0)
+   {
+      traces++;
+      errors = dht22_errors;
+      replay(us);
+
+      if(expect_ok)
+      {
+         if(!dht22_get(&s))
+            fail(name, "no reading");
+         else if((s.rh_hi != bytes[0]) || (s.rh_lo != bytes[1]) || (s.t_hi != bytes[2]) || (s.t_lo != bytes[3]))
+            fail(name, "wrong data");
+         else
+            printf("ok   %-9s %02X %02X %02X %02X\n", name, s.rh_hi, s.rh_lo, s.t_hi, s.t_lo);
+
+         if(!have_room)
+         {
+            memcpy(room, us, sizeof(room));
+            have_room = 1;
+         }
+      }
+      else
+      {
+         if(dht22_get(&s))
+            fail(name, "bad frame accepted");
+         else if(dht22_errors == errors)
+            fail(name, "error not counted");
+         else
+            printf("ok   %-9s rejected\n", name);
+      }
+
+      if(dht22_state != DHT22_IDLE)
+         fail(name, "decoder did not return to idle");
+   }
+   fclose(f);
+
+   if(r < 0)
+   {
+      printf("FAIL trace %s is malformed\n", name);
+      return(2);
+   }
+
+   // The ring holds DHT22_RING_SIZE - 1 readings, the rest are overruns
+   if(have_room)
+   {
+      for(r = 0; r < DHT22_RING_SIZE + 1; r++)
+         replay(room);
+
+      if(dht22_overruns != 2)
+         fail("overrun", "wrong overrun count");
+      for(r = 0; dht22_get(&s); r++);
+      if(r != DHT22_RING_SIZE - 1)
+         fail("overrun", "wrong number of queued readings");
+   }
+
+   // DHT22 temperature is sign and magnitude
+   s.rh_hi = 0x01;
+   s.rh_lo = 0x90;
+   s.t_hi = 0x80;
+   s.t_lo = 0x65;
+   if((dht22_temperature(&s) != -101) || (dht22_humidity(&s) != 400))
+      fail("convert", "wrong temperature or humidity");
+
+   printf("%d traces, %d failures\n", traces, failures);
+   return(failures ? 1 : 0);
+}
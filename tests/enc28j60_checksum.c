@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                        enc28j60_checksum.c                        ////
+////                                                                   ////
+//// Runs enc28j60.c's checksum functions on the chip model in         ////
+//// enc28j60_sim.h and checks them against a plain C IP checksum.     ////
+//// Built with the DMA checksum and with the software one             ////
+//// (ENC_CHECKSUM_DMA 1 or 0), for both type models.                  ////
+////                                                                   ////
+////    NICCalcTxChecksum   even and odd lengths of data full of high  ////
+////                        bytes (0x80-0xFF), where sign extension    ////
+////                        would show up                              ////
+////    NICPutTxChecksum    the same data with seeds that have the     ////
+////                        high bit set, and the packet then sums to  ////
+////                        0 with its checksum in it                  ////
+////    read pointer        the software checksum puts it back         ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+#include "enc28j60_sim.h"
+
+#define ENC_MAC_DMA_CHECKSUM     ENC_CHECKSUM_DMA
+
+#define debug_printf(...)
+#define DO_DEBUG                 FALSE
+
+#define PIN_ENC_MAC_SO           ENC_SIM_SO
+#define PIN_ENC_MAC_SI           ENC_SIM_SI
+#define PIN_ENC_MAC_CLK          ENC_SIM_CLK
+#define PIN_ENC_MAC_CS           ENC_SIM_CS
+#define PIN_ENC_MAC_RST          ENC_SIM_RST
+#define mac_enc_spi_tris_init()
+
+#define output_high(p)           enc_sim_pin(p, 1)
+#define output_low(p)            enc_sim_pin(p, 0)
+#define output_bit(p,v)          enc_sim_pin(p, v)
+#define output_float(p)
+#define input(p)                 enc_sim.so
+#define delay_us(x)
+#define delay_ms(x)
+
+#include "enc28j60.c"
+
+static int failures;
+
+static void check(const char *what, unsigned long got, unsigned long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: got 0x%lX, want 0x%lX\n", what, got, want);
+      failures++;
+   }
+}
+
+// IP checksum of data, with seed added to the sum first
+static uint16_t ref_checksum(const uint8_t *data, int len, uint16_t seed)
+{
+   uint32_t sum = seed;
+   int i;
+
+   for(i = 0; i < len; i++)
+      sum += (i & 1) ? data[i] : (data[i] << 8);
+   while(sum >> 16)
+      sum = (sum & 0xFFFF) + (sum >> 16);
+   return((uint16_t)~sum);
+}
+
+static void put_packet(const uint8_t *data, int len)
+{
+   NICSetTxBuffer(0, 0);
+   NICPutArray((char *)data, len);
+}
+
+int main(void)
+{
+   static const int lengths[] = {1, 2, 3, 20, 21, 64, 255, 1000};
+   static const uint16_t seeds[] = {0x0000, 0x0001, 0x7FFF, 0x8000, 0xFFFE, 0xFFFF};
+   uint8_t data[1100], got[2];
+   char what[80];
+   uint16_t erdpt, want;
+   unsigned int i, j, len;
+
+   enc_sim_init();
+
+   // high bytes everywhere, 0xFF runs make the one's complement carry
+   for(i = 0; i < sizeof(data); i++)
+      data[i] = (i % 7 < 3) ? 0xFF : (uint8_t)(0x80 | (i * 37));
+
+   for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+   {
+      len = lengths[i];
+      put_packet(data, len);
+
+      enc_mac_write_control_word(ENC_MAC_ERDPTL, 0x0123);
+      sprintf(what, "NICCalcTxChecksum length %u", len);
+      check(what, (uint16_t)NICCalcTxChecksum(0, len), ref_checksum(data, len, 0));
+      sprintf(what, "read pointer after length %u", len);
+      erdpt = enc_mac_read_control_word(ENC_MAC_ERDPTL, 0);
+      check(what, erdpt, 0x0123);
+
+      for(j = 0; j < sizeof(seeds) / sizeof(seeds[0]); j++)
+      {
+         // the checksum goes after the data, on an even offset
+         put_packet(data, len);
+         NICPut(0);
+         NICPut(0);
+         NICPutTxChecksum(0, len, seeds[j], len + (len & 1));
+
+         NICSetTxBuffer(0, len + (len & 1));
+         NICGetArray((char *)got, 2);
+         want = ref_checksum(data, len, seeds[j]);
+         sprintf(what, "NICPutTxChecksum length %u seed 0x%04X", len, seeds[j]);
+         check(what, make16(got[0], got[1]), want);
+
+         // the receiver's view: data, pad and checksum sum to 0
+         if(seeds[j] == 0)
+         {
+            sprintf(what, "checked length %u", len);
+            check(what, (uint16_t)NICCalcTxChecksum(0, len + (len & 1) + 2), 0);
+         }
+      }
+   }
+
+#if ENC_CHECKSUM_DMA
+   check("checksums by the DMA", enc_sim.checksum_runs > 0, 1);
+#else
+   check("checksums by the DMA", enc_sim.checksum_runs, 0);
+#endif
+
+   printf("%d failures\n", failures);
+   return(failures != 0);
+}
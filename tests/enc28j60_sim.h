@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                          enc28j60_sim.h                           ////
+////                                                                   ////
+//// An ENC28J60 on enc28j60.c's bit-banged SPI pins.  Map the pins    ////
+//// with enc_sim_pin() and input(PIN_ENC_MAC_SO) to enc_sim.so, the    ////
+//// way enc28j60_checksum.c does.                                     ////
+////                                                                   ////
+//// It knows the SPI opcodes (RCR, RBM, WCR, WBM, BFS, BFC and SRC),  ////
+//// the four control register banks, the buffer memory with the read  ////
+//// pointer wrapping at the end of the receive buffer, and the DMA    ////
+//// copy and checksum, which finish as soon as DMAST is set.  The MAC ////
+//// and PHY are not modeled.                                          ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __ENC28J60_SIM_H__
+#define __ENC28J60_SIM_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define ENC_SIM_MEMORY     8192
+
+// pins, any distinct values
+#define ENC_SIM_SO         1
+#define ENC_SIM_SI         2
+#define ENC_SIM_CLK        3
+#define ENC_SIM_CS         4
+#define ENC_SIM_RST        5
+
+struct enc_sim
+{
+   uint8_t mem[ENC_SIM_MEMORY];
+   uint8_t bank[4][32];          // 0x1B-0x1F live in bank 0 and are common
+   _Bool cs, clk, si, so;
+
+   // what's going on on the line
+   uint8_t opcode, in, out;
+   int bits, bytes;
+
+   // what the chip saw
+   unsigned long dma_runs, checksum_runs;
+};
+
+static struct enc_sim enc_sim;
+
+// The control register a 5 bit address means in the current bank
+static uint8_t *enc_sim_reg(uint8_t a)
+{
+   a &= 0x1F;
+   if(a >= 0x1B)
+      return(&enc_sim.bank[0][a]);
+   return(&enc_sim.bank[enc_sim.bank[0][0x1F] & 3][a]);
+}
+
+static uint16_t enc_sim_get16(int bank, uint8_t a)
+{
+   return(enc_sim.bank[bank][a] | (enc_sim.bank[bank][a + 1] << 8));
+}
+
+static void enc_sim_set16(int bank, uint8_t a, uint16_t v)
+{
+   enc_sim.bank[bank][a] = (uint8_t)v;
+   enc_sim.bank[bank][a + 1] = (uint8_t)(v >> 8);
+}
+
+// The next address after a, wrapping from ERXND to ERXST
+static uint16_t enc_sim_next(uint16_t a)
+{
+   if(a == enc_sim_get16(0, 0x0A))
+      return(enc_sim_get16(0, 0x08));
+   return((a + 1) & (ENC_SIM_MEMORY - 1));
+}
+
+// DMAST was set: copy or checksum EDMAST to EDMAND
+static void enc_sim_dma(void)
+{
+   uint16_t a, end, dst;
+   uint32_t sum;
+   int odd;
+
+   a = enc_sim_get16(0, 0x10);
+   end = enc_sim_get16(0, 0x12);
+   enc_sim.dma_runs++;
+
+   if(enc_sim.bank[0][0x1F] & 0x10)          // CSUMEN
+   {
+      enc_sim.checksum_runs++;
+      sum = 0;
+      odd = 0;
+      for(;;)
+      {
+         sum += odd ? enc_sim.mem[a] : (enc_sim.mem[a] << 8);
+         odd = !odd;
+         if(a == end)
+            break;
+         a = enc_sim_next(a);
+      }
+      while(sum >> 16)
+         sum = (sum & 0xFFFF) + (sum >> 16);
+      sum = ~sum & 0xFFFF;
+      enc_sim.bank[0][0x16] = (uint8_t)sum;  // EDMACSL
+      enc_sim.bank[0][0x17] = (uint8_t)(sum >> 8);
+   }
+   else
+   {
+      dst = enc_sim_get16(0, 0x14);
+      for(;;)
+      {
+         enc_sim.mem[dst] = enc_sim.mem[a];
+         dst = (dst + 1) & (ENC_SIM_MEMORY - 1);
+         if(a == end)
+            break;
+         a = enc_sim_next(a);
+      }
+   }
+
+   enc_sim.bank[0][0x1F] &= ~0x20;           // DMAST clears when it's done
+}
+
+static void enc_sim_reset(void)
+{
+   memset(enc_sim.bank, 0, sizeof(enc_sim.bank));
+   enc_sim_set16(0, 0x08, 0x05FA);           // ERXST, ERXND as after a reset
+   enc_sim_set16(0, 0x0A, 0x1FFF);
+}
+
+void enc_sim_init(void)
+{
+   memset(&enc_sim, 0, sizeof(enc_sim));
+   enc_sim.cs = 1;
+   enc_sim_reset();
+}
+
+// A byte the host clocked in
+static void enc_sim_byte(uint8_t b)
+{
+   uint8_t *r;
+   uint16_t p;
+
+   if(enc_sim.bytes++ == 0)
+   {
+      enc_sim.opcode = b;
+      if(b == 0xFF)
+         enc_sim_reset();
+      return;
+   }
+
+   r = enc_sim_reg(enc_sim.opcode);
+   switch(enc_sim.opcode >> 5)
+   {
+      case 2:                                // WCR
+         *r = b;
+         break;
+      case 4:                                // BFS
+         *r |= b;
+         break;
+      case 5:                                // BFC
+         *r &= ~b;
+         break;
+      case 3:                                // WBM
+         if(enc_sim.opcode == 0x7A)
+         {
+            p = enc_sim_get16(0, 0x02);
+            enc_sim.mem[p] = b;
+            enc_sim_set16(0, 0x02, (p + 1) & (ENC_SIM_MEMORY - 1));
+         }
+         return;
+      default:
+         return;
+   }
+
+   if((r == &enc_sim.bank[0][0x1F]) && (*r & 0x20))
+      enc_sim_dma();
+}
+
+// What the chip shifts out for the byte that is starting
+static uint8_t enc_sim_out(void)
+{
+   uint16_t p;
+
+   if(enc_sim.bytes == 0)
+      return(0);
+   if(enc_sim.opcode == 0x3A)                // RBM
+   {
+      p = enc_sim_get16(0, 0x00);
+      enc_sim_set16(0, 0x00, enc_sim_next(p));
+      return(enc_sim.mem[p]);
+   }
+   if((enc_sim.opcode >> 5) == 0)            // RCR
+      return(*enc_sim_reg(enc_sim.opcode));
+   return(0);
+}
+
+void enc_sim_pin(int pin, int level)
+{
+   level = (level != 0);
+   switch(pin)
+   {
+      case ENC_SIM_CS:
+         if(!level && enc_sim.cs)
+         {
+            enc_sim.bytes = 0;
+            enc_sim.bits = 0;
+         }
+         enc_sim.cs = level;
+         break;
+
+      case ENC_SIM_SI:
+         enc_sim.si = level;
+         break;
+
+      case ENC_SIM_CLK:
+         // data is taken in and put out on the rising edge
+         if(level && !enc_sim.clk && !enc_sim.cs)
+         {
+            if(enc_sim.bits == 0)
+               enc_sim.out = enc_sim_out();
+            enc_sim.so = (enc_sim.out >> (7 - enc_sim.bits)) & 1;
+            enc_sim.in = (uint8_t)((enc_sim.in << 1) | enc_sim.si);
+            if(++enc_sim.bits == 8)
+            {
+               enc_sim.bits = 0;
+               enc_sim_byte(enc_sim.in);
+            }
+         }
+         enc_sim.clk = level;
+         break;
+   }
+}
+
+#endif
@@ -0,0 +1,700 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                            fat_bench.c                            ////
+////                                                                   ////
+//// fat.c and mmcsd.c running on the SD card model in sd_card_sim.h,  ////
+//// with a FAT32 image in RAM.  The mmcsd.c traffic counters          ////
+//// (MMCSD_STATS) give the SPI bytes, commands and busy polls each    ////
+//// operation costs, and the byte count times BYTE_NS is the modeled  ////
+//// time, busy and access waits included.                             ////
+////                                                                   ////
+////    fat_bench       multiple block writes that stop early or fail, ////
+////                    then files written with fatputs(), fatputc()   ////
+////                    and fatwrite(), appended to, read back and     ////
+////                    seeked through, and deleted again, with the    ////
+////                    card reinitialised after writing and after     ////
+////                    deleting; a file reserved with fatprealloc();  ////
+////                    full FAT sectors freed and filled again; and   ////
+////                    a directory of 40 files made, half deleted and ////
+////                    made again                                     ////
+////    fat_bench -b    adds the create/open/append/write/read/seek/   ////
+////                    delete workloads with their per operation cost ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+#include "sd_card_sim.h"
+
+// A 10MHz SPI clock plus the time the PIC takes between bytes
+#define BYTE_NS         1000
+
+#define IMAGE_MB        64
+#define IMAGE_BLOCKS    ((uint32_t)IMAGE_MB * 2048)
+#define SEC_PER_CLUS    8
+
+// Typical for a class 4 to class 10 card
+static const struct sd_sim_timing timing =
+{
+   100,     // read_access
+   10,      // read_next
+   250,     // prog_single
+   120,     // prog_multi
+   60,      // prog_erased
+   250      // prog_stop
+};
+
+// Hardware mmcsd.c touches
+#define MMCSD_PIN_SELECT         0
+#define output_low(p)            sd_sim_select(0)
+#define output_high(p)           sd_sim_select(1)
+#define output_drive(p)
+#define output_float(p)
+#define delay_ms(x)
+#define delay_us(x)
+
+#define MMCSD_SPI_XFER(x)        sd_sim_xfer(x)
+#define MMCSD_STATS
+
+// CCS lets an enum tag be used as a type name
+typedef enum MMCSD_err MMCSD_err;
+
+#include "mmcsd.c"
+
+// fat.c has its own FILE and a few other stdio names, and putc() to the
+// default RS232 stream
+#undef EOF
+#undef SEEK_CUR
+#undef SEEK_END
+#undef SEEK_SET
+#define FILE      FAT_FILE
+#define remove    fat_remove
+#define rewind    fat_rewind
+#define clearerr  fat_clearerr
+#undef putc
+#define putc(c)   putchar(c)
+
+#include "fat.c"
+
+static uint8_t *image;
+static int failures;
+
+static void check(const char *what, long got, long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: got %ld, want %ld\n", what, got, want);
+      failures++;
+   }
+}
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+   rnd_state = rnd_state * 1103515245 + 12345;
+   return(rnd_state >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+   return(p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+// A bare FAT32 volume with one FAT, no partition table, root directory in
+// cluster 2 and the free count left unknown.
+static void mkfs(void)
+{
+   uint8_t *bs = image, *fsinfo = image + 512, *fat;
+   uint32_t clusters, fat_sectors;
+
+   memset(image, 0, (size_t)IMAGE_BLOCKS * 512);
+
+   clusters = (IMAGE_BLOCKS - 32) / SEC_PER_CLUS;
+   fat_sectors = ((clusters + 2) * 4 + 511) / 512;
+   clusters = (IMAGE_BLOCKS - 32 - fat_sectors) / SEC_PER_CLUS;
+
+   bs[0] = 0xEB; bs[1] = 0x58; bs[2] = 0x90;
+   memcpy(bs + 3, "MSDOS5.0", 8);
+   bs[11] = 0x00; bs[12] = 0x02;    // 512 bytes per sector
+   bs[13] = SEC_PER_CLUS;
+   bs[14] = 32;                     // reserved sectors
+   bs[16] = 1;                      // FATs
+   bs[21] = 0xF8;
+   put32(bs + 32, IMAGE_BLOCKS);
+   put32(bs + 36, fat_sectors);
+   put32(bs + 44, 2);               // root cluster
+   bs[48] = 1;                      // FSInfo sector
+   bs[50] = 6;                      // backup boot sector
+   bs[66] = 0x29;
+   memcpy(bs + 71, "NO NAME    FAT32   ", 19);
+   bs[510] = 0x55; bs[511] = 0xAA;
+
+   put32(fsinfo, 0x41615252);
+   put32(fsinfo + 0x1E4, 0x61417272);
+   put32(fsinfo + 0x1E8, 0xFFFFFFFF);
+   put32(fsinfo + 0x1EC, 3);
+   fsinfo[510] = 0x55; fsinfo[511] = 0xAA;
+
+   fat = image + 32 * 512;
+   put32(fat, 0x0FFFFFF8);
+   put32(fat + 4, 0x0FFFFFFF);
+   put32(fat + 8, 0x0FFFFFFF);
+}
+
+// Multiple block writes straight through mmcsd.c
+
+#define BLK_BASE  (IMAGE_BLOCKS - 64)
+
+static uint8_t blk_src[4][512];
+static int blk_limit;
+
+static uint8_t* blk_cb(uint16_t block)
+{
+   if(block >= blk_limit)
+      return(NULL);
+   return(blk_src[block]);
+}
+
+static int blk_is(uint32_t block, uint8_t v)
+{
+   int i;
+
+   for(i = 0; i < 512; i++)
+      if(image[(size_t)block * 512 + i] != v)
+         return(0);
+   return(1);
+}
+
+static void block_checks(void)
+{
+   uint32_t addr = (uint32_t)BLK_BASE * 512;
+   int i;
+
+   for(i = 0; i < 4; i++)
+      memset(blk_src[i], 0x10 + i, 512);
+
+   // the blocks a stream that stops early doesn't get to are left alone
+   memset(image + (size_t)BLK_BASE * 512, 0xA5, 4 * 512);
+   blk_limit = 2;
+   check("write_blocks stopped early", mmcsd_write_blocks(addr, 4, blk_cb), MMCSD_GOODEC);
+   check("  block 1 written", blk_is(BLK_BASE + 1, 0x11), 1);
+   check("  block 2 untouched", blk_is(BLK_BASE + 2, 0xA5), 1);
+   check("  no pre-erase", sd.pre_erases, 0);
+
+   // a pre-erased stream has to be told all of its blocks
+   check("write_blocks_preerase stopped early", mmcsd_write_blocks_preerase(addr, 4, blk_cb), MMCSD_PARAM_ERR);
+   check("  pre-erased", sd.pre_erases, 1);
+
+   blk_limit = 4;
+   check("write_blocks_preerase", mmcsd_write_blocks_preerase(addr, 4, blk_cb), MMCSD_GOODEC);
+   check("  block 3 written", blk_is(BLK_BASE + 3, 0x13), 1);
+
+   // a rejected block ends the stream with the stop token, the status read
+   //  after it clears the card's error
+   sd.fail_block = BLK_BASE + 1;
+   check("write error data response", mmcsd_write_blocks(addr, 4, blk_cb), 0x0D);
+   check("  status cleared", sd.status, 0);
+   sd.fail_block = SD_SIM_NO_BLOCK;
+
+   // an error that only shows in the card status
+   sd.status_fail_block = BLK_BASE + 2;
+   check("error in status only", mmcsd_write_blocks(addr, 4, blk_cb), MMCSD_PARAM_ERR);
+   check("  status cleared", sd.status, 0);
+   sd.status_fail_block = SD_SIM_NO_BLOCK;
+
+   check("clear_blocks", mmcsd_clear_blocks(addr, 4), MMCSD_GOODEC);
+   check("  block 3 cleared", blk_is(BLK_BASE + 3, 0x00), 1);
+
+   // and the card is still usable
+   check("write_blocks after errors", mmcsd_write_blocks(addr, 4, blk_cb), MMCSD_GOODEC);
+   check("  block 2 written", blk_is(BLK_BASE + 2, 0x12), 1);
+}
+
+// Files through fat.c
+
+#define TEXT_MAX  16384
+#define BIN_SIZE  (100 + 8269 + 1000)
+#define FILL_SIZE (1100L * 1024)         // more clusters than two FAT sectors hold
+
+static char text[TEXT_MAX];
+static int text_len;
+static uint8_t bin[BIN_SIZE], fill[FILL_SIZE], back[FILL_SIZE];
+
+static void add_lines(FILE *f, int from, int n)
+{
+   char line[40];
+   int i;
+
+   for(i = from; i < from + n; i++)
+   {
+      sprintf(line, "line %04d of the test log\r\n", i);
+      fatputs(line, f);
+      memcpy(text + text_len, line, strlen(line));
+      text_len += strlen(line);
+   }
+}
+
+static void read_back(const char *what, char *name, const uint8_t *want, long len)
+{
+   FILE f;
+   char msg[64];
+   long i;
+
+   sprintf(msg, "%s open", what);
+   check(msg, fatopen(name, "rb", &f), GOODEC);
+   memset(back, 0, len);
+   if(len > 0)
+      fatread(back, 1, len, &f);
+   for(i = 0; (i < len) && (back[i] == want[i]); i++);
+   sprintf(msg, "%s contents", what);
+   check(msg, i, len);
+   fatclose(&f);
+}
+
+// Free clusters counted straight from the image's FAT
+static uint32_t image_free_clusters(void)
+{
+   uint8_t *fat = image + FAT_Start;
+   uint32_t c, n = 0;
+
+   for(c = 2; c < End_Clust; c++)
+      if((get32(fat + c * 4) & 0x0FFFFFFF) == 0)
+         n++;
+   return(n);
+}
+
+static void fs_checks(void)
+{
+   FILE f;
+   uint32_t free0, free1;
+   long i, pos;
+   int ok;
+
+   check("get_free_clusters", get_free_clusters(&free0), GOODEC);
+
+   // a text file through fatputs()
+   check("mk_file /LOG.TXT", mk_file("/LOG.TXT"), GOODEC);
+   check("open /LOG.TXT w", fatopen("/LOG.TXT", "w", &f), GOODEC);
+   add_lines(&f, 0, 200);
+   check("close /LOG.TXT", fatclose(&f), GOODEC);
+
+   // a binary file through fatputc() and fatwrite(), with whole sectors in the middle
+   for(i = 0; i < BIN_SIZE; i++)
+      bin[i] = (uint8_t)rnd();
+   check("mk_file /DATA.BIN", mk_file("/DATA.BIN"), GOODEC);
+   check("open /DATA.BIN w", fatopen("/DATA.BIN", "wb", &f), GOODEC);
+   for(i = 0; i < 100; i++)
+      fatputc(bin[i], &f);
+   fatwrite(bin + 100, 1, 8269, &f);
+   fatwrite(bin + 100 + 8269, 1, 1000, &f);
+   check("close /DATA.BIN", fatclose(&f), GOODEC);
+#if MMCSD_CACHE_SECTORS > 2
+   check("FAT sector pinned", FAT_Pinned != 0, 1);
+   check("directory sector pinned", Dir_Pinned != 0, 1);
+#endif
+
+   // appending
+   check("open /LOG.TXT a", fatopen("/LOG.TXT", "a", &f), GOODEC);
+   add_lines(&f, 200, 150);
+   check("close /LOG.TXT a", fatclose(&f), GOODEC);
+
+   // everything has to be on the card, not just in the cache
+   check("fat_init again", fat_init(), GOODEC);
+   read_back("/LOG.TXT", "/LOG.TXT", (uint8_t*)text, text_len);
+   read_back("/DATA.BIN", "/DATA.BIN", bin, BIN_SIZE);
+
+   // seeking
+   check("open /DATA.BIN r", fatopen("/DATA.BIN", "rb", &f), GOODEC);
+   ok = 0;
+   for(i = 0; i < 100; i++)
+   {
+      pos = rnd() % BIN_SIZE;
+      fatseek(&f, pos, SEEK_SET);
+      if((uint8_t)fatgetc(&f) == bin[pos])
+         ok++;
+   }
+   check("seek and getc", ok, 100);
+   fatclose(&f);
+
+   // deleting gives every cluster back
+   check("rm_file /LOG.TXT", rm_file("/LOG.TXT"), GOODEC);
+   check("rm_file /DATA.BIN", rm_file("/DATA.BIN"), GOODEC);
+   check("/LOG.TXT gone", fatopen("/LOG.TXT", "r", &f), EOF);
+   check("get_free_clusters after", get_free_clusters(&free1), GOODEC);
+   check("  free clusters", free1, free0);
+
+   // and that has to reach the card too, FSInfo included
+   check("fat_init after rm_file", fat_init(), GOODEC);
+   check("  free clusters in the FAT", image_free_clusters(), free0);
+   check("get_free_clusters after fat_init", get_free_clusters(&free1), GOODEC);
+   check("  free clusters", free1, free0);
+}
+
+// Clusters in the chain starting at cluster c in the image's FAT, and
+// whether each one follows the one before
+static uint32_t image_chain(uint32_t c, int *contiguous)
+{
+   uint8_t *fat = image + FAT_Start;
+   uint32_t n = 1, next;
+
+   *contiguous = 1;
+   for(;;)
+   {
+      next = get32(fat + c * 4) & 0x0FFFFFFF;
+      if((next < 2) || (next >= 0x0FFFFFF8))
+         return(n);
+      if(next != c + 1)
+         *contiguous = 0;
+      c = next;
+      n++;
+   }
+}
+
+// The first cluster of a file, 0 if it can't be opened
+static uint32_t first_cluster(char *name)
+{
+   FILE f;
+   uint32_t c;
+
+   if(fatopen(name, "r", &f) != GOODEC)
+      return(0);
+   c = addr_to_cluster(f.Start_Addr);
+   fatclose(&f);
+   return(c);
+}
+
+static void write_file(char *name, uint8_t *data, long len)
+{
+   FILE f;
+   char msg[64];
+
+   sprintf(msg, "mk_file %s", name);
+   check(msg, mk_file(name), GOODEC);
+   sprintf(msg, "open %s w", name);
+   check(msg, fatopen(name, "wb", &f), GOODEC);
+   fatwrite(data, 1, len, &f);
+   sprintf(msg, "close %s", name);
+   check(msg, fatclose(&f), GOODEC);
+}
+
+static void prealloc_checks(void)
+{
+   FILE f;
+   uint32_t free0, free1, c, n, want;
+   long i;
+   int contiguous;
+
+   for(i = 0; i < FILL_SIZE; i++)
+      fill[i] = (uint8_t)rnd();
+
+   check("get_free_clusters", get_free_clusters(&free0), GOODEC);
+
+   // a small file in the way, so the reserved run has to go around it
+   write_file("/GAP.BIN", fill, 100);
+
+   // reserve the whole fill and only write half of it
+   check("mk_file /PRE.BIN", mk_file("/PRE.BIN"), GOODEC);
+   check("open /PRE.BIN w", fatopen("/PRE.BIN", "wb", &f), GOODEC);
+   check("fatprealloc", fatprealloc(&f, FILL_SIZE), GOODEC);
+   check("fatprealloc twice", fatprealloc(&f, FILL_SIZE), EOF);
+   fatwrite(fill, 1, FILL_SIZE / 2, &f);
+   check("close /PRE.BIN", fatclose(&f), GOODEC);
+
+   check("open /PRE.BIN a", fatopen("/PRE.BIN", "a", &f), GOODEC);
+   check("fatprealloc with data", fatprealloc(&f, FILL_SIZE), EOF);
+   fatclose(&f);
+
+   // what wasn't written was given back, and what was is in one run
+   check("fat_init after fatprealloc", fat_init(), GOODEC);
+   want = (FILL_SIZE / 2 + Bytes_Per_Cluster - 1) / Bytes_Per_Cluster;
+   c = first_cluster("/PRE.BIN");
+   n = image_chain(c, &contiguous);
+   check("  clusters kept", n, want);
+   check("  contiguous", contiguous, 1);
+   check("  free clusters in the FAT", image_free_clusters(), free0 - want - 1);
+   read_back("/PRE.BIN", "/PRE.BIN", fill, FILL_SIZE / 2);
+
+   check("rm_file /PRE.BIN", rm_file("/PRE.BIN"), GOODEC);
+   check("rm_file /GAP.BIN", rm_file("/GAP.BIN"), GOODEC);
+   check("get_free_clusters after", get_free_clusters(&free1), GOODEC);
+   check("  free clusters", free1, free0);
+}
+
+// Full FAT sectors have to be searched again once something in them is freed
+static void full_sector_checks(void)
+{
+   uint32_t free0, free1, c;
+   int contiguous;
+
+   check("get_free_clusters", get_free_clusters(&free0), GOODEC);
+
+   // /A.BIN ahead of /FILL.BIN, then freed so the next search starts in front of it
+   write_file("/A.BIN", fill, 100);
+   write_file("/FILL.BIN", fill, FILL_SIZE);
+   c = first_cluster("/FILL.BIN");
+   check("rm_file /A.BIN", rm_file("/A.BIN"), GOODEC);
+
+   // the first file takes /A.BIN's cluster, the second one searches past /FILL.BIN
+   write_file("/B.BIN", fill, 100);
+   write_file("/C.BIN", fill, 100);
+#ifdef FAT_FULL_MAP_BYTES
+   check("full sectors found", FAT_Full_Map[0] != 0, 1);
+#endif
+
+   // freeing /FILL.BIN lets its clusters be found again
+   check("rm_file /FILL.BIN", rm_file("/FILL.BIN"), GOODEC);
+   write_file("/FILL2.BIN", fill, FILL_SIZE);
+   check("/FILL2.BIN where /FILL.BIN was", first_cluster("/FILL2.BIN"), c);
+   check("  contiguous", image_chain(c, &contiguous) > 0 && contiguous, 1);
+
+   check("fat_init after refill", fat_init(), GOODEC);
+   read_back("/FILL2.BIN", "/FILL2.BIN", fill, FILL_SIZE);
+
+   check("rm_file /FILL2.BIN", rm_file("/FILL2.BIN"), GOODEC);
+   check("rm_file /B.BIN", rm_file("/B.BIN"), GOODEC);
+   check("rm_file /C.BIN", rm_file("/C.BIN"), GOODEC);
+   check("get_free_clusters after", get_free_clusters(&free1), GOODEC);
+   check("  free clusters", free1, free0);
+}
+
+#define DIR_FILES 40
+
+// A directory with more files than FAT_DIR_INDEX_SIZE holds in the small
+// variant and fewer than it holds in the big one
+static void dir_checks(void)
+{
+   FILE f;
+   char dir[] = "/D/", name[16], msg[64];
+   uint32_t free0, free1;
+   int i, found;
+
+   check("get_free_clusters", get_free_clusters(&free0), GOODEC);
+
+   // mk_dir() and rm_dir() write into the name while they work on it
+   check("mk_dir /D/", mk_dir(dir), GOODEC);
+   for(i = 0; i < DIR_FILES; i++)
+   {
+      sprintf(name, "/D/F%02d.TXT", i);
+      check(name, mk_file(name), GOODEC);
+   }
+
+   found = 0;
+   for(i = DIR_FILES - 1; i >= 0; i--)
+   {
+      sprintf(name, "/D/F%02d.TXT", i);
+      if(fatopen(name, "r", &f) == GOODEC)
+      {
+         found++;
+         fatclose(&f);
+      }
+   }
+   check("files found", found, DIR_FILES);
+   check("missing file", fatopen("/D/NONE.TXT", "r", &f), EOF);
+   check("mk_file twice", mk_file("/D/F07.TXT"), EOF);
+
+   // every other file gone, then made again in the freed entries
+   for(i = 0; i < DIR_FILES; i += 2)
+   {
+      sprintf(name, "/D/F%02d.TXT", i);
+      check(name, rm_file(name), GOODEC);
+   }
+   found = 0;
+   for(i = 0; i < DIR_FILES; i++)
+   {
+      sprintf(name, "/D/F%02d.TXT", i);
+      if(fatopen(name, "r", &f) == GOODEC)
+      {
+         found += (i & 1) ? 1 : 100;
+         fatclose(&f);
+      }
+   }
+   check("files left", found, DIR_FILES / 2);
+
+   for(i = 0; i < DIR_FILES; i += 2)
+   {
+      sprintf(name, "/D/G%02d.TXT", i);
+      check(name, mk_file(name), GOODEC);
+   }
+   check("fat_init after mk_file", fat_init(), GOODEC);
+   found = 0;
+   for(i = 0; i < DIR_FILES; i++)
+   {
+      sprintf(name, "/D/%c%02d.TXT", (i & 1) ? 'F' : 'G', i);
+      if(fatopen(name, "r", &f) == GOODEC)
+      {
+         found++;
+         fatclose(&f);
+      }
+   }
+   check("files found again", found, DIR_FILES);
+
+   for(i = 0; i < DIR_FILES; i++)
+   {
+      sprintf(name, "/D/%c%02d.TXT", (i & 1) ? 'F' : 'G', i);
+      sprintf(msg, "rm_file %s", name);
+      check(msg, rm_file(name), GOODEC);
+   }
+   check("rm_dir /D/", rm_dir(dir), GOODEC);
+   check("get_free_clusters after", get_free_clusters(&free1), GOODEC);
+   check("  free clusters", free1, free0);
+}
+
+// Workloads
+
+struct snap
+{
+   unsigned long bytes, cmds, busy, rd, wr;
+};
+
+static void snap_take(struct snap *s)
+{
+   s->bytes = g_mmcsd_spi_bytes;
+   s->cmds = g_mmcsd_cmds;
+   s->busy = g_mmcsd_busy_polls;
+   s->rd = g_mmcsd_blocks_read;
+   s->wr = g_mmcsd_blocks_written;
+}
+
+// payload 0 reports operations per second, otherwise KB/s
+static void report(const char *name, struct snap *s0, long ops, long payload)
+{
+   struct snap s1;
+   double ms;
+
+   snap_take(&s1);
+   ms = (s1.bytes - s0->bytes) * (double)BYTE_NS / 1e6;
+   printf("   %-14s %5ld %9.0f %7.1f %8.0f %6.2f %6.2f %9.1f",
+      name, ops,
+      (double)(s1.bytes - s0->bytes) / ops,
+      (double)(s1.cmds - s0->cmds) / ops,
+      (double)(s1.busy - s0->busy) / ops,
+      (double)(s1.rd - s0->rd) / ops,
+      (double)(s1.wr - s0->wr) / ops,
+      ms);
+   if(payload)
+      printf(" %8.1f KB/s\n", payload / 1024.0 / (ms / 1000));
+   else
+      printf(" %8.1f op/s\n", ops / (ms / 1000));
+}
+
+#define FILES        32
+#define LOG_LINES    200
+#define BIG_SIZE     (512L * 1024)
+#define CHUNK        4096
+#define SEEKS        200
+
+static uint8_t chunk[CHUNK];
+
+static void bench(void)
+{
+   struct snap s;
+   FILE f;
+   char name[16], line[64];
+   long i, n;
+
+   fat_init();
+   mmcsd_stats_reset();
+
+   printf("   modeled at %d ns per SPI byte\n", BYTE_NS);
+   printf("   %-14s %5s %9s %7s %8s %6s %6s %9s %13s\n",
+      "workload", "ops", "bytes/op", "cmds/op", "busy/op", "rd/op", "wr/op", "ms", "rate");
+
+   snap_take(&s);
+   for(i = 0; i < FILES; i++)
+   {
+      sprintf(name, "/F%02ld.TXT", i);
+      mk_file(name);
+   }
+   report("create", &s, FILES, 0);
+
+   snap_take(&s);
+   for(i = 0; i < FILES; i++)
+   {
+      sprintf(name, "/F%02ld.TXT", i);
+      fatopen(name, "r", &f);
+      fatclose(&f);
+   }
+   report("open/close", &s, FILES, 0);
+
+   // a logger opening, appending one line and closing every time
+   mk_file("/LOG.TXT");
+   snap_take(&s);
+   n = 0;
+   for(i = 0; i < LOG_LINES; i++)
+   {
+      sprintf(line, "%08ld,%5ld,%5ld,%5ld,sample line for the append test\r\n", i, i * 3, i * 7, i * 11);
+      fatopen("/LOG.TXT", "a", &f);
+      fatputs(line, &f);
+      fatclose(&f);
+      n += strlen(line);
+   }
+   report("append line", &s, LOG_LINES, n);
+
+   for(i = 0; i < CHUNK; i++)
+      chunk[i] = (uint8_t)rnd();
+   mk_file("/BIG.BIN");
+   fatopen("/BIG.BIN", "wb", &f);
+   snap_take(&s);
+   for(i = 0; i < BIG_SIZE / CHUNK; i++)
+      fatwrite(chunk, 1, CHUNK, &f);
+   fatclose(&f);
+   report("write 4KB", &s, BIG_SIZE / CHUNK, BIG_SIZE);
+
+   fatopen("/BIG.BIN", "rb", &f);
+   snap_take(&s);
+   for(i = 0; i < BIG_SIZE / CHUNK; i++)
+      fatread(chunk, 1, CHUNK, &f);
+   report("read 4KB", &s, BIG_SIZE / CHUNK, BIG_SIZE);
+
+   snap_take(&s);
+   for(i = 0; i < SEEKS; i++)
+   {
+      fatseek(&f, rnd() % BIG_SIZE, SEEK_SET);
+      fatgetc(&f);
+   }
+   report("seek+getc", &s, SEEKS, 0);
+   fatclose(&f);
+
+   snap_take(&s);
+   for(i = 0; i < FILES; i++)
+   {
+      sprintf(name, "/F%02ld.TXT", i);
+      rm_file(name);
+   }
+   rm_file("/LOG.TXT");
+   rm_file("/BIG.BIN");
+   report("delete", &s, FILES + 2, 0);
+}
+
+int main(int argc, char **argv)
+{
+   image = malloc((size_t)IMAGE_BLOCKS * 512);
+   if(image == NULL)
+      return(1);
+
+   mkfs();
+   sd_sim_init(image, IMAGE_BLOCKS, BYTE_NS, &timing);
+   printf("%d MB FAT32 image, %d sectors per cluster, %d cache sectors\n",
+      IMAGE_MB, SEC_PER_CLUS, MMCSD_CACHE_SECTORS);
+
+   check("fat_init", fat_init(), GOODEC);
+   block_checks();
+   fs_checks();
+   prealloc_checks();
+   full_sector_checks();
+   dir_checks();
+
+   if((argc > 1) && (strcmp(argv[1], "-b") == 0))
+      bench();
+
+   printf("%d failures\n", failures);
+   return(failures != 0);
+}
@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                           glcd_pixels.c                           ////
+////                                                                   ////
+//// Draws through glcd.c with FAST_GLCD into a model of the two       ////
+//// KS0108 chips on the HDM64GS12 and checks what ends up on them.    ////
+////                                                                   ////
+////    on screen       the corners and chip edges land on the right   ////
+////                    bit of the right column, page and chip         ////
+////    off screen      pixels past the right or bottom edge, or at    ////
+////                    negative coordinates, draw nothing and leave   ////
+////                    the RAM copy and its dirty ranges alone        ////
+////    clipped circle  a circle hanging off the corner is the same    ////
+////                    on the LCD as in the RAM copy                  ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+
+#define BYTE            char
+
+#define PIN_B0          1
+#define PIN_B1          2
+#define PIN_B2          3
+#define PIN_B4          4
+#define PIN_B5          5
+#define PIN_C0          6
+
+#define delay_us(x)
+#define output_high(p)  lcd_pin(p, 1)
+#define output_low(p)   lcd_pin(p, 0)
+#define output_d(d)     (lcd_bus = (d))
+#define input_d()       lcd_read()
+
+// The LCD: a chip select, D/I, R/W and E on the pins, data on port D.  A
+// write happens on the falling edge of E.
+static uint8_t lcd_ram[2][8][64];
+static uint8_t lcd_page[2], lcd_column[2];
+static uint8_t lcd_bus;
+static _Bool lcd_cs1, lcd_cs2, lcd_di, lcd_rw;
+
+static uint8_t lcd_read(void)
+{
+   return(lcd_bus);
+}
+
+static void lcd_write(int chip)
+{
+   if(!lcd_di)
+   {
+      if((lcd_bus & 0xC0) == 0x40)           // column address
+         lcd_column[chip] = lcd_bus & 0x3F;
+      else if((lcd_bus & 0xF8) == 0xB8)      // page address
+         lcd_page[chip] = lcd_bus & 0x07;
+   }
+   else
+   {
+      lcd_ram[chip][lcd_page[chip]][lcd_column[chip]] = lcd_bus;
+      lcd_column[chip] = (lcd_column[chip] + 1) & 0x3F;
+   }
+}
+
+static void lcd_pin(int pin, _Bool level)
+{
+   switch(pin)
+   {
+      case PIN_B0:   lcd_cs1 = level;  break;
+      case PIN_B1:   lcd_cs2 = level;  break;
+      case PIN_B2:   lcd_di = level;   break;
+      case PIN_B4:   lcd_rw = level;   break;
+      case PIN_B5:
+         if(!level && !lcd_rw)
+         {
+            if(lcd_cs1)
+               lcd_write(0);
+            if(lcd_cs2)
+               lcd_write(1);
+         }
+         break;
+   }
+}
+
+#define FAST_GLCD
+#include "glcd.c"
+
+static int failures;
+
+static void check(const char *what, unsigned long got, unsigned long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: got %lu, want %lu\n", what, got, want);
+      failures++;
+   }
+}
+
+// Pixel (x, y) as the LCD shows it
+static int lcd_get(int x, int y)
+{
+   return((lcd_ram[x / 64][y / 8][x % 64] >> (y % 8)) & 1);
+}
+
+// The LCD must show the RAM copy once it has been updated
+static void check_lcd(const char *what)
+{
+   glcd_update();
+   check(what, memcmp(lcd_ram[0], glcd_displayData.left, 512) == 0, 1);
+   check(what, memcmp(lcd_ram[1], glcd_displayData.right, 512) == 0, 1);
+}
+
+static void check_on_screen(void)
+{
+   static const int corner[][2] = {{0, 0}, {127, 0}, {0, 63}, {127, 63}, {63, 8}, {64, 7}};
+   char what[64];
+   int i, x, y, lit;
+
+   glcd_fillScreen(OFF);
+   for(i = 0; i < 6; i++)
+      glcd_pixel(corner[i][0], corner[i][1], ON);
+   check_lcd("on screen update");
+
+   lit = 0;
+   for(x = 0; x < 128; x++)
+      for(y = 0; y < 64; y++)
+         lit += lcd_get(x, y);
+   check("on screen pixel count", lit, 6);
+
+   for(i = 0; i < 6; i++)
+   {
+      sprintf(what, "pixel (%d, %d)", corner[i][0], corner[i][1]);
+      check(what, lcd_get(corner[i][0], corner[i][1]), 1);
+   }
+}
+
+static void check_off_screen(void)
+{
+   static const int point[][2] = {{128, 0}, {0, 64}, {255, 255}, {200, 10}, {10, 200}, {-1, 0}, {0, -1}, {-1, -1}};
+   uint8_t left[512], right[512], first[16], last[16];
+   int i;
+
+   glcd_fillScreen(OFF);
+   glcd_pixel(5, 5, ON);
+   glcd_update();
+
+   memcpy(left, glcd_displayData.left, sizeof(left));
+   memcpy(right, glcd_displayData.right, sizeof(right));
+   memcpy(first, glcd_dirtyFirst, sizeof(first));
+   memcpy(last, glcd_dirtyLast, sizeof(last));
+
+   for(i = 0; i < 8; i++)
+   {
+      glcd_pixel(point[i][0], point[i][1], ON);
+      glcd_pixel(point[i][0], point[i][1], OFF);
+   }
+
+   check("off screen left RAM", memcmp(left, glcd_displayData.left, sizeof(left)) == 0, 1);
+   check("off screen right RAM", memcmp(right, glcd_displayData.right, sizeof(right)) == 0, 1);
+   check("off screen dirty first", memcmp(first, glcd_dirtyFirst, sizeof(first)) == 0, 1);
+   check("off screen dirty last", memcmp(last, glcd_dirtyLast, sizeof(last)) == 0, 1);
+   check_lcd("off screen update");
+}
+
+static void check_clipped_circle(void)
+{
+   int x, y, lit;
+
+   glcd_fillScreen(OFF);
+   glcd_circle(120, 58, 20, NO, ON);
+   check_lcd("clipped circle update");
+
+   // the part of the circle that is on the screen is drawn
+   check("clipped circle top", lcd_get(120, 38), 1);
+   check("clipped circle left", lcd_get(100, 58), 1);
+
+   lit = 0;
+   for(x = 0; x < 128; x++)
+      for(y = 0; y < 64; y++)
+         lit += lcd_get(x, y);
+   check("clipped circle drawn", lit > 0, 1);
+}
+
+int main(void)
+{
+   glcd_init(ON);
+
+   check_on_screen();
+   check_off_screen();
+   check_clipped_circle();
+
+   printf("%d failures\n", failures);
+   return(failures != 0);
+}
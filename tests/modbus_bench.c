@@ -0,0 +1,767 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                          modbus_bench.c                           ////
+////                                                                   ////
+//// A Modbus master and slave from modbus_node.c talking over a       ////
+//// simulated RS485 bus, in virtual time, once for RTU and once for   ////
+//// ASCII.  Each node has a UART with a transmit holding register, a  ////
+//// shift register and a two character receive FIFO, a 0.1ms tick,    ////
+//// a 0.1ms transmit timer interrupt and an interrupt controller.     ////
+//// The main programs run as coroutines that give up the CPU whenever ////
+//// they wait (delay_us(), MODBUS_SERIAL_IDLE(), a full UART), and    ////
+//// the interrupts run in between, as soon as they are pending and    ////
+//// enabled.  An idle main loop sleeps until the next interrupt,      ////
+//// character or timer tick of its node, which is all it could be     ////
+//// waiting for.                                                      ////
+////                                                                   ////
+//// Besides the master's own checks, the bus is watched for two       ////
+//// nodes driving it at once, characters sent with the driver off or  ////
+//// cut short, receive overruns and, for RTU, silences inside a frame ////
+//// longer than 1.5 characters or between frames shorter than 3.5.    ////
+////                                                                   ////
+//// Then the Modbus TCP client and server from modbus_tcp_node.c run  ////
+//// the same mixed traffic over tcp_socket_sim.h's sockets, one main  ////
+//// loop pass each in turn, with a tick per pass.  There is no line   ////
+//// to model, so that leg gives host time only, and checks the        ////
+//// client's timeout against MODBUS_SERVER_TIMEOUT.                   ////
+////                                                                   ////
+////    modbus_bench       200 transactions per mode and 2000 over     ////
+////                       TCP, timeouts, framing and the poll         ////
+////                       scheduler, with the traffic numbers         ////
+////    modbus_bench -b    5000 transactions per mode, 50000 over TCP  ////
+////                                                                   ////
+//// Frames per second are given in virtual time, which is what the    ////
+//// line allows, and in host time, which is what running the stack    ////
+//// (and the simulation) costs.  The interrupt service routines are   ////
+//// timed on their own, in host cycles per call, and the TCP client   ////
+//// and server in host cycles per transaction.                        ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+#include <time.h>
+#include <ucontext.h>
+#if defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+#endif
+
+#include "modbus_line_sim.h"
+#include "tcp_socket_sim.h"
+#include "tcp_socket_sim.c"
+
+#define STACK_SIZE      (256 * 1024)
+#define ISR_NS          2000        // a TBE interrupt that found nothing to do
+#define MAX_INJECT      256
+
+extern const struct modbus_sim_node_ops
+   modbus_rtu_master, modbus_rtu_slave, modbus_ascii_master, modbus_ascii_slave;
+extern const struct modbus_tcp_node_ops modbus_tcp_client, modbus_tcp_server;
+
+struct node
+{
+   const struct modbus_sim_node_ops *ops;
+   ucontext_t ctx;
+   char *stack;
+   int done, idle;
+   uint64_t wake, char_ns;
+
+   // UART transmitter
+   int txreg_full, tsr_busy, tsr_de;
+   uint8_t txreg, tsr;
+   uint64_t tsr_end, last_tx_end;
+   unsigned long writes;
+
+   // UART receiver
+   uint8_t rx[2];
+   int rx_count;
+
+   // interrupts, pins and timers
+   int gie, rda_en, tbe_en, de, timer_en;
+   uint64_t tbe_hold, timer_next;
+   int64_t tick_base;
+
+   // what was seen
+   unsigned long rx_isr_calls, tx_isr_calls, timer_isr_calls, tbe_spins, overruns, off_bus, cut;
+   uint64_t rx_isr_cycles, tx_isr_cycles, turnaround_max;
+};
+
+static struct node nodes[2], *cur;
+static const struct modbus_tcp_node_ops *tcp_cur;
+static ucontext_t sched_ctx;
+static uint64_t now;
+static int in_isr, bench_mode, failures;
+
+// the bus
+static int bus_used;
+static uint64_t bus_end;
+static unsigned long collisions, gap_errors;
+static uint64_t frame_gap_min, char_gap_max;
+
+// characters put on the slave's receive line by modbus_sim_inject()
+static struct
+{
+   uint64_t t;
+   uint8_t c;
+} inject[MAX_INJECT];
+static int inject_head, inject_tail;
+
+// results of one mode
+static uint64_t traffic_t0, traffic_ns, host_t0, host_ns;
+static unsigned long traffic_n;
+static uint64_t timeout_nominal, timeout_measured;
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   return(__rdtsc());
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+#endif
+}
+
+static uint64_t host_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static const char *node_name(struct node *n)
+{
+   if(n)
+      return(n->ops->name);
+   return(tcp_cur ? tcp_cur->name : "bench");
+}
+
+void modbus_sim_check(const char *what, long got, long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: %s: got %ld, want %ld\n", node_name(cur), what, got, want);
+      failures++;
+   }
+}
+
+void modbus_sim_check_range(const char *what, long got, long low, long high)
+{
+   if((got < low) || (got > high))
+   {
+      printf("FAIL %s: %s: got %ld, want %ld to %ld\n", node_name(cur), what, got, low, high);
+      failures++;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// The bus and the UARTs
+
+// Something an idle main loop may be waiting for happened
+static void wake_up(struct node *n)
+{
+   if(n->idle)
+      n->wake = now;
+}
+
+static void receive(struct node *n, uint8_t c)
+{
+   wake_up(n);
+   if(n->rx_count < 2)
+      n->rx[n->rx_count++] = c;
+   else
+      n->overruns++;
+}
+
+static void shift_out(struct node *n, uint8_t c)
+{
+   uint64_t gap;
+   int i;
+
+   for(i = 0; i < 2; i++)
+      if((nodes + i != n) && nodes[i].tsr_busy)
+         collisions++;
+
+   // silences on the bus, RTU only knows frames by them
+   if(n->ops->rtu && !bus_used)
+   {
+      gap = now - bus_end;
+      if((gap * 2 > n->char_ns * 3) && (gap * 2 < n->char_ns * 7))
+         gap_errors++;
+      if(gap * 2 <= n->char_ns * 3)
+      {
+         if(gap > char_gap_max)
+            char_gap_max = gap;
+      }
+      else if(gap < frame_gap_min)
+         frame_gap_min = gap;
+   }
+
+   bus_used++;
+   n->tsr = c;
+   n->tsr_busy = TRUE;
+   n->tsr_de = n->de;
+   n->tsr_end = now + n->char_ns;
+}
+
+// The stop bit of the character in the shift register is out
+static void shifted_out(struct node *n)
+{
+   int i;
+
+   n->tsr_busy = FALSE;
+   n->last_tx_end = now;
+   wake_up(n);
+   bus_used--;
+   bus_end = now;
+
+   if(n->tsr_de && n->de)
+   {
+      for(i = 0; i < 2; i++)
+         if(nodes + i != n)
+            receive(nodes + i, n->tsr);
+   }
+   else
+      n->off_bus++;
+
+   if(n->txreg_full)
+   {
+      n->txreg_full = FALSE;
+      shift_out(n, n->txreg);
+   }
+}
+
+void modbus_sim_putc(uint8_t c)
+{
+   // fputc() waits for the holding register, a TBE interrupt never has to
+   while(cur->txreg_full)
+      modbus_sim_wait_ns(cur->tsr_end - now);
+
+   cur->writes++;
+   if(cur->tsr_busy)
+   {
+      cur->txreg = c;
+      cur->txreg_full = TRUE;
+   }
+   else
+      shift_out(cur, c);
+}
+
+uint8_t modbus_sim_getc(void)
+{
+   uint8_t c;
+
+   if(cur->rx_count == 0)
+      return(0);
+   c = cur->rx[0];
+   cur->rx[0] = cur->rx[1];
+   cur->rx_count--;
+   return(c);
+}
+
+int modbus_sim_kbhit(void)
+{
+   return(cur->rx_count != 0);
+}
+
+int modbus_sim_trmt(void)
+{
+   return(!cur->tsr_busy);
+}
+
+void modbus_sim_pin(int pin, int level)
+{
+   if(pin != MODBUS_SIM_PIN_DE)
+      return;
+
+   if(cur->de && !level)
+   {
+      if(cur->tsr_busy)
+         cur->cut++;
+      else if(now - cur->last_tx_end > cur->turnaround_max)
+         cur->turnaround_max = now - cur->last_tx_end;
+   }
+   cur->de = level;
+}
+
+void modbus_sim_interrupt(int which, int enable)
+{
+   switch(which)
+   {
+      case MODBUS_SIM_INT_GLOBAL:
+         cur->gie = enable;
+         break;
+      case MODBUS_SIM_INT_RDA:
+         cur->rda_en = enable;
+         break;
+      case MODBUS_SIM_INT_TBE:
+         if(enable && !cur->tbe_en)
+            cur->tbe_hold = now;
+         cur->tbe_en = enable;
+         break;
+   }
+}
+
+void modbus_sim_timer(int enable)
+{
+   // starting it clears the count, the first interrupt is a full period away
+   if(enable)
+      cur->timer_next = now + 100000;
+   cur->timer_en = enable;
+}
+
+uint16_t modbus_sim_get_ticks(void)
+{
+   return((uint16_t)(((int64_t)now - cur->tick_base) / 100000));
+}
+
+void modbus_sim_set_ticks(uint16_t t)
+{
+   cur->tick_base = (int64_t)now - (int64_t)t * 100000;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Running the nodes
+
+static int tbe_pending(struct node *n)
+{
+   return(n->gie && n->ops->tx_isr && n->tbe_en && !n->txreg_full);
+}
+
+static int timer_pending(struct node *n)
+{
+   return(n->gie && n->ops->timer_isr && n->timer_en);
+}
+
+// When the next character, interrupt or wake up is due, leaving out the
+// wake up of the node that is waiting
+static uint64_t next_event(struct node *waiting)
+{
+   uint64_t next = UINT64_MAX;
+   int i;
+
+   for(i = 0; i < 2; i++)
+   {
+      struct node *n = nodes + i;
+
+      if((n != waiting) && !n->done && (n->wake < next))
+         next = n->wake;
+      if(n->tsr_busy && (n->tsr_end < next))
+         next = n->tsr_end;
+      if(tbe_pending(n) && (n->tbe_hold < next))
+         next = n->tbe_hold;
+      if(timer_pending(n) && (n->timer_next < next))
+         next = n->timer_next;
+   }
+   if((inject_head != inject_tail) && (inject[inject_head].t < next))
+      next = inject[inject_head].t;
+   return(next);
+}
+
+void modbus_sim_wait_ns(uint64_t ns)
+{
+   struct node *n = cur;
+
+   if(in_isr)
+   {
+      printf("FAIL %s: waits in an interrupt\n", node_name(cur));
+      exit(1);
+   }
+
+   // if nothing else happens in the meantime the clock can just move on,
+   // which saves a trip through the scheduler for every delay_us(1)
+   if(!(n->gie && n->rda_en && n->rx_count) && !(tbe_pending(n) && (n->tbe_hold <= now)) &&
+      !(timer_pending(n) && (n->timer_next <= now)) && (now + ns < next_event(n)))
+   {
+      now += ns;
+      return;
+   }
+
+   n->wake = now + ns;
+   swapcontext(&n->ctx, &sched_ctx);
+}
+
+void modbus_sim_idle(void)
+{
+   int64_t ticks = ((int64_t)now - cur->tick_base) / 100000;
+
+   cur->idle = TRUE;
+   modbus_sim_wait_ns(cur->tick_base + (ticks + 1) * 100000 - (int64_t)now);
+   cur->idle = FALSE;
+}
+
+uint64_t modbus_sim_now(void)
+{
+   return(now);
+}
+
+int modbus_sim_bench_mode(void)
+{
+   return(bench_mode);
+}
+
+static void node_entry(void)
+{
+   cur->ops->main();
+   cur->done = TRUE;
+}
+
+static void node_start(struct node *n, const struct modbus_sim_node_ops *ops)
+{
+   free(n->stack);
+   memset(n, 0, sizeof(*n));
+   n->ops = ops;
+   n->char_ns = (uint64_t)ops->char_bits * 1000000000 / ops->baud;
+   n->stack = malloc(STACK_SIZE);
+
+   getcontext(&n->ctx);
+   n->ctx.uc_stack.ss_sp = n->stack;
+   n->ctx.uc_stack.ss_size = STACK_SIZE;
+   n->ctx.uc_link = &sched_ctx;
+   makecontext(&n->ctx, node_entry, 0);
+}
+
+// Runs whatever interrupts of n are pending, as the PIC would
+static void interrupts(struct node *n)
+{
+   unsigned long writes;
+   uint64_t t;
+   int guard;
+
+   cur = n;
+   in_isr = TRUE;
+   for(guard = 0; (guard < 1000) && n->gie; guard++)
+   {
+      if(n->rda_en && n->rx_count)
+      {
+         wake_up(n);
+         n->rx_isr_calls++;
+         t = cycles();
+         n->ops->rx_isr();
+         n->rx_isr_cycles += cycles() - t;
+      }
+      else if(tbe_pending(n) && (n->tbe_hold <= now))
+      {
+         wake_up(n);
+         writes = n->writes;
+         n->ops->set_trmt(!n->tsr_busy);
+         n->tx_isr_calls++;
+         t = cycles();
+         n->ops->tx_isr();
+         n->tx_isr_cycles += cycles() - t;
+
+         // returned with the flag still up: it is entered again straight
+         // away, which keeps the CPU until there is something to do
+         if(n->tbe_en && (n->writes == writes))
+         {
+            n->tbe_spins++;
+            n->tbe_hold = now + ISR_NS;
+         }
+      }
+      else if(timer_pending(n) && (n->timer_next <= now))
+      {
+         wake_up(n);
+         n->timer_next += 100000;
+         n->ops->set_trmt(!n->tsr_busy);
+         n->timer_isr_calls++;
+         n->ops->timer_isr();
+      }
+      else
+         break;
+   }
+   in_isr = FALSE;
+   cur = NULL;
+}
+
+static void run(void)
+{
+   uint64_t next;
+   int i, ran;
+
+   for(;;)
+   {
+      // everything due now
+      do
+      {
+         ran = FALSE;
+         for(i = 0; i < 2; i++)
+            if(nodes[i].tsr_busy && (nodes[i].tsr_end <= now))
+               shifted_out(nodes + i);
+         while((inject_head != inject_tail) && (inject[inject_head].t <= now))
+         {
+            receive(nodes + 1, inject[inject_head].c);
+            inject_head = (inject_head + 1) % MAX_INJECT;
+         }
+         for(i = 0; i < 2; i++)
+            interrupts(nodes + i);
+
+         for(i = 0; i < 2; i++)
+         {
+            if(nodes[i].done || (nodes[i].wake > now))
+               continue;
+            cur = nodes + i;
+            cur->ops->set_trmt(!cur->tsr_busy);
+            swapcontext(&sched_ctx, &cur->ctx);
+            cur = NULL;
+            interrupts(nodes + i);
+            ran = TRUE;
+            if(nodes[i].ops->master && nodes[i].done)
+               return;
+         }
+      } while(ran);
+
+      // and on to the next thing that happens
+      next = next_event(NULL);
+      if(next <= now)
+         next = now + 1;
+      now = next;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// What the master's checks use
+
+void modbus_sim_inject(const uint8_t *data, int n, int pause_before, uint64_t pause_ns)
+{
+   uint64_t t = now;
+   int i;
+
+   for(i = 0; i < n; i++)
+   {
+      if(i == pause_before)
+         t += pause_ns;
+      t += nodes[1].char_ns;
+      inject[inject_tail].t = t;
+      inject[inject_tail].c = data[i];
+      inject_tail = (inject_tail + 1) % MAX_INJECT;
+   }
+}
+
+void modbus_sim_peer_stats(struct modbus_sim_stats *s)
+{
+   nodes[1].ops->stats(s);
+}
+
+uint64_t modbus_sim_last_tx_end(void)
+{
+   return(cur->last_tx_end);
+}
+
+void modbus_sim_timeout(uint64_t nominal_ns, uint64_t measured_ns)
+{
+   timeout_nominal = nominal_ns;
+   timeout_measured = measured_ns;
+   modbus_sim_check_range("response timeout, us", measured_ns / 1000, nominal_ns * 99 / 100000, nominal_ns * 5 / 4000);
+}
+
+void modbus_sim_traffic_start(void)
+{
+   int i;
+
+   for(i = 0; i < 2; i++)
+   {
+      nodes[i].rx_isr_calls = nodes[i].tx_isr_calls = nodes[i].timer_isr_calls = nodes[i].tbe_spins = 0;
+      nodes[i].rx_isr_cycles = nodes[i].tx_isr_cycles = 0;
+   }
+   traffic_t0 = now;
+   host_t0 = host_now();
+}
+
+void modbus_sim_traffic_stop(unsigned long transactions)
+{
+   traffic_n = transactions;
+   traffic_ns = now - traffic_t0;
+   host_ns = host_now() - host_t0;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+static void no_isr(void)
+{
+}
+
+// What timing a call costs by itself
+static uint64_t call_cycles(void)
+{
+   void (*volatile fn)(void) = no_isr;
+   uint64_t t, total = 0;
+   int i;
+
+   for(i = 0; i < 100000; i++)
+   {
+      t = cycles();
+      fn();
+      total += cycles() - t;
+   }
+   return(total / 100000);
+}
+
+static double per_call(uint64_t total, unsigned long calls, uint64_t overhead)
+{
+   if(calls == 0)
+      return(0);
+   total /= calls;
+   return((total > overhead) ? (double)(total - overhead) : 0);
+}
+
+static void mode(const char *name, const struct modbus_sim_node_ops *master, const struct modbus_sim_node_ops *slave, uint64_t overhead)
+{
+   struct modbus_sim_stats ms, ss;
+   struct node *m = nodes, *s = nodes + 1;
+   unsigned long calls;
+   int i;
+
+   node_start(m, master);
+   node_start(s, slave);
+   now = 0;
+   bus_used = 0;
+   bus_end = 0;
+   collisions = gap_errors = 0;
+   frame_gap_min = UINT64_MAX;
+   char_gap_max = 0;
+   inject_head = inject_tail = 0;
+   timeout_nominal = timeout_measured = 0;
+   traffic_n = 0;
+
+   run();
+
+   master->stats(&ms);
+   slave->stats(&ss);
+
+   cur = NULL;
+   modbus_sim_check("bus collisions", collisions, 0);
+   for(i = 0; i < 2; i++)
+   {
+      cur = nodes + i;
+      modbus_sim_check("characters sent with the driver off", nodes[i].off_bus, 0);
+      modbus_sim_check("characters cut short by the driver", nodes[i].cut, 0);
+      modbus_sim_check("receive overruns", nodes[i].overruns, 0);
+   }
+   cur = NULL;
+   if(master->rtu)
+   {
+      modbus_sim_check("RTU silences of 1.5 to 3.5 characters", gap_errors, 0);
+      for(i = 0; i < 2; i++)
+      {
+         cur = nodes + i;
+         modbus_sim_check("transmit interrupts with nothing to do", nodes[i].tbe_spins, 0);
+         modbus_sim_check_range("turnaround, us", nodes[i].turnaround_max / 1000, 0, nodes[i].char_ns / 1000);
+      }
+      cur = NULL;
+   }
+   modbus_sim_check("traffic ran", traffic_n != 0, 1);
+   if(traffic_n == 0)
+      return;
+
+   printf("%s, %lu baud, %lu transactions\n", name, master->baud, traffic_n);
+   printf("   line           %8.1f transactions/s in virtual time\n", traffic_n * 1e9 / traffic_ns);
+   printf("   host           %8.0f transactions/s\n", traffic_n * 1e9 / host_ns);
+   printf("   master         %lu frames out, %lu in, %lu bad\n", ms.tx_frames, ms.rx_frames, ms.rx_errors);
+   printf("   slave          %lu frames out, %lu in, %lu bad\n", ss.tx_frames, ss.rx_frames, ss.rx_errors);
+   printf("   receive ISR    %8.0f host cycles per character\n",
+      per_call(m->rx_isr_cycles + s->rx_isr_cycles, m->rx_isr_calls + s->rx_isr_calls, overhead));
+   if(master->rtu)
+   {
+      calls = m->tx_isr_calls + s->tx_isr_calls;
+      printf("   transmit ISR   %8.0f host cycles per character, %.1f calls\n",
+         per_call(m->tx_isr_cycles + s->tx_isr_cycles, calls, overhead) * calls / (ms.tx_bytes + ss.tx_bytes),
+         (double)calls / (ms.tx_bytes + ss.tx_bytes));
+      printf("   timer          %8.1f interrupts per frame for the gap and the turnaround\n",
+         (double)(m->timer_isr_calls + s->timer_isr_calls) / (ms.tx_frames + ss.tx_frames));
+      printf("   silences       %8.0f us most inside a frame, %.0f us least between frames (t1.5 %.0f us, t3.5 %.0f us)\n",
+         char_gap_max / 1e3, frame_gap_min / 1e3, m->char_ns * 1.5 / 1e3, m->char_ns * 3.5 / 1e3);
+   }
+   printf("   turnaround     %8.0f us most from the last stop bit to the driver off\n",
+      (m->turnaround_max > s->turnaround_max ? m->turnaround_max : s->turnaround_max) / 1e3);
+   printf("   timeout        %8.2f ms after the request, MODBUS_SERIAL_TIMEOUT is %.2f ms\n",
+      timeout_measured / 1e6, timeout_nominal / 1e6);
+}
+
+// Runs the TCP nodes' main loops, the client's and then the server's, until
+// the client has its reply.  Every pass is a tick.
+static void tcp_run(const struct modbus_tcp_node_ops *client, const struct modbus_tcp_node_ops *server,
+   uint64_t *client_cycles, uint64_t *server_cycles)
+{
+   uint64_t t;
+   unsigned long passes = 0;
+
+   do
+   {
+      if(++passes > 100000)
+      {
+         printf("FAIL %s: no reply\n", client->name);
+         exit(1);
+      }
+      tcp_sim.ticks++;
+      tcp_cur = client;
+      t = cycles();
+      client->task();
+      *client_cycles += cycles() - t;
+      tcp_cur = server;
+      t = cycles();
+      server->task();
+      *server_cycles += cycles() - t;
+      tcp_cur = client;
+   } while(!client->reply());
+   tcp_cur = NULL;
+}
+
+static void tcp_mode(const struct modbus_tcp_node_ops *client, const struct modbus_tcp_node_ops *server, uint64_t overhead)
+{
+   uint64_t client_cycles = 0, server_cycles = 0, t0;
+   unsigned long i, n = bench_mode ? 50000 : 2000, bytes;
+   TICK ticks;
+
+   tcp_sim_init();
+   server->init();
+   server->task();
+   client->init();
+
+   t0 = host_now();
+   for(i = 0; i < n; i++)
+   {
+      tcp_cur = client;
+      client->request(i);
+      tcp_run(client, server, &client_cycles, &server_cycles);
+   }
+   host_ns = host_now() - t0;
+
+   bytes = 0;
+   for(i = 0; i < TCP_SIM_SOCKETS; i++)
+      bytes += tcp_sim.socket[i].puts;
+
+   // a request nobody answers
+   tcp_cur = client;
+   client->request(MODBUS_SIM_NO_UNIT);
+   ticks = tcp_sim.ticks;
+   tcp_run(client, server, &t0, &t0);
+   ticks = tcp_sim.ticks - ticks;
+   tcp_cur = client;
+   modbus_sim_check_range("response timeout, ticks", ticks, client->timeout_ticks, client->timeout_ticks * 5 / 4);
+   tcp_cur = NULL;
+   modbus_sim_check("connections", tcp_sim.disconnects, 0);
+
+   printf("TCP, %lu transactions\n", n);
+   printf("   host           %8.0f transactions/s\n", n * 1e9 / host_ns);
+   printf("   client         %8.0f host cycles per transaction\n", per_call(client_cycles, n, overhead));
+   printf("   server         %8.0f host cycles per transaction, %.1f per byte in and out\n",
+      per_call(server_cycles, n, overhead), per_call(server_cycles, n, overhead) * n / bytes);
+   printf("   timeout        %8.2f s after the request, MODBUS_SERVER_TIMEOUT is %.2f s\n",
+      (double)ticks / TICKS_PER_SECOND, (double)client->timeout_ticks / TICKS_PER_SECOND);
+}
+
+int main(int argc, char **argv)
+{
+   uint64_t overhead;
+
+   bench_mode = (argc > 1) && (strcmp(argv[1], "-b") == 0);
+   overhead = call_cycles();
+
+   mode("RTU", &modbus_rtu_master, &modbus_rtu_slave, overhead);
+   mode("ASCII", &modbus_ascii_master, &modbus_ascii_slave, overhead);
+   tcp_mode(&modbus_tcp_client, &modbus_tcp_server, overhead);
+
+   printf("%d failures\n", failures);
+   return(failures != 0);
+}
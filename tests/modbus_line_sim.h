@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                         modbus_line_sim.h                         ////
+////                                                                   ////
+//// What modbus_node.c, modbus_tcp_node.c and modbus_bench.c share.  ////
+//// Each Modbus node is modbus.c built on its own, with its globals   ////
+//// kept to itself.  A serial node reaches the simulated RS485 bus,   ////
+//// clock and interrupt controller through the modbus_sim_*()         ////
+//// functions below, and the bench runs its main program as a         ////
+//// coroutine and the interrupt service routines in between, in       ////
+//// virtual time.  A TCP node uses tcp_socket_sim.h's sockets, and    ////
+//// the bench calls its main loop a pass at a time.                   ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __MODBUS_LINE_SIM_H__
+#define __MODBUS_LINE_SIM_H__
+
+#include <stdint.h>
+
+// Interrupts, as the node passes them to enable_interrupts() and friends
+#define MODBUS_SIM_INT_GLOBAL    1
+#define MODBUS_SIM_INT_RDA       2
+#define MODBUS_SIM_INT_TBE       3
+#define MODBUS_SIM_INT_OTHER     4
+
+// Pin the node drives the RS485 driver enable with
+#define MODBUS_SIM_PIN_DE        1
+
+#define MODBUS_SIM_SLAVE         17
+
+// What the slave's input registers read as
+#define MODBUS_SIM_INPUT(a)      ((uint16_t)((a) * 7 + 1))
+
+// The node's g_modbus_* counters
+struct modbus_sim_stats
+{
+   unsigned long
+      rx_bytes,
+      tx_bytes,
+      rx_frames,
+      tx_frames,
+      rx_errors,
+      rx_overruns,
+      timeouts;
+};
+
+// What the bench needs to run a node
+struct modbus_sim_node_ops
+{
+   const char *name;
+   unsigned long baud;
+   unsigned int char_bits;          // start, data, parity and stop bits
+   int rtu, master;
+   void (*main)(void);
+   void (*rx_isr)(void);
+   void (*tx_isr)(void);            // NULL if the node sends without one
+   void (*timer_isr)(void);         // 0.1ms transmit timer, NULL if there isn't one
+   void (*set_trmt)(int trmt);
+   void (*stats)(struct modbus_sim_stats *s);
+};
+
+// What the bench needs to run a TCP node.  The client sends request n and
+// checks the reply, where ~0 is a request to a unit the server doesn't
+// answer for.
+struct modbus_tcp_node_ops
+{
+   const char *name;
+   int client;
+   unsigned long timeout_ticks;     // MODBUS_SERVER_TIMEOUT
+   void (*init)(void);
+   void (*task)(void);              // a pass of the main loop
+   void (*request)(unsigned long n);
+   int (*reply)(void);              // TRUE once the reply to it is in
+};
+
+#define MODBUS_SIM_NO_UNIT       (~0UL)
+
+// Line and UART of the node that is running
+void modbus_sim_putc(uint8_t c);
+uint8_t modbus_sim_getc(void);
+int modbus_sim_kbhit(void);
+int modbus_sim_trmt(void);
+void modbus_sim_pin(int pin, int level);
+void modbus_sim_interrupt(int which, int enable);
+
+// Its transmit timer, interrupting every 0.1ms from when it is started
+void modbus_sim_timer(int enable);
+
+// Its timer, 0.1ms ticks
+uint16_t modbus_sim_get_ticks(void);
+void modbus_sim_set_ticks(uint16_t t);
+
+// Lets time pass for it, never called from an interrupt
+void modbus_sim_wait_ns(uint64_t ns);
+void modbus_sim_idle(void);
+
+// For the master's checks
+uint64_t modbus_sim_now(void);
+int modbus_sim_bench_mode(void);
+void modbus_sim_check(const char *what, long got, long want);
+void modbus_sim_check_range(const char *what, long got, long low, long high);
+void modbus_sim_inject(const uint8_t *data, int n, int pause_before, uint64_t pause_ns);
+void modbus_sim_peer_stats(struct modbus_sim_stats *s);
+uint64_t modbus_sim_last_tx_end(void);
+void modbus_sim_timeout(uint64_t nominal_ns, uint64_t measured_ns);
+void modbus_sim_traffic_start(void);
+void modbus_sim_traffic_stop(unsigned long transactions);
+
+#endif
@@ -0,0 +1,497 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                           modbus_node.c                           ////
+////                                                                   ////
+//// One Modbus node for modbus_bench.c: modbus.c on a hardware UART,  ////
+//// with the line, timers and interrupt controller of                 ////
+//// modbus_line_sim.h.  Built once per mode and role, MODBUS_SIM_NODE ////
+//// names the modbus_sim_node_ops it exports, everything else is      ////
+//// localized so the nodes don't see each other's globals.            ////
+////                                                                   ////
+//// The slave answers from a register map.  The master is the test:   ////
+//// mixed reads and writes it checks against what it wrote, an RTU    ////
+//// frame sent without waiting for it, a request nobody answers,      ////
+//// frames put straight onto the slave's receive line with pauses and ////
+//// bad checksums in them, and the poll scheduler merging ranges,     ////
+//// delivering them, timing out and measuring latency.                ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+#include "modbus_line_sim.h"
+
+#define MODBUS_PROTOCOL             MODBUS_PROTOCOL_SERIAL
+#define MODBUS_SERIAL_INT_SOURCE    MODBUS_INT_RDA
+#define MODBUS_SERIAL_BAUD          19200
+#define MODBUS_SERIAL_ENABLE_PIN    MODBUS_SIM_PIN_DE
+#define MODBUS_SERIAL_STATS
+
+#if NODE_MASTER
+ #define MODBUS_TYPE                MODBUS_TYPE_MASTER
+#else
+ #define MODBUS_TYPE                MODBUS_TYPE_SLAVE
+#endif
+
+// Hardware modbus.c touches
+#define INT_RDA                     MODBUS_SIM_INT_RDA
+#define INT_TBE                     MODBUS_SIM_INT_TBE
+#define GLOBAL                      MODBUS_SIM_INT_GLOBAL
+#define enable_interrupts(i)        modbus_sim_interrupt(i, 1)
+#define disable_interrupts(i)       modbus_sim_interrupt(i, 0)
+#define clear_interrupt(i)
+#define output_low(p)               modbus_sim_pin(p, 0)
+#define output_high(p)              modbus_sim_pin(p, 1)
+#define delay_us(x)                 modbus_sim_wait_ns((uint64_t)(x) * 1000)
+
+#define MODBUS_SERIAL_GETC()        modbus_sim_getc()
+#define MODBUS_SERIAL_PUTC(c)       modbus_sim_putc(c)
+#define MODBUS_SERIAL_KBHIT()       modbus_sim_kbhit()
+#define MODBUS_GET_TICKS()          modbus_sim_get_ticks()
+#define MODBUS_SET_TICKS(t)         modbus_sim_set_ticks(t)
+#define MODBUS_SERIAL_IDLE()        modbus_sim_idle()
+#define MODBUS_TX_TIMER_START()     modbus_sim_timer(1)
+#define MODBUS_TX_TIMER_STOP()      modbus_sim_timer(0)
+
+#include "modbus.c"
+
+#define NODE_REGS          64
+#define NODE_READ_MAX      30    // a read reply has to fit modbus_rx.data with its CRC
+#define NODE_WRITE_MAX     28    // and so does a write request on the slave
+
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+ #define NODE_CHAR_BITS    11    // 8 data bits and parity
+#else
+ #define NODE_CHAR_BITS    10    // 7 data bits and parity
+#endif
+#define NODE_CHAR_NS       ((uint64_t)NODE_CHAR_BITS * 1000000000 / MODBUS_SERIAL_BAUD)
+
+static void node_set_trmt(int trmt)
+{
+   TRMT = trmt;
+}
+
+static void node_stats(struct modbus_sim_stats *s)
+{
+   s->rx_bytes = g_modbus_rx_bytes;
+   s->tx_bytes = g_modbus_tx_bytes;
+   s->rx_frames = g_modbus_rx_frames;
+   s->tx_frames = g_modbus_tx_frames;
+   s->rx_errors = g_modbus_rx_errors;
+   s->rx_overruns = g_modbus_rx_overruns;
+   s->timeouts = g_modbus_timeouts;
+}
+
+#if (MODBUS_TYPE == MODBUS_TYPE_MASTER)
+// What the slave's holding registers and coils should hold
+static uint16_t node_regs[NODE_REGS];
+static uint8_t node_coils[NODE_REGS / 8];
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+   rnd_state = rnd_state * 1103515245 + 12345;
+   return(rnd_state >> 8);
+}
+
+static uint16_t rx16(int i)
+{
+   return(make16(modbus_rx.data[i], modbus_rx.data[i + 1]));
+}
+
+// Registers in a read reply, against what they should be
+static void check_regs(const char *what, uint16_t start, uint16_t quantity, int input)
+{
+   uint16_t i;
+
+   modbus_sim_check(what, modbus_rx.len, 1 + 2 * quantity);
+   modbus_sim_check(what, modbus_rx.data[0], 2 * quantity);
+   for(i = 0; i < quantity; i++)
+      modbus_sim_check(what, rx16(1 + 2 * i), input ? MODBUS_SIM_INPUT(start + i) : node_regs[start + i]);
+}
+
+static void transaction(unsigned long n)
+{
+   uint16_t start, quantity, values[NODE_WRITE_MAX], i;
+   int on;
+
+   switch(n % 5)
+   {
+      case 0:
+         quantity = 1 + rnd() % NODE_WRITE_MAX;
+         start = rnd() % (NODE_REGS - quantity + 1);
+         for(i = 0; i < quantity; i++)
+            values[i] = (uint16_t)rnd();
+         if(modbus_write_multiple_registers(MODBUS_SIM_SLAVE, start, quantity, values) == 0)
+         {
+            modbus_sim_check("write multiple registers reply", rx16(0), start);
+            modbus_sim_check("write multiple registers reply", rx16(2), quantity);
+            memcpy(node_regs + start, values, quantity * 2);
+         }
+         else
+            modbus_sim_check("write multiple registers", modbus_rx.error, 0);
+         break;
+
+      case 1:
+      case 2:
+         quantity = 1 + rnd() % NODE_READ_MAX;
+         start = rnd() % (NODE_REGS - quantity + 1);
+         if((n % 5) == 1)
+         {
+            modbus_sim_check("read holding registers", modbus_read_holding_registers(MODBUS_SIM_SLAVE, start, quantity), 0);
+            if(modbus_rx.error == 0)
+               check_regs("read holding registers", start, quantity, FALSE);
+         }
+         else
+         {
+            modbus_sim_check("read input registers", modbus_read_input_registers(MODBUS_SIM_SLAVE, start, quantity), 0);
+            if(modbus_rx.error == 0)
+               check_regs("read input registers", start, quantity, TRUE);
+         }
+         break;
+
+      case 3:
+         start = rnd() % NODE_REGS;
+         values[0] = (uint16_t)rnd();
+         modbus_sim_check("write single register", modbus_write_single_register(MODBUS_SIM_SLAVE, start, values[0]), 0);
+         if(modbus_rx.error == 0)
+         {
+            modbus_sim_check("write single register reply", rx16(2), values[0]);
+            node_regs[start] = values[0];
+         }
+         break;
+
+      default:
+         if((n % 10) == 4)
+         {
+            // past the end of the map
+            modbus_sim_check("read holding registers past the end",
+               modbus_read_holding_registers(MODBUS_SIM_SLAVE, NODE_REGS - 1, 2), ILLEGAL_DATA_ADDRESS);
+            break;
+         }
+
+         start = rnd() % NODE_REGS;
+         on = rnd() & 1;
+         modbus_sim_check("write single coil", modbus_write_single_coil(MODBUS_SIM_SLAVE, start, on), 0);
+         if(on)
+            node_coils[start / 8] |= 1 << (start % 8);
+         else
+            node_coils[start / 8] &= ~(1 << (start % 8));
+
+         modbus_sim_check("read coils", modbus_read_coils(MODBUS_SIM_SLAVE, start & ~7, 8), 0);
+         if(modbus_rx.error == 0)
+            modbus_sim_check("read coils", modbus_rx.data[1], node_coils[start / 8]);
+         break;
+   }
+}
+
+// Waits for a reply nobody asked for, as a master between requests would
+static int wait_reply(uint64_t ns)
+{
+   uint64_t end = modbus_sim_now() + ns;
+
+   while(modbus_sim_now() < end)
+   {
+      if(modbus_kbhit())
+         return(TRUE);
+      modbus_sim_idle();
+   }
+   return(FALSE);
+}
+
+// A request to a slave that isn't there times out once, after about
+// MODBUS_SERIAL_TIMEOUT, and the next one to the slave that is goes through.
+static void timeout_checks(void)
+{
+   unsigned long timeouts = g_modbus_timeouts;
+   struct modbus_sim_stats before, after;
+   exception error;
+
+   modbus_sim_peer_stats(&before);
+   error = modbus_read_holding_registers(MODBUS_SIM_SLAVE + 1, 0, 1);
+   modbus_sim_timeout((uint64_t)MODBUS_SERIAL_TIMEOUT * 1000, modbus_sim_now() - modbus_sim_last_tx_end());
+   modbus_sim_peer_stats(&after);
+
+   modbus_sim_check("request to a missing slave", error, TIMEOUT);
+   modbus_sim_check("master timeouts", g_modbus_timeouts, timeouts + 1);
+   modbus_sim_check("slave answers for another address", after.tx_frames, before.tx_frames);
+
+   modbus_sim_check("request after a timeout", modbus_read_input_registers(MODBUS_SIM_SLAVE, 5, 3), 0);
+   if(modbus_rx.error == 0)
+      check_regs("request after a timeout", 5, 3, TRUE);
+}
+
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+// Sending a frame only queues it, the gap in front of it, the frame and the
+// turnaround after it are done by the interrupts.
+static void send_checks(void)
+{
+   uint64_t t;
+
+   t = modbus_sim_now();
+   modbus_serial_send_start(MODBUS_SIM_SLAVE + 1, FUNC_READ_INPUT_REGISTERS);
+   modbus_serial_putc(0);
+   modbus_serial_putc(0);
+   modbus_serial_putc(0);
+   modbus_serial_putc(1);
+   modbus_serial_send_stop();
+   modbus_sim_check("time spent sending, ns", modbus_sim_now() - t, 0);
+   modbus_sim_check("frame still going out", modbus_serial_tx_busy(), TRUE);
+
+   while(modbus_serial_tx_busy())
+      modbus_sim_idle();
+   modbus_sim_check_range("frame out, us", (modbus_sim_now() - t) / 1000,
+      (3 * NODE_CHAR_NS + NODE_CHAR_NS / 2 + 8 * NODE_CHAR_NS) / 1000, (13 * NODE_CHAR_NS) / 1000);
+}
+
+static int request(uint8_t *f, uint8_t func, uint16_t a, uint16_t b)
+{
+   uint16_t crc = 0xFFFF;
+   int i, j;
+
+   f[0] = MODBUS_SIM_SLAVE;
+   f[1] = func;
+   f[2] = make8(a, 1);
+   f[3] = make8(a, 0);
+   f[4] = make8(b, 1);
+   f[5] = make8(b, 0);
+   for(i = 0; i < 6; i++)
+   {
+      crc ^= f[i];
+      for(j = 0; j < 8; j++)
+         crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+   }
+   f[6] = make8(crc, 0);
+   f[7] = make8(crc, 1);
+   return(8);
+}
+#else
+static char hex(int v)
+{
+   return("0123456789ABCDEF"[v & 0xF]);
+}
+
+static int request(uint8_t *f, uint8_t func, uint16_t a, uint16_t b)
+{
+   uint8_t bin[6], lrc = 0;
+   int i, n = 0;
+
+   bin[0] = MODBUS_SIM_SLAVE;
+   bin[1] = func;
+   bin[2] = make8(a, 1);
+   bin[3] = make8(a, 0);
+   bin[4] = make8(b, 1);
+   bin[5] = make8(b, 0);
+
+   f[n++] = ':';
+   for(i = 0; i < 6; i++)
+   {
+      f[n++] = hex(bin[i] >> 4);
+      f[n++] = hex(bin[i]);
+      lrc += bin[i];
+   }
+   lrc = -lrc;
+   f[n++] = hex(lrc >> 4);
+   f[n++] = hex(lrc);
+   f[n++] = '\r';
+   f[n++] = '\n';
+   return(n);
+}
+#endif
+
+// Frames put on the slave's receive line directly, the way another master
+// or a noisy line would.
+static void framing_checks(void)
+{
+   struct modbus_sim_stats before, after;
+   uint8_t f[32];
+   int n;
+
+   n = request(f, FUNC_READ_INPUT_REGISTERS, 3, 2);
+
+   // a pause of a character inside a frame doesn't end it
+   modbus_sim_inject(f, n, 4, NODE_CHAR_NS);
+   modbus_sim_check("reply to a frame with a short pause", wait_reply(100000000), TRUE);
+   if(modbus_rx.error == 0)
+      check_regs("reply to a frame with a short pause", 3, 2, TRUE);
+
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+   // one longer than the frame timeout does, and both halves are dropped
+   modbus_sim_peer_stats(&before);
+   modbus_sim_inject(f, n, 4, (MODBUS_GETDATA_TIMEOUT + 20) * 100000ULL);
+   modbus_sim_check("reply to a split frame", wait_reply(50000000), FALSE);
+   modbus_sim_peer_stats(&after);
+   modbus_sim_check("halves of a split frame dropped", after.rx_errors - before.rx_errors, 2);
+#endif
+
+   // so is a frame with a bad CRC or LRC
+   f[n - 1 - 2 * (MODBUS_SERIAL_TYPE == MODBUS_ASCII)] ^= 0x01;
+   modbus_sim_peer_stats(&before);
+   modbus_sim_inject(f, n, 0, 0);
+   modbus_sim_check("reply to a bad checksum", wait_reply(50000000), FALSE);
+   modbus_sim_peer_stats(&after);
+   modbus_sim_check("bad checksum dropped", after.rx_errors - before.rx_errors, 1);
+   modbus_sim_check("frames answered", after.tx_frames, before.tx_frames);
+}
+
+// The poll scheduler, on a millisecond clock, against the slave and a slave
+// that isn't there.  The two input register ranges touch and go out as one
+// read of NODE_READ_MAX registers, the longest reply the buffer takes.
+#define POLL_MS()          ((uint16_t)(modbus_sim_now() / 1000000))
+
+static void poll_callback(modbus_poll_entry *entry, exception error, uint8_t *data);
+
+static modbus_poll_entry poll_table[] =
+{
+   {MODBUS_SIM_SLAVE,     FUNC_READ_INPUT_REGISTERS,   0,  10,                  200, poll_callback},
+   {MODBUS_SIM_SLAVE,     FUNC_READ_HOLDING_REGISTERS, 40, 4,                   100, poll_callback},
+   {MODBUS_SIM_SLAVE + 1, FUNC_READ_INPUT_REGISTERS,   0,  1,                   400, poll_callback},
+   {MODBUS_SIM_SLAVE,     FUNC_READ_INPUT_REGISTERS,   10, NODE_READ_MAX - 10,  200, poll_callback}
+};
+static unsigned long poll_calls[4];
+
+static void poll_callback(modbus_poll_entry *entry, exception error, uint8_t *data)
+{
+   uint16_t i, want;
+
+   poll_calls[entry - poll_table]++;
+   if(entry->address != MODBUS_SIM_SLAVE)
+   {
+      modbus_sim_check("poll of a missing slave", error, TIMEOUT);
+      modbus_sim_check("poll of a missing slave data", data == NULL, TRUE);
+      return;
+   }
+
+   modbus_sim_check("poll", error, 0);
+   if(error)
+      return;
+   for(i = 0; i < entry->quantity; i++)
+   {
+      if(entry->func == FUNC_READ_INPUT_REGISTERS)
+         want = MODBUS_SIM_INPUT(entry->start + i);
+      else
+         want = node_regs[entry->start + i];
+      modbus_sim_check("poll data", make16(data[2 * i], data[2 * i + 1]), want);
+   }
+}
+
+static void poll_checks(void)
+{
+   struct modbus_sim_stats before, after;
+   modbus_poll_stats *st;
+   uint16_t start;
+
+   modbus_sim_check("modbus_poll_init", modbus_poll_init(poll_table, 4), TRUE);
+   modbus_sim_check("poll ranges merged", poll_table[3].group, 0);
+   modbus_sim_check("poll merged quantity", poll_table[0].req_quantity, NODE_READ_MAX);
+   modbus_sim_check("poll holding registers on their own", poll_table[1].group, 1);
+
+   modbus_sim_peer_stats(&before);
+   start = POLL_MS();
+   while((uint16_t)(POLL_MS() - start) < 2000 || !modbus_poll_idle())
+   {
+      modbus_poll_task(POLL_MS());
+      modbus_sim_idle();
+   }
+   modbus_sim_peer_stats(&after);
+
+   st = modbus_poll_get_stats(MODBUS_SIM_SLAVE);
+   modbus_sim_check("poll stats of the slave", st != NULL, TRUE);
+   if(st)
+   {
+      // one request for both input register entries
+      modbus_sim_check("merged polls delivered to both", poll_calls[3], poll_calls[0]);
+      modbus_sim_check("requests answered", st->responses, poll_calls[0] + poll_calls[1]);
+      modbus_sim_check("replies sent", after.tx_frames - before.tx_frames, st->responses);
+      modbus_sim_check_range("polls every 200ms", poll_calls[0], 9, 11);
+      modbus_sim_check("polls every 100ms more often", poll_calls[1] > poll_calls[0], TRUE);
+
+      // the longest reply doesn't time out, and takes as long as it is
+      modbus_sim_check("poll timeouts", st->timeouts, 0);
+      modbus_sim_check("poll exceptions", st->exceptions, 0);
+      modbus_sim_check_range("poll latency, ms", st->latency_max,
+         (2 * NODE_READ_MAX + 5) * NODE_CHAR_NS / 1000000, MODBUS_POLL_TIMEOUT - 1);
+      modbus_sim_check_range("poll average latency, ms", st->latency_avg8 / 8, 1, st->latency_max);
+   }
+
+   st = modbus_poll_get_stats(MODBUS_SIM_SLAVE + 1);
+   modbus_sim_check("poll stats of the missing slave", st != NULL, TRUE);
+   if(st)
+   {
+      modbus_sim_check("missing slave timeouts", st->timeouts, poll_calls[2]);
+      modbus_sim_check_range("missing slave polls", poll_calls[2], 4, 6);
+      modbus_sim_check("missing slave responses", st->responses, 0);
+   }
+}
+
+static void node_main(void)
+{
+   unsigned long i, n = modbus_sim_bench_mode() ? 5000 : 200;
+
+   modbus_init();
+
+   modbus_sim_traffic_start();
+   for(i = 0; i < n; i++)
+      transaction(i);
+   modbus_sim_traffic_stop(n);
+
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+   send_checks();
+#endif
+   timeout_checks();
+   framing_checks();
+   poll_checks();
+}
+#else
+static uint16_t node_regs[NODE_REGS];
+static uint8_t node_coils[NODE_REGS / 8];
+
+static uint16_t node_input(uint16_t address)
+{
+   return(MODBUS_SIM_INPUT(address));
+}
+
+static modbus_map_entry node_map[] =
+{
+   {MODBUS_MAP_COILS,             0, NODE_REGS, node_coils, NULL,       NULL},
+   {MODBUS_MAP_HOLDING_REGISTERS, 0, NODE_REGS, node_regs,  NULL,       NULL},
+   {MODBUS_MAP_INPUT_REGISTERS,   0, NODE_REGS, NULL,       node_input, NULL}
+};
+
+static void node_main(void)
+{
+   modbus_init();
+   modbus_sim_check("modbus_map_init", modbus_map_init(node_map, 3), TRUE);
+
+   for(;;)
+   {
+      while(!modbus_kbhit())
+         modbus_sim_idle();
+      modbus_map_process(MODBUS_SIM_SLAVE);
+   }
+}
+#endif
+
+#define NODE_STR(x)     #x
+#define NODE_NAME(x)    NODE_STR(x)
+
+__attribute__((visibility("default")))
+const struct modbus_sim_node_ops MODBUS_SIM_NODE =
+{
+   NODE_NAME(MODBUS_SIM_NODE),
+   MODBUS_SERIAL_BAUD,
+   NODE_CHAR_BITS,
+   MODBUS_SERIAL_TYPE == MODBUS_RTU,
+   NODE_MASTER,
+   node_main,
+   incomming_modbus_serial,
+#if (MODBUS_SERIAL_TYPE == MODBUS_RTU)
+   outgoing_modbus_serial,
+   modbus_tx_timer_isr,
+#else
+   NULL,
+   NULL,
+#endif
+   node_set_trmt,
+   node_stats
+};
@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                         modbus_tcp_node.c                         ////
+////                                                                   ////
+//// One Modbus TCP node for modbus_bench.c: modbus.c with             ////
+//// MODBUS_PROTOCOL_TCPIP on tcp_socket_sim.h's sockets.  Built once  ////
+//// as the client and once as the server, MODBUS_SIM_NODE names the   ////
+//// modbus_tcp_node_ops it exports, everything else is localized like ////
+//// modbus_node.c's.                                                  ////
+////                                                                   ////
+//// The server answers from a register map.  The client is the test:  ////
+//// the same mixed reads and writes as the serial master, checked     ////
+//// against what it wrote, and a request to a unit the server doesn't ////
+//// answer for, which has to time out.                                ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+#include "modbus_line_sim.h"
+
+#define MODBUS_PROTOCOL             MODBUS_PROTOCOL_TCPIP
+#define debug_printf(...)
+
+#if NODE_CLIENT
+ #define MODBUS_TYPE                MODBUS_TYPE_CLIENT
+#else
+ #define MODBUS_TYPE                MODBUS_TYPE_SERVER
+ #define MODBUS_LISTEN_SOCKETS      2
+#endif
+
+#include "modbus.c"
+
+#define NODE_REGS          64
+#define NODE_READ_MAX      30    // a read reply has to fit modbus_rx.data
+#define NODE_WRITE_MAX     28    // and a write request modbus_tx.data
+
+#if (MODBUS_TYPE == MODBUS_TYPE_CLIENT)
+// What the server's holding registers should hold
+static uint16_t node_regs[NODE_REGS];
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+   rnd_state = rnd_state * 1103515245 + 12345;
+   return(rnd_state >> 8);
+}
+
+// The request in flight
+static function node_func;
+static uint16_t node_start, node_quantity, node_values[NODE_WRITE_MAX];
+static int node_no_unit;
+
+static void node_init(void)
+{
+   modbus_init();
+}
+
+static void node_task(void)
+{
+   ModbusTask();
+}
+
+static void node_request(unsigned long n)
+{
+   uint16_t i;
+
+   node_no_unit = (n == MODBUS_SIM_NO_UNIT);
+   if(node_no_unit)
+   {
+      node_func = FUNC_READ_HOLDING_REGISTERS;
+      modbus_sim_check("request", modbus_read_holding_registers(MODBUS_SIM_SLAVE + 1, 0, 1), FALSE);
+      return;
+   }
+
+   switch(n % 3)
+   {
+      case 0:
+         node_func = FUNC_WRITE_MULTIPLE_REGISTERS;
+         node_quantity = 1 + rnd() % NODE_WRITE_MAX;
+         node_start = rnd() % (NODE_REGS - node_quantity + 1);
+         for(i = 0; i < node_quantity; i++)
+            node_values[i] = (uint16_t)rnd();
+         modbus_sim_check("write multiple registers",
+            modbus_write_multiple_registers(MODBUS_SIM_SLAVE, node_start, node_quantity, node_values), FALSE);
+         break;
+
+      case 1:
+         node_func = FUNC_READ_HOLDING_REGISTERS;
+         node_quantity = 1 + rnd() % NODE_READ_MAX;
+         node_start = rnd() % (NODE_REGS - node_quantity + 1);
+         modbus_sim_check("read holding registers",
+            modbus_read_holding_registers(MODBUS_SIM_SLAVE, node_start, node_quantity), FALSE);
+         break;
+
+      default:
+         node_func = FUNC_READ_INPUT_REGISTERS;
+         node_quantity = 1 + rnd() % NODE_READ_MAX;
+         node_start = rnd() % (NODE_REGS - node_quantity + 1);
+         modbus_sim_check("read input registers",
+            modbus_read_input_registers(MODBUS_SIM_SLAVE, node_start, node_quantity), FALSE);
+         break;
+   }
+}
+
+static int node_reply(void)
+{
+   uint8_t unit, len, data[MODBUS_BUFFER_SIZE];
+   function func;
+   exception error;
+   uint16_t i, want;
+
+   if(!modbus_kbhit())
+      return(FALSE);
+
+   error = modbus_getd(&unit, &func, &len, data);
+   if(node_no_unit)
+   {
+      modbus_sim_check("request to a unit nobody answers for", error, TIMEOUT);
+      return(TRUE);
+   }
+
+   modbus_sim_check("reply", error, 0);
+   modbus_sim_check("reply unit", unit, MODBUS_SIM_SLAVE);
+   modbus_sim_check("reply function", func, node_func);
+   if(error)
+      return(TRUE);
+
+   if(node_func == FUNC_WRITE_MULTIPLE_REGISTERS)
+   {
+      modbus_sim_check("write multiple registers reply", len, 4);
+      modbus_sim_check("write multiple registers reply", make16(data[0], data[1]), node_start);
+      modbus_sim_check("write multiple registers reply", make16(data[2], data[3]), node_quantity);
+      memcpy(node_regs + node_start, node_values, node_quantity * 2);
+      return(TRUE);
+   }
+
+   modbus_sim_check("read reply length", len, 1 + 2 * node_quantity);
+   modbus_sim_check("read reply byte count", data[0], 2 * node_quantity);
+   for(i = 0; i < node_quantity; i++)
+   {
+      want = (node_func == FUNC_READ_INPUT_REGISTERS) ? MODBUS_SIM_INPUT(node_start + i) : node_regs[node_start + i];
+      modbus_sim_check("read reply", make16(data[1 + 2 * i], data[2 + 2 * i]), want);
+   }
+   return(TRUE);
+}
+#else
+static uint16_t node_regs[NODE_REGS];
+
+static void node_init(void)
+{
+   modbus_init();
+}
+
+static void node_answer(MBAP_HEADER hdr, function func, uint8_t len, uint8_t *data)
+{
+   uint16_t start, quantity, values[NODE_READ_MAX], i;
+
+   // a gateway whose target is gone
+   if(hdr.UnitIdentifier != MODBUS_SIM_SLAVE)
+      return;
+
+   start = make16(data[0], data[1]);
+   quantity = make16(data[2], data[3]);
+   if(start + quantity > NODE_REGS)
+   {
+      modbus_sim_check("exception fits", modbus_exception_rsp(hdr, func, ILLEGAL_DATA_ADDRESS), FALSE);
+      return;
+   }
+
+   switch(func)
+   {
+      case FUNC_READ_HOLDING_REGISTERS:
+         modbus_sim_check("reply fits", modbus_read_holding_registers_rsp(hdr, quantity * 2, node_regs + start), FALSE);
+         break;
+
+      case FUNC_READ_INPUT_REGISTERS:
+         for(i = 0; i < quantity && i < NODE_READ_MAX; i++)
+            values[i] = MODBUS_SIM_INPUT(start + i);
+         modbus_sim_check("reply fits", modbus_read_input_registers_rsp(hdr, quantity * 2, values), FALSE);
+         break;
+
+      case FUNC_WRITE_MULTIPLE_REGISTERS:
+         for(i = 0; i < quantity; i++)
+            node_regs[start + i] = make16(data[5 + 2 * i], data[6 + 2 * i]);
+         modbus_sim_check("reply fits", modbus_write_multiple_registers_rsp(hdr, start, quantity), FALSE);
+         break;
+
+      default:
+         modbus_sim_check("exception fits", modbus_exception_rsp(hdr, func, ILLEGAL_FUNCTION), FALSE);
+         break;
+   }
+}
+
+static void node_task(void)
+{
+   MBAP_HEADER hdr;
+   function func;
+   uint8_t len, data[MODBUS_BUFFER_SIZE];
+
+   ModbusTask();
+   while(modbus_getd(&hdr, &func, &len, data))
+      node_answer(hdr, func, len, data);
+}
+#endif
+
+#define NODE_STR(x)     #x
+#define NODE_NAME(x)    NODE_STR(x)
+
+__attribute__((visibility("default")))
+const struct modbus_tcp_node_ops MODBUS_SIM_NODE =
+{
+   NODE_NAME(MODBUS_SIM_NODE),
+   NODE_CLIENT,
+   (unsigned long)TICKS_PER_SECOND * MODBUS_SERVER_TIMEOUT,
+   node_init,
+   node_task,
+#if (MODBUS_TYPE == MODBUS_TYPE_CLIENT)
+   node_request,
+   node_reply
+#else
+   NULL,
+   NULL
+#endif
+};
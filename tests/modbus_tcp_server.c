@@ -0,0 +1,367 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                        modbus_tcp_server.c                        ////
+////                                                                   ////
+//// The Modbus TCP server, modbus.c with MODBUS_TYPE_SERVER on two    ////
+//// listening sockets, with clients on tcp_socket_sim.h's sockets.    ////
+//// The test is both the application, taking requests with           ////
+//// modbus_getd() and answering them from a register map, and the     ////
+//// clients.                                                          ////
+////                                                                   ////
+////    pipelining      requests sent back to back by one client are   ////
+////                    taken one at a time, the other client gets its ////
+////                    turn in between, and answers given out of      ////
+////                    order go back with their own transaction IDs.  ////
+////                    An answer to a request that is not pending is  ////
+////                    dropped, and past MODBUS_MAX_PENDING the       ////
+////                    oldest is forgotten.                           ////
+////    full TX buffer  an answer that doesn't fit the socket is       ////
+////                    refused whole and goes out once there is room  ////
+////    bad MBAP header a length the receive buffer can't hold or a    ////
+////                    protocol other than Modbus drops the           ////
+////                    connection, the socket listens again, and an   ////
+////                    answer to the old connection's request doesn't ////
+////                    reach the new one.  The longest length that    ////
+////                    fits is taken.                                 ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+
+#define MODBUS_PROTOCOL          MODBUS_PROTOCOL_TCPIP
+#define MODBUS_TYPE              MODBUS_TYPE_SERVER
+#define MODBUS_LISTEN_SOCKETS    2
+#define MODBUS_MAX_PENDING       4
+#define debug_printf(...)
+
+#include "modbus.c"
+#include "tcp_socket_sim.c"
+
+#define REGS            64
+#define UNIT            1
+
+struct request
+{
+   MBAP_HEADER hdr;
+   function func;
+   uint8_t len;
+   uint8_t data[MODBUS_BUFFER_SIZE];
+};
+
+static uint16_t regs[REGS];
+
+static int failures;
+
+static void check(const char *what, unsigned long got, unsigned long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: got %lu, want %lu\n", what, got, want);
+      failures++;
+   }
+}
+
+// The server's main loop, a few times round so every socket moves on
+static void serve(void)
+{
+   int i;
+
+   for(i = 0; i < 4; i++)
+      ModbusTask();
+}
+
+static int take(struct request *r)
+{
+   return(modbus_getd(&r->hdr, &r->func, &r->len, r->data));
+}
+
+// Answers a read holding registers request, TRUE if it didn't fit
+static int answer(struct request *r)
+{
+   uint16_t start = make16(r->data[0], r->data[1]);
+   uint16_t quantity = make16(r->data[2], r->data[3]);
+
+   return(modbus_read_holding_registers_rsp(r->hdr, quantity * 2, regs + start));
+}
+
+static TCP_SOCKET client_connect(void)
+{
+   TCP_SOCKET s = TCPOpen("", TCP_OPEN_RAM_HOST, MODBUS_SERVER_LISTEN_PORT, TCP_PURPOSE_DEFAULT);
+
+   check("client connects", s != INVALID_SOCKET, TRUE);
+   serve();
+   return(s);
+}
+
+static void client_close(TCP_SOCKET s)
+{
+   TCPDisconnect(s);
+   serve();
+}
+
+static void put16(TCP_SOCKET s, uint16_t v)
+{
+   TCPPut(s, make8(v, 1));
+   TCPPut(s, make8(v, 0));
+}
+
+// A read holding registers request, not flushed so several go together
+static void client_request(TCP_SOCKET s, uint16_t tid, uint16_t start, uint16_t quantity)
+{
+   put16(s, tid);
+   put16(s, 0);
+   put16(s, 6);
+   TCPPut(s, UNIT);
+   TCPPut(s, FUNC_READ_HOLDING_REGISTERS);
+   put16(s, start);
+   put16(s, quantity);
+}
+
+static uint16_t get16(TCP_SOCKET s)
+{
+   uint8_t h = 0, l = 0;
+
+   TCPGet(s, &h);
+   TCPGet(s, &l);
+   return(make16(h, l));
+}
+
+// Reads one response and checks it against the register map.  Returns its
+// transaction ID, or 0xFFFF if there is none.
+static uint16_t client_response(const char *what, TCP_SOCKET s, uint16_t start, uint16_t quantity)
+{
+   uint16_t tid, i;
+   uint8_t b;
+
+   if(TCPIsGetReady(s) == 0)
+      return(0xFFFF);
+
+   tid = get16(s);
+   check(what, get16(s), 0);
+   check(what, get16(s), 3 + 2 * quantity);
+   TCPGet(s, &b);
+   check(what, b, UNIT);
+   TCPGet(s, &b);
+   check(what, b, FUNC_READ_HOLDING_REGISTERS);
+   TCPGet(s, &b);
+   check(what, b, 2 * quantity);
+   for(i = 0; i < quantity; i++)
+      check(what, get16(s), regs[start + i]);
+   return(tid);
+}
+
+static void pipelining(void)
+{
+   struct request r[6];
+   TCP_SOCKET a, b;
+   int i;
+
+   a = client_connect();
+   b = client_connect();
+
+   // three from a in one segment, one from b
+   client_request(a, 0x0100, 0, 4);
+   client_request(a, 0x0101, 10, 2);
+   client_request(a, 0x0102, 20, 1);
+   TCPFlush(a);
+   client_request(b, 0x0200, 30, 3);
+   TCPFlush(b);
+   serve();
+
+   // a's first and b's before a's second
+   check("first request", take(&r[0]), TRUE);
+   check("second request", take(&r[1]), TRUE);
+   check("no more until the server reads on", take(&r[2]), FALSE);
+   check("requests from both clients", r[0].hdr.WhichSocket != r[1].hdr.WhichSocket, TRUE);
+   if(r[0].hdr.WhichSocket != 0)
+   {
+      r[5] = r[0];
+      r[0] = r[1];
+      r[1] = r[5];
+   }
+   check("a's first request", r[0].hdr.TransactionIdentifier, 0x0100);
+   check("b's request", r[1].hdr.TransactionIdentifier, 0x0200);
+
+   serve();
+   check("a's second request", take(&r[2]), TRUE);
+   check("a's second request", r[2].hdr.TransactionIdentifier, 0x0101);
+   check("a's second request length", r[2].len, 4);
+
+   check("pending 0x0100", ModbusPendingFind(0, 0x0100) != 0xFF, TRUE);
+   check("pending 0x0101", ModbusPendingFind(0, 0x0101) != 0xFF, TRUE);
+   check("pending 0x0200", ModbusPendingFind(1, 0x0200) != 0xFF, TRUE);
+   check("0x0200 is not a's", ModbusPendingFind(0, 0x0200), 0xFF);
+
+   // out of order
+   check("answer 0x0101", answer(&r[2]), FALSE);
+   check("answer 0x0200", answer(&r[1]), FALSE);
+   check("answer 0x0100", answer(&r[0]), FALSE);
+   serve();
+
+   check("a gets 0x0101 first", client_response("0x0101", a, 10, 2), 0x0101);
+   check("a gets 0x0100 next", client_response("0x0100", a, 0, 4), 0x0100);
+   check("b gets 0x0200", client_response("0x0200", b, 30, 3), 0x0200);
+   check("0x0100 no longer pending", ModbusPendingFind(0, 0x0100), 0xFF);
+
+   // a second answer to the same request goes nowhere
+   check("answer 0x0100 again", answer(&r[0]), FALSE);
+   serve();
+   check("a gets nothing more", TCPIsGetReady(a), 0);
+
+   check("a's third request", take(&r[3]), TRUE);
+   check("a's third request", r[3].hdr.TransactionIdentifier, 0x0102);
+   check("answer 0x0102", answer(&r[3]), FALSE);
+   serve();
+   check("a gets 0x0102", client_response("0x0102", a, 20, 1), 0x0102);
+   check("nothing pending on a", modbus_pending_used[0], 0);
+   check("nothing pending on b", modbus_pending_used[1], 0);
+
+   // one more than can be pending: the oldest is forgotten
+   for(i = 0; i <= MODBUS_MAX_PENDING; i++)
+      client_request(a, 0x0300 + i, i, 1);
+   TCPFlush(a);
+   for(i = 0; i <= MODBUS_MAX_PENDING; i++)
+   {
+      serve();
+      check("pipelined request", take(&r[i]), TRUE);
+   }
+   check("oldest forgotten", ModbusPendingFind(0, 0x0300), 0xFF);
+   for(i = 1; i <= MODBUS_MAX_PENDING; i++)
+      check("newer ones pending", ModbusPendingFind(0, 0x0300 + i) != 0xFF, TRUE);
+   for(i = 0; i <= MODBUS_MAX_PENDING; i++)
+      answer(&r[i]);
+   serve();
+   for(i = 1; i <= MODBUS_MAX_PENDING; i++)
+      check("answers to the newer ones", client_response("pipelined", a, i, 1), 0x0300 + i);
+   check("no answer to the oldest", TCPIsGetReady(a), 0);
+
+   client_close(a);
+   client_close(b);
+}
+
+static void full_tx_buffer(void)
+{
+   struct request r[2];
+   TCP_SOCKET a;
+   uint16_t room;
+
+   a = client_connect();
+
+   // room for one 10 register answer and all but a byte of another
+   room = 2 * (6 + 3 + 20) - 1;
+   tcp_sim.socket[socket[0]].tx.size = room;
+
+   client_request(a, 0x0400, 0, 10);
+   client_request(a, 0x0401, 10, 10);
+   TCPFlush(a);
+   serve();
+   check("first request", take(&r[0]), TRUE);
+   serve();
+   check("second request", take(&r[1]), TRUE);
+
+   check("first answer fits", answer(&r[0]), FALSE);
+   check("second answer doesn't", answer(&r[1]), TRUE);
+   check("nothing of it written", TCPIsPutReady(socket[0]), room - 29);
+   check("still pending", ModbusPendingFind(0, 0x0401) != 0xFF, TRUE);
+   check("no puts past the end", tcp_sim.socket[socket[0]].overruns, 0);
+
+   // the first goes out, and then the second fits
+   serve();
+   check("second answer once there is room", answer(&r[1]), FALSE);
+   serve();
+   check("first answer", client_response("first answer", a, 0, 10), 0x0400);
+   check("second answer", client_response("second answer", a, 10, 10), 0x0401);
+   check("nothing else", TCPIsGetReady(a), 0);
+
+   client_close(a);
+   tcp_sim.socket[socket[0]].tx.size = tcp_sim.tx_size;
+}
+
+static void bad_header(void)
+{
+   struct request r;
+   TCP_SOCKET a;
+   unsigned long drops;
+   int i;
+
+   // a request taken and not answered before the connection goes
+   a = client_connect();
+   client_request(a, 0x0500, 0, 2);
+   TCPFlush(a);
+   serve();
+   check("request before the drop", take(&r), TRUE);
+
+   drops = tcp_sim.disconnects;
+   put16(a, 0x0501);
+   put16(a, 0);
+   put16(a, MODBUS_BUFFER_SIZE + 3);
+   for(i = 0; i < MODBUS_BUFFER_SIZE + 3; i++)
+      TCPPut(a, 0x55);
+   TCPFlush(a);
+   serve();
+   check("oversize length drops the connection", tcp_sim.disconnects, drops + 1);
+   check("client sees it", TCPIsConnected(a), FALSE);
+   check("nothing taken from it", modbus_kbhit(), FALSE);
+   client_close(a);
+
+   // the socket listens again and the new client is served
+   a = client_connect();
+   check("answer to the old connection", answer(&r), FALSE);
+   serve();
+   check("old answer doesn't reach the new client", TCPIsGetReady(a), 0);
+
+   client_request(a, 0x0502, 5, 2);
+   TCPFlush(a);
+   serve();
+   check("request after reconnecting", take(&r), TRUE);
+   answer(&r);
+   serve();
+   check("answer after reconnecting", client_response("after reconnecting", a, 5, 2), 0x0502);
+
+   // the longest length the buffer holds is fine
+   put16(a, 0x0503);
+   put16(a, 0);
+   put16(a, MODBUS_BUFFER_SIZE + 2);
+   TCPPut(a, UNIT);
+   TCPPut(a, FUNC_WRITE_MULTIPLE_REGISTERS);
+   for(i = 0; i < MODBUS_BUFFER_SIZE; i++)
+      TCPPut(a, i);
+   TCPFlush(a);
+   serve();
+   check("longest request", take(&r), TRUE);
+   check("longest request length", r.len, MODBUS_BUFFER_SIZE);
+   check("longest request last byte", r.data[MODBUS_BUFFER_SIZE - 1], MODBUS_BUFFER_SIZE - 1);
+   check("still connected", TCPIsConnected(a), TRUE);
+   modbus_exception_rsp(r.hdr, r.func, ILLEGAL_FUNCTION);
+   serve();
+   TCPDiscard(a);
+
+   // so is another protocol
+   drops = tcp_sim.disconnects;
+   put16(a, 0x0504);
+   put16(a, 1);
+   put16(a, 6);
+   TCPFlush(a);
+   serve();
+   check("other protocol drops the connection", tcp_sim.disconnects, drops + 1);
+   client_close(a);
+}
+
+int main(void)
+{
+   int i;
+
+   for(i = 0; i < REGS; i++)
+      regs[i] = 0x1000 + i * 0x0101;
+
+   tcp_sim_init();
+   modbus_init();
+   serve();
+
+   pipelining();
+   full_tx_buffer();
+   bad_header();
+
+   printf("%d failures\n", failures);
+   return(failures != 0);
+}
@@ -0,0 +1,371 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                           sd_card_sim.h                           ////
+////                                                                   ////
+//// An SD card in SPI mode, one byte at a time, backed by a disk      ////
+//// image in RAM.  Define MMCSD_SPI_XFER(x) as sd_sim_xfer(x) and     ////
+//// drive the select line with sd_sim_select() to run mmcsd.c on it.  ////
+////                                                                   ////
+//// It knows the commands mmcsd.c sends: reset and init, single and   ////
+//// multiple block reads and writes, CMD12, CMD13 and ACMD23.  Busy   ////
+//// periods and the read access time are given in us and turned into  ////
+//// the number of bytes the host has to clock through while it waits, ////
+//// so the byte count alone gives the modeled bus time.               ////
+////                                                                   ////
+//// ACMD23 erases the blocks up front, so blocks that were pre-erased ////
+//// but never written show up as 0xFF.  Writes can be made to fail on ////
+//// a given block, either with a write error data response or with    ////
+//// the error only showing up in the card status.                     ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __SD_CARD_SIM_H__
+#define __SD_CARD_SIM_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SD_SIM_BLOCK       512
+#define SD_SIM_QUEUE       4096
+#define SD_SIM_NO_BLOCK    0xFFFFFFFF
+
+// how long things take on the card, in us
+struct sd_sim_timing
+{
+   unsigned int
+      read_access,         // command to first data token
+      read_next,           // between blocks of a multiple block read
+      prog_single,         // busy after a single block write
+      prog_multi,          // busy after each block of a multiple block write
+      prog_erased,         // the same, for a block ACMD23 pre-erased
+      prog_stop;           // busy after the stop token
+};
+
+enum sd_sim_state
+{
+   SD_SIM_CMD,             // waiting for a command
+   SD_SIM_READ_MULTI,      // streaming blocks until CMD12
+   SD_SIM_WRITE_TOKEN,     // waiting for a start token (or stop token)
+   SD_SIM_WRITE_DATA       // taking in a block
+};
+
+struct sd_sim
+{
+   uint8_t *image;
+   uint32_t blocks;
+   unsigned int byte_ns;
+   struct sd_sim_timing t;
+
+   // what's going on on the line
+   enum sd_sim_state state;
+   int selected, idle, app, init_polls, multi;
+   uint8_t cmd[6];
+   int cmd_len;
+   uint32_t block;               // block being read or written
+   uint32_t erase_count;         // from ACMD23, for the next CMD25
+   uint32_t erased_first, erased_end;
+   uint8_t data[SD_SIM_BLOCK + 2];
+   int data_len;
+   uint8_t status;               // second byte of R2, cleared by CMD13
+
+   // bytes on their way back to the host
+   uint8_t queue[SD_SIM_QUEUE];
+   int q_head, q_tail;
+
+   // fault injection, SD_SIM_NO_BLOCK when off
+   uint32_t fail_block;          // answer with a write error data response
+   uint32_t status_fail_block;   // accept it, but flag an ECC failure in the status
+
+   // what the card saw
+   unsigned long
+      bytes,
+      cmds,
+      pre_erases,
+      blocks_read,
+      blocks_written;
+};
+
+static struct sd_sim sd;
+
+static void sd_sim_push(uint8_t b)
+{
+   if(sd.q_tail < SD_SIM_QUEUE)
+      sd.queue[sd.q_tail++] = b;
+}
+
+// n bytes of b, for us worth of bus time
+static void sd_sim_wait(uint8_t b, unsigned int us)
+{
+   unsigned long n = ((unsigned long)us * 1000 + sd.byte_ns - 1) / sd.byte_ns;
+
+   while(n--)
+      sd_sim_push(b);
+}
+
+// mmcsd_get_r1() gives up after 255 bytes, a card that is slower than that
+//  to start a read isn't one mmcsd.c can use
+static void sd_sim_access(unsigned int us)
+{
+   unsigned long n = ((unsigned long)us * 1000 + sd.byte_ns - 1) / sd.byte_ns;
+
+   if(n > 200)
+      n = 200;
+   while(n--)
+      sd_sim_push(0xFF);
+}
+
+static void sd_sim_send_block(void)
+{
+   int i;
+   uint8_t *p = sd.image + (size_t)sd.block * SD_SIM_BLOCK;
+
+   sd_sim_push(0xFE);
+   for(i = 0; i < SD_SIM_BLOCK; i++)
+      sd_sim_push(p[i]);
+   sd_sim_push(0xFF);      // CRC, turned off
+   sd_sim_push(0xFF);
+   sd.blocks_read++;
+}
+
+void sd_sim_init(uint8_t *image, uint32_t blocks, unsigned int byte_ns, const struct sd_sim_timing *t)
+{
+   memset(&sd, 0, sizeof(sd));
+   sd.image = image;
+   sd.blocks = blocks;
+   sd.byte_ns = byte_ns;
+   sd.t = *t;
+   sd.idle = 1;
+   sd.fail_block = SD_SIM_NO_BLOCK;
+   sd.status_fail_block = SD_SIM_NO_BLOCK;
+}
+
+static void sd_sim_command(void)
+{
+   uint8_t
+      cmd = sd.cmd[0] & 0x3F,
+      r1 = 0;
+   uint32_t
+      arg = ((uint32_t)sd.cmd[1] << 24) | ((uint32_t)sd.cmd[2] << 16) | ((uint32_t)sd.cmd[3] << 8) | sd.cmd[4],
+      i;
+   int app = sd.app;
+
+   sd.cmds++;
+   sd.app = 0;
+   sd.q_head = sd.q_tail = 0;
+   sd_sim_push(0xFF);      // NCR
+
+   switch(cmd)
+   {
+      case 0:
+         sd.idle = 1;
+         sd.init_polls = 2;
+         sd.state = SD_SIM_CMD;
+         break;
+
+      case 1:
+      case 41:
+         if(sd.init_polls)
+            sd.init_polls--;
+         else
+            sd.idle = 0;
+         break;
+
+      case 55:
+         sd.app = 1;
+         break;
+
+      case 16:
+         if(arg != SD_SIM_BLOCK)
+            r1 = 0x40;
+         break;
+
+      case 59:
+         break;
+
+      case 12:
+         if(sd.state == SD_SIM_READ_MULTI)
+         {
+            // R1b, R1 and then a short busy
+            sd_sim_push(0x00);
+            sd_sim_wait(0x00, 1);
+            sd.state = SD_SIM_CMD;
+            return;
+         }
+         r1 = 0x04;
+         break;
+
+      case 13:
+         sd_sim_push(sd.idle);
+         sd_sim_push(sd.status);
+         sd.status = 0;
+         return;
+
+      case 17:
+      case 18:
+      case 24:
+      case 25:
+         if(arg % SD_SIM_BLOCK)
+            r1 = 0x20;
+         else if(arg / SD_SIM_BLOCK >= sd.blocks)
+            r1 = 0x40;
+         if(r1)
+            break;
+
+         sd.block = arg / SD_SIM_BLOCK;
+         sd_sim_push(0x00);
+         if(cmd == 17)
+         {
+            sd_sim_access(sd.t.read_access);
+            sd_sim_send_block();
+         }
+         else if(cmd == 18)
+         {
+            sd_sim_access(sd.t.read_access);
+            sd_sim_send_block();
+            sd.block++;
+            sd.state = SD_SIM_READ_MULTI;
+         }
+         else
+         {
+            sd.multi = (cmd == 25);
+            sd.state = SD_SIM_WRITE_TOKEN;
+            sd.erased_first = sd.erased_end = sd.block;
+            if(sd.multi && sd.erase_count)
+            {
+               // what isn't written over is gone
+               sd.pre_erases++;
+               sd.erased_end = sd.block + sd.erase_count;
+               if(sd.erased_end > sd.blocks)
+                  sd.erased_end = sd.blocks;
+               for(i = sd.block; i < sd.erased_end; i++)
+                  memset(sd.image + (size_t)i * SD_SIM_BLOCK, 0xFF, SD_SIM_BLOCK);
+            }
+            sd.erase_count = 0;
+         }
+         return;
+
+      case 23:
+         if(app)
+            sd.erase_count = arg & 0x7FFFFF;
+         else
+            r1 = 0x04;
+         break;
+
+      default:
+         r1 = 0x04;
+         break;
+   }
+
+   sd_sim_push(r1 | sd.idle);
+}
+
+static void sd_sim_data(void)
+{
+   uint8_t response = 0x05;
+   unsigned int busy;
+
+   if((sd.block >= sd.blocks) || (sd.block == sd.fail_block))
+   {
+      response = 0x0D;
+      sd.status |= (sd.block >= sd.blocks) ? 0x80 : 0x04;
+   }
+   else if(sd.block == sd.status_fail_block)
+      sd.status |= 0x10;
+   else
+   {
+      memcpy(sd.image + (size_t)sd.block * SD_SIM_BLOCK, sd.data, SD_SIM_BLOCK);
+      sd.blocks_written++;
+   }
+
+   if(!sd.multi)
+      busy = sd.t.prog_single;
+   else if((sd.block >= sd.erased_first) && (sd.block < sd.erased_end))
+      busy = sd.t.prog_erased;
+   else
+      busy = sd.t.prog_multi;
+
+   sd_sim_push(response);
+   sd_sim_wait(0x00, busy);
+   sd.block++;
+   sd.state = sd.multi ? SD_SIM_WRITE_TOKEN : SD_SIM_CMD;
+}
+
+// one byte each way
+uint8_t sd_sim_xfer(uint8_t in)
+{
+   uint8_t out = 0xFF;
+
+   if(!sd.selected)
+      return(0xFF);
+
+   sd.bytes++;
+
+   // keep a multiple block read going
+   if((sd.state == SD_SIM_READ_MULTI) && (sd.q_head == sd.q_tail) && (sd.cmd_len == 0))
+   {
+      sd.q_head = sd.q_tail = 0;
+      if(sd.block < sd.blocks)
+      {
+         sd_sim_access(sd.t.read_next);
+         sd_sim_send_block();
+         sd.block++;
+      }
+   }
+
+   if(sd.q_head < sd.q_tail)
+      out = sd.queue[sd.q_head++];
+   if(sd.q_head == sd.q_tail)
+      sd.q_head = sd.q_tail = 0;
+
+   switch(sd.state)
+   {
+      case SD_SIM_WRITE_TOKEN:
+         if((in == 0xFE) && !sd.multi)
+            sd.state = SD_SIM_WRITE_DATA;
+         else if((in == 0xFC) && sd.multi)
+            sd.state = SD_SIM_WRITE_DATA;
+         else if((in == 0xFD) && sd.multi)
+         {
+            sd_sim_push(0xFF);
+            sd_sim_wait(0x00, sd.t.prog_stop);
+            sd.state = SD_SIM_CMD;
+         }
+         sd.data_len = 0;
+         break;
+
+      case SD_SIM_WRITE_DATA:
+         sd.data[sd.data_len++] = in;
+         if(sd.data_len == SD_SIM_BLOCK + 2)
+            sd_sim_data();
+         break;
+
+      default:
+         if((sd.cmd_len == 0) && ((in & 0xC0) != 0x40))
+            break;
+         sd.cmd[sd.cmd_len++] = in;
+         if(sd.cmd_len == 6)
+         {
+            sd.cmd_len = 0;
+            sd_sim_command();
+         }
+         break;
+   }
+
+   return(out);
+}
+
+// low is selected
+void sd_sim_select(int level)
+{
+   sd.selected = !level;
+   if(level)
+   {
+      // a deselect throws away whatever was going on
+      sd.q_head = sd.q_tail = 0;
+      sd.cmd_len = 0;
+      sd.state = SD_SIM_CMD;
+   }
+}
+
+#endif
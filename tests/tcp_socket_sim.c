@@ -0,0 +1,220 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                         tcp_socket_sim.c                          ////
+////                                                                   ////
+//// The sockets of tcp_socket_sim.h.                                  ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+struct tcp_sim tcp_sim;
+
+void tcp_sim_init(void)
+{
+   memset(&tcp_sim, 0, sizeof(tcp_sim));
+   tcp_sim.tx_size = 256;
+   tcp_sim.rx_size = 256;
+}
+
+static struct tcp_sim_socket *tcp_sim_get(TCP_SOCKET s)
+{
+   if(s >= TCP_SIM_SOCKETS || tcp_sim.socket[s].state == TCP_SIM_FREE)
+   {
+      printf("FAIL tcp_socket_sim: socket %u is not open\n", s);
+      exit(1);
+   }
+   return(&tcp_sim.socket[s]);
+}
+
+static void tcp_sim_clear(struct tcp_sim_socket *p)
+{
+   p->tx.head = p->tx.count = 0;
+   p->rx.head = p->rx.count = 0;
+   p->pushed = 0;
+}
+
+static TCP_SOCKET tcp_sim_new(uint16_t port)
+{
+   struct tcp_sim_socket *p;
+   TCP_SOCKET s;
+
+   for(s = 0; s < TCP_SIM_SOCKETS; s++)
+   {
+      p = &tcp_sim.socket[s];
+      if(p->state == TCP_SIM_FREE)
+      {
+         memset(p, 0, sizeof(*p));
+         p->port = port;
+         p->tx.size = tcp_sim.tx_size;
+         p->rx.size = tcp_sim.rx_size;
+         return(s);
+      }
+   }
+   return(INVALID_SOCKET);
+}
+
+static void tcp_sim_push(struct tcp_sim_buffer *b, uint8_t c)
+{
+   b->data[(b->head + b->count) % TCP_SIM_BUFFER] = c;
+   b->count++;
+}
+
+static uint8_t tcp_sim_pop(struct tcp_sim_buffer *b)
+{
+   uint8_t c = b->data[b->head];
+
+   b->head = (b->head + 1) % TCP_SIM_BUFFER;
+   b->count--;
+   return(c);
+}
+
+// Moves what s flushed into its peer's receive buffer, as far as it goes
+static void tcp_sim_deliver(struct tcp_sim_socket *p)
+{
+   struct tcp_sim_socket *q;
+
+   if(p->state != TCP_SIM_CONNECTED)
+      return;
+   q = &tcp_sim.socket[p->peer];
+   while(p->pushed && q->rx.count < q->rx.size)
+   {
+      tcp_sim_push(&q->rx, tcp_sim_pop(&p->tx));
+      p->pushed--;
+   }
+}
+
+TICK TickGet(void)
+{
+   return(tcp_sim.ticks);
+}
+
+TCP_SOCKET TCPListen(uint16_t port)
+{
+   TCP_SOCKET s = tcp_sim_new(port);
+
+   if(s != INVALID_SOCKET)
+   {
+      tcp_sim.socket[s].state = TCP_SIM_LISTENING;
+      tcp_sim.socket[s].listener = TRUE;
+   }
+   return(s);
+}
+
+TCP_SOCKET TCPOpen(char *host, uint8_t type, uint16_t port, uint8_t purpose)
+{
+   TCP_SOCKET s, l;
+
+   for(l = 0; l < TCP_SIM_SOCKETS; l++)
+      if(tcp_sim.socket[l].state == TCP_SIM_LISTENING && tcp_sim.socket[l].port == port)
+         break;
+   if(l == TCP_SIM_SOCKETS)
+      return(INVALID_SOCKET);
+
+   s = tcp_sim_new(port);
+   if(s == INVALID_SOCKET)
+      return(INVALID_SOCKET);
+
+   tcp_sim.socket[s].state = TCP_SIM_CONNECTED;
+   tcp_sim.socket[s].peer = l;
+   tcp_sim.socket[l].state = TCP_SIM_CONNECTED;
+   tcp_sim.socket[l].peer = s;
+   tcp_sim.socket[l].connects++;
+   tcp_sim_clear(&tcp_sim.socket[l]);
+   return(s);
+}
+
+_Bool TCPIsConnected(TCP_SOCKET s)
+{
+   return(tcp_sim_get(s)->state == TCP_SIM_CONNECTED);
+}
+
+uint16_t TCPIsGetReady(TCP_SOCKET s)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   if(p->state == TCP_SIM_CONNECTED)
+      tcp_sim_deliver(&tcp_sim.socket[p->peer]);
+   return(p->rx.count);
+}
+
+_Bool TCPGet(TCP_SOCKET s, uint8_t *data)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   if(TCPIsGetReady(s) == 0)
+      return(FALSE);
+   *data = tcp_sim_pop(&p->rx);
+   return(TRUE);
+}
+
+uint16_t TCPIsPutReady(TCP_SOCKET s)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   if(p->state != TCP_SIM_CONNECTED)
+      return(0);
+   return(p->tx.size - p->tx.count);
+}
+
+_Bool TCPPut(TCP_SOCKET s, uint8_t data)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   if(TCPIsPutReady(s) == 0)
+   {
+      p->overruns++;
+      return(FALSE);
+   }
+   tcp_sim_push(&p->tx, data);
+   p->puts++;
+   return(TRUE);
+}
+
+uint16_t TCPPutArray(TCP_SOCKET s, uint8_t *data, uint16_t len)
+{
+   uint16_t i;
+
+   for(i = 0; i < len; i++)
+      if(!TCPPut(s, data[i]))
+         break;
+   return(i);
+}
+
+void TCPFlush(TCP_SOCKET s)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   p->flushes++;
+   p->pushed = p->tx.count;
+   tcp_sim_deliver(p);
+}
+
+void TCPDiscard(TCP_SOCKET s)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   p->rx.head = p->rx.count = 0;
+}
+
+static void tcp_sim_close(struct tcp_sim_socket *p)
+{
+   tcp_sim_clear(p);
+   if(p->listener)
+      p->state = TCP_SIM_LISTENING;
+   else
+      p->state = TCP_SIM_FREE;
+}
+
+void TCPDisconnect(TCP_SOCKET s)
+{
+   struct tcp_sim_socket *p = tcp_sim_get(s);
+
+   // the other end sees the connection go and closes it itself
+   if(p->state == TCP_SIM_CONNECTED)
+   {
+      tcp_sim.socket[p->peer].state = TCP_SIM_CLOSED;
+      tcp_sim.disconnects++;
+   }
+   tcp_sim_close(p);
+}
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                         tcp_socket_sim.h                          ////
+////                                                                   ////
+//// The part of the Microchip TCP/IP stack's socket API the Modbus    ////
+//// TCP driver uses, on sockets that live in memory.  modbus_tcpip.sed ////
+//// points the driver's tcp.h and tick.h includes here.  Include      ////
+//// tcp_socket_sim.c once, in the test.                               ////
+////                                                                   ////
+//// TCPListen() opens a socket that waits for a TCPOpen() to the same ////
+//// port, which connects at once.  Each socket has a transmit buffer  ////
+//// of tx_size bytes, which is what TCPIsPutReady() reports, and a    ////
+//// receive buffer of rx_size.  TCPFlush() moves what was put to the  ////
+//// peer as far as its receive buffer has room, and the rest follows  ////
+//// as the peer reads, the way the TCP window would.  TCPDisconnect() ////
+//// closes both ends and puts a listening socket back to listening.   ////
+//// The clock is tcp_sim.ticks, which only the test moves.            ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __TCP_SOCKET_SIM_H__
+#define __TCP_SOCKET_SIM_H__
+
+#include <stdint.h>
+
+#define TCP_SIM_SOCKETS       8
+#define TCP_SIM_BUFFER        1024     // largest tx_size or rx_size
+
+typedef uint8_t TCP_SOCKET;
+#define INVALID_SOCKET        0xFE
+
+#define TCP_OPEN_RAM_HOST     1
+#define TCP_PURPOSE_DEFAULT   0
+
+typedef uint32_t TICK;
+#define TICKS_PER_SECOND      100
+#define TickGetDiff(a,b)      ((TICK)((a) - (b)))
+
+typedef union
+{
+   uint32_t Val;
+   uint8_t v[4];
+} IP_ADDR;
+
+enum {TCP_SIM_FREE = 0, TCP_SIM_LISTENING, TCP_SIM_CONNECTED, TCP_SIM_CLOSED};
+
+struct tcp_sim_buffer
+{
+   uint8_t data[TCP_SIM_BUFFER];
+   uint16_t head, count, size;
+};
+
+struct tcp_sim_socket
+{
+   int state;
+   int listener;                 // goes back to listening when closed
+   uint16_t port;
+   TCP_SOCKET peer;
+   struct tcp_sim_buffer tx, rx;
+   uint16_t pushed;              // bytes of tx flushed and not yet at the peer
+
+   // what the socket saw
+   unsigned long puts, overruns, flushes, connects;
+};
+
+struct tcp_sim
+{
+   struct tcp_sim_socket socket[TCP_SIM_SOCKETS];
+   TICK ticks;
+   uint16_t tx_size, rx_size;    // for sockets opened from now on
+   unsigned long disconnects;
+};
+
+extern struct tcp_sim tcp_sim;
+
+void tcp_sim_init(void);
+
+// The stack API
+TICK TickGet(void);
+TCP_SOCKET TCPListen(uint16_t port);
+TCP_SOCKET TCPOpen(char *host, uint8_t type, uint16_t port, uint8_t purpose);
+_Bool TCPIsConnected(TCP_SOCKET s);
+uint16_t TCPIsGetReady(TCP_SOCKET s);
+_Bool TCPGet(TCP_SOCKET s, uint8_t *data);
+uint16_t TCPIsPutReady(TCP_SOCKET s);
+_Bool TCPPut(TCP_SOCKET s, uint8_t data);
+uint16_t TCPPutArray(TCP_SOCKET s, uint8_t *data, uint16_t len);
+void TCPFlush(TCP_SOCKET s);
+void TCPDiscard(TCP_SOCKET s);
+void TCPDisconnect(TCP_SOCKET s);
+
+#endif
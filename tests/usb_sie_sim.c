@@ -0,0 +1,635 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                           usb_sie_sim.c                           ////
+////                                                                   ////
+//// The hardware layer and SIE model described in usb_sie_sim.h.      ////
+//// The firmware half follows pic18_usb.c function for function, the  ////
+//// host half plays the SIE's part of each transaction.               ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+// BD status bits, as the firmware writes them and as the SIE hands them back
+#define BD_UOWN      0x80
+#define BD_DTS       0x40
+#define BD_DTSEN     0x08
+#define BD_BSTALL    0x04
+
+#define SIE_PID_OUT     0x1
+#define SIE_PID_IN      0x9
+#define SIE_PID_SETUP   0xD
+
+#define USB_PIC_PID_IN       0x24  //device to host transactions
+#define USB_PIC_PID_OUT      0x04  //host to device transactions
+#define USB_PIC_PID_SETUP    0x34  //host to device setup transaction
+
+#define USTAT_IN_E0        4
+#define USTAT_OUT_SETUP_E0 0
+
+//See UEPn (0xF70-0xF7F)
+#define ENDPT_DISABLED    0x00  //endpoint not used
+#define ENDPT_CONTROL     0x06  //Supports IN, OUT and CONTROL transactions - Only use with EP0
+
+typedef struct
+{
+   uint8_t stat;
+   uint16_t cnt;
+   uint8_t *addr;
+} STRUCT_BD;
+
+struct
+{
+   STRUCT_BD out;    //pc -> pic
+   STRUCT_BD in;     //pc <- pic
+} g_USBBDT[USB_SIM_NUM_EP];
+
+#define EP_BDxST_O(x)    g_USBBDT[x].out.stat
+#define EP_BDxCNT_O(x)   g_USBBDT[x].out.cnt
+#define EP_BDxADR_O(x)   g_USBBDT[x].out.addr
+#define EP_BDxST_I(x)    g_USBBDT[x].in.stat
+#define EP_BDxCNT_I(x)   g_USBBDT[x].in.cnt
+#define EP_BDxADR_I(x)   g_USBBDT[x].in.addr
+
+#define USB_DATA_BUFFER_LOCATION g_USBRAM
+
+static uint8_t g_UEP[USB_SIM_NUM_EP];
+#define UEP(x) g_UEP[x]
+
+static uint8_t UADDR;
+static uint8_t USTATCopy;
+static uint8_t __setup_0_tx_size;
+
+enum {USB_STATE_DETACHED=0, USB_STATE_ATTACHED=1, USB_STATE_POWERED=2, USB_STATE_DEFAULT=3,
+    USB_STATE_ADDRESS=4, USB_STATE_CONFIGURED=5} usb_state;
+
+// the SIE and the host
+struct usb_sim_stats usb_sim;
+static uint8_t sie_ustat;
+static _Bool sie_trn;
+static uint8_t host_in_dts[USB_SIM_NUM_EP];     // toggle the host expects next
+static uint8_t host_out_dts[USB_SIM_NUM_EP];    // toggle the host sends next
+
+void usb_isr_tok_dne(void);
+void usb_init_ep0_setup(void);
+
+/// BEGIN User Functions:
+
+// see usb_hw_layer.h for more documentation
+_Bool usb_kbhit(uint8_t en)
+{
+   return((UEP(en)!=ENDPT_DISABLED)&&(!bit_test(EP_BDxST_O(en),7)));
+}
+
+// see usb_hw_layer.h for documentation
+_Bool usb_tbe(uint8_t en)
+{
+   return((UEP(en)!=ENDPT_DISABLED)&&(!bit_test(EP_BDxST_I(en),7)));
+}
+
+// see usb_hw_layer.h for documentation
+void usb_detach(void)
+{
+   USBIE = 0;
+   usb_state = USB_STATE_DETACHED;
+   usb_token_reset();
+}
+
+// see usb_hw_layer.h for documentation
+void usb_attach(void)
+{
+   usb_token_reset();
+   usb_state = USB_STATE_ATTACHED;
+}
+
+// see usb_hw_layer.h for documentation
+void usb_init_cs(void)
+{
+   usb_detach();
+}
+
+// see usb_hw_layer.h for documentation
+void usb_task(void)
+{
+   if (usb_state == USB_STATE_DETACHED)
+      usb_attach();
+
+   if (usb_state == USB_STATE_ATTACHED)
+   {
+      USBIE = 1;
+      usb_state = USB_STATE_POWERED;
+   }
+}
+
+// see usb_hw_layer.h for documentation
+void usb_init(void)
+{
+   usb_init_cs();
+
+   do
+   {
+      usb_task();
+   } while (usb_state != USB_STATE_POWERED);
+}
+
+// see pic18_usb.h for documentation
+_Bool usb_flush_in(uint8_t endpoint, uint16_t len, USB_DTS_BIT tgl)
+{
+   uint8_t i;
+
+   if (usb_tbe(endpoint))
+   {
+      EP_BDxCNT_I(endpoint)=len;
+
+      if (tgl == USB_DTS_TOGGLE)
+      {
+         i = EP_BDxST_I(endpoint);
+         if (bit_test(i,6))
+            tgl = USB_DTS_DATA0;  //was DATA1, goto DATA0
+         else
+            tgl = USB_DTS_DATA1;  //was DATA0, goto DATA1
+      }
+      else if (tgl == USB_DTS_USERX)
+      {
+         i = EP_BDxST_O(endpoint);
+         if (bit_test(i,6))
+            tgl = USB_DTS_DATA1;
+         else
+            tgl = USB_DTS_DATA0;
+      }
+      if (tgl == USB_DTS_DATA1)
+         i=0x48;  //DATA1, UOWN
+      else
+         i=0x08; //DATA0, UOWN
+
+      EP_BDxST_I(endpoint) = i;
+      EP_BDxST_I(endpoint) |= 0x80;
+
+      return(1);
+   }
+   return(0);
+}
+
+// see usb_hw_layer.h for documentation
+_Bool usb_put_packet(uint8_t endpoint, uint8_t * ptr, uint16_t len, USB_DTS_BIT tgl)
+{
+   if (usb_tbe(endpoint))
+   {
+      memcpy(EP_BDxADR_I(endpoint), ptr, len);
+
+      return(usb_flush_in(endpoint, len, tgl));
+   }
+   return(0);
+}
+
+// see pic18_usb.h for documentation
+void usb_flush_out(uint8_t endpoint, USB_DTS_BIT tgl)
+{
+   uint8_t i;
+
+   i = EP_BDxST_O(endpoint);
+   if (tgl == USB_DTS_TOGGLE)
+   {
+      if (bit_test(i,6))
+         tgl = USB_DTS_DATA0;  //was DATA1, goto DATA0
+      else
+         tgl = USB_DTS_DATA1;  //was DATA0, goto DATA1
+   }
+   if (tgl == USB_DTS_STALL)
+   {
+      i = 0x84;
+      EP_BDxST_I(endpoint) = 0x84; //stall both in and out endpoints
+   }
+   else if (tgl == USB_DTS_DATA1)
+      i = 0xC8;  //DATA1, UOWN
+   else
+      i = 0x88; //DATA0, UOWN
+
+   EP_BDxCNT_O(endpoint) = usb_ep_rx_size[endpoint];
+   EP_BDxST_O(endpoint) = i;
+}
+
+// see pic18_usb.h for documentation
+uint16_t usb_rx_packet_size(uint8_t endpoint)
+{
+   return(EP_BDxCNT_O(endpoint));
+}
+
+// see pic18_usb.c for documentation
+uint16_t usb_get_packet_buffer(uint8_t endpoint, uint8_t *ptr, uint16_t max)
+{
+   uint16_t i;
+
+   i = EP_BDxCNT_O(endpoint);
+   if (i < max) {max = i;}
+
+   memcpy(ptr, EP_BDxADR_O(endpoint), max);
+
+   return(max);
+}
+
+// see usb_hw_layer.h for documentation
+uint16_t usb_get_packet(uint8_t endpoint, uint8_t * ptr, uint16_t max)
+{
+   max = usb_get_packet_buffer(endpoint, ptr, max);
+   usb_flush_out(endpoint, USB_DTS_TOGGLE);
+
+   return(max);
+}
+
+// see usb_hw_layer.h for documentation
+void usb_stall_ep(uint8_t endpoint)
+{
+   if (bit_test(endpoint,7))
+      EP_BDxST_I(endpoint & 0x7F) = 0x84;
+   else
+      EP_BDxST_O(endpoint) = 0x84;
+}
+
+// see usb_hw_layer.h for documentation
+void usb_unstall_ep(uint8_t endpoint)
+{
+   if (bit_test(endpoint,7))
+      EP_BDxST_I(endpoint & 0x7F) = 0x88;
+   else
+      EP_BDxST_O(endpoint) = 0x00;
+}
+
+// see usb_hw_layer.h for documentation
+_Bool usb_endpoint_stalled(uint8_t endpoint)
+{
+   uint8_t st;
+
+   if (bit_test(endpoint,7))
+      st=EP_BDxST_I(endpoint & 0x7F);
+   else
+      st=EP_BDxST_O(endpoint);
+
+   return(bit_test(st,7) && bit_test(st,2));
+}
+
+// see usb_hw_layer.h for documentation
+void usb_set_address(uint8_t address)
+{
+   UADDR = address;
+
+   if (address)
+      usb_state = USB_STATE_ADDRESS;
+   else
+      usb_state = USB_STATE_POWERED;
+}
+
+// see usb_hw_layer.h for documentation
+void usb_disable_endpoint(uint8_t en)
+{
+   UEP(en) = ENDPT_DISABLED;
+
+   if (usb_endpoint_is_valid(en))
+   {
+      EP_BDxST_O(en) = 0;   //clear state, deque if necessary
+      EP_BDxST_I(en) = 0;   //clear state, deque if necessary
+   }
+}
+
+// see usb_hw_layer.h for documentation
+void usb_disable_endpoints(void)
+{
+   uint8_t i;
+
+   for (i=1; i<USB_SIM_NUM_EP; i++)
+      usb_disable_endpoint(i);
+}
+
+// see usb_hw_layer.h for documentation
+void usb_set_configured(uint8_t config)
+{
+   uint8_t en;
+   uint8_t *addy;
+   uint8_t new_uep;
+
+   if (config == 0)
+   {
+      // if config=0 then set addressed state
+      usb_state = USB_STATE_ADDRESS;
+      usb_disable_endpoints();
+   }
+   else
+   {
+      // else set configed state
+      usb_state = USB_STATE_CONFIGURED;
+      addy = USB_DATA_BUFFER_LOCATION+(2*USB_MAX_EP0_PACKET_LENGTH);
+      for (en=1; en<USB_SIM_NUM_EP; en++)
+      {
+         // enable and config endpoints based upon user configuration
+         usb_disable_endpoint(en);
+         new_uep = 0;
+         if (usb_ep_rx_type[en] != USB_ENABLE_DISABLED)
+         {
+            new_uep = 0x04;
+            EP_BDxCNT_O(en) = usb_ep_rx_size[en];
+            EP_BDxADR_O(en) = addy;
+            addy += usb_ep_rx_size[en];
+            EP_BDxST_O(en) = 0x88;
+         }
+         if (usb_ep_tx_type[en] != USB_ENABLE_DISABLED)
+         {
+            new_uep |= 0x02;
+            EP_BDxADR_I(en) = addy;
+            addy += usb_ep_tx_size[en];
+            EP_BDxST_I(en) = 0x40;
+         }
+         if (new_uep == 0x06) {new_uep = 0x0E;}
+         if (usb_ep_tx_type[en] != USB_ENABLE_ISOCHRONOUS) {new_uep |= 0x10;}
+
+         UEP(en) = new_uep;
+      }
+   }
+}
+
+// see usb_hw_layer.h for documentation
+void usb_request_send_response(uint8_t len) {__setup_0_tx_size = len;}
+void usb_request_get_data(void)  {__setup_0_tx_size = 0xFE;}
+void usb_request_stall(void)  {__setup_0_tx_size = 0xFF;}
+
+/// BEGIN USB Interrupt Service Routine
+
+// Only the token done interrupt, taken as soon as the SIE raises it unless
+// __USB_PAUSE_ISR() has it masked.
+void usb_isr(void)
+{
+   while (sie_trn && USBIE)
+   {
+      USTATCopy = sie_ustat;
+      sie_trn = 0;
+      usb_sim.tokens_done++;
+      usb_isr_tok_dne();
+   }
+}
+
+void usb_isr_rst(void)
+{
+   UADDR = 0;
+
+   UEP(0) = ENDPT_DISABLED;
+
+   usb_disable_endpoints();
+
+   usb_token_reset();
+
+   UEP(0) = ENDPT_CONTROL | 0x10;
+
+   sie_trn = 0;
+
+   usb_init_ep0_setup();
+
+   usb_state = USB_STATE_DEFAULT; //put usb mcu into default state
+}
+
+void usb_init_ep0_setup(void)
+{
+    EP_BDxCNT_O(0) = USB_MAX_EP0_PACKET_LENGTH;
+    EP_BDxADR_O(0) = USB_DATA_BUFFER_LOCATION;
+    EP_BDxST_O(0) = 0x88; //give control to SIE, DATA0, data toggle synch on
+
+    EP_BDxST_I(0) = 0;
+    EP_BDxADR_I(0) = USB_DATA_BUFFER_LOCATION + USB_MAX_EP0_PACKET_LENGTH;
+}
+
+// see pic18_usb.c for documentation
+void usb_isr_tok_dne(void)
+{
+   uint8_t en;
+
+   en = USTATCopy>>3;
+
+   if (USTATCopy == USTAT_OUT_SETUP_E0)
+   {
+      //new out or setup token in the buffer
+      uint8_t pidKey;
+
+      pidKey = EP_BDxST_O(0) & 0x3C;  //save PID
+
+      EP_BDxST_O(0) &= 0x43;  //clear pid, prevent bdstal/pid confusion
+
+      if (pidKey == USB_PIC_PID_SETUP)
+      {
+         if ((EP_BDxST_I(0) & 0x80) != 0x00)
+            EP_BDxST_I(0)=0;   // return the in buffer to us (dequeue any pending requests)
+
+         usb_isr_tok_setup_dne();
+
+         if (__setup_0_tx_size == 0xFF)
+            usb_flush_out(0, USB_DTS_STALL);
+         else
+         {
+            usb_flush_out(0, USB_DTS_TOGGLE);
+            if (__setup_0_tx_size != 0xFE)
+               usb_flush_in(0 ,__setup_0_tx_size, USB_DTS_USERX);
+         }
+      }
+      else if (pidKey == USB_PIC_PID_OUT)
+      {
+         usb_isr_tok_out_dne(0);
+         usb_flush_out(0, USB_DTS_TOGGLE);
+         if ((__setup_0_tx_size!=0xFE) && (__setup_0_tx_size!=0xFF))
+         {
+            usb_flush_in(0,__setup_0_tx_size,USB_DTS_DATA1);   //send response (usually a 0len)
+         }
+      }
+   }
+   else if (USTATCopy == USTAT_IN_E0)
+   {
+      //pic -> host transfer completed
+      __setup_0_tx_size = 0xFF;
+      usb_isr_tok_in_dne(0);
+      if (__setup_0_tx_size!=0xFF)
+         usb_flush_in(0, __setup_0_tx_size, USB_DTS_TOGGLE);
+   }
+   else
+   {
+      if (!bit_test(USTATCopy, 2))
+         usb_isr_tok_out_dne(en);
+      else
+         usb_isr_tok_in_dne(en);
+   }
+}
+
+/// END USB Interrupt Service Routine
+
+
+/// BEGIN SIE and host
+
+// The SIE is done with a BD: hand it back and raise token done.
+static void sie_token_done(uint8_t ep, int in)
+{
+   sie_ustat = (ep << 3) | (in ? 4 : 0);
+   sie_trn = 1;
+   usb_isr();
+}
+
+// see usb_sie_sim.h
+void usb_sim_reset(void)
+{
+   uint8_t i;
+
+   for (i = 0; i < USB_SIM_NUM_EP; i++)
+   {
+      host_in_dts[i] = 0;
+      host_out_dts[i] = 0;
+   }
+   usb_isr_rst();
+}
+
+// see usb_sie_sim.h
+uint8_t usb_sim_address(void)
+{
+   return(UADDR);
+}
+
+// see usb_sie_sim.h
+int usb_sim_setup(const uint8_t *request)
+{
+   STRUCT_BD *bd = &g_USBBDT[0].out;
+
+   if (!(bd->stat & BD_UOWN))
+   {
+      usb_sim.out_naks++;
+      return(USB_SIM_NAK);
+   }
+
+   // a setup is always DATA0 and is taken whatever DTS says
+   memcpy(bd->addr, request, 8);
+   bd->cnt = 8;
+   bd->stat = SIE_PID_SETUP << 2;
+   host_in_dts[0] = 1;
+   host_out_dts[0] = 1;
+   usb_sim.setups++;
+
+   sie_token_done(0, 0);
+   return(8);
+}
+
+// see usb_sie_sim.h
+int usb_sim_in(uint8_t ep, uint8_t *data)
+{
+   STRUCT_BD *bd = &g_USBBDT[ep].in;
+   uint8_t dts;
+   uint16_t len;
+
+   if (UEP(ep) == ENDPT_DISABLED)
+      return(USB_SIM_STALL);
+
+   if (!(bd->stat & BD_UOWN))
+   {
+      usb_sim.in_naks++;
+      return(USB_SIM_NAK);
+   }
+   if (bd->stat & BD_BSTALL)
+      return(USB_SIM_STALL);
+
+   // the host drops a packet with the toggle it has already seen
+   dts = (bd->stat & BD_DTS) ? 1 : 0;
+   if (dts != host_in_dts[ep])
+      usb_sim.toggle_errors++;
+   host_in_dts[ep] = !dts;
+
+   len = bd->cnt;
+   memcpy(data, bd->addr, len);
+   usb_sim.in_packets++;
+   if (!len)
+      usb_sim.in_zlps++;
+
+   bd->stat = (bd->stat & BD_DTS) | (SIE_PID_IN << 2);
+   sie_token_done(ep, 1);
+   return(len);
+}
+
+// see usb_sie_sim.h
+int usb_sim_out(uint8_t ep, const uint8_t *data, uint16_t len)
+{
+   STRUCT_BD *bd = &g_USBBDT[ep].out;
+   uint8_t dts;
+
+   if (UEP(ep) == ENDPT_DISABLED)
+      return(USB_SIM_STALL);
+
+   if (!(bd->stat & BD_UOWN))
+   {
+      usb_sim.out_naks++;
+      return(USB_SIM_NAK);
+   }
+   if (bd->stat & BD_BSTALL)
+      return(USB_SIM_STALL);
+
+   if (len > bd->cnt)
+   {
+      usb_sim.babbles++;
+      return(USB_SIM_BABBLE);
+   }
+
+   // ACKed either way, so the host moves on to the next toggle
+   dts = host_out_dts[ep];
+   host_out_dts[ep] = !dts;
+   if ((bd->stat & BD_DTSEN) && (dts != ((bd->stat & BD_DTS) ? 1 : 0)))
+   {
+      usb_sim.toggle_errors++;
+      return(len);
+   }
+
+   memcpy(bd->addr, data, len);
+   bd->cnt = len;
+   bd->stat = (dts ? BD_DTS : 0) | (SIE_PID_OUT << 2);
+   usb_sim.out_packets++;
+
+   sie_token_done(ep, 0);
+   return(len);
+}
+
+// see usb_sie_sim.h
+int usb_sim_control(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint8_t *data, uint16_t len)
+{
+   uint8_t setup[8], packet[USB_MAX_EP0_PACKET_LENGTH];
+   uint16_t done = 0;
+   int n;
+
+   setup[0] = type;
+   setup[1] = request;
+   setup[2] = (uint8_t)value;
+   setup[3] = (uint8_t)(value >> 8);
+   setup[4] = (uint8_t)index;
+   setup[5] = (uint8_t)(index >> 8);
+   setup[6] = (uint8_t)len;
+   setup[7] = (uint8_t)(len >> 8);
+
+   if (usb_sim_setup(setup) < 0)
+      return(USB_SIM_NAK);
+
+   if ((type & 0x80) && len)
+   {
+      // data stage in, then a 0 length status out
+      do
+      {
+         n = usb_sim_in(0, packet);
+         if (n < 0)
+            return(n);
+         if (n > len - done)
+            n = len - done;
+         memcpy(data + done, packet, n);
+         done += n;
+      } while ((n == USB_MAX_EP0_PACKET_LENGTH) && (done < len));
+
+      host_out_dts[0] = 1;
+      n = usb_sim_out(0, packet, 0);
+   }
+   else
+   {
+      // 0 length status in
+      n = usb_sim_in(0, packet);
+   }
+
+   if (n < 0)
+      return(n);
+   return(done);
+}
+
+/// END SIE and host
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                           usb_sie_sim.h                           ////
+////                                                                   ////
+//// A PIC18 USB peripheral for usb.c to run on, with the host on the  ////
+//// other side of it.  Include this where pic18_usb.h would go and    ////
+//// usb_sie_sim.c after usb.c.                                        ////
+////                                                                   ////
+//// The buffer descriptors work the way the SIE's do: the firmware    ////
+//// hands a BD over by setting UOWN, the SIE answers the host's token ////
+//// from it, hands it back with the count, PID and data toggle filled ////
+//// in and raises the token done interrupt.  A token that finds the   ////
+//// BD owned by the firmware is NAKed.  The data toggle the host      ////
+//// sends is checked against DTS when DTSEN is set, and a mismatch is ////
+//// ACKed and dropped, as on the real part.  What the host sees back  ////
+//// (packets, NAKs, toggle errors) is counted in usb_sim.             ////
+////                                                                   ////
+//// The driver side is pic18_usb.c with the BDT in plain RAM, so the  ////
+//// buffer addresses are pointers instead of 16 bit USB RAM addresses ////
+//// and only the token done interrupt is modeled.                     ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef __USB_SIE_SIM_H__
+#define __USB_SIE_SIM_H__
+
+#include <stdint.h>
+
+#define __USB_HARDWARE__
+
+//let the USB Stack know that we are using a PIC with internal USB peripheral.
+//gcc has its own __PIC__ for position independent code.
+#undef __PIC__
+#define __PIC__   1
+
+#define USB_USE_FULL_SPEED          1
+#define USB_MAX_EP0_PACKET_LENGTH   64
+
+#define USB_SIM_NUM_EP     16
+
+// usb_sim_in()/usb_sim_out() results other than a packet length
+#define USB_SIM_NAK        (-1)
+#define USB_SIM_STALL      (-2)
+#define USB_SIM_BABBLE     (-3)     // more data than the BD has room for
+
+// CCS lets an enum tag be used as a type name
+typedef enum USB_DTS_BIT USB_DTS_BIT;
+
+#include <usb_hw_layer.h>
+
+// The pic18_usb.h/pic18_usb.c extras usb.c uses
+_Bool usb_flush_in(uint8_t endpoint, uint16_t len, USB_DTS_BIT tgl);
+void usb_flush_out(uint8_t endpoint, USB_DTS_BIT tgl);
+uint16_t usb_rx_packet_size(uint8_t endpoint);
+uint16_t usb_get_packet_buffer(uint8_t endpoint, uint8_t *ptr, uint16_t max);
+
+// Dual port USB RAM the endpoint buffers are carved from, endpoint 0's first
+static uint8_t g_USBRAM[2 * USB_MAX_EP0_PACKET_LENGTH + 2 * (USB_SIM_NUM_EP - 1) * 64];
+
+#define usb_ep0_rx_buffer  g_USBRAM
+#define usb_ep0_tx_buffer  (g_USBRAM + USB_MAX_EP0_PACKET_LENGTH)
+
+// USB interrupt enable, __USB_PAUSE_ISR() clears it
+static _Bool USBIE;
+
+struct usb_sim_stats
+{
+   unsigned long
+      setups,
+      in_packets,
+      in_zlps,             // 0 length IN packets
+      in_naks,
+      out_packets,
+      out_naks,
+      toggle_errors,       // packets the SIE dropped, or the host would
+      babbles,
+      tokens_done;         // token done interrupts serviced
+};
+
+extern struct usb_sim_stats usb_sim;
+
+// Host side.  Each of these is one transaction on the bus; the token done
+// interrupt it causes has been serviced by the time it returns.
+void usb_sim_reset(void);
+int usb_sim_setup(const uint8_t *request);
+int usb_sim_in(uint8_t ep, uint8_t *data);
+int usb_sim_out(uint8_t ep, const uint8_t *data, uint16_t len);
+
+// A whole control transfer on endpoint 0: setup, data and status stages.
+// Returns the number of data bytes moved, or USB_SIM_STALL.
+int usb_sim_control(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint8_t *data, uint16_t len);
+
+// What SET_ADDRESS left in UADDR
+uint8_t usb_sim_address(void);
+
+#endif
@@ -0,0 +1,417 @@
+///////////////////////////////////////////////////////////////////////////
+////                                                                   ////
+////                       usb_stream_loopback.c                       ////
+////                                                                   ////
+//// usb.c's usb_stream_put()/usb_stream_get() on the simulated SIE in ////
+//// usb_sie_sim.h, enumerated as the usb_desc_bulk.h device with both ////
+//// stream directions on endpoint 1 and 64 byte packets.              ////
+////                                                                   ////
+////    IN     a short buffer, the 0 length packet after a buffer that ////
+////           ends on a full packet, buffers sent back to back and    ////
+////           each one retired on the token done of its last packet   ////
+////    OUT    a packet held in the endpoint until a buffer is queued, ////
+////           a packet that doesn't fit split into the next buffer,   ////
+////           and buffers ended by a full fill, a short packet or a   ////
+////           0 length packet                                         ////
+////    loop   the device echoing everything it gets back to the host  ////
+////           through a small pool of buffers, with random transfer   ////
+////           lengths and the host polling both endpoints at random   ////
+////                                                                   ////
+////    usb_stream_loopback -b   a longer loopback run with totals     ////
+////                                                                   ////
+///////////////////////////////////////////////////////////////////////////
+
+#include "ccs_host.h"
+#include "usb_sie_sim.h"
+
+#define delay_ms(x)
+#define delay_us(x)
+#define restart_wdt()
+
+// CCS lets these be called with fewer arguments than they are defined with
+#define debug_usb(...)
+#define debug_usb_control(...)
+#define debug_usb_token(...)
+
+#define USB_EP1_TX_SIZE          64
+#define USB_EP1_RX_SIZE          64
+
+#define USB_STREAM_DEVICE        TRUE
+#define USB_STREAM_IN_DONE(p,n)  stream_in_done(p, n)
+#define USB_STREAM_OUT_DONE(p,n) stream_out_done(p, n)
+
+static void stream_in_done(uint8_t *ptr, uint16_t len);
+static void stream_out_done(uint8_t *ptr, uint16_t len);
+
+// CCS lets an enum tag be used as a type name
+typedef enum USB_STATES USB_STATES;
+typedef enum USB_GETDESC_TYPES USB_GETDESC_TYPES;
+
+#include "usb_desc_bulk.h"
+#include "usb.c"
+#include "usb_sie_sim.c"
+
+#define PACKET    64
+#define DONE_MAX  64
+
+static int failures;
+
+static void check(const char *what, long got, long want)
+{
+   if(got != want)
+   {
+      printf("FAIL %s: got %ld, want %ld\n", what, got, want);
+      failures++;
+   }
+}
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+   rnd_state = rnd_state * 1103515245 + 12345;
+   return(rnd_state >> 8);
+}
+
+// Buffers handed back by USB_STREAM_IN_DONE()/USB_STREAM_OUT_DONE(), the
+// last DONE_MAX of them
+struct done_log
+{
+   uint8_t *ptr[DONE_MAX];
+   uint16_t len[DONE_MAX];
+   int n;
+};
+
+static struct done_log in_done, out_done;
+
+static void log_done(struct done_log *l, uint8_t *ptr, uint16_t len)
+{
+   l->ptr[l->n % DONE_MAX] = ptr;
+   l->len[l->n % DONE_MAX] = len;
+   l->n++;
+}
+
+static void stream_in_done(uint8_t *ptr, uint16_t len)
+{
+   log_done(&in_done, ptr, len);
+}
+
+static void stream_out_done(uint8_t *ptr, uint16_t len)
+{
+   log_done(&out_done, ptr, len);
+}
+
+static void fill(uint8_t *p, int n, uint8_t seed)
+{
+   int i;
+
+   for(i = 0; i < n; i++)
+      p[i] = (uint8_t)(seed + i * 3);
+}
+
+static void enumerate(void)
+{
+   usb_init();
+   usb_sim_reset();
+
+   check("SET_ADDRESS", usb_sim_control(0x00, USB_STANDARD_REQUEST_SET_ADDRESS, 5, 0, NULL, 0), 0);
+   check("  address", usb_sim_address(), 5);
+   check("SET_CONFIGURATION", usb_sim_control(0x00, USB_STANDARD_REQUEST_SET_CONFIGURATION, 1, 0, NULL, 0), 0);
+   check("  enumerated", usb_enumerated(), 1);
+
+   usb_stream_init();
+}
+
+// IN: what the host reads, packet by packet, until it is NAKed
+
+static void in_checks(void)
+{
+   static uint8_t a[200], b[PACKET], c[30];
+   uint8_t packet[PACKET];
+
+   fill(a, sizeof(a), 1);
+   fill(b, sizeof(b), 2);
+   fill(c, sizeof(c), 3);
+
+   // a short buffer goes out at once and is retired on its token done
+   memset(&in_done, 0, sizeof(in_done));
+   check("put short", usb_stream_put(c, 10), TRUE);
+   check("  pending before IN", usb_stream_in_pending(), 1);
+   check("  no done before IN", in_done.n, 0);
+   check("  IN", usb_sim_in(1, packet), 10);
+   check("  data", memcmp(packet, c, 10), 0);
+   check("  done on token done", in_done.n, 1);
+   check("  done len", in_done.len[0], 10);
+   check("  pending after", usb_stream_in_pending(), 0);
+   check("  no 0 length packet after a short one", usb_sim_in(1, packet), USB_SIM_NAK);
+
+   // a buffer that ends on a full packet is followed by a 0 length packet
+   memset(&in_done, 0, sizeof(in_done));
+   check("put 2 full packets", usb_stream_put(a, 2 * PACKET), TRUE);
+   check("  IN 1", usb_sim_in(1, packet), PACKET);
+   check("  not done after packet 1", in_done.n, 0);
+   check("  IN 2", usb_sim_in(1, packet), PACKET);
+   check("  data", memcmp(packet, a + PACKET, PACKET), 0);
+   check("  done after packet 2", in_done.n, 1);
+   check("  done len", in_done.len[0], 2 * PACKET);
+   check("  0 length packet", usb_sim_in(1, packet), 0);
+   check("  then NAK", usb_sim_in(1, packet), USB_SIM_NAK);
+
+   // queued buffers go back to back, the next one started from the token
+   // done of the last packet of the one before, no 0 length packet between
+   // them even when one ends on a full packet
+   memset(&in_done, 0, sizeof(in_done));
+   usb_sim.in_zlps = 0;
+   check("put a", usb_stream_put(a, 100), TRUE);
+   check("put b", usb_stream_put(b, PACKET), TRUE);
+   check("put c", usb_stream_put(c, 30), TRUE);
+   check("  queue full", usb_stream_put(c, 1), FALSE);
+   check("  pending", usb_stream_in_pending(), 3);
+   check("  a 1", usb_sim_in(1, packet), PACKET);
+   check("  a 2", usb_sim_in(1, packet), 36);
+   check("  a data", memcmp(packet, a + PACKET, 36), 0);
+   check("  a done", in_done.n, 1);
+   check("  b", usb_sim_in(1, packet), PACKET);
+   check("  b data", memcmp(packet, b, PACKET), 0);
+   check("  b done", in_done.n, 2);
+   check("  c", usb_sim_in(1, packet), 30);
+   check("  c data", memcmp(packet, c, 30), 0);
+   check("  c done", in_done.n, 3);
+   check("  order", (in_done.ptr[0] == a) && (in_done.ptr[1] == b) && (in_done.ptr[2] == c), 1);
+   check("  no 0 length packet", usb_sim.in_zlps, 0);
+   check("  then NAK", usb_sim_in(1, packet), USB_SIM_NAK);
+
+   // a full packet that empties the queue gets its 0 length packet even if
+   // a buffer is queued before the host comes back for it
+   memset(&in_done, 0, sizeof(in_done));
+   check("put full packet", usb_stream_put(b, PACKET), TRUE);
+   check("  IN", usb_sim_in(1, packet), PACKET);
+   check("  put next", usb_stream_put(c, 5), TRUE);
+   check("  0 length packet first", usb_sim_in(1, packet), 0);
+   check("  next", usb_sim_in(1, packet), 5);
+   check("  done", in_done.n, 2);
+
+   check("  0 length put", usb_stream_put(c, 0), FALSE);
+}
+
+// OUT: what the device makes of the packets the host sends
+
+static void out_checks(void)
+{
+   static uint8_t a[100], b[100], c[2 * PACKET];
+   uint8_t packet[3][PACKET];
+
+   fill(packet[0], PACKET, 10);
+   fill(packet[1], PACKET, 20);
+   fill(packet[2], PACKET, 30);
+
+   // with nothing queued the packet is ACKed and then held in the
+   // endpoint, so the host is NAKed until a buffer comes
+   memset(&out_done, 0, sizeof(out_done));
+   check("OUT with no buffer", usb_sim_out(1, packet[0], 20), 20);
+   check("  held, next one NAKed", usb_sim_out(1, packet[1], 20), USB_SIM_NAK);
+   check("  no done", out_done.n, 0);
+   check("get", usb_stream_get(a, sizeof(a)), TRUE);
+   check("  held packet taken, short so done", out_done.n, 1);
+   check("  done len", out_done.len[0], 20);
+   check("  data", memcmp(a, packet[0], 20), 0);
+   check("  endpoint re-armed", usb_sim_out(1, packet[1], 20), 20);
+   check("  held again", usb_sim_out(1, packet[1], 20), USB_SIM_NAK);
+   check("get", usb_stream_get(a, sizeof(a)), TRUE);
+   check("  done", out_done.n, 2);
+   check("  data", memcmp(a, packet[1], 20), 0);
+
+   // a packet that doesn't fit in what is left completes the buffer and
+   // goes into the next one
+   memset(&out_done, 0, sizeof(out_done));
+   check("get a", usb_stream_get(a, sizeof(a)), TRUE);
+   check("get b", usb_stream_get(b, sizeof(b)), TRUE);
+   check("  OUT 1", usb_sim_out(1, packet[0], PACKET), PACKET);
+   check("  not done", out_done.n, 0);
+   check("  OUT 2", usb_sim_out(1, packet[1], PACKET), PACKET);
+   check("  a done", out_done.n, 1);
+   check("  a len", out_done.len[0], PACKET);
+   check("  a data", memcmp(a, packet[0], PACKET), 0);
+   check("  OUT 3 short", usb_sim_out(1, packet[2], 10), 10);
+   check("  b done", out_done.n, 2);
+   check("  b len", out_done.len[1], PACKET + 10);
+   check("  b data", memcmp(b, packet[1], PACKET) || memcmp(b + PACKET, packet[2], 10), 0);
+   check("  pending", usb_stream_out_pending(), 0);
+
+   // a buffer that fills up exactly is done without a short packet, and
+   // the 0 length packet that ends the transfer has nothing to hand over
+   memset(&out_done, 0, sizeof(out_done));
+   check("get c", usb_stream_get(c, sizeof(c)), TRUE);
+   check("get a", usb_stream_get(a, sizeof(a)), TRUE);
+   check("  OUT 1", usb_sim_out(1, packet[0], PACKET), PACKET);
+   check("  OUT 2", usb_sim_out(1, packet[1], PACKET), PACKET);
+   check("  c done full", out_done.n, 1);
+   check("  c len", out_done.len[0], 2 * PACKET);
+   check("  0 length OUT", usb_sim_out(1, packet[0], 0), 0);
+   check("  a not done", out_done.n, 1);
+   check("  a still pending", usb_stream_out_pending(), 1);
+   check("  OUT short", usb_sim_out(1, packet[2], 1), 1);
+   check("  a done", out_done.n, 2);
+   check("  a len", out_done.len[1], 1);
+
+   // a 0 length packet after some data ends the buffer
+   check("get a", usb_stream_get(a, sizeof(a)), TRUE);
+   check("  OUT", usb_sim_out(1, packet[0], PACKET), PACKET);
+   check("  0 length OUT", usb_sim_out(1, packet[0], 0), 0);
+   check("  done", out_done.n, 3);
+   check("  len", out_done.len[2], PACKET);
+
+   check("  too big for the endpoint", usb_sim_out(1, packet[0], PACKET + 1), USB_SIM_BABBLE);
+   usb_sim.babbles = 0;
+}
+
+// Loopback: the device queues receive buffers from a pool, hands every
+// filled one to usb_stream_put() as it is and puts it back in the pool
+// when it has been sent.  The host sends transfers of random length and
+// reads IN whenever it likes; what it reads has to be what it sent.
+
+#define POOL      6
+#define POOL_LEN  96
+
+static uint8_t pool[POOL][POOL_LEN];
+static int pool_free[POOL], pool_free_n;
+
+// filled buffers waiting for room in the IN queue
+static uint8_t *filled_ptr[POOL];
+static uint16_t filled_len[POOL];
+static int filled_head, filled_n;
+
+static int in_seen, out_seen;
+
+static void loop_device(void)
+{
+   int i;
+
+   // whatever USB_STREAM_OUT_DONE()/USB_STREAM_IN_DONE() logged since last
+   // time.  the logs are only used as queues here.
+   for(; out_seen < out_done.n; out_seen++)
+   {
+      i = (filled_head + filled_n) % POOL;
+      filled_ptr[i] = out_done.ptr[out_seen % DONE_MAX];
+      filled_len[i] = out_done.len[out_seen % DONE_MAX];
+      filled_n++;
+   }
+   for(; in_seen < in_done.n; in_seen++)
+      pool_free[pool_free_n++] = (int)((in_done.ptr[in_seen % DONE_MAX] - pool[0]) / POOL_LEN);
+
+   while(filled_n && (usb_stream_in_pending() < USB_STREAM_QUEUE_SIZE - 1))
+   {
+      check("loop put", usb_stream_put(filled_ptr[filled_head], filled_len[filled_head]), TRUE);
+      filled_head = (filled_head + 1) % POOL;
+      filled_n--;
+   }
+   while(pool_free_n && (usb_stream_out_pending() < USB_STREAM_QUEUE_SIZE - 1))
+      check("loop get", usb_stream_get(pool[pool_free[--pool_free_n]], POOL_LEN), TRUE);
+}
+
+// byte n of what the host sends
+static uint8_t loop_byte(long n)
+{
+   return((uint8_t)(n * 131 + (n >> 9)));
+}
+
+static void loopback(int transfers, int report)
+{
+   long n_sent = 0, n_got = 0, transfer_end = 0, bad = 0;
+   uint8_t packet[PACKET];
+   int t = 0, n, i, zlp = 0, idle = 0;
+   struct usb_sim_stats before = usb_sim;
+
+   memset(&in_done, 0, sizeof(in_done));
+   memset(&out_done, 0, sizeof(out_done));
+   in_seen = out_seen = 0;
+   filled_head = filled_n = 0;
+   for(pool_free_n = 0; pool_free_n < POOL; pool_free_n++)
+      pool_free[pool_free_n] = pool_free_n;
+
+   while((t < transfers) || zlp || (n_sent < transfer_end) || (n_got < n_sent))
+   {
+      // both endpoints NAKing for this long means the stream is stuck
+      if(++idle > 1000)
+      {
+         check("loop stuck, bytes", n_got, n_sent);
+         break;
+      }
+
+      loop_device();
+
+      if((rnd() % 3) && ((t < transfers) || zlp || (n_sent < transfer_end)))
+      {
+         // the next packet of the transfer going out, a new transfer of
+         // 1 to 400 bytes once the last one has ended
+         if(!zlp && (n_sent == transfer_end))
+         {
+            transfer_end = n_sent + 1 + rnd() % 400;
+            t++;
+         }
+         n = zlp ? 0 : ((transfer_end - n_sent > PACKET) ? PACKET : transfer_end - n_sent);
+         for(i = 0; i < n; i++)
+            packet[i] = loop_byte(n_sent + i);
+         n = usb_sim_out(1, packet, n);
+         if(n >= 0)
+         {
+            idle = 0;
+            if(zlp)
+               zlp = 0;
+            else
+            {
+               n_sent += n;
+               zlp = (n_sent == transfer_end) && (n == PACKET);
+            }
+         }
+      }
+      else
+      {
+         n = usb_sim_in(1, packet);
+         if(n >= 0)
+            idle = 0;
+         if(n > 0)
+         {
+            if(n_got + n > n_sent)
+            {
+               check("loop got more than was sent", n_got + n, n_sent);
+               break;
+            }
+            for(i = 0; i < n; i++)
+               if(packet[i] != loop_byte(n_got + i))
+                  bad++;
+            n_got += n;
+         }
+      }
+   }
+
+   check("loop bytes", n_got, n_sent);
+   check("loop bad bytes", bad, 0);
+   check("loop toggle errors", usb_sim.toggle_errors, 0);
+   check("loop babbles", usb_sim.babbles, 0);
+
+   if(report)
+   {
+      printf("loopback: %d transfers, %ld bytes each way\n", t, n_sent);
+      printf("  OUT %lu packets, %lu NAKed\n", usb_sim.out_packets - before.out_packets, usb_sim.out_naks - before.out_naks);
+      printf("  IN  %lu packets (%lu 0 length), %lu NAKed\n", usb_sim.in_packets - before.in_packets,
+         usb_sim.in_zlps - before.in_zlps, usb_sim.in_naks - before.in_naks);
+      printf("  %d buffers received and %d sent, %lu token done interrupts\n", out_done.n, in_done.n,
+         usb_sim.tokens_done - before.tokens_done);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   int bench = (argc > 1) && (strcmp(argv[1], "-b") == 0);
+
+   enumerate();
+   in_checks();
+   out_checks();
+   check("toggle errors", usb_sim.toggle_errors, 0);
+   check("babbles", usb_sim.babbles, 0);
+   loopback(bench ? 20000 : 500, bench);
+
+   printf("%d failures\n", failures);
+   return(failures != 0);
+}